@@ -1,7 +1,8 @@
 #include "common.h"
 #include "oxy.h"
 
-bool debug = true;
+// prints the tokens and the trace of the parser, set by --trace.
+bool debug = false;
 
 int main(int argc, const char* const* argv) {
   return oxy_main(argc, argv);
@@ -1,4 +1,7 @@
 #include "ast.h"
+#include "visit.h"
+
+#include <stdatomic.h>
 
 const char* item_strings[] = {
 #define ITEMKIND(n) #n,
@@ -30,8 +33,23 @@ const char* pattern_strings[] = {
   #undef PATTERNKIND
 };
 
+// the arena nodes are allocated from on this thread.
+static _Thread_local Arena* ast_arena = NULL;
+
+Arena* set_ast_arena(Arena* arena) {
+  Arena* old = ast_arena;
+  ast_arena = arena;
+  return old;
+}
+
+void* ast_alloc(size_t size) {
+  void* ptr = ast_arena ? arena_alloc(ast_arena, size) : malloc(size);
+  memset(ptr, 0, size);
+  return ptr;
+}
+
 Ident* new_ident(const char* name, SourceLoc loc) {
-  Ident* ident = malloc(sizeof(Ident));
+  Ident* ident = ast_alloc(sizeof(Ident));
   ident->value = name;
   ident->loc = loc;
   return ident;
@@ -46,7 +64,7 @@ SourceLoc new_sourceloc(File* file, u64 line, u64 column, u64 span) {
 }
 
 TypeSpec* new_typespec(TypeSpecKind kind, Mutability mut, SourceLoc loc) {
-	TypeSpec* spec = malloc(sizeof(TypeSpec));
+	TypeSpec* spec = ast_alloc(sizeof(TypeSpec));
 	spec->kind = kind;
 	spec->mut = mut;
 	spec->loc = loc;
@@ -109,7 +127,7 @@ TypeSpec* new_tuple_typespec(TypeSpec** types, Mutability mut, SourceLoc loc) {
 }
 
 Stmt* new_stmt(StmtKind kind, SourceLoc loc) {
-  Stmt* stmt = malloc(sizeof(Stmt));
+  Stmt* stmt = ast_alloc(sizeof(Stmt));
   stmt->kind = kind;
   stmt->loc = loc;
   return stmt;
@@ -134,7 +152,7 @@ Stmt* new_item_stmt(Item* item, SourceLoc loc) {
 }
 
 Expr* new_expr(ExprKind kind, SourceLoc loc) {
-  Expr* expr = malloc(sizeof(Expr));
+  Expr* expr = ast_alloc(sizeof(Expr));
   expr->kind = kind;
   expr->loc = loc;
   return expr;
@@ -329,6 +347,14 @@ Expr* new_cast(Expr* op, TypeSpec* spec, SourceLoc loc) {
   return expr;
 }
 
+Expr* new_when(Expr* cond, Expr* body, Expr* else_when, SourceLoc loc) {
+  Expr* expr = new_expr(When, loc);
+  expr->if_expr.cond = cond;
+  expr->if_expr.body = body;
+  expr->if_expr.else_if = else_when;
+  return expr;
+}
+
 Expr* new_slice(Expr* operand, Expr* start, Expr* end, SourceLoc loc) {
   Expr* expr = new_expr(Slice, loc);
   expr->slice.operand = operand;
@@ -339,7 +365,7 @@ Expr* new_slice(Expr* operand, Expr* start, Expr* end, SourceLoc loc) {
 
 
 Clause* new_clause(Pattern** patterns, Expr* body, SourceLoc loc) {
-  Clause* clause = (Clause*) malloc(sizeof(Clause));
+  Clause* clause = (Clause*) ast_alloc(sizeof(Clause));
   clause->patterns = patterns;
   clause->num_patterns = buf_len(patterns);
   clause->body = body;
@@ -348,7 +374,7 @@ Clause* new_clause(Pattern** patterns, Expr* body, SourceLoc loc) {
 }
 
 Item* new_item(ItemKind kind, SourceLoc loc) {
-  Item* item = malloc(sizeof(Item));
+  Item* item = ast_alloc(sizeof(Item));
   item->kind = kind;
   item->loc = loc;
   return item;
@@ -378,6 +404,8 @@ Item* new_itemfunction(Ident* name, Item** arguments, TypeSpec* ret, Expr* body,
   item->function.num_args = buf_len(arguments);
   item->function.ret = ret;
   item->function.body = body;
+  item->function.body_begin = 0;
+  item->function.body_end = 0;
   return item;
 }
 
@@ -405,11 +433,12 @@ Item* new_itemenum(Ident* name, Item** elems, SourceLoc loc) {
   return item;
 }
 
-Item* new_itemuse(Ident* name, Expr** members, SourceLoc loc) {
+Item* new_itemuse(Ident** path, Ident** names, SourceLoc loc) {
   Item* item = new_item(ItemUse, loc);
-  item->use.name = name;
-  item->use.members = members;
-  item->use.num_members = buf_len(members);
+  item->use.path = path;
+  item->use.num_path = buf_len(path);
+  item->use.names = names;
+  item->use.num_names = buf_len(names);
   return item;
 }
 
@@ -437,7 +466,7 @@ Item* new_itemname(Ident* name, Expr* value, SourceLoc loc) {
 }
 
 Pattern* new_pattern(PatternKind kind, SourceLoc loc) {
-  Pattern* pat = (Pattern*) malloc(sizeof(Pattern));
+  Pattern* pat = (Pattern*) ast_alloc(sizeof(Pattern));
   pat->kind = kind;
   pat->loc = loc;
   return pat;
@@ -518,151 +547,163 @@ const char* pattern_string(PatternKind kind) {
 	return pattern_strings[kind];
 }
 
-void destroy_expr(Expr* expr) {
-	switch(expr->kind) {
-    case Name: {
-
-    } break;
-    case Literal: {
-
-    } break;
-    case StructLiteral: {
-
-    } break;
-    case CompoundLiteral: {
-
-    } break;
-    case Unary: {
-
-    } break;
-    case Binary: {
-
-    } break;
-    case FnCall: {
-
-    } break;
-    case Field: {
-
-    } break;
-    case DotFnCall: {
-
-    } break;
-    case If: {
-
-    } break;
-    case While: {
-
-    } break;
-    case For: {
-
-    } break;
-    case Return: {
-
-    } break;
-    case Break: {
-
-    } break;
-    case Continue: {
-
-    } break;
-    case Block: {
-
-    } break;
-    case Binding: {
-
-    } break;
-    case In: {
-
-    } break;
-    case Tuple: {
-
-    } break;
-    case PatternExpr: {
-
-    } break;
-    case Assignment: {
-
-    } break;
-    default:;
-  }
+void shift_loc(SourceLoc* loc, LineShift shift) {
+  if(loc->line < shift.line)
+    return;
+  if(loc->line == shift.line)
+    loc->column += shift.columns;
+  loc->line += shift.lines;
 }
 
-void destroy_item(Item* item) {
-	switch(item->kind) {
-    case ItemLocal: {
-
-    } break;
-    case ItemFunction: {
-
-    } break;
-    case ItemStruct: {
-
-    } break;
-    case ItemTupleStruct: {
-
-    } break;
-    case ItemEnum: {
-
-    } break;
-    case ItemUse: {
-
-    } break;
-    case ItemModule: {
-
-    } break;
-    case ItemField: {
+void shift_token(Token* token, LineShift shift) {
+  if(token->line < shift.line)
+    return;
+  if(token->line == shift.line)
+    token->column += shift.columns;
+  token->line += shift.lines;
+}
 
-    } break;
-    default:;
+#define SHIFT_NODE(name, type) \
+  bool shift_##name##_node(void* data, type* name) { \
+    shift_loc(&name->loc, *(LineShift*) data); \
+    return true; \
+  }
+SHIFT_NODE(item, Item)
+SHIFT_NODE(stmt, Stmt)
+SHIFT_NODE(expr, Expr)
+SHIFT_NODE(spec, TypeSpec)
+SHIFT_NODE(pat, Pattern)
+SHIFT_NODE(clause, Clause)
+SHIFT_NODE(ident, Ident)
+#undef SHIFT_NODE
+
+bool shift_token_leaf(void* data, Token* token) {
+  shift_token(token, *(LineShift*) data);
+  return true;
+}
+
+void shift_item(Item* item, LineShift shift) {
+  Visitor visitor = {
+    .pre_item = shift_item_node, .pre_stmt = shift_stmt_node, .pre_expr = shift_expr_node,
+    .pre_spec = shift_spec_node, .pre_pat = shift_pat_node, .pre_clause = shift_clause_node,
+    .pre_ident = shift_ident_node, .pre_token = shift_token_leaf,
+    .data = &shift,
+  };
+  visit_item(&visitor, item);
+}
+
+// frees the child lists of a node once its children are visited, the nodes
+// themselves are owned by the arenas.
+#define EXPR(x)
+#define STMT(x)
+#define ITEM(x)
+#define SPEC(x)
+#define PAT(x)
+#define CLAUSE(x)
+#define IDENT(x)
+#define TOKEN(x)
+#define MUT(x)
+#define EXPRS(list, num) buf_free(list);
+#define STMTS(list, num) buf_free(list);
+#define ITEMS(list, num) buf_free(list);
+#define SPECS(list, num) buf_free(list);
+#define PATS(list, num) buf_free(list);
+#define CLAUSES(list, num) buf_free(list);
+#define IDENTS(list, num) buf_free(list);
+
+void free_item_lists(void* data, Item* item) {
+  UNUSED(data);
+  switch(item->kind) {
+#define ITEMKIND(n) case n: CHILDREN_##n break;
+    ITEMKINDS
+#undef ITEMKIND
   }
 }
 
-void destroy_stmt(Stmt* stmt) {
-  switch(stmt->kind) {
-    case ExprStmt:;
-    case ItemStmt:;
-    default:;
+void free_expr_lists(void* data, Expr* expr) {
+  UNUSED(data);
+  switch(expr->kind) {
+#define EXPRKIND(n) case n: CHILDREN_##n break;
+    EXPRKINDS
+#undef EXPRKIND
   }
 }
 
-void destroy_typesepc(TypeSpec* spec) {
+void free_spec_lists(void* data, TypeSpec* spec) {
+  UNUSED(data);
   switch(spec->kind) {
-    case TypeSpecNone: {
-
-    } break;
-    case TypeSpecName: {
-
-    } break;
-    case TypeSpecFunc: {
+#define TYPESPECKIND(n) case n: CHILDREN_##n break;
+    TYPESPECKINDS
+#undef TYPESPECKIND
+  }
+}
 
-    } break;
-    case TypeSpecArray: {
+void free_pat_lists(void* data, Pattern* pat) {
+  UNUSED(data);
+  switch(pat->kind) {
+#define PATTERNKIND(n) case n: CHILDREN_##n break;
+    PATTERNKINDS
+#undef PATTERNKIND
+  }
+}
 
-    } break;
-    case TypeSpecPtr: {
+void free_clause_lists(void* data, Clause* clause) {
+  UNUSED(data);
+  CHILDREN_Clause
+}
+
+#undef EXPR
+#undef STMT
+#undef ITEM
+#undef SPEC
+#undef PAT
+#undef CLAUSE
+#undef IDENT
+#undef TOKEN
+#undef MUT
+#undef EXPRS
+#undef STMTS
+#undef ITEMS
+#undef SPECS
+#undef PATS
+#undef CLAUSES
+#undef IDENTS
+
+static const Visitor list_destroyer = {
+  .post_item = free_item_lists,
+  .post_expr = free_expr_lists,
+  .post_spec = free_spec_lists,
+  .post_pat = free_pat_lists,
+  .post_clause = free_clause_lists,
+};
 
-    } break;
-    case TypeSpecRef: {
+void destroy_expr(Expr* expr) {
+  visit_expr((Visitor*) &list_destroyer, expr);
+}
 
-    } break;
-    case TypeSpecMap: {
+void destroy_item(Item* item) {
+  visit_item((Visitor*) &list_destroyer, item);
+}
 
-    } break;
-    case TypeSpecTuple: {
+// files are parsed on several threads.
+static atomic_uint uid = 0;
 
-    } break;
-    default:;
-  }
+u32 new_ast_uid() {
+  return atomic_fetch_add(&uid, 1);
 }
 
-static u32 uid = 0;
 AstFile* new_ast_file(File* file) {
   AstFile* ast = (AstFile*) malloc(sizeof(AstFile));
 
   ast->file = file;
   ast->items = NULL;
   ast->scope = NULL;
-  ast->uid = uid++;
+  ast->uid = new_ast_uid();
+  ast->tokens = NULL;
+  ast->arenas = NULL;
+  ast->item_tokens = NULL;
+  ast->flags = 0;
+  ast->truncated = false;
 
   return ast;
 }
@@ -674,3 +715,23 @@ void add_item(AstFile* file, Item* item) {
 u32 ast_num_items(AstFile* file) {
   return buf_len(file->items);
 }
+
+Arena* add_ast_arena(AstFile* file) {
+  Arena* arena = (Arena*) malloc(sizeof(Arena));
+  memset(arena, 0, sizeof(Arena));
+  buf_push(file->arenas, arena);
+  return arena;
+}
+
+void destroy_ast_file(AstFile* file) {
+  visit_ast_file((Visitor*) &list_destroyer, file);
+  for(u32 i = 0; i < buf_len(file->arenas); ++i) {
+    arena_free(file->arenas[i]);
+    free(file->arenas[i]);
+  }
+  buf_free(file->arenas);
+  buf_free(file->items);
+  buf_free(file->item_tokens);
+  buf_free(file->tokens);
+  free(file);
+}
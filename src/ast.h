@@ -39,6 +39,27 @@ typedef enum TypeSpecKind {
 #undef TYPESPECKIND
 } TypeSpecKind;
 
+// Children
+//
+// The children of every node kind are listed once, in the order they are
+// visited, by a CHILDREN_<kind> macro next to the kinds. Each child is one of
+// EXPR, STMT, ITEM, SPEC, PAT, CLAUSE, IDENT, TOKEN or MUT with the field
+// holding it, or a list EXPRS, STMTS, ITEMS, SPECS, PATS, CLAUSES or IDENTS
+// with the fields of the list and its length. The fields are relative to the
+// node variable expr, stmt, item, spec, pat or clause. Code walking the tree,
+// see visit.h, is generated by expanding the kind lists with these macros, so
+// a kind without its children does not compile.
+
+#define CHILDREN_TypeSpecNone MUT(spec->mut)
+#define CHILDREN_TypeSpecName MUT(spec->mut) IDENT(spec->name.name)
+#define CHILDREN_TypeSpecPath MUT(spec->mut) SPEC(spec->path.parent) SPEC(spec->path.elem)
+#define CHILDREN_TypeSpecFunc MUT(spec->mut) SPECS(spec->funct.args, spec->funct.num_args) SPEC(spec->funct.ret)
+#define CHILDREN_TypeSpecArray MUT(spec->mut) SPEC(spec->array.elem)
+#define CHILDREN_TypeSpecPtr MUT(spec->mut) SPEC(spec->ptr.elem)
+#define CHILDREN_TypeSpecRef MUT(spec->mut) SPEC(spec->ref.elem)
+#define CHILDREN_TypeSpecMap MUT(spec->mut) SPEC(spec->map.key) SPEC(spec->map.value)
+#define CHILDREN_TypeSpecTuple MUT(spec->mut) SPECS(spec->tuple.types, spec->tuple.num_types)
+
 typedef enum Mutability {
   None,
   Immutable,
@@ -59,6 +80,13 @@ typedef struct Ident {
 
 Ident* new_ident(const char* name, SourceLoc loc);
 
+// nodes are allocated from the given arena on the calling thread, or with
+// malloc when it is NULL. Returns the previous arena.
+Arena* set_ast_arena(Arena* arena);
+
+// zero initialized node memory.
+void* ast_alloc(size_t size);
+
 
 typedef struct TypeSpec {
   TypeSpecKind kind;
@@ -133,6 +161,10 @@ typedef enum StmtKind {
   #undef STMTKIND
 } StmtKind;
 
+#define CHILDREN_ExprStmt EXPR(stmt->expr)
+#define CHILDREN_SemiStmt EXPR(stmt->semi)
+#define CHILDREN_ItemStmt ITEM(stmt->item)
+
 typedef struct Stmt {
   StmtKind kind;
   SourceLoc loc;
@@ -180,7 +212,8 @@ Stmt* new_item_stmt(Item* item, SourceLoc loc);
   EXPRKIND(Assignment) \
   EXPRKIND(Range) \
   EXPRKIND(Cast) \
-  EXPRKIND(Slice)
+  EXPRKIND(Slice) \
+  EXPRKIND(When)
 
 typedef enum ExprKind {
   #define EXPRKIND(n) n,
@@ -188,6 +221,40 @@ typedef enum ExprKind {
   #undef EXPRKIND
 } ExprKind;
 
+#define CHILDREN_Name IDENT(expr->name)
+#define CHILDREN_Literal TOKEN(expr->literal)
+#define CHILDREN_CompoundLiteral EXPRS(expr->compound_lit.members, expr->compound_lit.num_members)
+#define CHILDREN_StructLiteral SPEC(expr->struct_lit.name) \
+  EXPRS(expr->struct_lit.members, expr->struct_lit.num_members)
+#define CHILDREN_Unary TOKEN(expr->unary.op) EXPR(expr->unary.expr)
+#define CHILDREN_Binary TOKEN(expr->binary.op) EXPR(expr->binary.lhs) EXPR(expr->binary.rhs)
+#define CHILDREN_FnCall EXPR(expr->fncall.name) EXPRS(expr->fncall.actuals, expr->fncall.num_actuals)
+#define CHILDREN_Field EXPR(expr->field.operand) IDENT(expr->field.name)
+#define CHILDREN_DotFnCall EXPR(expr->dotcall.operand) EXPR(expr->dotcall.name) \
+  EXPRS(expr->dotcall.actuals, expr->dotcall.num_actuals)
+#define CHILDREN_If EXPR(expr->if_expr.cond) EXPR(expr->if_expr.body) EXPR(expr->if_expr.else_if)
+#define CHILDREN_MatchIf EXPR(expr->matchif_expr.cond) \
+  CLAUSES(expr->matchif_expr.body, expr->matchif_expr.num_body)
+#define CHILDREN_While EXPR(expr->while_expr.cond) EXPR(expr->while_expr.body)
+#define CHILDREN_For PAT(expr->for_expr.pat) EXPR(expr->for_expr.cond) EXPR(expr->for_expr.body)
+#define CHILDREN_Return EXPRS(expr->return_expr.exprs, expr->return_expr.num_exprs)
+#define CHILDREN_Break TOKEN(expr->break_expr)
+#define CHILDREN_Continue TOKEN(expr->continue_expr)
+#define CHILDREN_Block STMTS(expr->block.stmts, expr->block.num_stmts)
+#define CHILDREN_Binding EXPR(expr->binding.name) EXPR(expr->binding.binding)
+#define CHILDREN_In EXPR(expr->in.in) EXPR(expr->in.expr)
+#define CHILDREN_Tuple EXPRS(expr->tuple.elems, expr->tuple.num_elems)
+#define CHILDREN_PatternExpr PAT(expr->pattern.pat)
+#define CHILDREN_Index EXPR(expr->index.operand) EXPR(expr->index.index)
+#define CHILDREN_TupleElem EXPR(expr->tupleelem.operand) TOKEN(expr->tupleelem.elem)
+#define CHILDREN_Assignment TOKEN(expr->assign.op) EXPR(expr->assign.variable) EXPR(expr->assign.value)
+#define CHILDREN_Range EXPR(expr->range.start) EXPR(expr->range.end) EXPR(expr->range.step)
+#define CHILDREN_Cast EXPR(expr->cast.expr) SPEC(expr->cast.spec)
+#define CHILDREN_Slice EXPR(expr->slice.operand) EXPR(expr->slice.start) EXPR(expr->slice.end)
+#define CHILDREN_When EXPR(expr->if_expr.cond) EXPR(expr->if_expr.body) EXPR(expr->if_expr.else_if)
+
+#define CHILDREN_Clause PATS(clause->patterns, clause->num_patterns) EXPR(clause->body)
+
 typedef struct Clause {
   Pattern** patterns;
   u32 num_patterns;
@@ -239,7 +306,8 @@ typedef struct Expr {
       Expr** actuals;
       u32 num_actuals;
     } dotcall;
-    // standard if expression
+    // standard if expression, and when expression whose condition is
+    // known at compile time.
     struct {
       Expr* cond;
       Expr* body;
@@ -343,6 +411,7 @@ Expr* new_tupelelem(Expr* operand, Token elem, SourceLoc loc);
 Expr* new_range(Expr* start, Expr* end, Expr* step, SourceLoc loc);
 Expr* new_slice(Expr* operand, Expr* start, Expr* end, SourceLoc loc);
 Expr* new_cast(Expr* expr, TypeSpec* spec, SourceLoc loc);
+Expr* new_when(Expr* cond, Expr* body, Expr* else_when, SourceLoc loc);
 
 Clause* new_clause(Pattern** pattern, Expr* body, SourceLoc loc);
 
@@ -366,6 +435,24 @@ typedef enum ItemKind {
 #undef ITEMKIND
 } ItemKind;
 
+#define CHILDREN_ItemLocal MUT(item->local.mut) PAT(item->local.name) SPEC(item->local.type) \
+  EXPR(item->local.init)
+#define CHILDREN_ItemAlias IDENT(item->alias.name) SPEC(item->alias.type)
+#define CHILDREN_ItemFunction IDENT(item->function.name) \
+  ITEMS(item->function.arguments, item->function.num_args) SPEC(item->function.ret) \
+  EXPR(item->function.body)
+#define CHILDREN_ItemStruct IDENT(item->structure.name) \
+  ITEMS(item->structure.fields, item->structure.num_fields)
+#define CHILDREN_ItemTupleStruct IDENT(item->tuplestruct.name) \
+  SPECS(item->tuplestruct.fields, item->tuplestruct.num_fields)
+#define CHILDREN_ItemEnum IDENT(item->enumeration.name) \
+  ITEMS(item->enumeration.elems, item->enumeration.num_elems)
+#define CHILDREN_ItemUse IDENTS(item->use.path, item->use.num_path) \
+  IDENTS(item->use.names, item->use.num_names)
+#define CHILDREN_ItemModule IDENT(item->module.name) ITEMS(item->module.members, item->module.num_members)
+#define CHILDREN_ItemField IDENT(item->field.name) SPEC(item->field.type) EXPR(item->field.init)
+#define CHILDREN_ItemName IDENT(item->name.name) EXPR(item->name.value)
+
 typedef struct Item {
   ItemKind kind;
   SourceLoc loc;
@@ -389,6 +476,10 @@ typedef struct Item {
       u32 num_args;
       TypeSpec* ret;
       Expr* body;
+      // token range of a body that has not been parsed yet,
+      // see parse_function_body.
+      u32 body_begin;
+      u32 body_end;
     } function;
     struct {
       Ident* name;
@@ -406,9 +497,13 @@ typedef struct Item {
       u32 num_elems;
     } enumeration;
     struct {
-      Ident* name;
-      Expr** members;
-      u32 num_members;
+      // module path, a.b in 'use a.b.{c, d};'
+      Ident** path;
+      u32 num_path;
+      // imported names, there are none when the module itself is imported.
+      // A '*' name imports every name of the module.
+      Ident** names;
+      u32 num_names;
     } use;
     struct {
       Ident* name;
@@ -434,7 +529,7 @@ Item* new_itemfunction(Ident* name, Item** arguments, TypeSpec* ret, Expr* body,
 Item* new_itemstruct(Ident* name, Item** fields, SourceLoc loc);
 Item* new_itemtuplestruct(Ident* name, TypeSpec** fields, SourceLoc loc);
 Item* new_itemenum(Ident* name, Item** elems, SourceLoc loc);
-Item* new_itemuse(Ident* name, Expr** memebers, SourceLoc loc);
+Item* new_itemuse(Ident** path, Ident** names, SourceLoc loc);
 Item* new_itemmodule(Ident* name, Item** memebers, SourceLoc loc);
 Item* new_itemfield(TypeSpec* type, Ident* name, Expr* init, SourceLoc loc);
 Item* new_itemname(Ident* name, Expr* value, SourceLoc loc);
@@ -456,6 +551,15 @@ typedef enum PatternKind {
   #undef PATTERNKIND
 } PatternKind;
 
+#define CHILDREN_WildCard TOKEN(pat->wildcard)
+#define CHILDREN_StructPattern SPEC(pat->structure.path) PATS(pat->structure.elems, pat->structure.num_elems)
+#define CHILDREN_TuplePattern PATS(pat->tuple.elems, pat->tuple.num_elems)
+#define CHILDREN_RefPattern MUT(pat->ref.mut) PAT(pat->ref.pat)
+#define CHILDREN_PointerPattern MUT(pat->ptr.mut) PAT(pat->ptr.pat)
+#define CHILDREN_IdentPattern IDENT(pat->ident)
+#define CHILDREN_LiteralPattern TOKEN(pat->literal)
+#define CHILDREN_RangePattern PAT(pat->range.start) PAT(pat->range.end)
+
 typedef struct Pattern {
   PatternKind kind;
   SourceLoc loc;
@@ -520,18 +624,52 @@ typedef struct AstFile {
   ItemSet items;
   File* file;
   Scope* scope;
+  // unique among the trees of the process, a tree whose items change gets
+  // a new one.
   u32 uid;
+
+  // token stream of the file, kept for deferred function bodies.
+  Token* tokens;
+
+  // arenas owning the nodes of the file, one per parsing thread.
+  Arena** arenas;
+
+  // index of the first token of each item, used to reparse edits.
+  u32* item_tokens;
+  // ParseFlags the file was parsed with.
+  u32 flags;
+  // parsing stopped once the syntax errors of the file used up the error
+  // budget, the items after the last error are missing.
+  bool truncated;
 } AstFile;
 
 AstFile* new_ast_file(File* file);
 
+u32 new_ast_uid();
+
+Arena* add_ast_arena(AstFile* file);
+
+// frees the file and the nodes allocated in its arenas.
+void destroy_ast_file(AstFile* file);
+
 void add_item(AstFile* file, Item* item);
 
 u32 ast_num_items(AstFile* file);
 
+// moves a location that follows an edit. Every location on or after line is
+// moved down by lines, the ones on line itself are also moved by columns.
+typedef struct LineShift {
+  u64 line;
+  i64 lines;
+  i64 columns;
+} LineShift;
+
+void shift_token(Token* token, LineShift shift);
+
+void shift_item(Item* item, LineShift shift);
+
+// frees the node lists of the tree, the nodes are freed with their arenas.
 void destroy_expr(Expr* expr);
-void destroy_item(Item* expr);
-void destroy_stmt(Stmt* expr);
-void destroy_typesepc(TypeSpec* expr);
+void destroy_item(Item* item);
 
 #endif
@@ -1,3 +1,770 @@
 #include "ast_io.h"
+#include "parser.h"
+#include "visit.h"
 
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+u64 source_hash(const char* source, u64 len) {
+  u64 hash = hash_uint64(len ^ 0x736f75726365ull);
+  u64 i = 0;
+  for(; i + sizeof(u64) <= len; i += sizeof(u64)) {
+    u64 word;
+    memcpy(&word, source + i, sizeof(u64));
+    hash = hash_mix(hash, word);
+  }
+  u64 word = 0;
+  memcpy(&word, source + i, len - i);
+  return hash_mix(hash, word);
+}
+
+// the kinds of the entries of the stacks of the writer and the reader.
+enum {
+#define VISITKIND(name, type) Image_##name,
+  VISITKINDS
+#undef VISITKIND
+  // the length of a list, before its elements.
+  Image_list,
+};
+
+// a node left to write or read. The writer and the reader keep them on a
+// stack instead of recursing, so a deep tree such as a long chain of
+// operators does not overflow the stack of the thread. The entry of a node
+// being written is the node, the one of a node being read is the field it is
+// read into.
+typedef struct ImageEntry {
+  void* node;
+  u32 kind;
+  // the length of a list being written, the kind of the elements of a list
+  // being read.
+  u32 count;
+  // the length field of a list being read.
+  u32* num;
+} ImageEntry;
+
+void push_entry(ImageEntry** stack, u32 kind, void* node, u32 count, u32* num) {
+  buf_push(*stack, (ImageEntry) {node, kind, count, num});
+}
+
+// reverses the entries pushed from first on, the children of a node are
+// pushed in the order they are listed and have to be popped in it.
+void reverse_image_entries(ImageEntry* stack, u64 first) {
+  for(u64 i = first, j = buf_len(stack); i + 1 < j; ++i, --j) {
+    ImageEntry entry = stack[i];
+    stack[i] = stack[j - 1];
+    stack[j - 1] = entry;
+  }
+}
+
+typedef struct AstWriter {
+  AstFile* ast;
+  // the node section.
+  char* nodes;
+  // offsets plus one of the written strings in the string section.
+  Map strings;
+  char* string_data;
+  // the nodes left to write.
+  ImageEntry* stack;
+} AstWriter;
+
+void write_bytes(AstWriter* writer, const void* data, size_t size) {
+  u64 len = buf_len(writer->nodes);
+  buf_fit(writer->nodes, len + size);
+  memcpy(writer->nodes + len, data, size);
+  buf__hdr(writer->nodes)->len = len + size;
+}
+
+void write_u8(AstWriter* writer, u8 value) {
+  write_bytes(writer, &value, sizeof(u8));
+}
+
+void write_u32(AstWriter* writer, u32 value) {
+  write_bytes(writer, &value, sizeof(u32));
+}
+
+void write_u64(AstWriter* writer, u64 value) {
+  write_bytes(writer, &value, sizeof(u64));
+}
+
+// a string is its offset in the string section plus one, 0 is NULL.
+void write_string(AstWriter* writer, const char* string) {
+  if(!string) {
+    write_u32(writer, 0);
+    return;
+  }
+  // the strings of the tree are interned, equal strings are the same pointer.
+  u64 offset = (u64) (uintptr_t) map_get(&writer->strings, string);
+  if(!offset) {
+    offset = buf_len(writer->string_data) + 1;
+    u64 len = strlen(string) + 1;
+    buf_fit(writer->string_data, offset - 1 + len);
+    memcpy(writer->string_data + offset - 1, string, len);
+    buf__hdr(writer->string_data)->len = offset - 1 + len;
+    map_put(&writer->strings, string, (void*) (uintptr_t) offset);
+  }
+  write_u32(writer, (u32) offset);
+}
+
+// the file of a location is the one the image is loaded for.
+void write_loc(AstWriter* writer, SourceLoc loc) {
+  write_u32(writer, (u32) loc.line);
+  write_u32(writer, (u32) loc.column);
+  write_u32(writer, (u32) loc.span);
+}
+
+// only the member of the literal union used by the kind is written.
+void write_token(AstWriter* writer, Token* token) {
+  write_u8(writer, token->kind);
+  write_u8(writer, token->type);
+  write_u32(writer, (u32) token->line);
+  write_u32(writer, (u32) token->column);
+  write_u32(writer, (u32) token->span);
+  write_u32(writer, (u32) token->index);
+  switch(token->kind) {
+    case Tkn_IntLiteral:
+      write_u64(writer, (u64) token->literal.value_i64);
+      break;
+    case Tkn_FloatLiteral:
+      write_bytes(writer, &token->literal.value_float, sizeof(f64));
+      break;
+    case Tkn_CharLiteral:
+      write_u8(writer, (u8) token->literal.value_char);
+      break;
+    case Tkn_StrLiteral:
+    case Tkn_Identifier:
+    case Tkn_Comment:
+      write_string(writer, token->literal.value_string.value);
+      write_u32(writer, token->literal.value_string.len);
+      break;
+    default:
+      break;
+  }
+  write_string(writer, token->string);
+}
+
+void write_ident(AstWriter* writer, Ident* ident) {
+  write_u8(writer, ident != NULL);
+  if(!ident)
+    return;
+  write_loc(writer, ident->loc);
+  write_string(writer, ident->value);
+}
+
+// the children of the nodes are pushed in the order of the CHILDREN_<kind>
+// lists, a list as its length followed by its elements.
+#define PUSH(kind, x) push_entry(&writer->stack, kind, x, 0, NULL);
+#define EXPR(x) PUSH(Image_expr, x)
+#define STMT(x) PUSH(Image_stmt, x)
+#define ITEM(x) PUSH(Image_item, x)
+#define SPEC(x) PUSH(Image_spec, x)
+#define PAT(x) PUSH(Image_pat, x)
+#define CLAUSE(x) PUSH(Image_clause, x)
+#define IDENT(x) PUSH(Image_ident, x)
+#define TOKEN(x) PUSH(Image_token, &(x))
+#define MUT(x) PUSH(Image_mut, &(x))
+#define WRITE_LIST(list, num, kind) \
+  push_entry(&writer->stack, Image_list, NULL, num, NULL); \
+  for(u32 i_ = 0; i_ < (num); ++i_) \
+    PUSH(kind, (list)[i_])
+#define EXPRS(list, num) WRITE_LIST(list, num, Image_expr)
+#define STMTS(list, num) WRITE_LIST(list, num, Image_stmt)
+#define ITEMS(list, num) WRITE_LIST(list, num, Image_item)
+#define SPECS(list, num) WRITE_LIST(list, num, Image_spec)
+#define PATS(list, num) WRITE_LIST(list, num, Image_pat)
+#define CLAUSES(list, num) WRITE_LIST(list, num, Image_clause)
+#define IDENTS(list, num) WRITE_LIST(list, num, Image_ident)
+
+// a node is its kind plus one, 0 when it is missing, and its location. Its
+// children are pushed to be written after it.
+void write_entry(AstWriter* writer, ImageEntry entry) {
+  switch(entry.kind) {
+    case Image_item: {
+      Item* item = (Item*) entry.node;
+      if(item and is_body_deferred(item))
+        parse_function_body(writer->ast, item);
+      write_u8(writer, item ? item->kind + 1 : 0);
+      if(!item)
+        break;
+      write_loc(writer, item->loc);
+      switch(item->kind) {
+#define ITEMKIND(n) case n: CHILDREN_##n break;
+        ITEMKINDS
+#undef ITEMKIND
+      }
+    } break;
+    case Image_stmt: {
+      Stmt* stmt = (Stmt*) entry.node;
+      write_u8(writer, stmt ? stmt->kind + 1 : 0);
+      if(!stmt)
+        break;
+      write_loc(writer, stmt->loc);
+      switch(stmt->kind) {
+#define STMTKIND(n) case n: CHILDREN_##n break;
+        STMTKINDS
+#undef STMTKIND
+      }
+    } break;
+    case Image_expr: {
+      Expr* expr = (Expr*) entry.node;
+      write_u8(writer, expr ? expr->kind + 1 : 0);
+      if(!expr)
+        break;
+      write_loc(writer, expr->loc);
+      switch(expr->kind) {
+#define EXPRKIND(n) case n: CHILDREN_##n break;
+        EXPRKINDS
+#undef EXPRKIND
+      }
+    } break;
+    // the resolved type is not written, types are resolved again after loading.
+    case Image_spec: {
+      TypeSpec* spec = (TypeSpec*) entry.node;
+      write_u8(writer, spec ? spec->kind + 1 : 0);
+      if(!spec)
+        break;
+      write_loc(writer, spec->loc);
+      switch(spec->kind) {
+#define TYPESPECKIND(n) case n: CHILDREN_##n break;
+        TYPESPECKINDS
+#undef TYPESPECKIND
+      }
+    } break;
+    case Image_pat: {
+      Pattern* pat = (Pattern*) entry.node;
+      write_u8(writer, pat ? pat->kind + 1 : 0);
+      if(!pat)
+        break;
+      write_loc(writer, pat->loc);
+      switch(pat->kind) {
+#define PATTERNKIND(n) case n: CHILDREN_##n break;
+        PATTERNKINDS
+#undef PATTERNKIND
+      }
+    } break;
+    case Image_clause: {
+      Clause* clause = (Clause*) entry.node;
+      write_u8(writer, clause != NULL);
+      if(!clause)
+        break;
+      write_loc(writer, clause->loc);
+      CHILDREN_Clause
+    } break;
+    case Image_ident: write_ident(writer, (Ident*) entry.node); break;
+    case Image_token: write_token(writer, (Token*) entry.node); break;
+    case Image_mut: write_u8(writer, *(Mutability*) entry.node); break;
+    case Image_list: write_u32(writer, entry.count); break;
+  }
+}
+
+// writes the node of the kind and every node under it.
+void write_node(AstWriter* writer, u32 kind, void* node) {
+  u64 base = buf_len(writer->stack);
+  push_entry(&writer->stack, kind, node, 0, NULL);
+  while(buf_len(writer->stack) > base) {
+    ImageEntry entry = writer->stack[--buf__hdr(writer->stack)->len];
+    u64 first = buf_len(writer->stack);
+    write_entry(writer, entry);
+    reverse_image_entries(writer->stack, first);
+  }
+}
+
+#undef PUSH
+#undef EXPR
+#undef STMT
+#undef ITEM
+#undef SPEC
+#undef PAT
+#undef CLAUSE
+#undef IDENT
+#undef TOKEN
+#undef MUT
+#undef EXPRS
+#undef STMTS
+#undef ITEMS
+#undef SPECS
+#undef PATS
+#undef CLAUSES
+#undef IDENTS
+
+bool write_ast_image(AstFile* ast, const char* path) {
+  // the locations and offsets of the image are u32.
+  if(ast->file->len > UINT32_MAX)
+    return false;
+  AstWriter writer = {0};
+  writer.ast = ast;
+
+  u32 num_items = ast_num_items(ast);
+  for(u32 i = 0; i < num_items; ++i)
+    write_node(&writer, Image_item, ast->items[i]);
+
+  AstImageHeader header;
+  memcpy(header.magic, AST_IMAGE_MAGIC, sizeof(header.magic));
+  header.version = AST_IMAGE_VERSION;
+  header.num_items = num_items;
+  header.source_len = (u32) ast->file->len;
+  header.nodes_size = (u32) buf_len(writer.nodes);
+  header.strings_size = (u32) buf_len(writer.string_data);
+  header.source_hash = source_hash(ast->file->content, ast->file->len);
+
+  bool result = false;
+  FILE* out = NULL;
+  if(buf_len(writer.nodes) <= UINT32_MAX and buf_len(writer.string_data) <= UINT32_MAX)
+    out = fopen(path, "wb");
+  if(out) {
+    // the sections of a file without items are empty, and their buffers NULL.
+    result = fwrite(&header, sizeof(AstImageHeader), 1, out) == 1 and
+      (!writer.nodes or fwrite(writer.nodes, 1, buf_len(writer.nodes), out) == buf_len(writer.nodes)) and
+      (!writer.string_data or
+       fwrite(writer.string_data, 1, buf_len(writer.string_data), out) == buf_len(writer.string_data));
+    result = fclose(out) == 0 and result;
+  }
+
+  buf_free(writer.nodes);
+  buf_free(writer.string_data);
+  buf_free(writer.stack);
+  free(writer.strings.keys);
+  free(writer.strings.vals);
+  return result;
+}
+
+typedef struct AstReader {
+  // the node section and the offset of the next read in it.
+  const char* nodes;
+  u64 size;
+  u64 offset;
+  const char* strings;
+  u32 strings_size;
+  File* file;
+  StringTable* table;
+  // the interned strings by their offset plus one, each string of the
+  // section is only interned once.
+  Map interned;
+  // set by a read past the end of the nodes or of an invalid value. Every
+  // read after it is zero, so the nodes being read end right away.
+  bool failed;
+  // the fields left to read nodes into.
+  ImageEntry* stack;
+} AstReader;
+
+void read_bytes(AstReader* reader, void* data, size_t size) {
+  if(reader->failed or size > reader->size - reader->offset) {
+    reader->failed = true;
+    memset(data, 0, size);
+    return;
+  }
+  memcpy(data, reader->nodes + reader->offset, size);
+  reader->offset += size;
+}
+
+u8 read_u8(AstReader* reader) {
+  u8 value;
+  read_bytes(reader, &value, sizeof(u8));
+  return value;
+}
+
+u32 read_u32(AstReader* reader) {
+  u32 value;
+  read_bytes(reader, &value, sizeof(u32));
+  return value;
+}
+
+u64 read_u64(AstReader* reader) {
+  u64 value;
+  read_bytes(reader, &value, sizeof(u64));
+  return value;
+}
+
+// the length of a list, every element takes at least a byte.
+u32 read_count(AstReader* reader) {
+  u32 count = read_u32(reader);
+  if(count > reader->size - reader->offset) {
+    reader->failed = true;
+    return 0;
+  }
+  return count;
+}
+
+Mutability read_mut(AstReader* reader) {
+  u8 mut = read_u8(reader);
+  if(mut > Mutable)
+    reader->failed = true;
+  return reader->failed ? None : (Mutability) mut;
+}
+
+// the string section ends with a terminator, so every offset within it is a
+// terminated string.
+const char* read_string(AstReader* reader) {
+  u32 offset = read_u32(reader);
+  if(offset == 0)
+    return NULL;
+  if(offset > reader->strings_size) {
+    reader->failed = true;
+    return NULL;
+  }
+  const char* value = map_get(&reader->interned, (void*) (uintptr_t) offset);
+  if(!value) {
+    value = table_insert_string(reader->table, reader->strings + offset - 1);
+    map_put(&reader->interned, (void*) (uintptr_t) offset, (void*) value);
+  }
+  return value;
+}
+
+SourceLoc read_loc(AstReader* reader) {
+  SourceLoc loc;
+  loc.file = reader->file;
+  loc.line = read_u32(reader);
+  loc.column = read_u32(reader);
+  loc.span = read_u32(reader);
+  return loc;
+}
+
+void read_token(AstReader* reader, Token* token) {
+  memset(token, 0, sizeof(Token));
+  u8 kind = read_u8(reader);
+  u8 type = read_u8(reader);
+  if(kind >= Num_Tokens or type > F64)
+    reader->failed = true;
+  token->kind = (TokenKind) kind;
+  token->type = (ExpectedType) type;
+  token->line = read_u32(reader);
+  token->column = read_u32(reader);
+  token->span = read_u32(reader);
+  token->index = read_u32(reader);
+  switch(token->kind) {
+    case Tkn_IntLiteral:
+      token->literal.value_i64 = (i64) read_u64(reader);
+      break;
+    case Tkn_FloatLiteral:
+      read_bytes(reader, &token->literal.value_float, sizeof(f64));
+      break;
+    case Tkn_CharLiteral:
+      token->literal.value_char = (char) read_u8(reader);
+      break;
+    case Tkn_StrLiteral:
+    case Tkn_Identifier:
+    case Tkn_Comment:
+      token->literal.value_string.value = (char*) read_string(reader);
+      token->literal.value_string.len = read_u32(reader);
+      break;
+    default:
+      break;
+  }
+  token->string = read_string(reader);
+  token->string_len = token->string ? strlen(token->string) : 0;
+}
+
+Ident* read_ident(AstReader* reader) {
+  u8 present = read_u8(reader);
+  if(present > 1)
+    reader->failed = true;
+  if(present != 1 or reader->failed)
+    return NULL;
+  SourceLoc loc = read_loc(reader);
+  return new_ident(read_string(reader), loc);
+}
+
+// the fields of the children of the nodes are pushed in the order of the
+// CHILDREN_<kind> lists.
+#define PUSH(kind, x) push_entry(&reader->stack, kind, &(x), 0, NULL);
+#define EXPR(x) PUSH(Image_expr, x)
+#define STMT(x) PUSH(Image_stmt, x)
+#define ITEM(x) PUSH(Image_item, x)
+#define SPEC(x) PUSH(Image_spec, x)
+#define PAT(x) PUSH(Image_pat, x)
+#define CLAUSE(x) PUSH(Image_clause, x)
+#define IDENT(x) PUSH(Image_ident, x)
+#define TOKEN(x) PUSH(Image_token, x)
+#define MUT(x) PUSH(Image_mut, x)
+#define READ_LIST(list, num, kind) push_entry(&reader->stack, Image_list, &(list), kind, &(num));
+#define EXPRS(list, num) READ_LIST(list, num, Image_expr)
+#define STMTS(list, num) READ_LIST(list, num, Image_stmt)
+#define ITEMS(list, num) READ_LIST(list, num, Image_item)
+#define SPECS(list, num) READ_LIST(list, num, Image_spec)
+#define PATS(list, num) READ_LIST(list, num, Image_pat)
+#define CLAUSES(list, num) READ_LIST(list, num, Image_clause)
+#define IDENTS(list, num) READ_LIST(list, num, Image_ident)
+
+// reads the kind of a node, false when it is missing. An unknown kind fails
+// the read when the children of the node are pushed.
+bool read_kind(AstReader* reader, u32* kind) {
+  u8 tag = read_u8(reader);
+  *kind = tag - 1;
+  return tag != 0;
+}
+
+// reads a node into its field and pushes the fields of its children.
+void read_entry(AstReader* reader, ImageEntry entry) {
+  u32 kind;
+  switch(entry.kind) {
+    case Image_item: {
+      Item* item = NULL;
+      if(read_kind(reader, &kind)) {
+        item = (Item*) ast_alloc(sizeof(Item));
+        item->kind = (ItemKind) kind;
+        item->loc = read_loc(reader);
+        switch(item->kind) {
+#define ITEMKIND(n) case n: CHILDREN_##n break;
+          ITEMKINDS
+#undef ITEMKIND
+          default: reader->failed = true; break;
+        }
+      }
+      *(Item**) entry.node = item;
+    } break;
+    case Image_stmt: {
+      Stmt* stmt = NULL;
+      if(read_kind(reader, &kind)) {
+        stmt = (Stmt*) ast_alloc(sizeof(Stmt));
+        stmt->kind = (StmtKind) kind;
+        stmt->loc = read_loc(reader);
+        switch(stmt->kind) {
+#define STMTKIND(n) case n: CHILDREN_##n break;
+          STMTKINDS
+#undef STMTKIND
+          default: reader->failed = true; break;
+        }
+      }
+      *(Stmt**) entry.node = stmt;
+    } break;
+    case Image_expr: {
+      Expr* expr = NULL;
+      if(read_kind(reader, &kind)) {
+        expr = (Expr*) ast_alloc(sizeof(Expr));
+        expr->kind = (ExprKind) kind;
+        expr->loc = read_loc(reader);
+        switch(expr->kind) {
+#define EXPRKIND(n) case n: CHILDREN_##n break;
+          EXPRKINDS
+#undef EXPRKIND
+          default: reader->failed = true; break;
+        }
+      }
+      *(Expr**) entry.node = expr;
+    } break;
+    case Image_spec: {
+      TypeSpec* spec = NULL;
+      if(read_kind(reader, &kind)) {
+        spec = (TypeSpec*) ast_alloc(sizeof(TypeSpec));
+        spec->kind = (TypeSpecKind) kind;
+        spec->loc = read_loc(reader);
+        switch(spec->kind) {
+#define TYPESPECKIND(n) case n: CHILDREN_##n break;
+          TYPESPECKINDS
+#undef TYPESPECKIND
+          default: reader->failed = true; break;
+        }
+      }
+      *(TypeSpec**) entry.node = spec;
+    } break;
+    case Image_pat: {
+      Pattern* pat = NULL;
+      if(read_kind(reader, &kind)) {
+        pat = (Pattern*) ast_alloc(sizeof(Pattern));
+        pat->kind = (PatternKind) kind;
+        pat->loc = read_loc(reader);
+        switch(pat->kind) {
+#define PATTERNKIND(n) case n: CHILDREN_##n break;
+          PATTERNKINDS
+#undef PATTERNKIND
+          default: reader->failed = true; break;
+        }
+      }
+      *(Pattern**) entry.node = pat;
+    } break;
+    case Image_clause: {
+      Clause* clause = NULL;
+      u8 present = read_u8(reader);
+      if(present > 1)
+        reader->failed = true;
+      if(present == 1 and !reader->failed) {
+        clause = (Clause*) ast_alloc(sizeof(Clause));
+        clause->loc = read_loc(reader);
+        CHILDREN_Clause
+      }
+      *(Clause**) entry.node = clause;
+    } break;
+    case Image_ident: *(Ident**) entry.node = read_ident(reader); break;
+    case Image_token: read_token(reader, (Token*) entry.node); break;
+    case Image_mut: *(Mutability*) entry.node = read_mut(reader); break;
+    // the list is made as long as it is read, its elements are then read into
+    // it and it does not grow again.
+    case Image_list: {
+      u32 count = read_count(reader);
+      void** list = NULL;
+      if(count) {
+        buf_fit(list, count);
+        memset(list, 0, count * sizeof(void*));
+        buf__hdr(list)->len = count;
+      }
+      memcpy(entry.node, &list, sizeof(void*));
+      *entry.num = count;
+      for(u32 i = 0; i < count; ++i)
+        push_entry(&reader->stack, entry.count, list + i, 0, NULL);
+    } break;
+  }
+}
+
+// reads the node of the kind and every node under it into the field. The
+// read stops at the first failure, leaving the fields not read yet NULL.
+void read_node(AstReader* reader, u32 kind, void* field) {
+  u64 base = buf_len(reader->stack);
+  push_entry(&reader->stack, kind, field, 0, NULL);
+  while(buf_len(reader->stack) > base and !reader->failed) {
+    ImageEntry entry = reader->stack[--buf__hdr(reader->stack)->len];
+    u64 first = buf_len(reader->stack);
+    read_entry(reader, entry);
+    reverse_image_entries(reader->stack, first);
+  }
+  buf__hdr(reader->stack)->len = base;
+}
+
+#undef PUSH
+#undef EXPR
+#undef STMT
+#undef ITEM
+#undef SPEC
+#undef PAT
+#undef CLAUSE
+#undef IDENT
+#undef TOKEN
+#undef MUT
+#undef EXPRS
+#undef STMTS
+#undef ITEMS
+#undef SPECS
+#undef PATS
+#undef CLAUSES
+#undef IDENTS
+
+bool valid_image(AstImageHeader* header, u64 size, File* file) {
+  if(size < sizeof(AstImageHeader) or memcmp(header->magic, AST_IMAGE_MAGIC, sizeof(header->magic)) != 0)
+    return false;
+  if(header->version != AST_IMAGE_VERSION or
+     size != sizeof(AstImageHeader) + (u64) header->nodes_size + header->strings_size)
+    return false;
+  // the string section ends with the terminator of its last string.
+  const char* strings = (const char*) header + size - header->strings_size;
+  if(header->strings_size and strings[header->strings_size - 1] != 0)
+    return false;
+  if(header->num_items > header->nodes_size)
+    return false;
+  if(file and (header->source_len != file->len or
+     header->source_hash != source_hash(file->content, file->len)))
+    return false;
+  return true;
+}
+
+AstFile* load_ast_image(const char* path, File* file, StringTable* table) {
+  assert(table);
+  int fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return NULL;
+  struct stat st;
+  if(fstat(fd, &st) != 0 or st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  u64 size = st.st_size;
+  char* image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(image == MAP_FAILED)
+    return NULL;
+
+  AstImageHeader* header = (AstImageHeader*) image;
+  if(!valid_image(header, size, file)) {
+    munmap(image, size);
+    return NULL;
+  }
+
+  AstReader reader = {0};
+  reader.nodes = image + sizeof(AstImageHeader);
+  reader.size = header->nodes_size;
+  reader.strings = reader.nodes + header->nodes_size;
+  reader.strings_size = header->strings_size;
+  reader.file = file;
+  reader.table = table;
+
+  AstFile* ast = new_ast_file(file);
+  Arena* old = set_ast_arena(add_ast_arena(ast));
+  for(u32 i = 0; i < header->num_items and !reader.failed; ++i) {
+    Item* item = NULL;
+    read_node(&reader, Image_item, &item);
+    if(!item)
+      reader.failed = true;
+    else
+      add_item(ast, item);
+  }
+  set_ast_arena(old);
+  // the nodes have to fill the section exactly.
+  bool failed = reader.failed or reader.offset != reader.size;
+
+  buf_free(reader.stack);
+  free(reader.interned.keys);
+  free(reader.interned.vals);
+  munmap(image, size);
+  if(failed) {
+    destroy_ast_file(ast);
+    return NULL;
+  }
+  return ast;
+}
+
+// writes the file, loads it back and writes the loaded nodes again. Both
+// images have to be the same.
+void ast_io_test(AstFile* ast, StringTable* table) {
+  const char* first = "ast_io_test.0.img";
+  const char* second = "ast_io_test.1.img";
+
+  clock_t start = clock();
+  if(!write_ast_image(ast, first)) {
+    printf("ast_io_test: failed to write %s\n", first);
+    return;
+  }
+  clock_t written = clock();
+  AstFile* loaded = load_ast_image(first, ast->file, table);
+  clock_t loaded_at = clock();
+  if(!loaded) {
+    printf("ast_io_test: failed to load %s\n", first);
+    return;
+  }
+  assert(ast_num_items(loaded) == ast_num_items(ast));
+  write_ast_image(loaded, second);
+
+  File* a = read_file(first);
+  File* b = read_file(second);
+  bool same = a and b and a->len == b->len and memcmp(a->content, b->content, a->len) == 0;
+  printf("ast_io_test: %u items, %lu bytes, write %.2fms, load %.2fms, %s\n",
+    ast_num_items(ast), (unsigned long) (a ? a->len : 0),
+    (written - start) * 1000.0 / CLOCKS_PER_SEC, (loaded_at - written) * 1000.0 / CLOCKS_PER_SEC,
+    same ? "same" : "different");
+  assert(same);
+
+  // another source of the same length is told apart by its hash.
+  File other = *ast->file;
+  other.content = malloc(other.len);
+  memcpy(other.content, ast->file->content, other.len);
+  other.content[other.len / 2] ^= 1;
+  assert(other.len == 0 or !load_ast_image(first, &other, table));
+  free(other.content);
+
+  // a truncated image, and one whose first node has an unknown kind, are
+  // rejected.
+  FILE* out = fopen(first, "wb");
+  fwrite(a->content, 1, a->len - 1, out);
+  fclose(out);
+  assert(!load_ast_image(first, ast->file, table));
+  if(ast_num_items(ast)) {
+    a->content[sizeof(AstImageHeader)] = (char) 0xff;
+    out = fopen(first, "wb");
+    fwrite(a->content, 1, a->len, out);
+    fclose(out);
+    assert(!load_ast_image(first, ast->file, table));
+  }
+
+  destroy_ast_file(loaded);
+  remove(first);
+  remove(second);
+}
@@ -3,5 +3,61 @@
 
 #include "print.h"
 
+// binary images of a parsed file.
+//
+// An image is the tree of a file encoded field by field, with no padding and
+// only the members of the kind of each node. A node is its kind plus one, or
+// 0 for a missing node, its location and then its children in the order of
+// the CHILDREN_<kind> lists of ast.h, a list being its length followed by
+// its elements. Locations, lengths and the offsets of strings are u32, kinds
+// and mutabilities a byte. Names and literal strings are stored once in a
+// string section and interned into the string table when loaded.
+//
+// Every read is checked against the size of the image, so a truncated or
+// corrupted image is rejected instead of read past its end. The writer and
+// the reader keep the nodes left on a stack of their own, so the depth of a
+// tree is not limited by the stack of the thread.
+//
+// Loading is not zero-copy. The image is mapped and decoded into nodes
+// allocated like parsed ones, which saves lexing and parsing but not the
+// allocation of the nodes. Nodes used in place would need the node structs
+// laid out with offsets for pointers, several times the size of this
+// encoding, and trees whose lists can not grow.
 
-#endif
\ No newline at end of file
+#define AST_IMAGE_MAGIC "OXYA"
+// bumped whenever the encoding of the nodes or the image changes.
+#define AST_IMAGE_VERSION 5
+
+typedef struct AstImageHeader {
+  char magic[4];
+  u32 version;
+  u32 num_items;
+  // length of the source the image was written from, files longer than a
+  // u32 are not written.
+  u32 source_len;
+  // sizes of the node and string sections, which follow the header.
+  u32 nodes_size;
+  u32 strings_size;
+  // hash of the source the image was written from, see source_hash.
+  u64 source_hash;
+} AstImageHeader;
+
+// the hash of a source checked when an image is loaded. It is independent of
+// string_hash, which the cache keys its images by, so a source whose key
+// collides with another is still told apart.
+u64 source_hash(const char* source, u64 len);
+
+// writes the items of ast to path. Deferred function bodies are parsed first.
+bool write_ast_image(AstFile* ast, const char* path);
+
+// reads an image written by write_ast_image. The locations of the nodes refer
+// to file. NULL is returned when the image can not be read, is malformed or
+// was written from another version of the source.
+//
+// The nodes are allocated in an arena of the file like parsed ones. There is
+// no token stream so the file can not be reparsed.
+AstFile* load_ast_image(const char* path, File* file, StringTable* table);
+
+void ast_io_test(AstFile* ast, StringTable* table);
+
+#endif
@@ -0,0 +1,69 @@
+// mkstemp
+#define _XOPEN_SOURCE 700
+
+#include "cache.h"
+#include "parser.h"
+#include "report.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool init_parse_cache(ParseCache* cache, const char* dir) {
+  cache->dir = dir;
+  atomic_init(&cache->hits, 0);
+  atomic_init(&cache->misses, 0);
+  if(mkdir(dir, 0755) != 0 and errno != EEXIST)
+    return false;
+  struct stat st;
+  return stat(dir, &st) == 0 and S_ISDIR(st.st_mode);
+}
+
+u64 hash_combine(u64 hash, u64 value) {
+  return hash ^ (value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+}
+
+u64 cache_key(File* file) {
+  u64 hash = string_hash(file->content, file->len);
+  hash = hash_combine(hash, string_hash(OXC_VERSION, strlen(OXC_VERSION)));
+  return hash_combine(hash, AST_IMAGE_VERSION);
+}
+
+AstFile* cached_parse(ParseCache* cache, File* file, StringTable* table, u32 flags, Pool* pool) {
+  char* path = NULL;
+  buf_printf(path, "%s/%016llx.ast", cache->dir, (unsigned long long) cache_key(file));
+
+  AstFile* ast = load_ast_image(path, file, table);
+  if(ast) {
+    atomic_fetch_add(&cache->hits, 1);
+    buf_free(path);
+    return ast;
+  }
+  atomic_fetch_add(&cache->misses, 1);
+
+  u32 errors = thread_error_count();
+  ast = parse_file_parallel(file, table, flags, pool);
+  if(thread_error_count() == errors) {
+    // written next to the entry and renamed, so a reader never maps a
+    // partial image. The temporary file is made by mkstemp, two threads or
+    // processes writing the same entry each write their own.
+    char* temp = NULL;
+    buf_printf(temp, "%s.XXXXXX", path);
+    int fd = mkstemp(temp);
+    if(fd >= 0) {
+      close(fd);
+      if(write_ast_image(ast, temp))
+        rename(temp, path);
+      else
+        remove(temp);
+    }
+    buf_free(temp);
+  }
+  buf_free(path);
+  return ast;
+}
+
+void print_cache_stats(ParseCache* cache) {
+  printf("cache: %u hits, %u misses\n", atomic_load(&cache->hits), atomic_load(&cache->misses));
+}
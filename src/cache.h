@@ -0,0 +1,32 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include "ast_io.h"
+#include "pool.h"
+
+#include <stdatomic.h>
+
+// bumped with every change to the compiler that changes the parsed trees.
+#define OXC_VERSION "0.1.0"
+
+// an on disk cache of parsed files. The images of ast_io are stored under a
+// key hashed from the contents of the file and the version of the compiler,
+// so an entry never has to be invalidated. An image also holds the length and
+// a second, independent hash of its source, which are checked when it is
+// loaded, so two files whose keys collide never load each other's tree.
+typedef struct ParseCache {
+  const char* dir;
+  atomic_uint hits;
+  atomic_uint misses;
+} ParseCache;
+
+// creates dir when it does not exist.
+bool init_parse_cache(ParseCache* cache, const char* dir);
+
+// loads the tree of file from the cache, or parses it and stores the tree
+// when it parsed without errors.
+AstFile* cached_parse(ParseCache* cache, File* file, StringTable* table, u32 flags, Pool* pool);
+
+void print_cache_stats(ParseCache* cache);
+
+#endif
@@ -0,0 +1,2579 @@
+#include "checker.h"
+#include "fingerprint.h"
+#include "parser.h"
+#include "report.h"
+#include "visit.h"
+
+// the result of an expression, its type and its value when it is known. An
+// expression naming a type or a module has its entity instead of a type.
+typedef struct Result {
+  Expr* expr;
+  Type* type;
+  Value value;
+  Entity* entity;
+} Result;
+
+Result resolve_expr(Checker* checker, Expr* expr);
+Type* resolve_typespec(Checker* checker, TypeSpec* spec);
+Type* resolve_entity(Checker* checker, Entity* entity);
+void resolve_local_item(Checker* checker, Item* item, bool declare);
+void collect_block_items(Checker* checker, Stmt** stmts, u32 num);
+void init_operator_tables();
+Result keep_constant(Checker* checker, Result result);
+
+Scope* new_checker_scope(Checker* checker, ScopeKind kind, Scope* parent) {
+  Scope* scope = new_scope(&checker->arena, kind, parent);
+  buf_push(checker->scopes, scope);
+  return scope;
+}
+
+Ident* builtin_ident(Checker* checker, const char* name) {
+  Ident* ident = (Ident*) arena_alloc(&checker->arena, sizeof(Ident));
+  memset(ident, 0, sizeof(Ident));
+  ident->value = (char*) table_insert_string(checker->table, name);
+  return ident;
+}
+
+Entity* new_checker_entity(Checker* checker, EntityKind kind, Ident* name, Item* item, Type* type) {
+  checker->num_entities++;
+  return new_entity(&checker->arena, kind, name, item, type);
+}
+
+void add_builtin(Checker* checker, EntityKind kind, const char* name, Type* type, Value value) {
+  Entity* entity = new_checker_entity(checker, kind, builtin_ident(checker, name), NULL, type);
+  entity->value = value;
+  entity->state = Entity_Resolved;
+  scope_add(checker->global_scope, entity);
+}
+
+void init_checker(Checker* checker, StringTable* table) {
+  memset(checker, 0, sizeof(Checker));
+  checker->table = table;
+  init_operator_tables();
+  checker->types = &checker->type_table;
+  init_type_table(checker->types);
+  init_evaluator(&checker->eval);
+  checker->global_scope = new_checker_scope(checker, Scope_Global, NULL);
+  checker->scope = checker->global_scope;
+
+  u32 num = 0;
+  Type** primitives = primitive_types(&num);
+  for(u32 i = 0; i < num; ++i)
+    add_builtin(checker, Entity_Type, primitives[i]->name, primitives[i], default_value);
+  add_builtin(checker, Entity_Const, "null", null_t, new_null_value());
+}
+
+void destroy_checker(Checker* checker) {
+  for(u32 i = 0; i < buf_len(checker->files); ++i)
+    checker->files[i]->scope = NULL;
+  for(u32 i = 0; i < buf_len(checker->scopes); ++i) {
+    Scope* scope = checker->scopes[i];
+    for(u32 j = 0; j < buf_len(scope->declared); ++j)
+      buf_free(scope->declared[j]->deps);
+    destroy_scope(scope);
+  }
+  buf_free(checker->scopes);
+  buf_free(checker->files);
+  free((void*) checker->trees.keys);
+  free(checker->trees.vals);
+  buf_free(checker->queue);
+  buf_free(checker->bodies);
+  buf_free(checker->resolving);
+  free((void*) checker->constants.keys);
+  free(checker->constants.vals);
+  free((void*) checker->recorded_types.keys);
+  free(checker->recorded_types.vals);
+  free((void*) checker->recorded_entities.keys);
+  free(checker->recorded_entities.vals);
+  free((void*) checker->body_errors.keys);
+  free(checker->body_errors.vals);
+  destroy_evaluator(&checker->eval);
+  destroy_type_table(&checker->type_table);
+  arena_free(&checker->arena);
+}
+
+// Declarations
+
+void declare(Scope* scope, Entity* entity) {
+  Entity* previous = scope_add(scope, entity);
+  if(previous) {
+    if(previous->name->loc.file)
+      check_error(entity->name->loc, "redeclaration of '%s', previously declared on line %llu\n",
+        entity->name->value, (unsigned long long) previous->name->loc.line);
+    else
+      check_error(entity->name->loc, "redeclaration of '%s'\n", entity->name->value);
+  }
+}
+
+// an entity for every name bound by a pattern of a declaration in scope.
+void collect_pattern(Checker* checker, Scope* scope, Pattern* pat, Item* item, bool immutable) {
+  if(!pat)
+    return;
+  switch(pat->kind) {
+    case IdentPattern: {
+      Entity* entity = new_checker_entity(checker, Entity_Local, pat->ident, item, NULL);
+      entity->pattern = pat;
+      entity->immutable = immutable;
+      declare(scope, entity);
+      buf_push(checker->queue, entity);
+    } break;
+    case TuplePattern:
+      for(u32 i = 0; i < pat->tuple.num_elems; ++i)
+        collect_pattern(checker, scope, pat->tuple.elems[i], item, immutable);
+      break;
+    case StructPattern:
+      for(u32 i = 0; i < pat->structure.num_elems; ++i)
+        collect_pattern(checker, scope, pat->structure.elems[i], item, immutable);
+      break;
+    case RefPattern:
+      collect_pattern(checker, scope, pat->ref.pat, item, immutable);
+      break;
+    case PointerPattern:
+      collect_pattern(checker, scope, pat->ptr.pat, item, immutable);
+      break;
+    default:;
+  }
+}
+
+void collect_entity(Checker* checker, Scope* scope, EntityKind kind, Ident* name, Item* item) {
+  if(!name)
+    return;
+  Entity* entity = new_checker_entity(checker, kind, name, item, NULL);
+  declare(scope, entity);
+  buf_push(checker->queue, entity);
+}
+
+// phase one, the entity of a declaration. Nothing is resolved.
+void collect_item(Checker* checker, Scope* scope, Item* item) {
+  if(!item)
+    return;
+  switch(item->kind) {
+    case ItemLocal:
+      collect_pattern(checker, scope, item->local.name, item, item->local.mut != Mutable);
+      break;
+    case ItemFunction:
+      collect_entity(checker, scope, Entity_Funct, item->function.name, item);
+      break;
+    case ItemStruct:
+      collect_entity(checker, scope, Entity_Struct, item->structure.name, item);
+      break;
+    case ItemTupleStruct:
+      collect_entity(checker, scope, Entity_Struct, item->tuplestruct.name, item);
+      break;
+    case ItemEnum:
+      collect_entity(checker, scope, Entity_Enum, item->enumeration.name, item);
+      break;
+    case ItemAlias:
+      collect_entity(checker, scope, Entity_Alias, item->alias.name, item);
+      break;
+    default:;
+  }
+}
+
+// the name of the module of a use item, the first len names of its path.
+char* use_module_name(Item* use, u32 len) {
+  char* name = NULL;
+  for(u32 i = 0; i < len; ++i)
+    buf_printf(name, i ? ".%s" : "%s", use->use.path[i]->value);
+  return name;
+}
+
+void import_name(Scope* scope, Scope* members, Ident* name, Item* use, u32 len) {
+  Entity* entity = scope_find(members, name->value);
+  if(!entity or entity->scope != members) {
+    char* module = use_module_name(use, len);
+    check_error(name->loc, "module '%s' has no declaration '%s'\n", module, name->value);
+    buf_free(module);
+    return;
+  }
+  Entity* previous = scope_import(scope, name->value, entity);
+  if(previous and previous != entity)
+    check_error(name->loc, "'%s' is already declared in this file\n", name->value);
+}
+
+// binds the names of the use items of the module in its file scope.
+void bind_imports(Checker* checker, Module* module) {
+  Scope* scope = module->ast->scope;
+  for(u32 i = 0; i < buf_len(module->imports); ++i) {
+    Module* imported = module->imports[i];
+    Item* use = module->import_items[i];
+    u32 len = module->import_lengths[i];
+    if(!imported->ast or !imported->ast->scope)
+      continue;
+    Scope* members = imported->ast->scope;
+
+    if(len < use->use.num_path) {
+      // the rest of the path names a declaration of the module.
+      if(len + 1 < use->use.num_path or use->use.num_names) {
+        check_error(use->use.path[len]->loc, "'%s' is not a module\n", use->use.path[len]->value);
+        continue;
+      }
+      import_name(scope, members, use->use.path[len], use, len);
+    }
+    else if(use->use.num_names == 0) {
+      Ident* name = use->use.path[len - 1];
+      Entity* entity = new_checker_entity(checker, Entity_Module, name, use, NULL);
+      entity->members = members;
+      entity->state = Entity_Resolved;
+      declare(scope, entity);
+    }
+    else {
+      for(u32 j = 0; j < use->use.num_names; ++j) {
+        Ident* name = use->use.names[j];
+        if(strcmp(name->value, "*") != 0) {
+          import_name(scope, members, name, use, len);
+          continue;
+        }
+        // the declarations of the file shadow the ones imported by a '*'.
+        for(u32 k = 0; k < buf_len(members->declared); ++k) {
+          Entity* entity = members->declared[k];
+          scope_import(scope, entity->name->value, entity);
+        }
+      }
+    }
+  }
+}
+
+// Resolving
+
+// the entity is an item, declared in a file or a body, that can have
+// dependencies. The locals of bodies, parameters and builtins are not.
+bool is_item_entity(Entity* entity) {
+  if(!entity->item or entity->kind == Entity_Module)
+    return false;
+  return entity->kind != Entity_Local or entity->scope->kind == Scope_File;
+}
+
+// the item is used by the item whose declaration or body is checked. The
+// bodies checked again for the evaluator add nothing, they can be checked
+// by several workers at once.
+void use_entity(Checker* checker, Entity* entity) {
+  Entity* dependent = checker->dependent;
+  if(!dependent or dependent == entity or checker->replaying or !is_item_entity(entity))
+    return;
+  for(u32 i = buf_len(dependent->deps); i > 0; --i) {
+    if(dependent->deps[i - 1] == entity)
+      return;
+  }
+  buf_push(dependent->deps, entity);
+}
+
+// an entity needed while it is being resolved, the cycle is every entity on
+// the resolving stack since then.
+void report_cycle(Checker* checker, Entity* entity) {
+  char* path = NULL;
+  u32 start = 0;
+  for(u32 i = 0; i < buf_len(checker->resolving); ++i) {
+    if(checker->resolving[i] == entity)
+      start = i;
+  }
+  for(u32 i = start; i < buf_len(checker->resolving); ++i)
+    buf_printf(path, "'%s' -> ", checker->resolving[i]->name->value);
+  buf_printf(path, "'%s'", entity->name->value);
+  check_error(entity->name->loc, "cycle in the declaration of '%s': %s\n", entity->name->value, path);
+  buf_free(path);
+}
+
+// the checker state that depends on where a name is used.
+typedef struct CheckContext {
+  Scope* scope;
+  Entity* function;
+  u32 loops;
+} CheckContext;
+
+CheckContext enter_context(Checker* checker, Scope* scope, Entity* function) {
+  CheckContext saved = {checker->scope, checker->function, checker->loops};
+  checker->scope = scope;
+  checker->function = function;
+  checker->loops = 0;
+  return saved;
+}
+
+void leave_context(Checker* checker, CheckContext saved) {
+  checker->scope = saved.scope;
+  checker->function = saved.function;
+  checker->loops = saved.loops;
+}
+
+Type* declared_type(Checker* checker, Entity* entity) {
+  if(!entity->type) {
+    if(entity->kind == Entity_Struct)
+      entity->type = struct_type(checker->types, entity, entity->name->value);
+    else if(entity->kind == Entity_Enum)
+      entity->type = enum_type(checker->types, entity, entity->name->value);
+  }
+  return entity->type;
+}
+
+// a type used by value needs its members, so the declaration of a struct
+// or enum in it is resolved. Holding a struct being resolved is a cycle.
+bool require_complete(Checker* checker, Type* type, SourceLoc loc) {
+  if(!type)
+    return true;
+  switch(type->kind) {
+    case Type_Struct:
+    case Type_Enum: {
+      bool complete = type->kind == Type_Struct ? type->strct.complete : type->enm.complete;
+      if(complete)
+        return true;
+      Entity* entity = type->kind == Type_Struct ? type->strct.entity : type->enm.entity;
+      if(entity->state == Entity_Resolving) {
+        check_error(loc, "recursive type '%s' has infinite size\n", type->name);
+        return false;
+      }
+      resolve_entity(checker, entity);
+      return true;
+    }
+    case Type_Tuple: {
+      bool complete = true;
+      for(u32 i = 0; i < type->tuple.num_elems; ++i)
+        complete = require_complete(checker, type->tuple.elems[i], loc) and complete;
+      layout_tuple_type(type);
+      return complete;
+    }
+    default:
+      return true;
+  }
+}
+
+// the types of the members of a struct, its fields or the types of a tuple
+// struct.
+void resolve_struct_item(Checker* checker, Entity* entity) {
+  Item* item = entity->item;
+  Type* type = declared_type(checker, entity);
+  const char** names = NULL;
+  Type** members = NULL;
+
+  if(item->kind == ItemStruct) {
+    for(u32 i = 0; i < item->structure.num_fields; ++i) {
+      Item* field = item->structure.fields[i];
+      Type* member = field->field.type ? resolve_typespec(checker, field->field.type) : NULL;
+      if(field->field.init) {
+        Result init = resolve_expr(checker, field->field.init);
+        if(!field->field.type)
+          member = init.type;
+        else if(member and init.type and !type_convertable(init.type, member))
+          check_error(field->field.init->loc, "mismatched types: expected '%s', found '%s'\n",
+            type_string(member), type_string(init.type));
+      }
+      for(u32 j = 0; j < buf_len(names); ++j) {
+        if(names[j] == field->field.name->value)
+          check_error(field->field.name->loc, "duplicate member '%s'\n", field->field.name->value);
+      }
+      if(!require_complete(checker, member, field->loc))
+        member = NULL;
+      buf_push(names, field->field.name->value);
+      buf_push(members, member);
+    }
+  }
+  else {
+    for(u32 i = 0; i < item->tuplestruct.num_fields; ++i) {
+      TypeSpec* spec = item->tuplestruct.fields[i];
+      Type* member = resolve_typespec(checker, spec);
+      if(!require_complete(checker, member, spec->loc))
+        member = NULL;
+      char index[16];
+      snprintf(index, sizeof(index), "%u", i);
+      buf_push(names, table_insert_string(checker->table, index));
+      buf_push(members, member);
+    }
+  }
+
+  complete_struct_type(checker->types, type, names, members, buf_len(members));
+  buf_free(names);
+  buf_free(members);
+}
+
+void resolve_enum_item(Checker* checker, Entity* entity) {
+  Item* item = entity->item;
+  Type* type = declared_type(checker, entity);
+  EnumVariant* variants = NULL;
+  i64 next = 0;
+
+  for(u32 i = 0; i < item->enumeration.num_elems; ++i) {
+    Item* elem = item->enumeration.elems[i];
+    if(!elem)
+      continue;
+    EnumVariant variant = {NULL, NULL, next};
+    Ident* name = NULL;
+    if(elem->kind == ItemName) {
+      name = elem->name.name;
+      if(elem->name.value) {
+        Result value = resolve_expr(checker, elem->name.value);
+        if(value.value.kind == Value_Integer)
+          variant.value = value.value.integer_value;
+        else if(value.type)
+          check_error(elem->name.value->loc, "the value of '%s' must be a constant integer\n", name->value);
+      }
+    }
+    else if(elem->kind == ItemTupleStruct) {
+      name = elem->tuplestruct.name;
+      Type** payload = NULL;
+      for(u32 j = 0; j < elem->tuplestruct.num_fields; ++j) {
+        Type* member = resolve_typespec(checker, elem->tuplestruct.fields[j]);
+        if(!require_complete(checker, member, elem->tuplestruct.fields[j]->loc))
+          member = NULL;
+        buf_push(payload, member);
+      }
+      variant.payload = tuple_type(checker->types, payload, buf_len(payload));
+      buf_free(payload);
+    }
+    else
+      continue;
+
+    for(u32 j = 0; j < buf_len(variants); ++j) {
+      if(variants[j].name == name->value)
+        check_error(name->loc, "duplicate variant '%s'\n", name->value);
+    }
+    variant.name = name->value;
+    buf_push(variants, variant);
+    next = variant.value + 1;
+  }
+
+  complete_enum_type(checker->types, type, variants, buf_len(variants));
+  buf_free(variants);
+}
+
+// the signature of a function, the body is checked later.
+void resolve_function_item(Checker* checker, Entity* entity) {
+  Item* item = entity->item;
+  Type** params = NULL;
+  bool valid = true;
+  for(u32 i = 0; i < item->function.num_args; ++i) {
+    Item* param = item->function.arguments[i];
+    Type* type = param->field.type ? resolve_typespec(checker, param->field.type) : NULL;
+    if(param->field.init) {
+      Result init = resolve_expr(checker, param->field.init);
+      if(!param->field.type)
+        type = init.type;
+      else if(type and init.type and !type_convertable(init.type, type))
+        check_error(param->field.init->loc, "mismatched types: expected '%s', found '%s'\n",
+          type_string(type), type_string(init.type));
+    }
+    valid = valid and type;
+    buf_push(params, type);
+  }
+  Type* ret = item->function.ret ? resolve_typespec(checker, item->function.ret) : unit_t;
+  if(valid and ret)
+    entity->type = func_type(checker->types, params, buf_len(params), ret);
+  buf_free(params);
+
+  // a body the parser skipped is not checked, it is parsed once something
+  // needs it, see record_body. The functions declared in a body that is
+  // checked again already are.
+  if(item->function.body and !checker->replaying)
+    buf_push(checker->bodies, entity);
+}
+
+// resolves the declaration of the entity if it is not yet, in the scope it
+// is declared in. Returns its type, NULL when it has errors.
+Type* resolve_entity(Checker* checker, Entity* entity) {
+  if(entity->state == Entity_Resolved)
+    return entity->type;
+  if(entity->state == Entity_Resolving) {
+    // structs and enums can be named while their members are resolved.
+    if(entity->kind == Entity_Struct or entity->kind == Entity_Enum)
+      return entity->type;
+    report_cycle(checker, entity);
+    return NULL;
+  }
+
+  entity->state = Entity_Resolving;
+  buf_push(checker->resolving, entity);
+  CheckContext saved = enter_context(checker, entity->scope, NULL);
+  Entity* dependent = checker->dependent;
+  if(is_item_entity(entity))
+    checker->dependent = entity;
+
+  switch(entity->kind) {
+    case Entity_Local:
+      resolve_local_item(checker, entity->item, false);
+      break;
+    case Entity_Alias:
+      entity->type = resolve_typespec(checker, entity->item->alias.type);
+      break;
+    case Entity_Struct:
+      resolve_struct_item(checker, entity);
+      break;
+    case Entity_Enum:
+      resolve_enum_item(checker, entity);
+      break;
+    case Entity_Funct:
+      resolve_function_item(checker, entity);
+      break;
+    default:;
+  }
+
+  checker->dependent = dependent;
+  leave_context(checker, saved);
+  buf__hdr(checker->resolving)->len--;
+  entity->state = Entity_Resolved;
+  return entity->type;
+}
+
+// Types
+
+Entity* lookup_name(Checker* checker, Ident* name) {
+  Entity* entity = cached_lookup(&checker->cache, &checker->arena, checker->scope, name->value);
+  if(!entity)
+    check_error(name->loc, "use of undeclared identifier '%s'\n", name->value);
+  return entity;
+}
+
+Type* entity_as_type(Checker* checker, Entity* entity, SourceLoc loc) {
+  use_entity(checker, entity);
+  if(!is_entity_type(entity)) {
+    check_error(loc, "'%s' is a %s, not a type\n", entity->name->value, entity_string(entity));
+    return NULL;
+  }
+  // the members of a struct or enum are only needed where it is used by
+  // value, which resolves them.
+  if(entity->kind == Entity_Struct or entity->kind == Entity_Enum)
+    return declared_type(checker, entity);
+  return resolve_entity(checker, entity);
+}
+
+Type* resolve_typespec(Checker* checker, TypeSpec* spec) {
+  if(!spec)
+    return NULL;
+  Type* type = NULL;
+  switch(spec->kind) {
+    case TypeSpecNone:
+      check_error(spec->loc, "invalid type\n");
+      break;
+    case TypeSpecName: {
+      Entity* entity = lookup_name(checker, spec->name.name);
+      if(entity)
+        type = entity_as_type(checker, entity, spec->loc);
+    } break;
+    case TypeSpecPath: {
+      TypeSpec* parent = spec->path.parent;
+      TypeSpec* elem = spec->path.elem;
+      if(!parent or !elem or parent->kind != TypeSpecName or elem->kind != TypeSpecName) {
+        check_error(spec->loc, "invalid type path\n");
+        break;
+      }
+      Entity* module = lookup_name(checker, parent->name.name);
+      if(!module)
+        break;
+      if(module->kind != Entity_Module) {
+        check_error(parent->loc, "'%s' is not a module\n", module->name->value);
+        break;
+      }
+      Entity* entity = scope_find(module->members, elem->name.name->value);
+      if(!entity or entity->scope != module->members) {
+        check_error(elem->loc, "module '%s' has no declaration '%s'\n", module->name->value, elem->name.name->value);
+        break;
+      }
+      type = entity_as_type(checker, entity, elem->loc);
+    } break;
+    case TypeSpecFunc: {
+      Type** params = NULL;
+      bool valid = true;
+      for(u32 i = 0; i < spec->funct.num_args; ++i) {
+        Type* param = resolve_typespec(checker, spec->funct.args[i]);
+        valid = valid and param;
+        buf_push(params, param);
+      }
+      Type* ret = spec->funct.ret ? resolve_typespec(checker, spec->funct.ret) : unit_t;
+      if(valid and ret)
+        type = func_type(checker->types, params, buf_len(params), ret);
+      buf_free(params);
+    } break;
+    case TypeSpecArray: {
+      Type* elem = resolve_typespec(checker, spec->array.elem);
+      if(elem)
+        type = array_type(checker->types, elem);
+    } break;
+    case TypeSpecPtr: {
+      Type* elem = resolve_typespec(checker, spec->ptr.elem);
+      if(elem)
+        type = ptr_type(checker->types, elem);
+    } break;
+    case TypeSpecRef: {
+      Type* elem = resolve_typespec(checker, spec->ref.elem);
+      if(elem)
+        type = ref_type(checker->types, elem);
+    } break;
+    case TypeSpecMap: {
+      Type* key = resolve_typespec(checker, spec->map.key);
+      Type* value = resolve_typespec(checker, spec->map.value);
+      if(key and value)
+        type = map_type(checker->types, key, value);
+    } break;
+    case TypeSpecTuple: {
+      Type** elems = NULL;
+      bool valid = true;
+      for(u32 i = 0; i < spec->tuple.num_types; ++i) {
+        Type* elem = resolve_typespec(checker, spec->tuple.types[i]);
+        valid = valid and elem;
+        buf_push(elems, elem);
+      }
+      if(valid)
+        type = tuple_type(checker->types, elems, buf_len(elems));
+      buf_free(elems);
+    } break;
+  }
+  spec->type = type;
+  return type;
+}
+
+// Patterns
+
+// binds the names of a pattern matched against a value of type. Locals are
+// declared in the current scope, the entities of a declaration in file
+// scope were collected and only get their types.
+void bind_pattern(Checker* checker, Pattern* pat, Type* type, Item* item, bool declare_names, bool immutable) {
+  if(!pat)
+    return;
+  switch(pat->kind) {
+    case WildCard:
+      break;
+    case IdentPattern: {
+      Entity* entity = NULL;
+      if(declare_names) {
+        entity = new_checker_entity(checker, Entity_Local, pat->ident, item, type);
+        entity->pattern = pat;
+        entity->immutable = immutable;
+        entity->state = Entity_Resolved;
+        declare(checker->scope, entity);
+        if(checker->recording)
+          map_put(&checker->recorded_entities, pat, entity);
+      }
+      else {
+        entity = scope_find(checker->scope, pat->ident->value);
+        if(entity and entity->pattern == pat)
+          entity->type = type;
+      }
+    } break;
+    case TuplePattern: {
+      u32 num = pat->tuple.num_elems;
+      if(type and (type->kind != Type_Tuple or type->tuple.num_elems != num)) {
+        check_error(pat->loc, "the pattern has %u elements but the type is '%s'\n", num, type_string(type));
+        type = NULL;
+      }
+      for(u32 i = 0; i < num; ++i)
+        bind_pattern(checker, pat->tuple.elems[i], type ? type->tuple.elems[i] : NULL, item, declare_names, immutable);
+    } break;
+    case StructPattern: {
+      Type* path = resolve_typespec(checker, pat->structure.path);
+      require_complete(checker, path, pat->loc);
+      if(path and path->kind != Type_Struct) {
+        check_error(pat->loc, "'%s' is not a struct\n", type_string(path));
+        path = NULL;
+      }
+      if(path and type and path != type) {
+        check_error(pat->loc, "mismatched types: expected '%s', found '%s'\n", type_string(type), type_string(path));
+        path = NULL;
+      }
+      if(path and pat->structure.num_elems > path->strct.num_members) {
+        check_error(pat->loc, "'%s' has %u members\n", type_string(path), path->strct.num_members);
+        path = NULL;
+      }
+      for(u32 i = 0; i < pat->structure.num_elems; ++i)
+        bind_pattern(checker, pat->structure.elems[i], path ? path->strct.members[i] : NULL, item, declare_names, immutable);
+    } break;
+    case RefPattern:
+      bind_pattern(checker, pat->ref.pat, type ? ref_type(checker->types, type) : NULL, item, declare_names,
+        pat->ref.mut != Mutable);
+      break;
+    case PointerPattern:
+      bind_pattern(checker, pat->ptr.pat, type ? ptr_type(checker->types, type) : NULL, item, declare_names,
+        pat->ptr.mut != Mutable);
+      break;
+    case LiteralPattern: {
+      Expr literal = {Literal, pat->loc, .literal = pat->literal};
+      Result result = resolve_expr(checker, &literal);
+      if(type and result.type and !type_convertable(result.type, type))
+        check_error(pat->loc, "mismatched types: expected '%s', found '%s'\n", type_string(type), type_string(result.type));
+    } break;
+    case RangePattern:
+      break;
+  }
+}
+
+// the value of a constant initialized by init, evaluated when it does not
+// fold.
+Value constant_initializer(Checker* checker, Expr* expr, Result init, Type* type, Ident* name) {
+  ValueType folded = value_type(type);
+  if(init.value.kind == Value_Invalid or init.expr != expr) {
+    Value value = default_value;
+    char* what = NULL;
+    buf_printf(what, "'%s'", name->value);
+    evaluate(checker, expr, type, what, &value);
+    buf_free(what);
+    return value;
+  }
+  if(folded.kind == Value_Invalid)
+    return default_value;
+  FoldError error;
+  Value value = value_convert(init.value, folded, &error);
+  if(error == Fold_Overflow)
+    check_error(expr->loc, "initializer of '%s' out of range for '%s'\n", name->value, type_string(type));
+  else if(error != Fold_Ok)
+    check_error(expr->loc, "initializer of '%s' can not be converted to '%s'\n", name->value, type_string(type));
+  return error == Fold_Ok ? value : default_value;
+}
+
+// a let item, in a block or in file scope. The immutable locals of a file
+// are constants when their initializers are known at compile time.
+void resolve_local_item(Checker* checker, Item* item, bool declare_names) {
+  Pattern* pat = item->local.name;
+  bool constant = !declare_names and item->local.mut != Mutable and pat and pat->kind == IdentPattern;
+  Type* type = item->local.type ? resolve_typespec(checker, item->local.type) : NULL;
+  Value value = default_value;
+  if(item->local.init) {
+    u32 errors = thread_error_count();
+    checker->recording += constant;
+    Result init = resolve_expr(checker, item->local.init);
+    checker->recording -= constant;
+    if(!item->local.type)
+      type = init.type;
+    else if(type and init.type and !type_convertable(init.type, type))
+      check_error(item->local.init->loc, "mismatched types: expected '%s', found '%s'\n",
+        type_string(type), type_string(init.type));
+    if(constant and type and thread_error_count() == errors)
+      value = constant_initializer(checker, item->local.init, init, type, pat->ident);
+  }
+  bind_pattern(checker, pat, type, item, declare_names, item->local.mut != Mutable);
+  if(constant) {
+    Entity* entity = scope_find(checker->scope, pat->ident->value);
+    if(entity and entity->pattern == pat)
+      entity->value = value;
+  }
+}
+
+// Expressions
+
+Result result_of(Expr* expr, Type* type) {
+  Result result = {expr, type, default_value, NULL};
+  return result;
+}
+
+// Recording
+
+// the value is kept when the result is the expression's own, not the one
+// of the last expression of a block.
+void record_result(Checker* checker, Expr* expr, Result result) {
+  if(result.type)
+    map_put(&checker->recorded_types, expr, result.type);
+  if(result.expr == expr and result.value.kind != Value_Invalid and !map_get(&checker->constants, expr))
+    keep_constant(checker, result);
+}
+
+Type* recorded_type(Checker* checker, Expr* expr) {
+  return (Type*) map_get(&checker->recorded_types, expr);
+}
+
+Entity* recorded_entity(Checker* checker, const void* node) {
+  return (Entity*) map_get(&checker->recorded_entities, node);
+}
+
+SourceLoc token_loc(Expr* expr, Token token) {
+  SourceLoc loc = {expr->loc.file, token.line, token.column, token.span};
+  return loc;
+}
+
+// how the constants of a type are folded, of the invalid kind when they
+// are not folded.
+ValueType value_type(Type* type) {
+  ValueType value = {Value_Invalid, type ? type->size : 0, is_signed_type(type)};
+  if(is_integer_type(type))
+    value.kind = Value_Integer;
+  else if(is_float_type(type))
+    value.kind = Value_Float;
+  else if(type) {
+    switch(type->kind) {
+      case Type_Bool: value.kind = Value_Bool; break;
+      case Type_Char: value.kind = Value_Char; break;
+      case Type_Str: value.kind = Value_String; break;
+      case Type_Null: value.kind = Value_Null; break;
+      default:;
+    }
+  }
+  return value;
+}
+
+Type* literal_type(Token token) {
+  switch(token.kind) {
+    case Tkn_IntLiteral:
+      switch(token.type) {
+        case I8: return i8_t;
+        case I16: return i16_t;
+        case I64: return i64_t;
+        case U8: return u8_t;
+        case U16: return u16_t;
+        case U32: return u32_t;
+        case U64: return u64_t;
+        case F32: return f32_t;
+        case F64: return f64_t;
+        // unsuffixed integers too large for an i32 are i64.
+        default:
+          if(token.literal.value_i64 > INT32_MAX or token.literal.value_i64 < INT32_MIN)
+            return i64_t;
+          return i32_t;
+      }
+    case Tkn_FloatLiteral:
+      return token.type == F32 ? f32_t : f64_t;
+    case Tkn_CharLiteral:
+      return char_t;
+    case Tkn_StrLiteral:
+      return str_t;
+    case Tkn_True:
+    case Tkn_False:
+      return bool_t;
+    default:
+      return NULL;
+  }
+}
+
+Result resolve_literal(Expr* expr) {
+  Token token = expr->literal;
+  Result result = result_of(expr, literal_type(token));
+  FoldError error = Fold_Ok;
+  switch(token.kind) {
+    case Tkn_IntLiteral:
+      result.value = value_convert(new_integer_value(token.literal.value_i64), value_type(result.type), &error);
+      if(error == Fold_Overflow and token.type != U64)
+        check_error(expr->loc, "literal out of range for '%s'\n", type_string(result.type));
+      break;
+    case Tkn_FloatLiteral:
+      result.value = value_convert(new_float_value(token.literal.value_float), value_type(result.type), &error);
+      break;
+    case Tkn_CharLiteral:
+      result.value = new_char_value(token.literal.value_char);
+      break;
+    case Tkn_StrLiteral:
+      result.value = new_string_value(token.literal.value_string.value);
+      break;
+    case Tkn_True:
+    case Tkn_False:
+      result.value = new_bool_value(token.kind == Tkn_True);
+      break;
+    default:
+      check_error(expr->loc, "invalid literal\n");
+  }
+  return result;
+}
+
+// the value of an entity named by an expression.
+Result entity_value(Checker* checker, Expr* expr, Entity* entity) {
+  use_entity(checker, entity);
+  Result result = result_of(expr, NULL);
+  if(is_entity_type(entity) or entity->kind == Entity_Module) {
+    result.entity = entity;
+    return result;
+  }
+  result.type = resolve_entity(checker, entity);
+  result.value = entity->value;
+  return result;
+}
+
+// an operand of a member access or call, which can name a type or module.
+Result resolve_operand(Checker* checker, Expr* expr) {
+  if(expr and expr->kind == Name) {
+    Entity* entity = lookup_name(checker, expr->name);
+    if(entity and checker->recording)
+      map_put(&checker->recorded_entities, expr, entity);
+    return entity ? entity_value(checker, expr, entity) : result_of(expr, NULL);
+  }
+  return resolve_expr(checker, expr);
+}
+
+// a value is expected, not a type or module.
+Result expect_value(Result result) {
+  if(result.entity) {
+    check_error(result.expr->loc, "'%s' is a %s, not a value\n", result.entity->name->value,
+      entity_string(result.entity));
+    result.entity = NULL;
+  }
+  return result;
+}
+
+Result resolve_value(Checker* checker, Expr* expr) {
+  return expect_value(resolve_expr(checker, expr));
+}
+
+void check_condition(Result cond) {
+  Type* type = cond.type;
+  if(type and !is_bool_type(type) and !is_integer_type(type) and !is_ptr_type(type))
+    check_error(cond.expr->loc, "the condition must be a boolean, found '%s'\n", type_string(type));
+}
+
+void check_integer(Result result, const char* what) {
+  if(result.type and !is_integer_type(result.type))
+    check_error(result.expr->loc, "%s must be an integer, found '%s'\n", what, type_string(result.type));
+}
+
+// the type of arithmetic on two types, the one with the larger rank, or
+// size when the ranks are the same.
+Type* unify_types(Type* lhs, Type* rhs) {
+  i32 rank_lhs = type_rank(lhs);
+  i32 rank_rhs = type_rank(rhs);
+  if(rank_lhs == -1 or rank_rhs == -1)
+    return NULL;
+  if(rank_lhs == rank_rhs)
+    return lhs->size < rhs->size ? rhs : lhs;
+  return rank_lhs < rank_rhs ? rhs : lhs;
+}
+
+// Operators
+//
+// The operands of an operator are reduced to their class, and the result of
+// every operator on every class is looked up in tables built once, from the
+// rules below. Only arithmetic of two different types needs to look at the
+// types themselves, to find the wider one.
+
+typedef enum TypeClass {
+  Class_Other,
+  Class_Int,
+  Class_Float,
+  Class_Char,
+  Class_Bool,
+  Class_Ptr,
+  Class_Null,
+  Class_Array,
+  Class_Struct,
+  Num_Classes
+} TypeClass;
+
+#define CLASS(c) (1 << Class_##c)
+#define ARITHMETIC_CLASSES (CLASS(Int) | CLASS(Float) | CLASS(Char))
+#define ALL_CLASSES ((1 << Num_Classes) - 1)
+
+typedef enum OperatorRule {
+  Rule_Invalid,
+  // the wider of the arithmetic operands.
+  Rule_Unify,
+  Rule_Lhs,
+  Rule_Rhs,
+  Rule_Bool,
+  // a bool when both operands have the same type.
+  Rule_BoolSame,
+  // the element of a pointer or array operand.
+  Rule_Elem,
+  // a pointer to the operand.
+  Rule_Address,
+} OperatorRule;
+
+u8 type_classes[Num_Types];
+u8 binary_rules[Num_Tokens][Num_Classes][Num_Classes];
+u8 unary_rules[Num_Tokens][Num_Classes];
+// the operator of a compound assignment, Tkn_Error for the other tokens.
+TokenKind compound_operators[Num_Tokens];
+pthread_once_t operator_tables_once = PTHREAD_ONCE_INIT;
+
+void binary_rule(TokenKind op, u32 lhs_classes, u32 rhs_classes, OperatorRule rule) {
+  for(u32 lhs = 0; lhs < Num_Classes; ++lhs) {
+    for(u32 rhs = 0; rhs < Num_Classes; ++rhs) {
+      if((lhs_classes & (1 << lhs)) and (rhs_classes & (1 << rhs)))
+        binary_rules[op][lhs][rhs] = rule;
+    }
+  }
+}
+
+void unary_rule(TokenKind op, u32 classes, OperatorRule rule) {
+  for(u32 c = 0; c < Num_Classes; ++c) {
+    if(classes & (1 << c))
+      unary_rules[op][c] = rule;
+  }
+}
+
+void build_operator_tables() {
+  for(u32 kind = 0; kind < Num_Types; ++kind) {
+    switch(kind) {
+      case Type_I8: case Type_I16: case Type_I32: case Type_I64:
+      case Type_U8: case Type_U16: case Type_U32: case Type_U64:
+        type_classes[kind] = Class_Int;
+        break;
+      case Type_F32: case Type_F64: type_classes[kind] = Class_Float; break;
+      case Type_Char: type_classes[kind] = Class_Char; break;
+      case Type_Bool: type_classes[kind] = Class_Bool; break;
+      case Type_Ptr: case Type_Ref: type_classes[kind] = Class_Ptr; break;
+      case Type_Null: type_classes[kind] = Class_Null; break;
+      case Type_Array: type_classes[kind] = Class_Array; break;
+      case Type_Struct: type_classes[kind] = Class_Struct; break;
+      default: type_classes[kind] = Class_Other;
+    }
+  }
+
+  TokenKind arithmetic[] = {Tkn_Plus, Tkn_Minus, Tkn_Astrick, Tkn_Slash, Tkn_Percent, Tkn_AstrickAstrick};
+  for(u32 i = 0; i < sizeof(arithmetic) / sizeof(arithmetic[0]); ++i)
+    binary_rule(arithmetic[i], ARITHMETIC_CLASSES, ARITHMETIC_CLASSES, Rule_Unify);
+  binary_rule(Tkn_Plus, CLASS(Ptr), CLASS(Int), Rule_Lhs);
+  binary_rule(Tkn_Plus, CLASS(Int), CLASS(Ptr), Rule_Rhs);
+  binary_rule(Tkn_Minus, CLASS(Ptr), CLASS(Int), Rule_Lhs);
+
+  binary_rule(Tkn_LessLess, CLASS(Int), CLASS(Int), Rule_Lhs);
+  binary_rule(Tkn_GreaterGreater, CLASS(Int), CLASS(Int), Rule_Lhs);
+  binary_rule(Tkn_Ampersand, CLASS(Int), CLASS(Int), Rule_Unify);
+  binary_rule(Tkn_Pipe, CLASS(Int), CLASS(Int), Rule_Unify);
+  binary_rule(Tkn_Carrot, CLASS(Int), CLASS(Int), Rule_Unify);
+
+  TokenKind equality[] = {Tkn_EqualEqual, Tkn_BangEqual};
+  for(u32 i = 0; i < 2; ++i) {
+    binary_rule(equality[i], ALL_CLASSES & ~CLASS(Struct), ALL_CLASSES & ~CLASS(Struct), Rule_BoolSame);
+    binary_rule(equality[i], ARITHMETIC_CLASSES, ARITHMETIC_CLASSES, Rule_Bool);
+    binary_rule(equality[i], CLASS(Ptr) | CLASS(Null), CLASS(Ptr) | CLASS(Null), Rule_Bool);
+  }
+  TokenKind ordering[] = {Tkn_Less, Tkn_Greater, Tkn_LessEqual, Tkn_GreaterEqual};
+  for(u32 i = 0; i < 4; ++i) {
+    binary_rule(ordering[i], ARITHMETIC_CLASSES, ARITHMETIC_CLASSES, Rule_Bool);
+    binary_rule(ordering[i], CLASS(Ptr), CLASS(Ptr), Rule_BoolSame);
+  }
+  binary_rule(Tkn_And, CLASS(Bool) | CLASS(Int), CLASS(Bool) | CLASS(Int), Rule_Bool);
+  binary_rule(Tkn_Or, CLASS(Bool) | CLASS(Int), CLASS(Bool) | CLASS(Int), Rule_Bool);
+
+  unary_rule(Tkn_Minus, ARITHMETIC_CLASSES, Rule_Lhs);
+  unary_rule(Tkn_Bang, CLASS(Bool) | CLASS(Int), Rule_Bool);
+  unary_rule(Tkn_Tilde, CLASS(Int), Rule_Lhs);
+  unary_rule(Tkn_Astrick, CLASS(Ptr) | CLASS(Array), Rule_Elem);
+  unary_rule(Tkn_Ampersand, ALL_CLASSES, Rule_Address);
+
+  TokenKind compound[][2] = {
+    {Tkn_PlusEqual, Tkn_Plus}, {Tkn_MinusEqual, Tkn_Minus}, {Tkn_AstrickEqual, Tkn_Astrick},
+    {Tkn_SlashEqual, Tkn_Slash}, {Tkn_PercentEqual, Tkn_Percent},
+    {Tkn_AstrickAstrickEqual, Tkn_AstrickAstrick}, {Tkn_LessLessEqual, Tkn_LessLess},
+    {Tkn_GreaterGreaterEqual, Tkn_GreaterGreater}, {Tkn_CarrotEqual, Tkn_Carrot},
+    {Tkn_AmpersandEqual, Tkn_Ampersand}, {Tkn_PipeEqual, Tkn_Pipe},
+  };
+  for(u32 i = 0; i < Num_Tokens; ++i)
+    compound_operators[i] = Tkn_Error;
+  for(u32 i = 0; i < sizeof(compound) / sizeof(compound[0]); ++i)
+    compound_operators[compound[i][0]] = compound[i][1];
+}
+
+#undef CLASS
+#undef ARITHMETIC_CLASSES
+#undef ALL_CLASSES
+
+void init_operator_tables() {
+  pthread_once(&operator_tables_once, build_operator_tables);
+}
+
+// the type of a binary operation, NULL when the operands are invalid.
+Type* binary_type(TokenKind op, Type* lhs, Type* rhs) {
+  switch(binary_rules[op][type_classes[lhs->kind]][type_classes[rhs->kind]]) {
+    case Rule_Unify: return lhs == rhs ? lhs : unify_types(lhs, rhs);
+    case Rule_Lhs: return lhs;
+    case Rule_Rhs: return rhs;
+    case Rule_Bool: return bool_t;
+    case Rule_BoolSame: return lhs == rhs ? bool_t : NULL;
+    default: return NULL;
+  }
+}
+
+// reports the error of a folded operation, false when it did not fold.
+bool check_fold(Expr* expr, Type* type, FoldError error) {
+  switch(error) {
+    case Fold_Ok:
+      return true;
+    case Fold_Overflow:
+      check_error(expr->loc, "overflow in constant expression of type '%s'\n", type_string(type));
+      return true;
+    case Fold_DivideByZero:
+      check_error(expr->loc, "division by zero in constant expression\n");
+      return false;
+    case Fold_ShiftRange:
+      check_error(expr->loc, "shift amount out of range for '%s'\n", type_string(type));
+      return false;
+    default:
+      return false;
+  }
+}
+
+// the value of a constant expression is kept so it is only folded once.
+Result keep_constant(Checker* checker, Result result) {
+  Value* value = (Value*) arena_alloc(&checker->arena, sizeof(Value));
+  *value = result.value;
+  map_put(&checker->constants, result.expr, value);
+  return result;
+}
+
+Type* operation_type(TokenKind op, Type* lhs, Type* rhs, Type* result) {
+  // comparisons are done in the type of their operands.
+  if(result == bool_t and op != Tkn_And and op != Tkn_Or)
+    return lhs == rhs ? lhs : unify_types(lhs, rhs);
+  return result;
+}
+
+TokenKind compound_operator(TokenKind op) {
+  return compound_operators[op];
+}
+
+Result fold_binary(Checker* checker, Token op, Result lhs, Result rhs, Result result) {
+  if(lhs.value.kind == Value_Invalid or rhs.value.kind == Value_Invalid)
+    return result;
+  Type* type = operation_type(op.kind, lhs.type, rhs.type, result.type);
+  ValueType folded = value_type(type);
+  if(folded.kind == Value_Invalid)
+    return result;
+  FoldError error;
+  Value value = value_eval_binary(op.kind, lhs.value, rhs.value, folded, &error);
+  if(!check_fold(result.expr, type, error))
+    return result;
+  result.value = value;
+  return keep_constant(checker, result);
+}
+
+Result binary_result(Checker* checker, Expr* expr, Token op, Result lhs, Result rhs) {
+  Result result = result_of(expr, NULL);
+  if(!lhs.type or !rhs.type)
+    return result;
+  result.type = binary_type(op.kind, lhs.type, rhs.type);
+  if(!result.type) {
+    check_error(token_loc(expr, op), "invalid operands to '%s': '%s' and '%s'\n",
+      get_token_string(&op), type_string(lhs.type), type_string(rhs.type));
+    return result;
+  }
+  return fold_binary(checker, op, lhs, rhs, result);
+}
+
+Result fold_unary(Checker* checker, Token op, Result operand, Result result) {
+  ValueType folded = value_type(operand.type);
+  if(operand.value.kind == Value_Invalid or folded.kind == Value_Invalid)
+    return result;
+  FoldError error;
+  Value value = value_eval_unary(op.kind, operand.value, folded, &error);
+  if(!check_fold(result.expr, operand.type, error))
+    return result;
+  result.value = value;
+  return keep_constant(checker, result);
+}
+
+Result unary_result(Checker* checker, Expr* expr, Token op, Result operand) {
+  Result result = result_of(expr, NULL);
+  Type* type = operand.type;
+  if(!type)
+    return result;
+  switch(unary_rules[op.kind][type_classes[type->kind]]) {
+    case Rule_Lhs:
+      result.type = type;
+      return fold_unary(checker, op, operand, result);
+    case Rule_Bool:
+      result.type = bool_t;
+      return fold_unary(checker, op, operand, result);
+    case Rule_Elem: result.type = type->elem; break;
+    case Rule_Address: result.type = ptr_type(checker->types, type); break;
+    default:
+      check_error(token_loc(expr, op), "invalid operand to '%s': '%s'\n", get_token_string(&op), type_string(type));
+  }
+  return result;
+}
+
+// the value of an argument, named arguments are bindings.
+Result resolve_argument(Checker* checker, Expr* arg) {
+  if(arg and arg->kind == Binding)
+    return resolve_value(checker, arg->binding.binding);
+  return resolve_value(checker, arg);
+}
+
+// checks the arguments of a call against the parameter types.
+void check_arguments(SourceLoc loc, const char* name, Type** params, u32 num_params,
+  Result* args, u32 num_args) {
+  if(num_params != num_args) {
+    check_error(loc, "'%s' takes %u arguments but %u were given\n", name, num_params, num_args);
+    return;
+  }
+  for(u32 i = 0; i < num_args; ++i) {
+    if(params[i] and args[i].type and !type_convertable(args[i].type, params[i]))
+      check_error(args[i].expr->loc, "mismatched types in argument %u: expected '%s', found '%s'\n",
+        i + 1, type_string(params[i]), type_string(args[i].type));
+  }
+}
+
+// a call of callee with the arguments, the operand of a method call is the
+// first argument.
+Result resolve_call(Checker* checker, Expr* expr, Result callee, Result* args, u32 num_args) {
+  Result result = result_of(expr, NULL);
+  const char* name = callee.expr and callee.expr->kind == Name ? callee.expr->name->value : "function";
+  if(callee.entity) {
+    Type* type = declared_type(checker, callee.entity);
+    if(callee.entity->kind == Entity_Struct and callee.entity->item->kind == ItemTupleStruct) {
+      require_complete(checker, type, expr->loc);
+      check_arguments(expr->loc, name, type->strct.members, type->strct.num_members, args, num_args);
+      result.type = type;
+    }
+    else
+      check_error(callee.expr->loc, "'%s' is a %s, not a function\n", callee.entity->name->value,
+        entity_string(callee.entity));
+    return result;
+  }
+  Type* type = callee.type;
+  if(!type)
+    return result;
+  if(type->kind != Type_Func) {
+    check_error(callee.expr->loc, "'%s' is not a function\n", type_string(type));
+    return result;
+  }
+  check_arguments(expr->loc, name, type->func.params, type->func.num_params, args, num_args);
+  result.type = type->func.ret;
+  return result;
+}
+
+// the struct type reached through pointers and references.
+Type* member_type(Checker* checker, Type* type, SourceLoc loc) {
+  while(type and is_ptr_type(type))
+    type = type->elem;
+  require_complete(checker, type, loc);
+  return type;
+}
+
+// a member of a module, an enum variant or a struct field.
+Result resolve_field_expr(Checker* checker, Expr* expr) {
+  Ident* name = expr->field.name;
+  Result operand = resolve_operand(checker, expr->field.operand);
+  Result result = result_of(expr, NULL);
+
+  if(operand.entity and operand.entity->kind == Entity_Module) {
+    Entity* entity = scope_find(operand.entity->members, name->value);
+    if(!entity or entity->scope != operand.entity->members) {
+      check_error(name->loc, "module '%s' has no declaration '%s'\n", operand.entity->name->value, name->value);
+      return result;
+    }
+    return entity_value(checker, expr, entity);
+  }
+  if(operand.entity and operand.entity->kind == Entity_Enum) {
+    Type* type = declared_type(checker, operand.entity);
+    require_complete(checker, type, expr->loc);
+    if(!enum_variant(type, name->value))
+      check_error(name->loc, "enum '%s' has no variant '%s'\n", type_string(type), name->value);
+    else
+      result.type = type;
+    return result;
+  }
+  operand = expect_value(operand);
+
+  Type* type = member_type(checker, operand.type, expr->loc);
+  if(!type)
+    return result;
+  if(type->kind == Type_Struct) {
+    i32 index = struct_member(type, name->value);
+    if(index >= 0) {
+      result.type = type->strct.members[index];
+      return result;
+    }
+  }
+  check_error(name->loc, "'%s' has no member '%s'\n", type_string(type), name->value);
+  return result;
+}
+
+Result* resolve_arguments(Checker* checker, Result* first, Expr** actuals, u32 num) {
+  Result* args = NULL;
+  if(first)
+    buf_push(args, *first);
+  for(u32 i = 0; i < num; ++i)
+    buf_push(args, resolve_argument(checker, actuals[i]));
+  return args;
+}
+
+// a call through a module, of an enum variant, or of a function with the
+// operand as its first argument.
+Result resolve_dotcall_expr(Checker* checker, Expr* expr) {
+  Result operand = resolve_operand(checker, expr->dotcall.operand);
+  Expr* name = expr->dotcall.name;
+  Result result = result_of(expr, NULL);
+  if(!name or name->kind != Name) {
+    check_error(expr->loc, "invalid method call\n");
+    return result;
+  }
+
+  if(operand.entity and operand.entity->kind == Entity_Module) {
+    Entity* entity = scope_find(operand.entity->members, name->name->value);
+    Result* args = resolve_arguments(checker, NULL, expr->dotcall.actuals, expr->dotcall.num_actuals);
+    if(!entity or entity->scope != operand.entity->members)
+      check_error(name->loc, "module '%s' has no declaration '%s'\n", operand.entity->name->value, name->name->value);
+    else
+      result = resolve_call(checker, expr, entity_value(checker, name, entity), args, buf_len(args));
+    buf_free(args);
+    return result;
+  }
+
+  if(operand.entity and operand.entity->kind == Entity_Enum) {
+    Type* type = declared_type(checker, operand.entity);
+    require_complete(checker, type, expr->loc);
+    Result* args = resolve_arguments(checker, NULL, expr->dotcall.actuals, expr->dotcall.num_actuals);
+    EnumVariant* variant = enum_variant(type, name->name->value);
+    if(!variant)
+      check_error(name->loc, "enum '%s' has no variant '%s'\n", type_string(type), name->name->value);
+    else if(!variant->payload or variant->payload->kind != Type_Tuple)
+      check_error(name->loc, "variant '%s' has no payload\n", name->name->value);
+    else {
+      check_arguments(expr->loc, name->name->value, variant->payload->tuple.elems,
+        variant->payload->tuple.num_elems, args, buf_len(args));
+      result.type = type;
+    }
+    buf_free(args);
+    return result;
+  }
+
+  operand = expect_value(operand);
+  Result* args = resolve_arguments(checker, &operand, expr->dotcall.actuals, expr->dotcall.num_actuals);
+  Result callee = resolve_operand(checker, name);
+  // the operand is passed by address to a function taking a pointer.
+  Type* type = callee.type;
+  if(type and type->kind == Type_Func and type->func.num_params and operand.type and
+     is_ptr_type(type->func.params[0]) and type->func.params[0]->elem == operand.type)
+    args[0].type = type->func.params[0];
+  result = resolve_call(checker, expr, callee, args, buf_len(args));
+  buf_free(args);
+  return result;
+}
+
+Result resolve_struct_literal(Checker* checker, Expr* expr) {
+  Result result = result_of(expr, resolve_typespec(checker, expr->struct_lit.name));
+  Type* type = result.type;
+  require_complete(checker, type, expr->loc);
+  if(type and type->kind != Type_Struct) {
+    check_error(expr->loc, "'%s' is not a struct\n", type_string(type));
+    type = NULL;
+  }
+  for(u32 i = 0; i < expr->struct_lit.num_members; ++i) {
+    Expr* member = expr->struct_lit.members[i];
+    Type* expected = NULL;
+    Result value;
+    if(member and member->kind == Binding and member->binding.name and member->binding.name->kind == Name) {
+      Ident* name = member->binding.name->name;
+      value = resolve_value(checker, member->binding.binding);
+      i32 index = type ? struct_member(type, name->value) : -1;
+      if(type and index < 0)
+        check_error(name->loc, "'%s' has no member '%s'\n", type_string(type), name->value);
+      else if(type)
+        expected = type->strct.members[index];
+    }
+    else {
+      value = resolve_value(checker, member);
+      if(type and i >= type->strct.num_members)
+        check_error(member->loc, "too many members for '%s'\n", type_string(type));
+      else if(type)
+        expected = type->strct.members[i];
+    }
+    if(expected and value.type and !type_convertable(value.type, expected))
+      check_error(value.expr->loc, "mismatched types: expected '%s', found '%s'\n",
+        type_string(expected), type_string(value.type));
+  }
+  return result;
+}
+
+// the elements of a list literal have the type of the first one.
+Result resolve_compound_literal(Checker* checker, Expr* expr) {
+  Type* elem = NULL;
+  for(u32 i = 0; i < expr->compound_lit.num_members; ++i) {
+    Result member = resolve_value(checker, expr->compound_lit.members[i]);
+    if(!elem)
+      elem = member.type;
+    else if(member.type and !type_convertable(member.type, elem))
+      check_error(member.expr->loc, "mismatched types: expected '%s', found '%s'\n",
+        type_string(elem), type_string(member.type));
+  }
+  return result_of(expr, elem ? array_type(checker->types, elem) : NULL);
+}
+
+bool is_assignable(Expr* expr, Result result) {
+  if(!expr)
+    return false;
+  switch(expr->kind) {
+    case Name:
+      return !result.entity and result.type and result.type->kind != Type_Func;
+    case Field:
+    case Index:
+    case TupleElem:
+      return true;
+    case Unary:
+      return expr->unary.op.kind == Tkn_Astrick;
+    default:
+      return false;
+  }
+}
+
+Result assignment_result(Checker* checker, Expr* expr, Result variable, Result value) {
+  if(variable.expr and !is_assignable(expr->assign.variable, variable)) {
+    check_error(variable.expr->loc, "can not assign to this expression\n");
+    return result_of(expr, unit_t);
+  }
+  Token op = expr->assign.op;
+  if(op.kind != Tkn_Equal) {
+    op.kind = compound_operators[op.kind];
+    binary_result(checker, expr, op, variable, value);
+  }
+  else if(variable.type and value.type and !type_convertable(value.type, variable.type))
+    check_error(value.expr->loc, "mismatched types: can not assign '%s' to '%s'\n",
+      type_string(value.type), type_string(variable.type));
+  return result_of(expr, unit_t);
+}
+
+// an operator whose operands are being resolved.
+typedef struct PendingOperator {
+  Expr* expr;
+  Result lhs;
+  // the left operand is resolved and the right one is being resolved.
+  bool rhs;
+} PendingOperator;
+
+bool is_operator_expr(Expr* expr) {
+  return expr and (expr->kind == Unary or expr->kind == Binary or expr->kind == Assignment);
+}
+
+Expr* first_operand(Expr* expr) {
+  switch(expr->kind) {
+    case Unary: return expr->unary.expr;
+    case Binary: return expr->binary.lhs;
+    default: return expr->assign.variable;
+  }
+}
+
+Result operator_result(Checker* checker, PendingOperator* op, Result operand) {
+  Expr* expr = op->expr;
+  switch(expr->kind) {
+    case Unary: return unary_result(checker, expr, expr->unary.op, expect_value(operand));
+    case Binary: return binary_result(checker, expr, expr->binary.op, op->lhs, expect_value(operand));
+    default: return assignment_result(checker, expr, op->lhs, expect_value(operand));
+  }
+}
+
+// unary, binary and assignment operators are resolved with a stack of the
+// ones whose operands are not resolved yet instead of recursing, long chains
+// of them are common in generated code.
+Result resolve_operator_expr(Checker* checker, Expr* expr) {
+  PendingOperator* pending = NULL;
+  Expr* operand = expr;
+  Result result;
+  for(;;) {
+    while(is_operator_expr(operand)) {
+      buf_push(pending, (PendingOperator) {operand, result_of(NULL, NULL), false});
+      operand = first_operand(operand);
+    }
+    result = resolve_expr(checker, operand);
+    // the operators whose last operand is resolved, up to one with its right
+    // operand left.
+    PendingOperator* top = NULL;
+    while(buf_len(pending)) {
+      top = pending + buf_len(pending) - 1;
+      if(top->expr->kind != Unary and !top->rhs)
+        break;
+      result = operator_result(checker, top, result);
+      if(checker->recording)
+        record_result(checker, top->expr, result);
+      buf__hdr(pending)->len--;
+      top = NULL;
+    }
+    if(!top)
+      break;
+    // the variable of an assignment is not a value.
+    top->lhs = top->expr->kind == Assignment ? result : expect_value(result);
+    top->rhs = true;
+    operand = top->expr->kind == Binary ? top->expr->binary.rhs : top->expr->assign.value;
+  }
+  buf_free(pending);
+  return result;
+}
+
+Scope* push_block(Checker* checker) {
+  checker->scope = new_checker_scope(checker, Scope_Block, checker->scope);
+  return checker->scope;
+}
+
+void pop_block(Checker* checker) {
+  checker->scope = checker->scope->parent;
+}
+
+// the type of a block is the type of its last expression statement.
+Result resolve_block(Checker* checker, Expr* expr) {
+  push_block(checker);
+  collect_block_items(checker, expr->block.stmts, expr->block.num_stmts);
+  Result result = result_of(expr, unit_t);
+  for(u32 i = 0; i < expr->block.num_stmts; ++i) {
+    Stmt* stmt = expr->block.stmts[i];
+    if(!stmt)
+      continue;
+    result = result_of(expr, unit_t);
+    switch(stmt->kind) {
+      case ExprStmt:
+        result = resolve_value(checker, stmt->expr);
+        break;
+      case SemiStmt:
+        resolve_value(checker, stmt->semi);
+        break;
+      case ItemStmt:
+        if(stmt->item and stmt->item->kind == ItemLocal)
+          resolve_local_item(checker, stmt->item, true);
+        break;
+    }
+  }
+  pop_block(checker);
+  return result;
+}
+
+// the items of a block other than its locals can be used anywhere in it,
+// they are resolved before its statements.
+void collect_block_items(Checker* checker, Stmt** stmts, u32 num) {
+  u32 first = buf_len(checker->scope->declared);
+  for(u32 i = 0; i < num; ++i) {
+    Stmt* stmt = stmts[i];
+    if(!stmt or stmt->kind != ItemStmt or !stmt->item or stmt->item->kind == ItemLocal)
+      continue;
+    if(stmt->item->kind == ItemUse) {
+      check_error(stmt->item->loc, "use items are only allowed in file scope\n");
+      continue;
+    }
+    u32 queued = buf_len(checker->queue);
+    collect_item(checker, checker->scope, stmt->item);
+    // resolved here rather than from the queue.
+    buf__hdr(checker->queue)->len = queued;
+  }
+  Scope* scope = checker->scope;
+  for(u32 i = first; i < buf_len(scope->declared); ++i)
+    resolve_entity(checker, scope->declared[i]);
+}
+
+// the type of the elements a for loop goes over.
+Type* iterated_type(Result iter) {
+  Type* type = iter.type;
+  if(!type)
+    return NULL;
+  switch(type->kind) {
+    case Type_Array:
+      return type->elem;
+    case Type_Map:
+      return type->map.key;
+    case Type_Str:
+      return char_t;
+    default:
+      if(is_integer_type(type))
+        return type;
+      check_error(iter.expr->loc, "can not iterate over '%s'\n", type_string(type));
+      return NULL;
+  }
+}
+
+Result resolve_if_expr(Checker* checker, Expr* expr) {
+  check_condition(resolve_value(checker, expr->if_expr.cond));
+  Result body = resolve_value(checker, expr->if_expr.body);
+  Result result = result_of(expr, unit_t);
+  if(expr->if_expr.else_if) {
+    Result other = resolve_value(checker, expr->if_expr.else_if);
+    if(body.type and body.type == other.type)
+      result.type = body.type;
+  }
+  return result;
+}
+
+Result resolve_match_expr(Checker* checker, Expr* expr) {
+  Result cond = resolve_value(checker, expr->matchif_expr.cond);
+  for(u32 i = 0; i < expr->matchif_expr.num_body; ++i) {
+    Clause* clause = expr->matchif_expr.body[i];
+    push_block(checker);
+    for(u32 j = 0; j < clause->num_patterns; ++j)
+      bind_pattern(checker, clause->patterns[j], cond.type, NULL, true, true);
+    resolve_value(checker, clause->body);
+    pop_block(checker);
+  }
+  return result_of(expr, unit_t);
+}
+
+Result resolve_for_expr(Checker* checker, Expr* expr) {
+  Result iter = resolve_value(checker, expr->for_expr.cond);
+  Type* elem = iterated_type(iter);
+  push_block(checker);
+  bind_pattern(checker, expr->for_expr.pat, elem, NULL, true, true);
+  checker->loops++;
+  resolve_value(checker, expr->for_expr.body);
+  checker->loops--;
+  pop_block(checker);
+  return result_of(expr, unit_t);
+}
+
+Result resolve_return_expr(Checker* checker, Expr* expr) {
+  Type** types = NULL;
+  for(u32 i = 0; i < expr->return_expr.num_exprs; ++i)
+    buf_push(types, resolve_value(checker, expr->return_expr.exprs[i]).type);
+  bool valid = true;
+  for(u32 i = 0; i < buf_len(types); ++i)
+    valid = valid and types[i];
+  Type* type = NULL;
+  if(valid)
+    type = buf_len(types) == 1 ? types[0] : tuple_type(checker->types, types, buf_len(types));
+  buf_free(types);
+
+  Entity* function = checker->function;
+  if(!function)
+    check_error(expr->loc, "return outside of a function\n");
+  else if(function->type and type) {
+    Type* ret = function->type->func.ret;
+    if(ret != unit_t and type == unit_t)
+      check_error(expr->loc, "missing return value of type '%s'\n", type_string(ret));
+    else if(!type_convertable(type, ret))
+      check_error(expr->loc, "mismatched types: expected '%s', found '%s'\n", type_string(ret), type_string(type));
+  }
+  return result_of(expr, unit_t);
+}
+
+Result resolve_index_expr(Checker* checker, Expr* expr) {
+  Result operand = resolve_value(checker, expr->index.operand);
+  Result index = resolve_value(checker, expr->index.index);
+  Result result = result_of(expr, NULL);
+  Type* type = operand.type;
+  if(!type)
+    return result;
+  switch(type->kind) {
+    case Type_Array:
+    case Type_Ptr:
+      check_integer(index, "the index");
+      result.type = type->elem;
+      break;
+    case Type_Str:
+      check_integer(index, "the index");
+      result.type = char_t;
+      break;
+    case Type_Map:
+      if(index.type and !type_convertable(index.type, type->map.key))
+        check_error(index.expr->loc, "mismatched types: expected '%s', found '%s'\n",
+          type_string(type->map.key), type_string(index.type));
+      result.type = type->map.value;
+      break;
+    default:
+      check_error(operand.expr->loc, "can not index '%s'\n", type_string(type));
+  }
+  return result;
+}
+
+Result resolve_tuple_elem_expr(Checker* checker, Expr* expr) {
+  Result operand = resolve_value(checker, expr->tupleelem.operand);
+  Result result = result_of(expr, NULL);
+  Type* type = member_type(checker, operand.type, expr->loc);
+  if(!type)
+    return result;
+  i64 index = expr->tupleelem.elem.literal.value_i64;
+  if(type->kind == Type_Tuple and index >= 0 and index < type->tuple.num_elems)
+    result.type = type->tuple.elems[index];
+  else if(type->kind == Type_Struct and index >= 0 and index < type->strct.num_members)
+    result.type = type->strct.members[index];
+  else
+    check_error(expr->loc, "'%s' has no element %lld\n", type_string(type), (long long) index);
+  return result;
+}
+
+Result resolve_range_expr(Checker* checker, Expr* expr) {
+  Type* type = NULL;
+  Expr* bounds[] = {expr->range.start, expr->range.end, expr->range.step};
+  for(u32 i = 0; i < 3; ++i) {
+    if(!bounds[i])
+      continue;
+    Result bound = resolve_value(checker, bounds[i]);
+    check_integer(bound, "a range bound");
+    if(is_integer_type(bound.type))
+      type = type ? unify_types(type, bound.type) : bound.type;
+  }
+  return result_of(expr, type ? array_type(checker->types, type) : NULL);
+}
+
+Result resolve_slice_expr(Checker* checker, Expr* expr) {
+  Result operand = resolve_value(checker, expr->slice.operand);
+  if(expr->slice.start)
+    check_integer(resolve_value(checker, expr->slice.start), "a slice bound");
+  if(expr->slice.end)
+    check_integer(resolve_value(checker, expr->slice.end), "a slice bound");
+  Type* type = operand.type;
+  if(type and type->kind != Type_Array and type->kind != Type_Str) {
+    check_error(operand.expr->loc, "can not slice '%s'\n", type_string(type));
+    type = NULL;
+  }
+  return result_of(expr, type);
+}
+
+Result resolve_cast_expr(Checker* checker, Expr* expr) {
+  Result value = resolve_value(checker, expr->cast.expr);
+  Type* type = resolve_typespec(checker, expr->cast.spec);
+  if(value.type and type and !type_castable(value.type, type))
+    check_error(expr->loc, "can not cast '%s' to '%s'\n", type_string(value.type), type_string(type));
+  return result_of(expr, type);
+}
+
+// only the branch selected by the condition is checked, the others can
+// use what does not exist in this build.
+Result resolve_when_expr(Checker* checker, Expr* expr) {
+  u32 errors = thread_error_count();
+  checker->recording++;
+  Result cond = resolve_value(checker, expr->if_expr.cond);
+  checker->recording--;
+  check_condition(cond);
+  if(thread_error_count() != errors)
+    return result_of(expr, NULL);
+
+  Value value = cond.value;
+  EvalStatus status = Eval_Ok;
+  if(value.kind == Value_Invalid)
+    status = evaluate(checker, cond.expr, cond.type, "the condition of 'when'", &value);
+  bool truth = false;
+  if(status == Eval_Failed)
+    return result_of(expr, NULL);
+  if(!value_truth(value, &truth)) {
+    check_error(cond.expr->loc, "the condition of 'when' is not known at compile time\n");
+    return result_of(expr, NULL);
+  }
+  // the evaluator compiles the selected branch from the value.
+  cond.value = value;
+  keep_constant(checker, cond);
+
+  Expr* taken = truth ? expr->if_expr.body : expr->if_expr.else_if;
+  if(!taken)
+    return result_of(expr, unit_t);
+  Result result = resolve_value(checker, taken);
+  result.expr = expr;
+  return result;
+}
+
+Result resolve_expr_kind(Checker* checker, Expr* expr) {
+  switch(expr->kind) {
+    case Name:
+      return resolve_operand(checker, expr);
+    case Literal:
+      return resolve_literal(expr);
+    case CompoundLiteral:
+      return resolve_compound_literal(checker, expr);
+    case StructLiteral:
+      return resolve_struct_literal(checker, expr);
+    case Unary:
+    case Binary:
+    case Assignment:
+      return resolve_operator_expr(checker, expr);
+    case FnCall: {
+      Result callee = resolve_operand(checker, expr->fncall.name);
+      Result* args = resolve_arguments(checker, NULL, expr->fncall.actuals, expr->fncall.num_actuals);
+      Result result = resolve_call(checker, expr, callee, args, buf_len(args));
+      buf_free(args);
+      return result;
+    }
+    case Field:
+      return resolve_field_expr(checker, expr);
+    case DotFnCall:
+      return resolve_dotcall_expr(checker, expr);
+    case If:
+      return resolve_if_expr(checker, expr);
+    case MatchIf:
+      return resolve_match_expr(checker, expr);
+    case While: {
+      check_condition(resolve_value(checker, expr->while_expr.cond));
+      checker->loops++;
+      resolve_value(checker, expr->while_expr.body);
+      checker->loops--;
+      return result_of(expr, unit_t);
+    }
+    case For:
+      return resolve_for_expr(checker, expr);
+    case Return:
+      return resolve_return_expr(checker, expr);
+    case Break:
+    case Continue:
+      if(checker->loops == 0)
+        check_error(expr->loc, "'%s' outside of a loop\n", expr->kind == Break ? "break" : "continue");
+      return result_of(expr, unit_t);
+    case Block:
+      return resolve_block(checker, expr);
+    case Binding:
+      return resolve_value(checker, expr->binding.binding);
+    case In: {
+      resolve_value(checker, expr->in.in);
+      resolve_value(checker, expr->in.expr);
+      return result_of(expr, bool_t);
+    }
+    case Tuple: {
+      Type** elems = NULL;
+      bool valid = true;
+      for(u32 i = 0; i < expr->tuple.num_elems; ++i) {
+        Type* elem = resolve_value(checker, expr->tuple.elems[i]).type;
+        valid = valid and elem;
+        buf_push(elems, elem);
+      }
+      Result result = result_of(expr, valid ? tuple_type(checker->types, elems, buf_len(elems)) : NULL);
+      buf_free(elems);
+      return result;
+    }
+    case PatternExpr:
+      return result_of(expr, NULL);
+    case Index:
+      return resolve_index_expr(checker, expr);
+    case TupleElem:
+      return resolve_tuple_elem_expr(checker, expr);
+    case Range:
+      return resolve_range_expr(checker, expr);
+    case Cast:
+      return resolve_cast_expr(checker, expr);
+    case Slice:
+      return resolve_slice_expr(checker, expr);
+    case When:
+      return resolve_when_expr(checker, expr);
+  }
+  return result_of(expr, NULL);
+}
+
+Result resolve_expr(Checker* checker, Expr* expr) {
+  if(!expr)
+    return result_of(NULL, NULL);
+  Result result = resolve_expr_kind(checker, expr);
+  if(checker->recording)
+    record_result(checker, expr, result);
+  return result;
+}
+
+Value* constant_value(Checker* checker, Expr* expr) {
+  return (Value*) map_get(&checker->constants, expr);
+}
+
+// the parameters are locals of the function scope, the value of the body
+// is its result.
+void check_body(Checker* checker, Entity* entity) {
+  Item* item = entity->item;
+  Type* type = entity->type;
+  Scope* scope = new_checker_scope(checker, Scope_Function, entity->scope);
+  CheckContext saved = enter_context(checker, scope, entity);
+  reset_scope_cache(&checker->cache, scope);
+  Entity* dependent = checker->dependent;
+  checker->dependent = entity;
+  u32 errors = thread_error_count();
+
+  for(u32 i = 0; i < item->function.num_args; ++i) {
+    Item* param = item->function.arguments[i];
+    Entity* local = new_checker_entity(checker, Entity_Local, param->field.name, param,
+      type ? type->func.params[i] : NULL);
+    local->state = Entity_Resolved;
+    local->immutable = true;
+    declare(scope, local);
+    if(checker->recording)
+      map_put(&checker->recorded_entities, param, local);
+  }
+
+  Result body = resolve_value(checker, item->function.body);
+  Type* ret = type ? type->func.ret : NULL;
+  if(ret and ret != unit_t and body.type and body.type != unit_t and !type_convertable(body.type, ret))
+    check_error(body.expr->loc, "mismatched types: expected '%s', found '%s'\n", type_string(ret), type_string(body.type));
+
+  checker->dependent = dependent;
+  leave_context(checker, saved);
+  checker->num_bodies += !checker->replaying;
+  if(checker->body_cache and !checker->replaying)
+    map_put(&checker->body_errors, entity, (void*) (uintptr_t) (thread_error_count() - errors + 1));
+}
+
+// bodies are parsed on demand by whichever thread needs them first.
+pthread_mutex_t body_parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the body of the function item, parsed first if the parser skipped it. A
+// body with syntax errors is reported and left skipped, it is never checked
+// and is reported again by the next compile that needs it.
+Expr* function_body(Checker* checker, Item* item) {
+  pthread_mutex_lock(&body_parse_lock);
+  AstFile* ast = is_body_deferred(item) ? map_get(&checker->trees, item->loc.file) : NULL;
+  if(ast) {
+    u32 begin = item->function.body_begin;
+    u32 end = item->function.body_end;
+    u32 errors = thread_error_count();
+    parse_function_body(ast, item);
+    if(thread_error_count() != errors) {
+      item->function.body = NULL;
+      item->function.body_begin = begin;
+      item->function.body_end = end;
+    }
+  }
+  Expr* body = item->function.body;
+  pthread_mutex_unlock(&body_parse_lock);
+  return body;
+}
+
+// the body is checked again with the diagnostics dropped, it was or will be
+// checked once for them. A body the parser skipped is only parsed here.
+bool record_body(Checker* checker, Entity* entity) {
+  if(!entity->item or entity->item->kind != ItemFunction or !entity->type or !function_body(checker, entity->item))
+    return false;
+  ReportBuffer buffer = {NULL};
+  ReportBuffer* old = set_report_buffer(&buffer);
+  Scope* cached = checker->cache.scope;
+  checker->recording++;
+  checker->replaying++;
+  check_body(checker, entity);
+  checker->replaying--;
+  checker->recording--;
+  reset_scope_cache(&checker->cache, cached);
+  set_report_buffer(old);
+  u32 errors = report_error_count(&buffer);
+  clear_report_buffer(&buffer);
+  return errors == 0;
+}
+
+// Checking bodies in parallel
+
+// bodies a worker takes at a time.
+#define BODIES_PER_TAKE 16
+
+typedef struct BodyWorker {
+  Checker checker;
+  Checker* parent;
+  ReportBuffer report;
+  // the next body of the parent to take, shared by the workers.
+  atomic_uint* next;
+} BodyWorker;
+
+// a copy of the parent that shares its declarations and types.
+void fork_checker(Checker* checker, Checker* parent) {
+  memset(checker, 0, sizeof(Checker));
+  checker->table = parent->table;
+  checker->types = parent->types;
+  checker->global_scope = parent->global_scope;
+  checker->scope = parent->global_scope;
+  checker->body_cache = parent->body_cache;
+  init_evaluator(&checker->eval);
+}
+
+// moves what the copy made into the parent and frees the rest.
+void join_checker(Checker* parent, Checker* checker) {
+  for(u32 i = 0; i < buf_len(checker->arena.blocks); ++i)
+    buf_push(parent->arena.blocks, checker->arena.blocks[i]);
+  buf_free(checker->arena.blocks);
+  for(u32 i = 0; i < buf_len(checker->scopes); ++i)
+    buf_push(parent->scopes, checker->scopes[i]);
+  buf_free(checker->scopes);
+  for(u32 i = 0; i < checker->constants.cap; ++i) {
+    if(checker->constants.keys[i])
+      map_put(&parent->constants, checker->constants.keys[i], checker->constants.vals[i]);
+  }
+  for(u32 i = 0; i < checker->body_errors.cap; ++i) {
+    if(checker->body_errors.keys[i])
+      map_put(&parent->body_errors, checker->body_errors.keys[i], checker->body_errors.vals[i]);
+  }
+
+  parent->num_entities += checker->num_entities;
+  parent->num_bodies += checker->num_bodies;
+  parent->cache.hits += checker->cache.hits;
+  parent->cache.misses += checker->cache.misses;
+  parent->eval.evaluations += checker->eval.evaluations;
+  parent->eval.total_steps += checker->eval.total_steps;
+  parent->eval.memo_hits += checker->eval.memo_hits;
+
+  buf_free(checker->queue);
+  buf_free(checker->bodies);
+  buf_free(checker->resolving);
+  free((void*) checker->constants.keys);
+  free(checker->constants.vals);
+  free((void*) checker->recorded_types.keys);
+  free(checker->recorded_types.vals);
+  free((void*) checker->recorded_entities.keys);
+  free(checker->recorded_entities.vals);
+  free((void*) checker->body_errors.keys);
+  free(checker->body_errors.vals);
+  destroy_evaluator(&checker->eval);
+}
+
+void check_bodies_task(void* data) {
+  BodyWorker* worker = (BodyWorker*) data;
+  Checker* checker = &worker->checker;
+  Entity** bodies = worker->parent->bodies;
+  u32 num = buf_len(bodies);
+  ReportBuffer* old = set_report_buffer(&worker->report);
+  for(;;) {
+    u32 start = atomic_fetch_add(worker->next, BODIES_PER_TAKE);
+    if(start >= num)
+      break;
+    u32 end = start + BODIES_PER_TAKE < num ? start + BODIES_PER_TAKE : num;
+    for(u32 i = start; i < end; ++i)
+      check_body(checker, bodies[i]);
+  }
+  // the functions declared in the bodies it checked.
+  for(u32 i = 0; i < buf_len(checker->bodies); ++i)
+    check_body(checker, checker->bodies[i]);
+  set_report_buffer(old);
+}
+
+// checks the bodies of the checker on the workers of its pool, the calling
+// thread takes part. The list of bodies is emptied.
+void check_bodies(Checker* checker) {
+  Pool* pool = checker->pool;
+  u32 num = pool_num_threads(pool) + 1;
+  BodyWorker* workers = (BodyWorker*) calloc(num, sizeof(BodyWorker));
+  atomic_uint next = 0;
+  TaskGroup group = {0};
+  for(u32 i = 0; i < num; ++i) {
+    fork_checker(&workers[i].checker, checker);
+    workers[i].parent = checker;
+    workers[i].next = &next;
+    pool_submit_group(pool, &group, check_bodies_task, &workers[i]);
+  }
+  pool_wait_group(pool, &group);
+
+  for(u32 i = 0; i < num; ++i) {
+    join_checker(checker, &workers[i].checker);
+    append_report_buffer(&workers[i].report);
+  }
+  free(workers);
+  buf_clear(checker->bodies);
+}
+
+// Reusing bodies
+
+void free_map(Map* map) {
+  free((void*) map->keys);
+  free(map->vals);
+  memset(map, 0, sizeof(Map));
+}
+
+void destroy_body_cache(BodyCache* cache) {
+  for(u32 i = 0; i < cache->modules.cap; ++i) {
+    ModuleRecord* module = (ModuleRecord*) cache->modules.vals[i];
+    if(!cache->modules.keys[i])
+      continue;
+    for(u32 j = 0; j < module->functions.cap; ++j) {
+      BodyRecord* record = (BodyRecord*) module->functions.vals[j];
+      if(!module->functions.keys[j])
+        continue;
+      buf_free(record->uses);
+      free(record);
+    }
+    free_map(&module->functions);
+    free_map(&module->signatures);
+    free(module);
+  }
+  free_map(&cache->modules);
+}
+
+// the record of the function of the module, made when add is set.
+BodyRecord* find_record(ModuleRecord* module, const char* name, bool add) {
+  BodyRecord* record = (BodyRecord*) map_get(&module->functions, name);
+  if(!record and add) {
+    record = (BodyRecord*) calloc(1, sizeof(BodyRecord));
+    map_put(&module->functions, name, record);
+  }
+  return record;
+}
+
+// a value by its elements, the arrays are interned again by every check.
+u64 value_fingerprint(Value value) {
+  if(value.kind != Value_Array)
+    return hash_value(value);
+  u64 hash = value.kind;
+  for(u32 i = 0; i < buf_len(value.array_value); ++i)
+    hash = hash_mix(hash, value_fingerprint(value.array_value[i]));
+  return hash;
+}
+
+// what the users of a file item see, a declaration with errors differs
+// from the same one without them.
+u64 signature_of(BodyCache* cache, Entity* entity) {
+  ModuleRecord* module = (ModuleRecord*) map_get(&cache->files, entity->scope);
+  u64 hash = (u64) (uintptr_t) map_get(&module->signatures, entity->item);
+  if(!hash) {
+    // odd, so it is never the missing value.
+    hash = signature_fingerprint(entity->item) | 1;
+    map_put(&module->signatures, entity->item, (void*) (uintptr_t) hash);
+  }
+  hash = hash_mix(hash, entity->type != NULL);
+  if(entity->kind == Entity_Local or entity->kind == Entity_Const)
+    hash = hash_mix(hash, value_fingerprint(entity->value));
+  return hash;
+}
+
+// the names of a file scope and the modules of what they name, in any
+// order.
+u64 names_fingerprint(BodyCache* cache, Scope* scope) {
+  u64 hash = 0;
+  for(u32 i = 0; i < scope->entities.cap; ++i) {
+    SymbolSlot* slot = scope->entities.slots + i;
+    if(!slot->name)
+      continue;
+    Entity* entity = slot->entity;
+    ModuleRecord* home = (ModuleRecord*) map_get(&cache->files,
+      entity->kind == Entity_Module ? entity->members : entity->scope);
+    hash += hash_mix(hash_ptr(slot->name), hash_mix(entity->kind, hash_ptr(home)));
+  }
+  return hash;
+}
+
+bool same_uses(BodyCache* cache, BodyRecord* record) {
+  for(u32 i = 0; i < buf_len(record->uses); ++i) {
+    BodyUse* use = record->uses + i;
+    ModuleRecord* module = (ModuleRecord*) map_get(&cache->modules, use->path);
+    Scope* scope = module ? module->scope : NULL;
+    Entity* entity = scope ? symbol_get(&scope->entities, use->name) : NULL;
+    if(!entity or entity->scope != scope or signature_of(cache, entity) != use->signature)
+      return false;
+  }
+  return true;
+}
+
+// the function, the file items it uses and the types and constants these
+// need, what a called function uses is not seen by its callers. false when
+// it uses an item that is neither in a file nor in its body.
+bool collect_uses(BodyCache* cache, Entity* function, BodyUse** uses) {
+  Map seen = {0};
+  Entity** stack = NULL;
+  ModuleRecord* home = (ModuleRecord*) map_get(&cache->files, function->scope);
+  buf_push(*uses, (BodyUse) {home->path, function->name->value, signature_of(cache, function)});
+  map_put(&seen, function, function);
+  buf_push(stack, function);
+  bool found = true;
+  while(found and buf_len(stack)) {
+    Entity* entity = stack[--buf__hdr(stack)->len];
+    for(u32 i = 0; i < buf_len(entity->deps); ++i) {
+      Entity* dep = entity->deps[i];
+      if(map_get(&seen, dep))
+        continue;
+      map_put(&seen, dep, dep);
+      ModuleRecord* module = (ModuleRecord*) map_get(&cache->files, dep->scope);
+      if(module) {
+        buf_push(*uses, (BodyUse) {module->path, dep->name->value, signature_of(cache, dep)});
+        if(dep->kind != Entity_Funct)
+          buf_push(stack, dep);
+      }
+      else if(dep->scope->kind == Scope_Function or dep->scope->kind == Scope_Block)
+        buf_push(stack, dep);
+      else
+        found = false;
+    }
+  }
+  buf_free(stack);
+  free_map(&seen);
+  return found;
+}
+
+// takes the bodies whose records are still valid out of the list, the
+// others get new records once they are checked.
+void reuse_bodies(Checker* checker, Module** modules, u32 num) {
+  BodyCache* cache = checker->body_cache;
+  for(u32 i = 0; i < num; ++i) {
+    AstFile* ast = modules[i]->ast;
+    if(!ast)
+      continue;
+    ModuleRecord* module = (ModuleRecord*) map_get(&cache->modules, modules[i]->path);
+    if(!module) {
+      module = (ModuleRecord*) calloc(1, sizeof(ModuleRecord));
+      module->path = modules[i]->path;
+      module->ast = ast->uid;
+      map_put(&cache->modules, module->path, module);
+    }
+    // the items of another tree can be at the same addresses.
+    if(module->ast != ast->uid) {
+      free_map(&module->signatures);
+      module->ast = ast->uid;
+    }
+    module->scope = ast->scope;
+    map_put(&cache->files, ast->scope, module);
+    buf_push(cache->checking, module);
+  }
+  for(u32 i = 0; i < buf_len(cache->checking); ++i)
+    cache->checking[i]->names = names_fingerprint(cache, cache->checking[i]->scope);
+
+  u32 kept = 0;
+  for(u32 i = 0; i < buf_len(checker->bodies); ++i) {
+    Entity* entity = checker->bodies[i];
+    ModuleRecord* module = (ModuleRecord*) map_get(&cache->files, entity->scope);
+    if(!module) {
+      checker->bodies[kept++] = entity;
+      continue;
+    }
+    BodyRecord* record = find_record(module, entity->name->value, false);
+    BodyRecord fresh = {0, module->ast, module->names, NULL, false, false};
+    if(record and record->ast == module->ast) {
+      fresh.body = record->body;
+      fresh.stable = record->stable;
+    }
+    else {
+      bool unstable = false;
+      fresh.body = body_fingerprint(entity->item, &unstable);
+      fresh.stable = !unstable;
+    }
+    if(record and record->reusable and record->body == fresh.body and record->names == fresh.names
+      and same_uses(cache, record)) {
+      record->ast = module->ast;
+      checker->num_reused++;
+      continue;
+    }
+    checker->bodies[kept++] = entity;
+    buf_push(cache->checked, entity);
+    buf_push(cache->fresh, fresh);
+  }
+  if(checker->bodies)
+    buf__hdr(checker->bodies)->len = kept;
+}
+
+// replaces the records of the checked bodies, a body with errors is
+// checked again next time.
+void record_bodies(Checker* checker) {
+  BodyCache* cache = checker->body_cache;
+  for(u32 i = 0; i < buf_len(cache->checked); ++i) {
+    Entity* entity = cache->checked[i];
+    BodyRecord* fresh = cache->fresh + i;
+    uintptr_t errors = (uintptr_t) map_get(&checker->body_errors, entity);
+    fresh->reusable = fresh->stable and errors == 1 and collect_uses(cache, entity, &fresh->uses);
+    if(!fresh->reusable)
+      buf_free(fresh->uses);
+    ModuleRecord* module = (ModuleRecord*) map_get(&cache->files, entity->scope);
+    BodyRecord* record = find_record(module, entity->name->value, true);
+    buf_free(record->uses);
+    *record = *fresh;
+  }
+  for(u32 i = 0; i < buf_len(cache->checking); ++i)
+    cache->checking[i]->scope = NULL;
+  buf_free(cache->checking);
+  buf_free(cache->checked);
+  buf_free(cache->fresh);
+  free_map(&cache->files);
+}
+
+void collect_modules(Checker* checker, Module** modules, u32 num) {
+  for(u32 i = 0; i < num; ++i) {
+    AstFile* ast = modules[i]->ast;
+    if(!ast)
+      continue;
+    ast->scope = new_checker_scope(checker, Scope_File, checker->global_scope);
+    buf_push(checker->files, ast);
+    map_put(&checker->trees, ast->file, ast);
+    for(u32 j = 0; j < ast_num_items(ast); ++j)
+      collect_item(checker, ast->scope, ast->items[j]);
+  }
+  for(u32 i = 0; i < num; ++i) {
+    if(modules[i]->ast)
+      bind_imports(checker, modules[i]);
+  }
+}
+
+void check_modules(Checker* checker, Module** modules, u32 num) {
+  // phase one, every declaration of every module.
+  collect_modules(checker, modules, num);
+
+  // phase two, the declarations in the order they were collected, and the
+  // ones they need first.
+  while(checker->queue_head < buf_len(checker->queue))
+    resolve_entity(checker, checker->queue[checker->queue_head++]);
+  if(checker->body_cache)
+    reuse_bodies(checker, modules, num);
+  // bodies can declare functions, which are added to the list.
+  if(checker->pool and buf_len(checker->bodies) > 1)
+    check_bodies(checker);
+  for(u32 i = 0; i < buf_len(checker->bodies); ++i)
+    check_body(checker, checker->bodies[i]);
+  if(checker->body_cache)
+    record_bodies(checker);
+}
+
+// Queries
+
+Type* type_of(Checker* checker, Entity* entity) {
+  Type* type = resolve_entity(checker, entity);
+  // the members of a struct or enum are resolved with it.
+  if(entity->kind == Entity_Struct or entity->kind == Entity_Enum)
+    return declared_type(checker, entity);
+  return type;
+}
+
+// the parents of a file scope are complete once the modules are collected,
+// so what a name resolves to from it does not change.
+Entity* resolve_name(Scope* scope, const char* name) {
+  Entity* entity = symbol_get(&scope->entities, name);
+  if(entity or !scope->parent)
+    return entity;
+  bool keep = scope->kind == Scope_File;
+  if(keep and (entity = symbol_get(&scope->resolved, name)))
+    return entity;
+  entity = scope_lookup(scope->parent, name);
+  if(keep and entity)
+    symbol_put(&scope->resolved, scope->arena, name, entity);
+  return entity;
+}
+
+Type* layout_of(Checker* checker, Type* type) {
+  SourceLoc loc = {NULL};
+  if(type and (type->kind == Type_Struct or type->kind == Type_Enum)) {
+    Entity* entity = type->kind == Type_Struct ? type->strct.entity : type->enm.entity;
+    loc = entity->name->loc;
+  }
+  return require_complete(checker, type, loc) ? type : NULL;
+}
+
+Type* expr_type(Checker* checker, Entity* function, Expr* expr) {
+  Type* type = recorded_type(checker, expr);
+  if(type or !type_of(checker, function))
+    return type;
+  record_body(checker, function);
+  return recorded_type(checker, expr);
+}
+
+// checks the source parsed with the flags as a module, the bodies on the
+// pool when it is not NULL. The diagnostics are printed when there is not the expected number
+// of errors.
+bool check_source(StringTable* table, Pool* pool, const char* source, u32 flags, u32 expected) {
+  File file = {"<checker_test>", (char*) source, strlen(source), NULL};
+  ReportBuffer buffer = {NULL};
+  ReportBuffer* old = set_report_buffer(&buffer);
+  AstFile* ast = parse_file_with_flags(&file, table, flags);
+  Module module;
+  memset(&module, 0, sizeof(Module));
+  module.file = &file;
+  module.ast = ast;
+  Module* modules[] = {&module};
+
+  Checker checker;
+  init_checker(&checker, table);
+  checker.pool = pool;
+  check_modules(&checker, modules, 1);
+  destroy_checker(&checker);
+  destroy_ast_file(ast);
+
+  set_report_buffer(old);
+  u32 errors = report_error_count(&buffer);
+  if(errors != expected) {
+    printf("checker_test: %u errors, expected %u, in:\n%s", errors, expected, source);
+    print_report_buffer(&buffer);
+  }
+  clear_report_buffer(&buffer);
+  return errors == expected;
+}
+
+Entity* query_name(Checker* checker, Scope* scope, const char* name) {
+  return resolve_name(scope, table_insert_string(checker->table, name));
+}
+
+bool has_dependency(Entity* entity, const char* name) {
+  for(u32 i = 0; i < buf_len(entity->deps); ++i) {
+    if(strcmp(entity->deps[i]->name->value, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+// the queries resolve only what they need, the dependencies are recorded by
+// a full check.
+void query_test(StringTable* table) {
+  const char* source =
+    "struct P { x: i64, y: u8 }\nstruct Q { p: P, n: i32 }\ntype R = Q;\n"
+    "fn f(q: R) i64 { g(q.p) }\nfn g(p: P) i64 { p.x }\nfn unused() i32 { 0 }\n"
+    "let a = b;\nlet b = a;\n";
+  File file = {"<query_test>", (char*) source, strlen(source), NULL};
+  ReportBuffer buffer = {NULL};
+  ReportBuffer* old = set_report_buffer(&buffer);
+  AstFile* ast = parse_file(&file, table);
+  Module module;
+  memset(&module, 0, sizeof(Module));
+  module.file = &file;
+  module.ast = ast;
+  Module* modules[] = {&module};
+
+  Checker checker;
+  init_checker(&checker, table);
+  collect_modules(&checker, modules, 1);
+  Scope* scope = ast->scope;
+  Entity* f = query_name(&checker, scope, "f");
+  Entity* g = query_name(&checker, scope, "g");
+  // a builtin is looked up in the global scope once.
+  assert(f and g and query_name(&checker, scope, "i64") == query_name(&checker, scope, "i64"));
+  assert(scope->resolved.num == 1);
+
+  Type* type = type_of(&checker, f);
+  assert(type and type->func.ret == i64_t);
+  assert(g->state == Entity_Unresolved and query_name(&checker, scope, "unused")->state == Entity_Unresolved);
+  Type* q = type->func.params[0];
+  assert(q->kind == Type_Struct and !q->strct.complete);
+  assert(layout_of(&checker, q) == q and q->size == 24 and q->align == 8);
+
+  Expr* call = f->item->function.body->block.stmts[0]->expr;
+  assert(expr_type(&checker, f, call) == i64_t and g->state == Entity_Resolved);
+  assert(query_name(&checker, scope, "unused")->state == Entity_Unresolved);
+
+  type_of(&checker, query_name(&checker, scope, "a"));
+  assert(report_error_count(&buffer) == 1);
+  destroy_checker(&checker);
+
+  init_checker(&checker, table);
+  check_modules(&checker, modules, 1);
+  f = scope_find(ast->scope, table_insert_string(table, "f"));
+  assert(has_dependency(f, "R") and has_dependency(f, "g") and !has_dependency(f, "P"));
+  g = scope_find(ast->scope, table_insert_string(table, "g"));
+  assert(has_dependency(g, "P") and buf_len(g->deps) == 1);
+  destroy_checker(&checker);
+  destroy_ast_file(ast);
+
+  set_report_buffer(old);
+  clear_report_buffer(&buffer);
+}
+
+// checks the tree as the same module every time, returns the number of
+// bodies checked.
+u32 check_cached(StringTable* table, Pool* pool, BodyCache* cache, AstFile* ast, u32 errors) {
+  ReportBuffer buffer = {NULL};
+  ReportBuffer* old = set_report_buffer(&buffer);
+  Module module;
+  memset(&module, 0, sizeof(Module));
+  module.path = table_insert_string(table, "<reuse_test>");
+  module.file = ast->file;
+  module.ast = ast;
+  Module* modules[] = {&module};
+
+  Checker checker;
+  init_checker(&checker, table);
+  checker.pool = pool;
+  checker.body_cache = cache;
+  check_modules(&checker, modules, 1);
+  u32 checked = checker.num_bodies;
+  destroy_checker(&checker);
+
+  set_report_buffer(old);
+  assert(report_error_count(&buffer) == errors);
+  clear_report_buffer(&buffer);
+  return checked;
+}
+
+// a body is checked again when it changed, when an item it uses changed
+// its signature or value, when it had errors or when its file declares
+// other names.
+void reuse_test(StringTable* table, Pool* pool) {
+  static const struct {
+    const char* source;
+    u32 errors;
+    u32 checked;
+  } steps[] = {
+    {"struct P { x: i64 }\nfn g(p: P) i64 { p.x }\nfn f(p: P) i64 { g(p) }\n"
+      "fn c() i64 { 1 }\nfn h() i64 { 2 }\nlet N = c();\nfn u() i64 { N }\n", 0, 5},
+    {"struct P { x: i64 }\n\nfn g(p: P) i64 { p.x + 1 }\nfn f(p: P) i64 { g(p) }\n"
+      "fn c() i64 { 1 }\nfn h() i64 { 2 }\nlet N = c();\nfn u() i64 { N }\n", 0, 1},
+    {"struct P { x: i64 }\nfn g(p: P) i64 { p.x + 1 }\nfn f(p: P) i64 { g(p) }\n"
+      "fn c() i64 { 2 }\nfn h() i64 { 2 }\nlet N = c();\nfn u() i64 { N }\n", 0, 2},
+    {"struct P { x: i64, y: i64 }\nfn g(p: P) i64 { p.x + 1 }\nfn f(p: P) i64 { g(p) }\n"
+      "fn c() i64 { 2 }\nfn h() i64 { 2 }\nlet N = c();\nfn u() i64 { N }\n", 0, 2},
+    {"struct P { x: i64, y: i64 }\nfn g(p: P) i64 { p.x + 1 }\nfn f(p: P) i64 { g(p) }\n"
+      "fn c() i64 { 2 }\nfn h() u8 { 2 }\nlet N = c();\nfn u() i64 { N }\n", 0, 1},
+    {"struct P { x: i64, y: i64 }\nfn g(p: i64) i64 { p }\nfn f(p: P) i64 { g(p) }\n"
+      "fn c() i64 { 2 }\nfn h() u8 { 2 }\nlet N = c();\nfn u() i64 { N }\n", 1, 2},
+    {"struct P { x: i64, y: i64 }\nfn g(p: i64) i64 { p }\nfn f(p: P) i64 { g(p.x) }\n"
+      "fn c() i64 { 2 }\nfn h() u8 { 2 }\nlet N = c();\nfn u() i64 { N }\n", 0, 1},
+    {"struct P { x: i64, y: i64 }\nfn g(p: i64) i64 { p }\nfn f(p: P) i64 { g(p.x) }\n"
+      "let h = 1;\nlet N = h;\nfn u() i64 { N }\n", 0, 3},
+  };
+  BodyCache cache;
+  memset(&cache, 0, sizeof(BodyCache));
+  for(u32 i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+    File file = {"<reuse_test>", (char*) steps[i].source, strlen(steps[i].source), NULL};
+    AstFile* ast = parse_file(&file, table);
+    assert(check_cached(table, pool, &cache, ast, steps[i].errors) == steps[i].checked);
+    // the same tree again, only a body with errors is checked.
+    assert(check_cached(table, pool, &cache, ast, steps[i].errors) == (steps[i].errors != 0));
+    destroy_ast_file(ast);
+  }
+  destroy_body_cache(&cache);
+}
+
+typedef struct DepthTest {
+  StringTable* table;
+  bool passed;
+} DepthTest;
+
+void* checker_depth_test_thread(void* data) {
+  DepthTest* test = (DepthTest*) data;
+  const u32 count = 200000;
+  struct {
+    const char* term;
+    const char* last;
+    u32 errors;
+  } chains[] = {
+    {"1 + ", "1", 0},
+    {"-", "1", 0},
+    // assignments group to the left, so each one but the first assigns to
+    // the one before it.
+    {"y = ", "1", count - 1},
+  };
+  test->passed = true;
+  for(u32 i = 0; i < sizeof(chains) / sizeof(chains[0]); ++i) {
+    char* source = chain_source(chains[i].term, count, chains[i].last);
+    test->passed = test->passed and check_source(test->table, NULL, source, Parse_Default, chains[i].errors);
+    buf_free(source);
+  }
+  return data;
+}
+
+// checks chains of operators as deep as the ones the walks are tested with,
+// on a thread with a small stack.
+void checker_depth_test(StringTable* table) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 256 * 1024);
+
+  DepthTest test = {table, false};
+  pthread_t thread;
+  int result = pthread_create(&thread, &attr, checker_depth_test_thread, &test);
+  assert(result == 0);
+  pthread_join(thread, NULL);
+  pthread_attr_destroy(&attr);
+  assert(test.passed);
+}
+
+void checker_test(StringTable* table) {
+  struct {
+    const char* source;
+    u32 errors;
+  } tests[] = {
+    // forward references and mutually dependent structs.
+    {"fn f() i32 { g(1) }\nfn g(x: i32) i32 { x * 2 }\n", 0},
+    {"struct A { b: *B, x: i32 }\nstruct B { a: *A }\nfn f(a: A) i32 { a.x }\n", 0},
+    {"let y: T = 1;\ntype T = i64;\n", 0},
+    {"struct P { x: f32, y: f32 }\nfn len(p: *P) f32 { p.x * p.x + p.y * p.y }\n", 0},
+    {"enum E { A, B = 4, C }\nfn f(e: E) E { e }\nfn g() E { E.C }\n", 0},
+    {"fn f(a: i32) i32 {\n  let x = a + 1;\n  while x { x = x - 1; }\n  for i in 0..10 { x = x + i; }\n  x\n}\n", 0},
+    // names from outside of a function are cached, locals still shadow them.
+    {"let x: bool = true;\nfn f() i32 {\n  let a: bool = x;\n  { { let x = 1; let b: i32 = x; } }\n  let c: bool = x;\n  0\n}\n", 0},
+    {"let x: bool = true;\nfn f() i32 {\n  let a: i32 = x;\n  { let x = 1; }\n  0\n}\n", 1},
+    // cycles.
+    {"struct A { b: B }\nstruct B { a: A }\n", 1},
+    {"type A = B;\ntype B = A;\n", 1},
+    {"let a = b;\nlet b = a;\n", 1},
+    // errors in declarations and bodies.
+    {"fn f() i32 { y }\n", 1},
+    {"fn f() {}\nfn f() {}\n", 1},
+    {"struct S { x: i32 }\nfn f(s: S) i32 { s.y }\n", 1},
+    {"fn f(x: i32) i32 { x }\nfn g() i32 { f(1, 2) }\n", 1},
+    {"fn f() i32 { 1.0 == true }\n", 1},
+    {"fn f(p: *i32, n: i64, c: u8) *i32 {\n  let x: i64 = n * c + (c << 2) ^ 1;\n  p + (x - 1)\n}\n", 0},
+    {"fn f(a: f32) f32 { a << 1 }\n", 1},
+    {"fn f() { return 1; }\n", 1},
+    {"let x: i32 = 1;\nlet y: *i32 = x;\n", 1},
+    // constant folding.
+    {"enum E { A = 1 << 4, B = -(2 * 3), C }\nlet x: u8 = 255u8 + 0u8;\n", 0},
+    {"let x = 2147483647 + 1;\n", 1},
+    {"let x = 10 / (3 - 3);\nlet y = 1 << 40;\n", 2},
+    {"let x = 300u8;\nlet y = 1.0 / 0.0;\n", 1},
+    // initializers converted to the declared type of a constant.
+    {"let N: u8 = 256;\n", 1},
+    {"let A: i8 = 127 + 1;\n", 1},
+    {"let B: u8 = 0 - 1;\n", 1},
+    {"let C: u8 = 255;\nlet D: i8 = -128;\nlet E: i8 = 100 + 27;\nlet F: f32 = 1;\n", 0},
+    // bodies checked by different workers, with functions declared in them.
+    {"fn a() i32 { x }\nfn b() i32 { y }\nfn c() i32 {\n  fn d() i32 { z }\n  d()\n}\n"
+      "fn e(n: i64) []i64 { [n, n] }\nfn f(n: i64) i64 { e(n)[0] }\n", 3},
+  };
+
+  // with the bodies skipped by the parser, only those the declarations need
+  // are parsed and their errors reported.
+  struct {
+    const char* source;
+    u32 errors;
+  } lazy[] = {
+    {"fn f() i32 { y }\n", 0},
+    {"fn f() i32 {\n  let x = 1;\n  x +\n}\nfn h() i32 { z }\n", 0},
+    {"fn f() i32 { 2 }\nlet x: i32 = f();\n", 0},
+    {"fn f() i32 { 2 + }\nlet x: i32 = f();\n", 1},
+  };
+
+  // every case is checked again with the bodies on a pool.
+  Pool* pool = new_pool(4);
+  for(u32 i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    bool passed = check_source(table, NULL, tests[i].source, Parse_Default, tests[i].errors);
+    passed = passed and check_source(table, pool, tests[i].source, Parse_Default, tests[i].errors);
+    assert(passed);
+  }
+  for(u32 i = 0; i < sizeof(lazy) / sizeof(lazy[0]); ++i) {
+    bool passed = check_source(table, NULL, lazy[i].source, Parse_LazyBodies, lazy[i].errors);
+    passed = passed and check_source(table, pool, lazy[i].source, Parse_LazyBodies, lazy[i].errors);
+    assert(passed);
+  }
+  reuse_test(table, NULL);
+  reuse_test(table, pool);
+  destroy_pool(pool);
+  query_test(table);
+  checker_depth_test(table);
+  printf("checker_test: %u cases\n", (u32) (sizeof(tests) / sizeof(tests[0])));
+}
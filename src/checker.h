@@ -0,0 +1,218 @@
+#ifndef CHECKER_H_
+#define CHECKER_H_
+
+#include "eval.h"
+#include "module.h"
+#include "pool.h"
+#include "scope.h"
+#include "type.h"
+
+// Semantic checking
+//
+// Checking is done in two phases. The first collects an entity for every
+// item of every module into the scope of its file and binds the names of
+// the use items, so every declaration is known before any is resolved.
+// The second resolves the entities from a worklist. An entity is resolved
+// on demand when a declaration being resolved needs it, which lets items
+// refer to items declared after them or in other modules in any order, and
+// an entity needed while it is being resolved is a cycle. Struct and enum
+// types exist before their members are resolved, so only a struct holding
+// itself by value is a cycle. Function bodies are checked last, once every
+// declaration they can name is resolved.
+//
+// The bodies only read the declarations, so with a pool they are checked
+// by its workers. A worker checks with a copy of the checker that has its
+// own arena, scopes, constants, evaluator and diagnostics, and shares the
+// type table, which is locked while a type is made. The copies are merged
+// into the checker in worker order once every body is checked. The
+// diagnostics are rendered sorted by location, so the output does not
+// depend on which worker checked a body.
+//
+// A tool asking about one declaration does not need every body checked.
+// After collect_modules the queries below resolve only what their answer
+// needs, and the entities stay resolved for the next query. A query that
+// needs its own answer is a cycle, reported like one between declarations.
+// While an item is resolved or its body checked, the other items it uses
+// are recorded as its dependencies.
+//
+// The immutable locals of a file are constants. Their initializers, the
+// conditions of 'when' and the bodies of the functions these call are
+// checked while recording, which keeps the type of every expression and
+// the entity of every name and binding for the evaluator.
+//
+// A server checks its modules again for every request while most bodies
+// did not change. With a body cache the declarations are still collected
+// and resolved each time, their entities point into the trees of the
+// files, but a body checked without errors is only checked again when its
+// fingerprint changed, see fingerprint.h, or the signature of an item it
+// used did. The items a body uses are its dependencies and the types and
+// constants these need, a constant also by its value. A change to the
+// names of its file, which can shadow what a name found before, checks
+// every body of the file again. The fingerprints are kept while the tree
+// of their module is the same, so a file that did not change is not walked.
+
+// an item a checked body used, by its module and name.
+typedef struct BodyUse {
+  // interned.
+  const char* path;
+  const char* name;
+  u64 signature;
+} BodyUse;
+
+typedef struct BodyRecord {
+  u64 body;
+  // the uid of the tree the fingerprint of the body was last taken from.
+  u32 ast;
+  // the names of the file of the function.
+  u64 names;
+  BodyUse* uses;
+  // the body does not declare functions or have a 'when'.
+  bool stable;
+  // false when the body had errors or is never reused.
+  bool reusable;
+} BodyRecord;
+
+typedef struct ModuleRecord {
+  const char* path;
+  // the uid of the tree the signatures were taken from.
+  u32 ast;
+  // Item to the fingerprint of its signature.
+  Map signatures;
+  // the names of the functions of the module to their BodyRecord.
+  Map functions;
+  // the file scope of the module and the fingerprint of its names, while
+  // it is checked.
+  Scope* scope;
+  u64 names;
+} ModuleRecord;
+
+typedef struct BodyCache {
+  // the interned path of a module to its ModuleRecord.
+  Map modules;
+
+  // the file Scope of a checked module to its ModuleRecord.
+  Map files;
+  ModuleRecord** checking;
+  // the functions whose bodies are checked this time and their new records.
+  Entity** checked;
+  BodyRecord* fresh;
+} BodyCache;
+
+void destroy_body_cache(BodyCache* cache);
+
+typedef struct Checker {
+  StringTable* table;
+  // scopes, entities and the names of the builtins.
+  Arena arena;
+  // the table of the checker, or the one of the checker a copy is made from.
+  TypeTable* types;
+  TypeTable type_table;
+  Scope* global_scope;
+  // every scope, freed with the checker.
+  Scope** scopes;
+  // Expr to the Value of the constant expressions that are not literals,
+  // folded once when they are checked, and of every recorded constant.
+  Map constants;
+  // Expr to its Type, and the Name, Pattern or parameter Item to its
+  // Entity, while recording.
+  Map recorded_types;
+  Map recorded_entities;
+  u32 recording;
+  // a body is checked again for the evaluator, its diagnostics are dropped.
+  u32 replaying;
+  Evaluator eval;
+  // the files given a scope, which is reset when the checker is destroyed.
+  AstFile** files;
+  // the File of each of them to its tree, for the bodies the parser skipped.
+  Map trees;
+
+  // entities waiting to be resolved.
+  Entity** queue;
+  u32 queue_head;
+  // functions with bodies, checked once the queue is empty.
+  Entity** bodies;
+  // entities being resolved, innermost last.
+  Entity** resolving;
+
+  // the scope names are looked up in.
+  Scope* scope;
+  // the function whose body is checked, NULL in declarations.
+  Entity* function;
+  // the names the checked body uses from outside of the function.
+  ScopeCache cache;
+  // the item whose declaration or body is checked, the items it uses are
+  // added to its dependencies.
+  Entity* dependent;
+  // number of loops around the checked expression.
+  u32 loops;
+
+  // checks the bodies on its workers when it is set.
+  Pool* pool;
+  // bodies that did not change since the cache has them are not checked.
+  BodyCache* body_cache;
+  // the function Entity of a checked body to its number of errors plus
+  // one, while a body cache is used.
+  Map body_errors;
+
+  u32 num_entities;
+  u32 num_bodies;
+  u32 num_reused;
+} Checker;
+
+void init_checker(Checker* checker, StringTable* table);
+
+void destroy_checker(Checker* checker);
+
+// checks the modules and everything they import, the modules are given in
+// the order of ordered_modules.
+void check_modules(Checker* checker, Module** modules, u32 num);
+
+// phase one of check_modules, the entities of the modules and their
+// imports. Nothing is resolved.
+void collect_modules(Checker* checker, Module** modules, u32 num);
+
+// Queries
+
+// the type of the entity, resolving its declaration and what it needs.
+Type* type_of(Checker* checker, Entity* entity);
+
+// the entity of the name seen from the scope. The lookups from file scopes
+// are kept.
+Entity* resolve_name(Scope* scope, const char* name);
+
+// the type once its size and alignment are known, NULL when it holds a
+// struct that is being resolved.
+Type* layout_of(Checker* checker, Type* type);
+
+// the type of an expression of the body of the function, which is checked
+// once for every expression of it.
+Type* expr_type(Checker* checker, Entity* function, Expr* expr);
+
+// the folded value of a checked constant expression, NULL when it is not
+// constant. The value of a literal is in its token.
+Value* constant_value(Checker* checker, Expr* expr);
+
+// the type a constant is folded in, of the invalid kind when its values
+// are not folded.
+ValueType value_type(Type* type);
+
+// the type a binary operation is done in, the type of the operands of a
+// comparison.
+Type* operation_type(TokenKind op, Type* lhs, Type* rhs, Type* result);
+
+// the operator of a compound assignment, Tkn_Plus for '+='.
+TokenKind compound_operator(TokenKind op);
+
+Type* resolve_entity(Checker* checker, Entity* entity);
+
+Type* recorded_type(Checker* checker, Expr* expr);
+
+Entity* recorded_entity(Checker* checker, const void* node);
+
+// checks the body of the function again while recording. false when it
+// has errors.
+bool record_body(Checker* checker, Entity* entity);
+
+void checker_test(StringTable* table);
+
+#endif
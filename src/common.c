@@ -289,42 +289,86 @@ void init_builtin(StringTable* table) {
 
 StringTable create_table(u64 size) {
   StringTable table;
-  table.strings = (char**) malloc(sizeof(char*) * size);
-
-  // set every element to NULL
-  memset(table.strings, 0, sizeof(char*) * size);
-
-  table.cap = size;
-  table.num = 0;
+  table.shards = (StringShard*) malloc(sizeof(StringShard) * TABLE_SHARDS);
+
+  // each shard has a power of two number of slots.
+  u64 cap = 16;
+  while(cap * TABLE_SHARDS < size)
+    cap *= 2;
+
+  for(u32 i = 0; i < TABLE_SHARDS; ++i) {
+    StringShard* shard = &table.shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->strings = (char**) calloc(cap, sizeof(char*));
+    shard->cap = cap;
+    shard->num = 0;
+  }
 
   init_builtin(&table);
 
   return table;
 }
 
-void table_rehash(StringTable* table) {
+// the low bits of the hash only depend on the low bits of the characters,
+// the high bits are folded in before they are used as an index.
+u64 table_slot(u64 hash) {
+  return hash ^ (hash >> 29) ^ (hash >> 47);
+}
+
+StringShard* table_shard(StringTable* table, u64 hash) {
+  return &table->shards[hash >> 60 & (TABLE_SHARDS - 1)];
+}
 
+// the slot holding the string, or the empty slot it would be inserted at.
+char** shard_find(StringShard* shard, const char* string, u64 hash) {
+  u64 mask = shard->cap - 1;
+  for(u64 index = table_slot(hash) & mask;; index = (index + 1) & mask) {
+    char* entry = shard->strings[index];
+    if(!entry or strcmp(entry, string) == 0)
+      return &shard->strings[index];
+  }
+}
+
+void shard_rehash(StringShard* shard) {
+  char** strings = shard->strings;
+  u64 cap = shard->cap;
+  shard->cap = cap * 2;
+  shard->strings = (char**) calloc(shard->cap, sizeof(char*));
+  for(u64 i = 0; i < cap; ++i) {
+    if(strings[i])
+      *shard_find(shard, strings[i], string_hash(strings[i], strlen(strings[i]))) = strings[i];
+  }
+  free(strings);
 }
 
 const char* table_insert_string(StringTable* table, const char* string) {
   u64 hash = string_hash(string, strlen(string));
-  u64 index = hash % table->cap;
-  if(table_contains(table, string)) {
-    // printf("Using String in table: %s\n", table->strings[index]);
-    return (const char*) table->strings[index];
-  }
-  else {
+  StringShard* shard = table_shard(table, hash);
+
+  pthread_mutex_lock(&shard->lock);
+  char** slot = shard_find(shard, string, hash);
+  if(!*slot) {
     u64 length = strlen(string);
-    table->strings[index] = (char*) malloc(length + 1);
-    strcpy(table->strings[index], string);
-    // printf("Inserting new string in table: %s %p\n", table->strings[index], (void*) table->strings[index]);
-    return (const char*) table->strings[index];
+    *slot = (char*) malloc(length + 1);
+    memcpy(*slot, string, length + 1);
+    // kept at most half full.
+    if(++shard->num * 2 > shard->cap) {
+      char* inserted = *slot;
+      shard_rehash(shard);
+      slot = shard_find(shard, inserted, hash);
+    }
   }
+  const char* result = *slot;
+  pthread_mutex_unlock(&shard->lock);
+  return result;
 }
 
-// for now assume there isnt a collision
 bool table_contains(StringTable* table, const char* string) {
   u64 hash = string_hash(string, strlen(string));
-  u64 index = hash % table->cap;
-  return table->strings[index] != NULL;
+  StringShard* shard = table_shard(table, hash);
+
+  pthread_mutex_lock(&shard->lock);
+  bool result = *shard_find(shard, string, hash) != NULL;
+  pthread_mutex_unlock(&shard->lock);
+  return result;
 }
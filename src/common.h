@@ -9,6 +9,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 typedef int8_t  i8;
 typedef int16_t i16;
@@ -39,6 +40,8 @@ u8 at_buffer(Buffer* buffer, u64 index);
 #define and &&
 #define or ||
 
+// a parameter a function takes but does not use, such as the data of a hook.
+#define UNUSED(x) (void) (x)
 
 // https://github.com/pervognsen/bitwise/blob/master/ion/common.c
 // the following are general data structure needed in a compiler.
@@ -119,16 +122,24 @@ const char *str_intern(const char *str);
 u64 string_hash(const char* string, u64 len);
 
 #define TABLE_START 1024
-// a table to store strings only once.
-typedef struct StringTable {
+#define TABLE_SHARDS 16
+
+// a table to store strings only once. It is split into shards by hash, each
+// with its own lock, so one table can be shared by threads lexing different
+// files.
+typedef struct StringShard {
+  pthread_mutex_t lock;
   char** strings;
   u64 cap;
   u64 num;
+} StringShard;
+
+typedef struct StringTable {
+  StringShard* shards;
 } StringTable;
 
 
 StringTable create_table(u64 size);
-void table_rehash(StringTable* table);
 
 // if the string is already in the table then it returns that pointer
 // if it is not then, the string is inserted into the table and returned
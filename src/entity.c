@@ -0,0 +1,39 @@
+#include "entity.h"
+
+Entity* new_entity(Arena* arena, EntityKind kind, Ident* name, Item* item, Type* type) {
+  Entity* entity = (Entity*) arena_alloc(arena, sizeof(Entity));
+  memset(entity, 0, sizeof(Entity));
+  entity->kind = kind;
+  entity->state = Entity_Unresolved;
+  entity->name = name;
+  entity->item = item;
+  entity->type = type;
+  return entity;
+}
+
+const char* entity_strings[] = {
+  [Entity_Const] = "constant",
+  [Entity_Local] = "variable",
+  [Entity_Alias] = "type alias",
+  [Entity_Struct] = "struct",
+  [Entity_Enum] = "enum",
+  [Entity_Funct] = "function",
+  [Entity_Type] = "type",
+  [Entity_Module] = "module",
+};
+
+const char* entity_string(Entity* entity) {
+  return entity_strings[entity->kind];
+}
+
+bool is_entity_type(Entity* entity) {
+  switch(entity->kind) {
+    case Entity_Alias:
+    case Entity_Struct:
+    case Entity_Enum:
+    case Entity_Type:
+      return true;
+    default:
+      return false;
+  }
+}
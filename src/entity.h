@@ -0,0 +1,65 @@
+#ifndef ENTITY_H_
+#define ENTITY_H_
+
+#include "ast.h"
+#include "value.h"
+
+// Entities
+//
+// An entity is a declared name: an item, a parameter, a local bound by a
+// pattern or a builtin. Entities of items start out unresolved and are
+// resolved once, by the checker, when their declaration is first needed.
+
+#define ENTITYKINDS \
+  ENTITYKIND(Const) \
+  ENTITYKIND(Local) \
+  ENTITYKIND(Alias) \
+  ENTITYKIND(Struct) \
+  ENTITYKIND(Enum) \
+  ENTITYKIND(Funct) \
+  ENTITYKIND(Type) \
+  ENTITYKIND(Module)
+
+typedef enum EntityKind {
+#define ENTITYKIND(n) Entity_##n,
+  ENTITYKINDS
+#undef ENTITYKIND
+} EntityKind;
+
+typedef enum EntityState {
+  Entity_Unresolved,
+  // the declaration is being resolved, needing it again is a cycle.
+  Entity_Resolving,
+  Entity_Resolved,
+} EntityState;
+
+typedef struct Entity {
+  EntityKind kind;
+  EntityState state;
+  Ident* name;
+  // the declaring item, NULL for parameters and builtins.
+  Item* item;
+  // the pattern binding a local.
+  Pattern* pattern;
+  // NULL when the declaration has errors.
+  Type* type;
+  // value of a constant.
+  Value value;
+  // scope the entity is declared in.
+  Scope* scope;
+  // declarations of a module, for Entity_Module.
+  Scope* members;
+  // the items its declaration and body use, a stretchy buffer.
+  struct Entity** deps;
+  bool immutable;
+} Entity;
+
+Entity* new_entity(Arena* arena, EntityKind kind, Ident* name, Item* item, Type* type);
+
+// the name of the kind of entity, "constant", "function", ...
+const char* entity_string(Entity* entity);
+
+// the entity names a type.
+bool is_entity_type(Entity* entity);
+
+#endif
@@ -0,0 +1,986 @@
+#include "eval.h"
+#include "checker.h"
+#include "parser.h"
+#include "report.h"
+
+#define EVAL_MAX_STEPS (1ull << 26)
+#define EVAL_MAX_MEMORY (64ull << 20)
+// operands are 24 bits.
+#define EVAL_MAX_OPERAND (1u << 24)
+
+void init_evaluator(Evaluator* eval) {
+  memset(eval, 0, sizeof(Evaluator));
+  eval->max_steps = EVAL_MAX_STEPS;
+  eval->max_memory = EVAL_MAX_MEMORY;
+}
+
+void free_code(EvalCode* code) {
+  buf_free(code->code);
+  buf_free(code->exprs);
+  buf_free(code->constants);
+  buf_free(code->operations);
+  buf_free(code->callees);
+}
+
+void destroy_evaluator(Evaluator* eval) {
+  for(u32 i = 0; i < buf_len(eval->codes); ++i) {
+    free_code(eval->codes[i]);
+    free(eval->codes[i]);
+  }
+  buf_free(eval->codes);
+  free((void*) eval->functions.keys);
+  free(eval->functions.vals);
+  for(u32 i = 0; i < eval->memo_cap; ++i)
+    buf_free(eval->memo[i].args);
+  free(eval->memo);
+  for(u32 i = 0; i < eval->arrays_cap; ++i) {
+    if(eval->arrays[i].kind == Value_Array)
+      buf_free(eval->arrays[i].array_value);
+  }
+  free(eval->arrays);
+  buf_free(eval->stack);
+  buf_free(eval->frames);
+  buf_free(eval->heap);
+}
+
+// Values
+
+// arrays are hashed by their elements, which are interned, so an array in
+// an array is hashed by its address.
+u64 hash_value(Value value) {
+  u64 hash = 0;
+  switch(value.kind) {
+    case Value_Bool: hash = value.bool_value; break;
+    case Value_String: hash = hash_bytes(value.string_value, strlen(value.string_value)); break;
+    case Value_Integer: hash = hash_uint64((u64) value.integer_value); break;
+    case Value_Float: hash = hash_bytes(&value.float_value, sizeof(f64)); break;
+    case Value_Char: hash = hash_uint64((u64) value.char_value); break;
+    case Value_Array: hash = hash_ptr(value.array_value); break;
+    default:;
+  }
+  return hash_mix(value.kind, hash);
+}
+
+u64 hash_values(u64 hash, Value* values, u32 num) {
+  for(u32 i = 0; i < num; ++i)
+    hash = hash_mix(hash, hash_value(values[i]));
+  return hash;
+}
+
+bool same_values(Value* a, u32 num_a, Value* b, u32 num_b) {
+  if(num_a != num_b)
+    return false;
+  for(u32 i = 0; i < num_a; ++i) {
+    if(!value_equal(a[i], b[i]))
+      return false;
+  }
+  return true;
+}
+
+bool is_scalar_value(Value value) {
+  return value.kind != Value_Invalid and value.kind != Value_Array and value.kind != Value_Map;
+}
+
+// the slot of the interned array with the elements, empty when there is none.
+Value* find_array(Evaluator* eval, u64 hash, Value* elems) {
+  u32 mask = eval->arrays_cap - 1;
+  for(u32 i = (u32) hash & mask;; i = (i + 1) & mask) {
+    Value* slot = eval->arrays + i;
+    if(slot->kind == Value_Invalid)
+      return slot;
+    if(same_values(slot->array_value, buf_len(slot->array_value), elems, buf_len(elems)))
+      return slot;
+  }
+}
+
+void grow_arrays(Evaluator* eval) {
+  u32 cap = eval->arrays_cap ? eval->arrays_cap * 2 : 16;
+  Value* old = eval->arrays;
+  u32 old_cap = eval->arrays_cap;
+  eval->arrays = (Value*) calloc(cap, sizeof(Value));
+  eval->arrays_cap = cap;
+  for(u32 i = 0; i < old_cap; ++i) {
+    if(old[i].kind == Value_Invalid)
+      continue;
+    Value* elems = old[i].array_value;
+    *find_array(eval, hash_values(0, elems, buf_len(elems)), elems) = old[i];
+  }
+  free(old);
+}
+
+// the value kept after the evaluation, its arrays are copied once into the
+// interned arrays.
+Value intern_constant(Evaluator* eval, Value value) {
+  if(value.kind != Value_Array)
+    return value;
+  Value* elems = NULL;
+  for(u32 i = 0; i < buf_len(value.array_value); ++i)
+    buf_push(elems, intern_constant(eval, value.array_value[i]));
+  if(2 * (eval->arrays_num + 1) > eval->arrays_cap)
+    grow_arrays(eval);
+  Value* slot = find_array(eval, hash_values(0, elems, buf_len(elems)), elems);
+  if(slot->kind == Value_Array) {
+    buf_free(elems);
+    return *slot;
+  }
+  *slot = new_array_value(elems);
+  eval->arrays_num++;
+  return *slot;
+}
+
+// Memoized calls
+
+u64 hash_call(Entity* function, Value* args, u32 num) {
+  return hash_values(hash_ptr(function), args, num);
+}
+
+// the slot of the call, empty when it is not memoized. NULL when there are
+// no slots.
+EvalMemo* find_memo(Evaluator* eval, u64 hash, Entity* function, Value* args, u32 num) {
+  if(eval->memo_cap == 0)
+    return NULL;
+  u32 mask = eval->memo_cap - 1;
+  for(u32 i = (u32) hash & mask;; i = (i + 1) & mask) {
+    EvalMemo* memo = eval->memo + i;
+    if(!memo->function)
+      return memo;
+    if(memo->hash == hash and memo->function == function and
+        same_values(memo->args, buf_len(memo->args), args, num))
+      return memo;
+  }
+}
+
+void grow_memo(Evaluator* eval) {
+  u32 cap = eval->memo_cap ? eval->memo_cap * 2 : 64;
+  EvalMemo* old = eval->memo;
+  u32 old_cap = eval->memo_cap;
+  eval->memo = (EvalMemo*) calloc(cap, sizeof(EvalMemo));
+  eval->memo_cap = cap;
+  for(u32 i = 0; i < old_cap; ++i) {
+    if(old[i].function)
+      *find_memo(eval, old[i].hash, old[i].function, old[i].args, buf_len(old[i].args)) = old[i];
+  }
+  free(old);
+}
+
+// takes the arguments, a stretchy buffer.
+void add_memo(Evaluator* eval, Entity* function, Value* args, Value result) {
+  if(2 * (eval->memo_num + 1) > eval->memo_cap)
+    grow_memo(eval);
+  u64 hash = hash_call(function, args, buf_len(args));
+  EvalMemo* memo = find_memo(eval, hash, function, args, buf_len(args));
+  if(memo->function) {
+    buf_free(args);
+    return;
+  }
+  *memo = (EvalMemo) {hash, function, args, result};
+  eval->memo_num++;
+}
+
+// Compiling
+
+typedef struct EvalCompiler {
+  Checker* checker;
+  EvalCode* code;
+  // local Entity to its slot plus one.
+  Map slots;
+  // return type of the function, NULL in an expression.
+  Type* ret;
+} EvalCompiler;
+
+u32 emit_instr(EvalCompiler* c, EvalOp op, u32 arg, Expr* expr) {
+  buf_push(c->code->code, (Instr) op | arg << 8);
+  buf_push(c->code->exprs, expr);
+  return buf_len(c->code->code) - 1;
+}
+
+// the jump at the instruction goes to the next one emitted.
+void patch(EvalCompiler* c, u32 at) {
+  c->code->code[at] = (c->code->code[at] & 0xff) | buf_len(c->code->code) << 8;
+}
+
+u32 here(EvalCompiler* c) {
+  return buf_len(c->code->code);
+}
+
+void emit_constant(EvalCompiler* c, Value value, Expr* expr) {
+  buf_push(c->code->constants, value);
+  emit_instr(c, Op_Const, buf_len(c->code->constants) - 1, expr);
+}
+
+void emit_operation(EvalCompiler* c, EvalOp op, TokenKind kind, ValueType type, Expr* expr) {
+  buf_push(c->code->operations, (EvalOperation) {kind, type});
+  emit_instr(c, op, buf_len(c->code->operations) - 1, expr);
+}
+
+u32 new_slot(EvalCompiler* c, Entity* entity) {
+  u32 slot = c->code->num_slots++;
+  if(entity)
+    map_put(&c->slots, entity, (void*) (uintptr_t) (slot + 1));
+  return slot;
+}
+
+bool find_slot(EvalCompiler* c, Entity* entity, u32* slot) {
+  uintptr_t found = (uintptr_t) map_get(&c->slots, entity);
+  *slot = (u32) found - 1;
+  return found != 0;
+}
+
+// the value on the stack of type from is converted to to.
+bool emit_convert(EvalCompiler* c, Type* from, Type* to, Expr* expr) {
+  if(!from or !to)
+    return false;
+  if(from == to)
+    return true;
+  ValueType a = value_type(from);
+  ValueType b = value_type(to);
+  if(a.kind == Value_Invalid or b.kind == Value_Invalid)
+    return false;
+  if(a.kind != b.kind or a.size != b.size or a.is_signed != b.is_signed)
+    emit_operation(c, Op_Convert, Tkn_Error, b, expr);
+  return true;
+}
+
+bool compile_expr(EvalCompiler* c, Expr* expr);
+
+// compiles the expression and converts it to type.
+bool compile_value(EvalCompiler* c, Expr* expr, Type* type) {
+  return compile_expr(c, expr) and emit_convert(c, recorded_type(c->checker, expr), type, expr);
+}
+
+bool compile_binary(EvalCompiler* c, Expr* expr, Type* type) {
+  Expr* lhs = expr->binary.lhs;
+  Expr* rhs = expr->binary.rhs;
+  TokenKind op = expr->binary.op.kind;
+  // the right operand is only evaluated when it decides the result.
+  if(op == Tkn_And or op == Tkn_Or) {
+    if(!compile_expr(c, lhs))
+      return false;
+    emit_instr(c, Op_Dup, 0, expr);
+    u32 skip = emit_instr(c, op == Tkn_And ? Op_JumpFalse : Op_JumpTrue, 0, expr);
+    emit_instr(c, Op_Pop, 0, expr);
+    if(!compile_expr(c, rhs))
+      return false;
+    patch(c, skip);
+    return true;
+  }
+  Type* lhs_type = recorded_type(c->checker, lhs);
+  Type* rhs_type = recorded_type(c->checker, rhs);
+  if(!type or !lhs_type or !rhs_type)
+    return false;
+  ValueType operation = value_type(operation_type(op, lhs_type, rhs_type, type));
+  if(operation.kind == Value_Invalid or !compile_expr(c, lhs) or !compile_expr(c, rhs))
+    return false;
+  emit_operation(c, Op_Binary, op, operation, expr);
+  return true;
+}
+
+bool compile_unary(EvalCompiler* c, Expr* expr) {
+  Expr* operand = expr->unary.expr;
+  TokenKind op = expr->unary.op.kind;
+  if(op != Tkn_Minus and op != Tkn_Tilde and op != Tkn_Bang)
+    return false;
+  ValueType operation = value_type(recorded_type(c->checker, operand));
+  if(operation.kind == Value_Invalid or !compile_expr(c, operand))
+    return false;
+  emit_operation(c, Op_Unary, op, operation, expr);
+  return true;
+}
+
+bool compile_call(EvalCompiler* c, Expr* expr) {
+  Expr* name = expr->fncall.name;
+  Entity* callee = name and name->kind == Name ? recorded_entity(c->checker, name) : NULL;
+  if(!callee or callee->kind != Entity_Funct or !callee->type)
+    return false;
+  Type* type = callee->type;
+  if(expr->fncall.num_actuals != type->func.num_params)
+    return false;
+  for(u32 i = 0; i < expr->fncall.num_actuals; ++i) {
+    Expr* arg = expr->fncall.actuals[i];
+    if(!arg or arg->kind == Binding or !compile_value(c, arg, type->func.params[i]))
+      return false;
+  }
+  buf_push(c->code->callees, callee);
+  emit_instr(c, Op_Call, buf_len(c->code->callees) - 1, expr);
+  return true;
+}
+
+bool compile_if(EvalCompiler* c, Expr* expr) {
+  if(!compile_expr(c, expr->if_expr.cond))
+    return false;
+  u32 skip = emit_instr(c, Op_JumpFalse, 0, expr);
+  if(!compile_expr(c, expr->if_expr.body))
+    return false;
+  if(!expr->if_expr.else_if) {
+    emit_instr(c, Op_Pop, 0, expr);
+    patch(c, skip);
+    emit_instr(c, Op_Unit, 0, expr);
+    return true;
+  }
+  u32 end = emit_instr(c, Op_Jump, 0, expr);
+  patch(c, skip);
+  if(!compile_expr(c, expr->if_expr.else_if))
+    return false;
+  patch(c, end);
+  return true;
+}
+
+bool compile_while(EvalCompiler* c, Expr* expr) {
+  u32 loop = here(c);
+  if(!compile_expr(c, expr->while_expr.cond))
+    return false;
+  u32 exit = emit_instr(c, Op_JumpFalse, 0, expr);
+  if(!compile_expr(c, expr->while_expr.body))
+    return false;
+  emit_instr(c, Op_Pop, 0, expr);
+  emit_instr(c, Op_Jump, loop, expr);
+  patch(c, exit);
+  emit_instr(c, Op_Unit, 0, expr);
+  return true;
+}
+
+// a loop over a range counts in a hidden slot, a loop over an array keeps
+// the array and an i64 index.
+bool compile_for(EvalCompiler* c, Expr* expr) {
+  Pattern* pat = expr->for_expr.pat;
+  Expr* iter = expr->for_expr.cond;
+  Type* type = iter ? recorded_type(c->checker, iter) : NULL;
+  if(!pat or !type or type->kind != Type_Array)
+    return false;
+  Entity* entity = pat->kind == IdentPattern ? recorded_entity(c->checker, pat) : NULL;
+  if(!entity and pat->kind != WildCard)
+    return false;
+  u32 var = new_slot(c, entity);
+  Type* elem = type->elem;
+  ValueType operation = value_type(elem);
+
+  u32 index = new_slot(c, NULL);
+  u32 end = new_slot(c, NULL);
+  u32 step = new_slot(c, NULL);
+  FoldError error;
+  if(iter->kind == Range) {
+    if(operation.kind != Value_Integer or !iter->range.start or !iter->range.end)
+      return false;
+    if(!compile_value(c, iter->range.start, elem))
+      return false;
+    emit_instr(c, Op_Store, index, expr);
+    if(!compile_value(c, iter->range.end, elem))
+      return false;
+    emit_instr(c, Op_Store, end, expr);
+    if(iter->range.step) {
+      if(!compile_value(c, iter->range.step, elem))
+        return false;
+    }
+    else
+      emit_constant(c, value_convert(new_integer_value(1), operation, &error), expr);
+    emit_instr(c, Op_Store, step, expr);
+  }
+  else {
+    operation = value_type(i64_t);
+    if(!compile_expr(c, iter))
+      return false;
+    emit_instr(c, Op_Store, end, expr);
+    emit_constant(c, new_integer_value(0), expr);
+    emit_instr(c, Op_Store, index, expr);
+    emit_constant(c, new_integer_value(1), expr);
+    emit_instr(c, Op_Store, step, expr);
+  }
+
+  u32 loop = here(c);
+  emit_instr(c, Op_Load, index, expr);
+  emit_instr(c, Op_Load, end, expr);
+  if(iter->kind != Range)
+    emit_instr(c, Op_Length, 0, expr);
+  emit_operation(c, Op_Binary, Tkn_Less, operation, expr);
+  u32 exit = emit_instr(c, Op_JumpFalse, 0, expr);
+  if(iter->kind != Range) {
+    emit_instr(c, Op_Load, end, expr);
+    emit_instr(c, Op_Load, index, expr);
+    emit_instr(c, Op_Index, 0, expr);
+  }
+  else
+    emit_instr(c, Op_Load, index, expr);
+  emit_instr(c, Op_Store, var, expr);
+  if(!compile_expr(c, expr->for_expr.body))
+    return false;
+  emit_instr(c, Op_Pop, 0, expr);
+  emit_instr(c, Op_Load, index, expr);
+  emit_instr(c, Op_Load, step, expr);
+  emit_operation(c, Op_Binary, Tkn_Plus, operation, expr);
+  emit_instr(c, Op_Store, index, expr);
+  emit_instr(c, Op_Jump, loop, expr);
+  patch(c, exit);
+  emit_instr(c, Op_Unit, 0, expr);
+  return true;
+}
+
+bool compile_local(EvalCompiler* c, Item* item) {
+  Pattern* pat = item->local.name;
+  Expr* init = item->local.init;
+  if(!pat or !init)
+    return false;
+  if(pat->kind == WildCard) {
+    if(!compile_expr(c, init))
+      return false;
+    emit_instr(c, Op_Pop, 0, init);
+    return true;
+  }
+  Entity* entity = pat->kind == IdentPattern ? recorded_entity(c->checker, pat) : NULL;
+  if(!entity or !compile_value(c, init, entity->type))
+    return false;
+  emit_instr(c, Op_Store, new_slot(c, entity), init);
+  return true;
+}
+
+bool compile_block(EvalCompiler* c, Expr* expr) {
+  bool value = false;
+  u32 num = expr->block.num_stmts;
+  for(u32 i = 0; i < num; ++i) {
+    Stmt* stmt = expr->block.stmts[i];
+    if(!stmt)
+      continue;
+    value = false;
+    switch(stmt->kind) {
+      case ExprStmt:
+        if(!compile_expr(c, stmt->expr))
+          return false;
+        if(i + 1 < num)
+          emit_instr(c, Op_Pop, 0, stmt->expr);
+        else
+          value = true;
+        break;
+      case SemiStmt:
+        if(!compile_expr(c, stmt->semi))
+          return false;
+        emit_instr(c, Op_Pop, 0, stmt->semi);
+        break;
+      case ItemStmt:
+        // the other items of the block are not code.
+        if(stmt->item and stmt->item->kind == ItemLocal and !compile_local(c, stmt->item))
+          return false;
+        break;
+    }
+  }
+  if(!value)
+    emit_instr(c, Op_Unit, 0, expr);
+  return true;
+}
+
+bool compile_return(EvalCompiler* c, Expr* expr) {
+  if(!c->ret or expr->return_expr.num_exprs > 1)
+    return false;
+  if(expr->return_expr.num_exprs == 0)
+    emit_instr(c, Op_Unit, 0, expr);
+  else if(!compile_value(c, expr->return_expr.exprs[0], c->ret))
+    return false;
+  emit_instr(c, Op_Return, 0, expr);
+  return true;
+}
+
+bool compile_assignment(EvalCompiler* c, Expr* expr) {
+  Expr* variable = expr->assign.variable;
+  Expr* value = expr->assign.value;
+  Type* type = recorded_type(c->checker, variable);
+  TokenKind op = expr->assign.op.kind == Tkn_Equal ? Tkn_Error : compound_operator(expr->assign.op.kind);
+  ValueType operation = value_type(type);
+  if(!type or !variable or (op != Tkn_Error and operation.kind == Value_Invalid))
+    return false;
+
+  if(variable->kind == Name) {
+    Entity* entity = recorded_entity(c->checker, variable);
+    u32 slot;
+    if(!entity or !find_slot(c, entity, &slot))
+      return false;
+    if(op != Tkn_Error) {
+      emit_instr(c, Op_Load, slot, variable);
+      if(!compile_expr(c, value))
+        return false;
+      emit_operation(c, Op_Binary, op, operation, expr);
+    }
+    else if(!compile_value(c, value, type))
+      return false;
+    emit_instr(c, Op_Store, slot, expr);
+  }
+  else if(variable->kind == Index) {
+    Expr* array = variable->index.operand;
+    Expr* index = variable->index.index;
+    Type* array_type = recorded_type(c->checker, array);
+    if(!array_type or array_type->kind != Type_Array)
+      return false;
+    if(!compile_expr(c, array) or !compile_expr(c, index))
+      return false;
+    if(op != Tkn_Error) {
+      if(!compile_expr(c, array) or !compile_expr(c, index))
+        return false;
+      emit_instr(c, Op_Index, 0, variable);
+      if(!compile_expr(c, value))
+        return false;
+      emit_operation(c, Op_Binary, op, operation, expr);
+    }
+    else if(!compile_value(c, value, type))
+      return false;
+    emit_instr(c, Op_SetIndex, 0, expr);
+  }
+  else
+    return false;
+  emit_instr(c, Op_Unit, 0, expr);
+  return true;
+}
+
+// every expression leaves one value on the stack, the invalid value for
+// the ones of unit type.
+bool compile_expr(EvalCompiler* c, Expr* expr) {
+  if(!expr)
+    return false;
+  Checker* checker = c->checker;
+  Value* value = constant_value(checker, expr);
+  if(value) {
+    emit_constant(c, *value, expr);
+    return true;
+  }
+  Type* type = recorded_type(checker, expr);
+  switch(expr->kind) {
+    case Name: {
+      Entity* entity = recorded_entity(checker, expr);
+      u32 slot;
+      if(!entity or !find_slot(c, entity, &slot))
+        return false;
+      emit_instr(c, Op_Load, slot, expr);
+      return true;
+    }
+    case Unary:
+      return compile_unary(c, expr);
+    case Binary:
+      return compile_binary(c, expr, type);
+    case FnCall:
+      return compile_call(c, expr);
+    case If:
+      return compile_if(c, expr);
+    case When: {
+      // the checker kept the value of the condition.
+      Value* cond = constant_value(checker, expr->if_expr.cond);
+      bool truth;
+      if(!cond or !value_truth(*cond, &truth))
+        return false;
+      Expr* taken = truth ? expr->if_expr.body : expr->if_expr.else_if;
+      if(taken)
+        return compile_expr(c, taken);
+      emit_instr(c, Op_Unit, 0, expr);
+      return true;
+    }
+    case While:
+      return compile_while(c, expr);
+    case For:
+      return compile_for(c, expr);
+    case Return:
+      return compile_return(c, expr);
+    case Block:
+      return compile_block(c, expr);
+    case Assignment:
+      return compile_assignment(c, expr);
+    case CompoundLiteral: {
+      if(!type or type->kind != Type_Array)
+        return false;
+      for(u32 i = 0; i < expr->compound_lit.num_members; ++i) {
+        if(!compile_value(c, expr->compound_lit.members[i], type->elem))
+          return false;
+      }
+      emit_instr(c, Op_Array, expr->compound_lit.num_members, expr);
+      return true;
+    }
+    case Index: {
+      Type* array = recorded_type(checker, expr->index.operand);
+      if(!array or array->kind != Type_Array)
+        return false;
+      if(!compile_expr(c, expr->index.operand) or !compile_expr(c, expr->index.index))
+        return false;
+      emit_instr(c, Op_Index, 0, expr);
+      return true;
+    }
+    case Cast:
+      return compile_value(c, expr->cast.expr, type);
+    default:
+      return false;
+  }
+}
+
+bool finish_code(EvalCompiler* c, bool compiled) {
+  free((void*) c->slots.keys);
+  free(c->slots.vals);
+  return compiled and here(c) < EVAL_MAX_OPERAND and buf_len(c->code->constants) < EVAL_MAX_OPERAND;
+}
+
+// the parameters are the first slots, the value of the body is returned.
+bool compile_function(Checker* checker, EvalCode* code) {
+  EvalCompiler c = {checker, code, {0}, NULL};
+  Entity* entity = code->entity;
+  Item* item = entity->item;
+  c.ret = entity->type->func.ret;
+  for(u32 i = 0; i < item->function.num_args; ++i) {
+    Entity* param = recorded_entity(checker, item->function.arguments[i]);
+    if(!param)
+      return finish_code(&c, false);
+    new_slot(&c, param);
+  }
+  code->num_params = item->function.num_args;
+
+  Expr* body = item->function.body;
+  if(!compile_expr(&c, body))
+    return finish_code(&c, false);
+  Type* type = recorded_type(checker, body);
+  // a body of unit type returns on every path or reaches the end of a
+  // function returning unit.
+  if(c.ret == unit_t or !type or type == unit_t) {
+    emit_instr(&c, Op_Pop, 0, body);
+    emit_instr(&c, Op_Unit, 0, body);
+  }
+  else if(!emit_convert(&c, type, c.ret, body))
+    return finish_code(&c, false);
+  emit_instr(&c, Op_Return, 0, body);
+  return finish_code(&c, true);
+}
+
+// the code of a function called at compile time, compiled once. NULL when
+// it is not known at compile time.
+EvalCode* function_code(Evaluator* eval, Checker* checker, Entity* function) {
+  EvalCode* code = (EvalCode*) map_get(&eval->functions, function);
+  if(code)
+    return code->state == Code_Valid ? code : NULL;
+  code = (EvalCode*) calloc(1, sizeof(EvalCode));
+  code->state = Code_Compiling;
+  code->entity = function;
+  map_put(&eval->functions, function, code);
+  buf_push(eval->codes, code);
+  bool valid = record_body(checker, function) and compile_function(checker, code);
+  code->state = valid ? Code_Valid : Code_Invalid;
+  return valid ? code : NULL;
+}
+
+// Running
+
+u64 memory_used(Evaluator* eval) {
+  return buf_len(eval->stack) * sizeof(Value) + buf_len(eval->frames) * sizeof(EvalFrame) + eval->heap_size;
+}
+
+Value pop(Evaluator* eval) {
+  return eval->stack[--buf__hdr(eval->stack)->len];
+}
+
+void push_frame(Evaluator* eval, EvalCode* code, u32 base, Value* args) {
+  buf_push(eval->frames, (EvalFrame) {code, 0, base, args});
+  for(u32 i = code->num_params; i < code->num_slots; ++i)
+    buf_push(eval->stack, default_value);
+}
+
+// a copy in the heap of the evaluation, the arrays of constants are never
+// changed.
+Value copy_heap_value(Evaluator* eval, Value value) {
+  if(value.kind != Value_Array)
+    return value;
+  Value* elems = NULL;
+  for(u32 i = 0; i < buf_len(value.array_value); ++i)
+    buf_push(elems, copy_heap_value(eval, value.array_value[i]));
+  buf_push(eval->heap, elems);
+  eval->heap_size += buf_len(elems) * sizeof(Value);
+  return new_array_value(elems);
+}
+
+SourceLoc instruction_loc(EvalCode* code, u32 pc, Expr* top) {
+  Expr* expr = code->exprs[pc] ? code->exprs[pc] : top;
+  return expr->loc;
+}
+
+EvalStatus fold_status(EvalCode* code, u32 pc, Expr* top, const char* what, FoldError error) {
+  switch(error) {
+    case Fold_DivideByZero:
+      check_error(instruction_loc(code, pc, top), "division by zero while evaluating %s\n", what);
+      return Eval_Failed;
+    case Fold_ShiftRange:
+      check_error(instruction_loc(code, pc, top), "shift amount out of range while evaluating %s\n", what);
+      return Eval_Failed;
+    case Fold_Invalid:
+      return Eval_Unknown;
+    default:
+      return Eval_Ok;
+  }
+}
+
+// the element of an array, NULL with the status when it can not be used.
+Value* array_element(EvalCode* code, u32 pc, Expr* top, const char* what, Value array, Value index,
+  EvalStatus* status) {
+  if(array.kind != Value_Array or index.kind != Value_Integer) {
+    *status = Eval_Unknown;
+    return NULL;
+  }
+  u32 len = buf_len(array.array_value);
+  if(index.integer_value < 0 or index.integer_value >= len) {
+    check_error(instruction_loc(code, pc, top), "index %lld is out of range of %u elements while evaluating %s\n",
+      (long long) index.integer_value, len, what);
+    *status = Eval_Failed;
+    return NULL;
+  }
+  return array.array_value + index.integer_value;
+}
+
+// runs the code until it returns. Evaluations can be started while another
+// runs, when checking a body needs a 'when', on top of its stack.
+EvalStatus run(Evaluator* eval, Checker* checker, EvalCode* entry, Expr* top, const char* what, Value* result) {
+  u32 frames_base = buf_len(eval->frames);
+  u32 stack_base = buf_len(eval->stack);
+  push_frame(eval, entry, stack_base, NULL);
+  EvalStatus status = Eval_Ok;
+
+  while(status == Eval_Ok and buf_len(eval->frames) > frames_base) {
+    EvalFrame* frame = &eval->frames[buf_len(eval->frames) - 1];
+    EvalCode* code = frame->code;
+    u32 pc = frame->pc++;
+    Instr instr = code->code[pc];
+    u32 arg = instr >> 8;
+    Value* slots = eval->stack + frame->base;
+    FoldError error = Fold_Ok;
+
+    if(++eval->steps > eval->max_steps) {
+      check_error(top->loc, "evaluating %s takes more than %llu steps\n", what,
+        (unsigned long long) eval->max_steps);
+      status = Eval_Failed;
+      break;
+    }
+
+    switch((EvalOp) (instr & 0xff)) {
+      case Op_Const:
+        buf_push(eval->stack, copy_heap_value(eval, code->constants[arg]));
+        break;
+      case Op_Unit:
+        buf_push(eval->stack, default_value);
+        break;
+      case Op_Load:
+        buf_push(eval->stack, slots[arg]);
+        break;
+      case Op_Store:
+        slots[arg] = pop(eval);
+        break;
+      case Op_Pop:
+        pop(eval);
+        break;
+      case Op_Dup: {
+        Value value = eval->stack[buf_len(eval->stack) - 1];
+        buf_push(eval->stack, value);
+      } break;
+      case Op_Binary: {
+        Value rhs = pop(eval);
+        Value lhs = pop(eval);
+        EvalOperation operation = code->operations[arg];
+        Value value = value_eval_binary(operation.op, lhs, rhs, operation.type, &error);
+        status = fold_status(code, pc, top, what, error);
+        buf_push(eval->stack, value);
+      } break;
+      case Op_Unary: {
+        EvalOperation operation = code->operations[arg];
+        Value value = value_eval_unary(operation.op, pop(eval), operation.type, &error);
+        status = fold_status(code, pc, top, what, error);
+        buf_push(eval->stack, value);
+      } break;
+      case Op_Convert: {
+        Value value = value_convert(pop(eval), code->operations[arg].type, &error);
+        status = fold_status(code, pc, top, what, error);
+        buf_push(eval->stack, value);
+      } break;
+      case Op_Jump:
+        frame->pc = arg;
+        break;
+      case Op_JumpFalse:
+      case Op_JumpTrue: {
+        bool truth;
+        if(!value_truth(pop(eval), &truth))
+          status = Eval_Unknown;
+        else if(truth == ((instr & 0xff) == Op_JumpTrue))
+          frame->pc = arg;
+      } break;
+      case Op_Call: {
+        Entity* callee = code->callees[arg];
+        // compiling the callee can run other evaluations on the stack.
+        EvalCode* target = function_code(eval, checker, callee);
+        if(!target) {
+          status = Eval_Unknown;
+          break;
+        }
+        u32 num = target->num_params;
+        u32 base = buf_len(eval->stack) - num;
+        Value* args = eval->stack + base;
+        bool memoized = true;
+        for(u32 i = 0; i < num; ++i)
+          memoized = memoized and is_scalar_value(args[i]);
+        Value* kept = NULL;
+        if(memoized) {
+          EvalMemo* memo = find_memo(eval, hash_call(callee, args, num), callee, args, num);
+          if(memo and memo->function) {
+            eval->memo_hits++;
+            buf__hdr(eval->stack)->len = base;
+            buf_push(eval->stack, memo->result);
+            break;
+          }
+          // a call without arguments is memoized too.
+          buf_fit(kept, 1);
+          for(u32 i = 0; i < num; ++i)
+            buf_push(kept, eval->stack[base + i]);
+        }
+        push_frame(eval, target, base, kept);
+      } break;
+      case Op_Return: {
+        Value value = pop(eval);
+        buf__hdr(eval->stack)->len = frame->base;
+        if(frame->args and is_scalar_value(value))
+          add_memo(eval, code->entity, frame->args, value);
+        else
+          buf_free(frame->args);
+        buf__hdr(eval->frames)->len--;
+        if(buf_len(eval->frames) == frames_base)
+          *result = value;
+        else
+          buf_push(eval->stack, value);
+      } break;
+      case Op_Array: {
+        Value* elems = NULL;
+        u32 base = buf_len(eval->stack) - arg;
+        for(u32 i = 0; i < arg; ++i)
+          buf_push(elems, eval->stack[base + i]);
+        buf__hdr(eval->stack)->len = base;
+        buf_push(eval->heap, elems);
+        eval->heap_size += arg * sizeof(Value);
+        buf_push(eval->stack, new_array_value(elems));
+      } break;
+      case Op_Index: {
+        Value index = pop(eval);
+        Value* elem = array_element(code, pc, top, what, pop(eval), index, &status);
+        buf_push(eval->stack, elem ? *elem : default_value);
+      } break;
+      case Op_SetIndex: {
+        Value value = pop(eval);
+        Value index = pop(eval);
+        Value* elem = array_element(code, pc, top, what, pop(eval), index, &status);
+        if(elem)
+          *elem = value;
+      } break;
+      case Op_Length: {
+        Value array = pop(eval);
+        if(array.kind != Value_Array)
+          status = Eval_Unknown;
+        buf_push(eval->stack, new_integer_value(array.kind == Value_Array ? buf_len(array.array_value) : 0));
+      } break;
+    }
+
+    if(status == Eval_Ok and memory_used(eval) > eval->max_memory) {
+      check_error(top->loc, "evaluating %s needs more than %llu bytes\n", what,
+        (unsigned long long) eval->max_memory);
+      status = Eval_Failed;
+    }
+  }
+
+  for(u32 i = frames_base; i < buf_len(eval->frames); ++i)
+    buf_free(eval->frames[i].args);
+  buf__hdr(eval->frames)->len = frames_base;
+  if(eval->stack)
+    buf__hdr(eval->stack)->len = stack_base;
+  return status;
+}
+
+EvalStatus evaluate(Checker* checker, Expr* expr, Type* type, const char* what, Value* result) {
+  Evaluator* eval = &checker->eval;
+  *result = default_value;
+  EvalCode code = {Code_Compiling};
+  EvalCompiler c = {checker, &code, {0}, NULL};
+  EvalStatus status = Eval_Unknown;
+  bool outermost = buf_len(eval->frames) == 0;
+  if(finish_code(&c, compile_value(&c, expr, type) and (emit_instr(&c, Op_Return, 0, expr), true))) {
+    if(outermost)
+      eval->steps = 0;
+    status = run(eval, checker, &code, expr, what, result);
+    eval->total_steps += outermost ? eval->steps : 0;
+    if(status == Eval_Ok)
+      *result = intern_constant(eval, *result);
+    else
+      *result = default_value;
+  }
+  free_code(&code);
+
+  // the arrays of the evaluation are kept until the outermost one ends.
+  if(outermost) {
+    for(u32 i = 0; i < buf_len(eval->heap); ++i)
+      buf_free(eval->heap[i]);
+    buf_clear(eval->heap);
+    eval->heap_size = 0;
+  }
+  eval->evaluations++;
+  return status;
+}
+
+// checks the source as a module with a small step budget, the value of the
+// constant name is given when it is an integer.
+bool eval_source(StringTable* table, const char* source, const char* name, u32 expected, i64* value) {
+  File file = {"<eval_test>", (char*) source, strlen(source), NULL};
+  ReportBuffer buffer = {NULL};
+  ReportBuffer* old = set_report_buffer(&buffer);
+  AstFile* ast = parse_file(&file, table);
+  Module module;
+  memset(&module, 0, sizeof(Module));
+  module.file = &file;
+  module.ast = ast;
+  Module* modules[] = {&module};
+
+  Checker checker;
+  init_checker(&checker, table);
+  checker.eval.max_steps = 1 << 16;
+  check_modules(&checker, modules, 1);
+  Entity* entity = name ? scope_find(ast->scope, table_insert_string(table, name)) : NULL;
+  bool found = entity and entity->value.kind == Value_Integer;
+  if(found)
+    *value = entity->value.integer_value;
+  destroy_checker(&checker);
+  destroy_ast_file(ast);
+
+  set_report_buffer(old);
+  u32 errors = report_error_count(&buffer);
+  if(errors != expected) {
+    printf("eval_test: %u errors, expected %u, in:\n%s", errors, expected, source);
+    print_report_buffer(&buffer);
+  }
+  clear_report_buffer(&buffer);
+  return errors == expected and (!name or found);
+}
+
+void eval_test(StringTable* table) {
+  struct {
+    const char* source;
+    const char* name;
+    i64 value;
+    u32 errors;
+  } tests[] = {
+    // calls are memoized, so this does not take 2^60 steps.
+    {"fn fib(n: i64) i64 { if n < 2 { n } else { fib(n - 1) + fib(n - 2) } }\nlet F = fib(60);\n",
+      "F", 1548008755920, 0},
+    {"fn sum(n: i32) i32 {\n  let mut s = 0;\n  let mut i = 0;\n  while i < n { s += i; i += 1; }\n  s\n}\n"
+      "let S = sum(10);\n", "S", 45, 0},
+    {"fn wrap(x: u8) u8 { x + 5u8 }\nlet W = wrap(255u8);\n", "W", 4, 0},
+    {"fn squares() []i64 {\n  let mut t = [0i64, 0i64, 0i64, 0i64];\n  for i in 0..4 { t[i] = i * i; }\n  t\n}\n"
+      "let T = squares();\nlet U = squares();\nlet N = T[3] + U[2];\n", "N", 13, 0},
+    {"fn clamp(x: i32) i32 { if x > 3 { 3 } else if x < 0 { 0 } else { x } }\n"
+      "let E = clamp(10) + clamp(-5) + clamp(2);\n", "E", 5, 0},
+    // only the branch of a 'when' that is taken is checked.
+    {"let DEBUG = false;\nfn f() i32 {\n  when DEBUG { undeclared }\n  else { 1 }\n}\nlet G = f();\n", "G", 1, 0},
+    {"fn is_big(x: i64) bool { x > 100 }\nfn f() i64 { when is_big(1000) { 2 } else { 3 } }\nlet H = f();\n", "H", 2, 0},
+    // failed evaluations.
+    {"fn spin() i32 { while true {} 0 }\nlet X = spin();\n", NULL, 0, 1},
+    {"fn div(a: i32, b: i32) i32 { a / b }\nlet X = div(1, 0);\n", NULL, 0, 1},
+    {"fn at(i: i64) i64 { let t = [1, 2, 3]; t[i] }\nlet X = at(3);\n", NULL, 0, 1},
+    {"fn f(x: bool) i32 { when x { 1 } else { 2 } }\n", NULL, 0, 1},
+    // a mutable global is not known at compile time.
+    {"let mut m: i64 = 1;\nfn get() i64 { m }\nlet X = get();\n", NULL, 0, 0},
+  };
+
+  for(u32 i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    i64 value = 0;
+    bool passed = eval_source(table, tests[i].source, tests[i].name, tests[i].errors, &value);
+    assert(passed and value == tests[i].value);
+  }
+  printf("eval_test: %u cases\n", (u32) (sizeof(tests) / sizeof(tests[0])));
+}
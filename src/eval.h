@@ -0,0 +1,153 @@
+#ifndef EVAL_H_
+#define EVAL_H_
+
+#include "entity.h"
+#include "type.h"
+
+// Compile-time evaluation
+//
+// A constant whose initializer does not fold, because it calls a function
+// or loops, and the condition of a 'when' are evaluated by interpreting
+// their checked code. The expression and every function it calls are
+// compiled to bytecode from the types and entities the checker recorded for
+// them, each function once, and run on a stack machine. An evaluation stops
+// with an error after max_steps instructions or when its stack and arrays
+// need more than max_memory bytes.
+//
+// The code can only change its own locals, so functions are pure and a call
+// with the same scalar arguments is run once. Code using something not
+// known at compile time, pointers, structs or mutable globals, does not
+// compile and its value is not a constant. Integers wrap like they would at
+// run time, a division by zero or an index out of range is an error.
+//
+// The elements of an array value are a stretchy buffer. The arrays of the
+// constants are interned, so equal tables share their elements.
+
+typedef struct Checker Checker;
+
+#define EVALOPS \
+  EVALOP(Const) \
+  EVALOP(Unit) \
+  EVALOP(Load) \
+  EVALOP(Store) \
+  EVALOP(Pop) \
+  EVALOP(Dup) \
+  EVALOP(Binary) \
+  EVALOP(Unary) \
+  EVALOP(Convert) \
+  EVALOP(Jump) \
+  EVALOP(JumpFalse) \
+  EVALOP(JumpTrue) \
+  EVALOP(Call) \
+  EVALOP(Return) \
+  EVALOP(Array) \
+  EVALOP(Index) \
+  EVALOP(SetIndex) \
+  EVALOP(Length)
+
+typedef enum EvalOp {
+#define EVALOP(n) Op_##n,
+  EVALOPS
+#undef EVALOP
+} EvalOp;
+
+// an instruction, the operation in the low 8 bits and its operand in the
+// others: an index into the constants, operations or callees of the code, a
+// slot, a jump target or the number of elements of an array.
+typedef u32 Instr;
+
+// the operator and type of a Binary, Unary or Convert instruction.
+typedef struct EvalOperation {
+  TokenKind op;
+  ValueType type;
+} EvalOperation;
+
+typedef enum EvalCodeState {
+  Code_Compiling,
+  Code_Valid,
+  // the code uses something not known at compile time.
+  Code_Invalid,
+} EvalCodeState;
+
+// the code of a function, or of an expression which has no parameters.
+typedef struct EvalCode {
+  EvalCodeState state;
+  Entity* entity;
+  Instr* code;
+  // the expression of each instruction, errors are reported at it.
+  Expr** exprs;
+  Value* constants;
+  EvalOperation* operations;
+  Entity** callees;
+  u32 num_params;
+  u32 num_slots;
+} EvalCode;
+
+typedef struct EvalFrame {
+  EvalCode* code;
+  u32 pc;
+  // the first slot on the stack, the parameters are the first slots.
+  u32 base;
+  // the arguments when the result of the call is memoized.
+  Value* args;
+} EvalFrame;
+
+typedef struct EvalMemo {
+  u64 hash;
+  Entity* function;
+  Value* args;
+  Value result;
+} EvalMemo;
+
+typedef enum EvalStatus {
+  Eval_Ok,
+  // the value is not known at compile time.
+  Eval_Unknown,
+  // the evaluation failed, which is reported.
+  Eval_Failed,
+} EvalStatus;
+
+typedef struct Evaluator {
+  // function Entity to its EvalCode.
+  Map functions;
+  EvalCode** codes;
+  // calls and their results, open addressed on the hash of the function
+  // and the arguments.
+  EvalMemo* memo;
+  u32 memo_cap;
+  u32 memo_num;
+  // interned arrays, open addressed on the hash of their elements.
+  Value* arrays;
+  u32 arrays_cap;
+  u32 arrays_num;
+
+  // the running evaluation.
+  Value* stack;
+  EvalFrame* frames;
+  // the arrays it allocated, freed when it ends.
+  Value** heap;
+  u64 heap_size;
+  u64 steps;
+
+  u64 max_steps;
+  u64 max_memory;
+
+  u32 evaluations;
+  u64 total_steps;
+  u64 memo_hits;
+} Evaluator;
+
+void init_evaluator(Evaluator* eval);
+
+void destroy_evaluator(Evaluator* eval);
+
+// evaluates the checked expression as a value of type, what names it in
+// errors.
+EvalStatus evaluate(Checker* checker, Expr* expr, Type* type, const char* what, Value* result);
+
+// the hash of a value, an array by the address of its elements.
+u64 hash_value(Value value);
+
+void eval_test(StringTable* table);
+
+#endif
@@ -0,0 +1,192 @@
+#include "fingerprint.h"
+#include "parser.h"
+#include "report.h"
+#include "visit.h"
+
+typedef struct Fingerprint {
+  u64 hash;
+  // the body of the function whose signature is taken, not visited.
+  Expr* skip;
+  // a body is taken.
+  bool body;
+  bool unstable;
+} Fingerprint;
+
+// the kinds of the nodes are told apart by the hook adding them.
+enum {
+  Print_Item = 1,
+  Print_Stmt,
+  Print_Expr,
+  Print_Spec,
+  Print_Pat,
+  Print_Clause,
+  Print_Ident,
+  Print_Token,
+  Print_Mut,
+  Print_End,
+};
+
+void add_fingerprint(Fingerprint* print, u64 value) {
+  print->hash = hash_mix(print->hash, value);
+}
+
+void add_node(Fingerprint* print, u32 node, u32 kind) {
+  add_fingerprint(print, ((u64) node << 32) | kind);
+}
+
+bool fingerprint_item(void* data, Item* item) {
+  Fingerprint* print = (Fingerprint*) data;
+  if(item->kind == ItemFunction and print->body)
+    print->unstable = true;
+  add_node(print, Print_Item, item->kind);
+  return true;
+}
+
+bool fingerprint_stmt(void* data, Stmt* stmt) {
+  add_node((Fingerprint*) data, Print_Stmt, stmt->kind);
+  return true;
+}
+
+bool fingerprint_expr(void* data, Expr* expr) {
+  Fingerprint* print = (Fingerprint*) data;
+  if(expr == print->skip)
+    return false;
+  if(expr->kind == When)
+    print->unstable = true;
+  add_node(print, Print_Expr, expr->kind);
+  return true;
+}
+
+bool fingerprint_spec(void* data, TypeSpec* spec) {
+  add_node((Fingerprint*) data, Print_Spec, spec->kind);
+  return true;
+}
+
+bool fingerprint_pat(void* data, Pattern* pat) {
+  add_node((Fingerprint*) data, Print_Pat, pat->kind);
+  return true;
+}
+
+bool fingerprint_clause(void* data, Clause* clause) {
+  UNUSED(clause);
+  add_node((Fingerprint*) data, Print_Clause, 0);
+  return true;
+}
+
+bool fingerprint_ident(void* data, Ident* ident) {
+  Fingerprint* print = (Fingerprint*) data;
+  add_node(print, Print_Ident, 0);
+  add_fingerprint(print, hash_bytes(ident->value, strlen(ident->value)));
+  return true;
+}
+
+// a literal by its value and suffix, the other tokens by their kind.
+bool fingerprint_token(void* data, Token* token) {
+  Fingerprint* print = (Fingerprint*) data;
+  add_node(print, Print_Token, token->kind);
+  u64 value = 0;
+  switch(token->kind) {
+    case Tkn_IntLiteral: value = hash_uint64((u64) token->literal.value_i64); break;
+    case Tkn_FloatLiteral: value = hash_bytes(&token->literal.value_float, sizeof(f64)); break;
+    case Tkn_CharLiteral: value = hash_uint64((u64) token->literal.value_char); break;
+    case Tkn_StrLiteral:
+      value = hash_bytes(token->literal.value_string.value, token->literal.value_string.len);
+      break;
+    default:
+      return true;
+  }
+  add_fingerprint(print, hash_mix(value, token->type));
+  return true;
+}
+
+bool fingerprint_mut(void* data, Mutability* mut) {
+  add_node((Fingerprint*) data, Print_Mut, *mut);
+  return true;
+}
+
+#define VISITKIND(name, type) \
+  void fingerprint_end_##name(void* data, type* name) { \
+    UNUSED(name); \
+    add_node((Fingerprint*) data, Print_End, 0); \
+  }
+VISITKINDS
+#undef VISITKIND
+
+Visitor fingerprint_visitor(Fingerprint* print) {
+  Visitor visitor;
+  memset(&visitor, 0, sizeof(Visitor));
+  visitor.pre_item = fingerprint_item;
+  visitor.pre_stmt = fingerprint_stmt;
+  visitor.pre_expr = fingerprint_expr;
+  visitor.pre_spec = fingerprint_spec;
+  visitor.pre_pat = fingerprint_pat;
+  visitor.pre_clause = fingerprint_clause;
+  visitor.pre_ident = fingerprint_ident;
+  visitor.pre_token = fingerprint_token;
+  visitor.pre_mut = fingerprint_mut;
+  visitor.post_item = fingerprint_end_item;
+  visitor.post_stmt = fingerprint_end_stmt;
+  visitor.post_expr = fingerprint_end_expr;
+  visitor.post_spec = fingerprint_end_spec;
+  visitor.post_pat = fingerprint_end_pat;
+  visitor.post_clause = fingerprint_end_clause;
+  visitor.data = print;
+  return visitor;
+}
+
+u64 signature_fingerprint(Item* item) {
+  Fingerprint print = {0, NULL, false, false};
+  if(item->kind == ItemFunction)
+    print.skip = item->function.body;
+  Visitor visitor = fingerprint_visitor(&print);
+  visit_item(&visitor, item);
+  return print.hash;
+}
+
+u64 body_fingerprint(Item* function, bool* unstable) {
+  Fingerprint print = {0, NULL, true, false};
+  Visitor visitor = fingerprint_visitor(&print);
+  if(function->function.body)
+    visit_expr(&visitor, function->function.body);
+  *unstable = print.unstable;
+  return print.hash;
+}
+
+u64 source_fingerprint(StringTable* table, const char* source, bool body, bool* unstable) {
+  File file = {"<fingerprint_test>", (char*) source, strlen(source), NULL};
+  AstFile* ast = parse_file(&file, table);
+  assert(ast and ast_num_items(ast) == 1);
+  Item* item = ast->items[0];
+  u64 hash = body ? body_fingerprint(item, unstable) : signature_fingerprint(item);
+  destroy_ast_file(ast);
+  return hash;
+}
+
+// moving an item or changing its body keeps its signature, any other
+// change to the tree does not.
+void fingerprint_test(StringTable* table) {
+  bool unstable = false;
+  u64 sig = source_fingerprint(table, "fn f(a: i32) i32 { a + 1 }\n", false, NULL);
+  assert(sig == source_fingerprint(table, "\n\n  fn f(a: i32)\n  i32 { a + 1 }\n", false, NULL));
+  assert(sig == source_fingerprint(table, "fn f(a: i32) i32 { a * 2 }\n", false, NULL));
+  assert(sig != source_fingerprint(table, "fn f(a: i64) i32 { a + 1 }\n", false, NULL));
+  assert(sig != source_fingerprint(table, "fn f(b: i32) i32 { a + 1 }\n", false, NULL));
+  assert(sig != source_fingerprint(table, "fn f(a: i32) { a + 1 }\n", false, NULL));
+
+  u64 body = source_fingerprint(table, "fn f(a: i32) i32 { a + 1 }\n", true, &unstable);
+  assert(!unstable);
+  assert(body == source_fingerprint(table, "fn f(b: i64) i32 {\n  a + 1\n}\n", true, &unstable));
+  assert(body != source_fingerprint(table, "fn f(a: i32) i32 { a + 2 }\n", true, &unstable));
+  assert(body != source_fingerprint(table, "fn f(a: i32) i32 { a - 1 }\n", true, &unstable));
+  assert(body != source_fingerprint(table, "fn f(a: i32) i32 { a + 1u8 }\n", true, &unstable));
+  source_fingerprint(table, "fn f() i32 { fn g() i32 { 1 } g() }\n", true, &unstable);
+  assert(unstable);
+  source_fingerprint(table, "fn f() i32 { when true { 1 } else { 2 } }\n", true, &unstable);
+  assert(unstable);
+
+  assert(source_fingerprint(table, "let a = \"ab\";\n", false, NULL) !=
+    source_fingerprint(table, "let a = \"ac\";\n", false, NULL));
+  assert(source_fingerprint(table, "struct P { x: i32 }\n", false, NULL) !=
+    source_fingerprint(table, "struct P { x: i32, y: i32 }\n", false, NULL));
+  printf("fingerprint_test: passed\n");
+}
@@ -0,0 +1,27 @@
+#ifndef FINGERPRINT_H_
+#define FINGERPRINT_H_
+
+#include "ast.h"
+
+// Fingerprints
+//
+// A fingerprint is a hash of a tree that does not depend on where its nodes
+// are, so an item that moved or whose file changed above it keeps its
+// fingerprint. Every node adds its kind before its children and an end
+// marker after them, names are hashed by their characters and literals by
+// their values.
+//
+// The signature of an item is the item without the body of a function,
+// which is what the items using it see. The body has its own fingerprint.
+
+// the fingerprint of the item, without the body of a function.
+u64 signature_fingerprint(Item* item);
+
+// the fingerprint of the body of the function. unstable is set when the
+// body declares functions or has a 'when', which depend on more than the
+// signatures of the items the body uses.
+u64 body_fingerprint(Item* function, bool* unstable);
+
+void fingerprint_test(StringTable* table);
+
+#endif
@@ -20,6 +20,42 @@ File* read_file(const char* path) {
   
   file->content[size] = 0;
   file->len = size;
+  file->lines = NULL;
 
   return file;
 }
+
+const char* file_line(File* file, u32 line, u64* len) {
+  if(!file->lines) {
+    buf_push(file->lines, 0);
+    for(u64 i = 0; i < file->len; ++i) {
+      if(file->content[i] == '\n')
+        buf_push(file->lines, i + 1);
+    }
+  }
+  if(line == 0 or line > buf_len(file->lines))
+    return NULL;
+  u64 begin = file->lines[line - 1];
+  u64 end = line < buf_len(file->lines) ? file->lines[line] - 1 : file->len;
+  if(end > begin and file->content[end - 1] == '\r')
+    --end;
+  *len = end - begin;
+  return file->content + begin;
+}
+
+void replace_text(File* file, u64 begin, u64 end, const char* text, u64 len) {
+  assert(begin <= end and end <= file->len);
+  u64 size = file->len - (end - begin) + len;
+  char* content = malloc(size + 1);
+
+  memcpy(content, file->content, begin);
+  memcpy(content + begin, text, len);
+  memcpy(content + begin + len, file->content + end, file->len - end);
+  content[size] = 0;
+
+  free(file->content);
+  file->content = content;
+  file->len = size;
+  // the line index is built again when needed.
+  buf_free(file->lines);
+}
@@ -7,8 +7,17 @@ typedef struct File {
   char* fullpath; //< will be copied
   char* content;
   u64 len;
+  // offsets of the starts of the lines, built by file_line.
+  u64* lines;
 } File;
 
 File* read_file(const char* path);
 
+// the text of a line, counted from one, without its line break. NULL when
+// the file has fewer lines.
+const char* file_line(File* file, u32 line, u64* len);
+
+// replaces the bytes [begin, end) of the file contents with text.
+void replace_text(File* file, u64 begin, u64 end, const char* text, u64 len);
+
 #endif // IO_H_
@@ -5,6 +5,8 @@
 #include <assert.h>
 #include <ctype.h>
 
+extern bool debug;
+
 typedef struct Scanner Scanner;
 
 Token scan_token(Scanner* scanner);
@@ -12,26 +14,11 @@ Token scan_token(Scanner* scanner);
 const char* substr(const char* src, u64 start, u64 len);
 ExpectedType scan_literal_suffix(Scanner* scanner);
 
+// interns a null terminated stretchy buffer and frees it.
 const char* table_get_string(StringTable* table, char* string) {
-  u64 index = 0;
-  if(table_contains(table, string)) {
-    u64 hash = string_hash(string, strlen(string));
-    u64 index = hash % table->cap;
-    const char* temp = table->strings[index];
-    buf_free(string);
-    return temp;
-  }
-  else {
-    u32 len = buf_len(string);
-    char* temp = (char*) malloc(sizeof(char) * (len + 1));
-    memcpy(temp, string, len);
-    temp[len] = 0;
-    buf_free(string);
-
-    const char* val = table_insert_string(table, temp);
-    free(temp);
-    return val;
-  }
+  const char* val = table_insert_string(table, string);
+  buf_free(string);
+  return val;
 }
 
 typedef struct Scanner {
@@ -59,10 +46,10 @@ Scanner new_scanner(File* file, StringTable* table) {
 Token* get_tokens(File* file, u32* num, StringTable* table) {
   Token* tokens = NULL;
   Scanner scanner = new_scanner(file, table);
-  assert(scanner.table->cap == 1024);
   while(true) {
     Token token = scan_token(&scanner);
-    print_token(&token);
+    if(debug)
+      print_token(&token);
     buf_push(tokens, token);
     if(token.kind == Tkn_Eof)
       break;
@@ -72,6 +59,31 @@ Token* get_tokens(File* file, u32* num, StringTable* table) {
   return tokens;
 }
 
+Token* get_tokens_from(File* file, StringTable* table, Token from, const u64* stops, u32 num_stops,
+  u32* stop, Token* last) {
+  Token* tokens = NULL;
+  Scanner scanner = new_scanner(file, table);
+  scanner.index = from.index;
+  scanner.line = from.line;
+  scanner.column = from.column;
+
+  u32 i = 0;
+  while(true) {
+    Token token = scan_token(&scanner);
+    while(i < num_stops and stops[i] < token.index)
+      ++i;
+    if(i < num_stops and stops[i] == token.index) {
+      *last = token;
+      break;
+    }
+    buf_push(tokens, token);
+    if(token.kind == Tkn_Eof)
+      break;
+  }
+  *stop = i;
+  return tokens;
+}
+
 bool is_eof(Scanner* scanner);
 Token scan_identifier(Scanner* scanner);
 Token scan_string(Scanner* scanner);
@@ -146,7 +158,6 @@ bool is_number(char ch) {
 	} break;
 
 Token scan_token(Scanner* scanner) {
-  assert(scanner->table->cap == 1024);
   while(Current(scanner) == '\t' or
         Current(scanner) == ' '  or
         Current(scanner) == '\v' or
@@ -217,7 +228,7 @@ Token scan_token(Scanner* scanner) {
         return scan_string(scanner);
       }
       default:
-        scan_error(scanner->file, scanner->line, scanner->column, "unrecognized character: '%c'\n", Current(scanner));
+        scan_error(scanner->file, save.line, save.column, "unrecognized character: '%c'\n", ch);
     }
   }
   return BUILD_TOKEN(Tkn_Error, scanner);
@@ -250,7 +261,7 @@ Token scan_identifier(Scanner* scanner) {
 Token scan_string(Scanner* scanner) {
   Scanner save = *scanner;
   char* buffer = NULL;
-  while(Current(scanner) != '"') {
+  while(!is_eof(scanner) and Current(scanner) != '"') {
     if(Current(scanner) == '\\')
       buf_push(buffer, validate_escape(scanner));
     else
@@ -258,11 +269,15 @@ Token scan_string(Scanner* scanner) {
 
     advance(scanner);
   }
-  // buf_push(buffer, '\0');
-  u64 size = scanner->index - save.index;
+  buf_push(buffer, '\0');
+  // the token starts at the opening quote.
+  u64 start = save.index - 1;
+  if(is_eof(scanner))
+    scan_error(scanner->file, save.line, save.column - 1, "unterminated string literal\n");
   advance(scanner);
+  // the buffer is freed by the table.
   const char* str = table_get_string(scanner->table, buffer);
-  return new_string_token(buffer, size, save.line, save.column, size, save.index);
+  return new_string_token(str, strlen(str), save.line, save.column - 1, scanner->index - start, start);
 }
 
 
@@ -357,7 +372,13 @@ Token scan_character(Scanner* scanner) {
     default:
       temp = Current(scanner);
   }
-  return new_char_token(temp, save.line, save.column, 1, save.index);
+  advance(scanner);
+  if(Check('\'', scanner))
+    advance(scanner);
+  else
+    scan_error(scanner->file, scanner->line, scanner->column, "expecting ' to close character literal\n");
+  // the token starts at the opening quote.
+  return new_char_token(temp, save.line, save.column - 1, scanner->index - (save.index - 1), save.index - 1);
 }
 
 Token scan_comment(Scanner* scanner) {
@@ -499,15 +520,18 @@ ExpectedType scan_literal_suffix(Scanner* scanner) {
     //print_token(&token);
     const char* val = get_string(&token);
     ExpectedType type = NoType;
-    if(strcmp(val, "i8") == 0)
+    // keywords, like the 'fn' in '1fn', are never a suffix.
+    if(token.kind != Tkn_Identifier)
+      *scanner = save;
+    else if(strcmp(val, "i8") == 0)
       type = I8;
     else if(strcmp(val, "i16") == 0)
       type = I16;
-    else if(strcmp(val, "i16") == 0)
+    else if(strcmp(val, "i32") == 0)
       type = I32;
-    else if(strcmp(val, "i16") == 0)
+    else if(strcmp(val, "i64") == 0)
       type = I64;
-    else if(strcmp(val, "u86") == 0)
+    else if(strcmp(val, "u8") == 0)
       type = U8;
     else if(strcmp(val, "u16") == 0)
       type = U16;
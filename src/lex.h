@@ -6,6 +6,13 @@ typedef struct Token Token;
 
 Token* get_tokens(File* file, u32* num, StringTable* table);
 
+// scans from the position of the token from until a token begins at one of
+// the sorted byte offsets in stops. That token is written to last and is not
+// part of the result. *stop is set to its position in stops, or to num_stops
+// when the result ends with the eof token instead.
+Token* get_tokens_from(File* file, StringTable* table, Token from, const u64* stops, u32 num_stops,
+  u32* stop, Token* last);
+
 void scan_test(File* file);
 
 #endif
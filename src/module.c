@@ -0,0 +1,398 @@
+// realpath
+#define _XOPEN_SOURCE 700
+
+#include "module.h"
+#include "parser.h"
+
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct LoadTask {
+  ModuleLoader* loader;
+  Module* module;
+  // path the file is read from, the roots keep the path they were given as.
+  const char* source;
+} LoadTask;
+
+void free_file(File* file) {
+  free(file->fullpath);
+  free(file->content);
+  buf_free(file->lines);
+  free(file);
+}
+
+// drops what was found in the tree of the module.
+void clear_module_imports(Module* module) {
+  buf_free(module->imports);
+  buf_free(module->import_items);
+  buf_free(module->import_lengths);
+  clear_report_buffer(&module->report);
+  module->stale = false;
+  module->missing_imports = false;
+}
+
+// drops everything loaded for the module.
+void reset_module(Module* module) {
+  if(module->ast)
+    destroy_ast_file(module->ast);
+  if(module->file)
+    free_file(module->file);
+  module->ast = NULL;
+  module->file = NULL;
+  clear_module_imports(module);
+}
+
+// updates the tree of the module to the text of file with reparse_file, the
+// edit being the bytes between the prefix and the suffix the old and the new
+// text share. Only a tree parsed from tokens with the flags of the load and
+// without diagnostics is updated, the items it keeps have none. Returns
+// false when the file has to be parsed from scratch.
+bool reparse_module(ModuleLoader* loader, Module* module, File* file) {
+  AstFile* ast = module->ast;
+  if(!ast or !ast->tokens or ast->truncated or module->flags != loader->flags or
+     buf_len(module->report.diagnostics) or strcmp(module->file->fullpath, file->fullpath) != 0)
+    return false;
+
+  File* old = module->file;
+  u64 len = old->len < file->len ? old->len : file->len;
+  u64 prefix = 0;
+  while(prefix < len and old->content[prefix] == file->content[prefix])
+    ++prefix;
+  u64 suffix = 0;
+  while(suffix < len - prefix and old->content[old->len - suffix - 1] == file->content[file->len - suffix - 1])
+    ++suffix;
+  SourceEdit edit = {prefix, old->len - suffix, file->len - suffix};
+
+  // the kept items point to the file, its text is replaced in place.
+  clear_module_imports(module);
+  replace_text(old, edit.begin, edit.end, file->content + edit.begin, edit.new_end - edit.begin);
+  free_file(file);
+  reparse_file(ast, edit, loader->table);
+  atomic_fetch_add(&loader->reparsed, 1);
+  return true;
+}
+
+u64 file_time(struct stat* st) {
+  return (u64) st->st_mtim.tv_sec * 1000000000ull + st->st_mtim.tv_nsec;
+}
+
+// a module has not changed when its file has the same modification time and
+// size, or else the same contents. The diagnostics name the file by the path
+// it was read from, so it is also read again when given by another path.
+bool module_changed(Module* module, const char* source) {
+  struct stat st;
+  if(!module->file or strcmp(module->file->fullpath, source) != 0 or stat(source, &st) != 0)
+    return true;
+  if(file_time(&st) == module->mtime and (u64) st.st_size == module->file->len)
+    return false;
+
+  File* file = read_file(source);
+  bool changed = !file or file->len != module->file->len or
+    memcmp(file->content, module->file->content, file->len) != 0;
+  if(!changed)
+    module->mtime = file_time(&st);
+  if(file)
+    free_file(file);
+  return changed;
+}
+
+ModuleLoader new_module_loader(StringTable* table, Pool* pool, ParseCache* cache, u32 flags) {
+  ModuleLoader loader;
+  memset(&loader, 0, sizeof(ModuleLoader));
+  loader.table = table;
+  loader.pool = pool;
+  loader.cache = cache;
+  loader.flags = flags;
+  pthread_mutex_init(&loader.lock, NULL);
+  atomic_init(&loader.group.pending, 0);
+  atomic_init(&loader.loaded, 0);
+  atomic_init(&loader.reparsed, 0);
+  loader.generation = 1;
+  return loader;
+}
+
+void destroy_module_loader(ModuleLoader* loader) {
+  for(u32 i = 0; i < buf_len(loader->found); ++i) {
+    Module* module = loader->found[i];
+    reset_module(module);
+    free(module);
+  }
+  buf_free(loader->found);
+  buf_free(loader->roots);
+  for(u32 i = 0; i < buf_len(loader->root_dirs); ++i)
+    buf_free(loader->root_dirs[i]);
+  buf_free(loader->root_dirs);
+  free(loader->modules.keys);
+  free(loader->modules.vals);
+  pthread_mutex_destroy(&loader->lock);
+}
+
+// the interned real path of a file, NULL when it does not exist.
+const char* module_path(ModuleLoader* loader, const char* path) {
+  char* real = realpath(path, NULL);
+  if(!real)
+    return NULL;
+  const char* result = table_insert_string(loader->table, real);
+  free(real);
+  return result;
+}
+
+// finds the file of the module named by a use item. The longest prefix of
+// the path naming a file is the module, the rest of it names items. The
+// length of the prefix is stored in path_len.
+const char* find_module_file(ModuleLoader* loader, const char* dir, Item* use, u32* path_len) {
+  char* file = NULL;
+  const char* result = NULL;
+  const char** dirs = NULL;
+  buf_push(dirs, dir);
+  // roots can still be added by load_module.
+  pthread_mutex_lock(&loader->lock);
+  for(u32 i = 0; i < buf_len(loader->root_dirs); ++i)
+    buf_push(dirs, loader->root_dirs[i]);
+  pthread_mutex_unlock(&loader->lock);
+  for(u32 i = 0; i < buf_len(loader->search_paths); ++i)
+    buf_push(dirs, loader->search_paths[i]);
+
+  for(u32 len = use->use.num_path; len > 0 and !result; --len) {
+    for(u32 i = 0; i < buf_len(dirs) and !result; ++i) {
+      buf_clear(file);
+      buf_printf(file, "%s", dirs[i]);
+      for(u32 j = 0; j < len; ++j)
+        buf_printf(file, "/%s", use->use.path[j]->value);
+      buf_printf(file, ".oxy");
+      if(access(file, R_OK) == 0) {
+        result = module_path(loader, file);
+        *path_len = len;
+      }
+    }
+  }
+  buf_free(file);
+  buf_free(dirs);
+  return result;
+}
+
+// the directory of a real path.
+char* module_dir(const char* path) {
+  char* dir = NULL;
+  const char* slash = strrchr(path, '/');
+  buf_printf(dir, "%.*s", (int) (slash - path), path);
+  return dir;
+}
+
+void load_module_task(void* data);
+
+// returns the module of the path. The first call for a path in a load
+// schedules its loading, unless it is unchanged since an earlier load.
+Module* add_module(ModuleLoader* loader, const char* path, const char* source) {
+  pthread_mutex_lock(&loader->lock);
+  Module* module = map_get(&loader->modules, path);
+  if(!module) {
+    module = (Module*) calloc(1, sizeof(Module));
+    module->path = path;
+    map_put(&loader->modules, path, module);
+    buf_push(loader->found, module);
+  }
+  bool visit = module->generation != loader->generation;
+  module->generation = loader->generation;
+  if(visit)
+    module->streamed = false;
+  pthread_mutex_unlock(&loader->lock);
+
+  if(!visit)
+    return module;
+
+  // a tree parsed with a smaller error budget may be missing items.
+  bool truncated = module->ast and module->ast->truncated;
+  if(!module->stale and !truncated and module->flags == loader->flags and !module_changed(module, source)) {
+    // the imports are checked as well.
+    for(u32 i = 0; i < buf_len(module->imports); ++i)
+      add_module(loader, module->imports[i]->path, module->imports[i]->path);
+    return module;
+  }
+
+  LoadTask* task = (LoadTask*) malloc(sizeof(LoadTask));
+  *task = (LoadTask) {loader, module, source};
+  if(loader->pool)
+    pool_submit_group(loader->pool, &loader->group, load_module_task, task);
+  else
+    load_module_task(task);
+  return module;
+}
+
+void load_module_task(void* data) {
+  LoadTask task = *(LoadTask*) data;
+  free(data);
+  ModuleLoader* loader = task.loader;
+  Module* module = task.module;
+
+  ReportBuffer* old = set_report_buffer(&module->report);
+  struct stat st;
+  u64 mtime = stat(task.source, &st) == 0 ? file_time(&st) : 0;
+  File* file = read_file(task.source);
+  // a file edited since it was parsed is only parsed again around the edit.
+  if(!file or !reparse_module(loader, module, file)) {
+    reset_module(module);
+    module->file = file;
+    if(file and loader->cache)
+      module->ast = cached_parse(loader->cache, module->file, loader->table, loader->flags, loader->pool);
+    else if(file)
+      module->ast = parse_file_parallel(module->file, loader->table, loader->flags, loader->pool);
+  }
+  module->mtime = mtime;
+  module->flags = loader->flags;
+  if(module->file) {
+    char* dir = module_dir(module->path);
+
+    // only the use items in file scope are followed.
+    for(u32 i = 0; i < ast_num_items(module->ast); ++i) {
+      Item* item = module->ast->items[i];
+      if(item->kind != ItemUse)
+        continue;
+      u32 path_len = 0;
+      const char* path = find_module_file(loader, dir, item, &path_len);
+      if(path) {
+        buf_push(module->imports, add_module(loader, path, path));
+        buf_push(module->import_items, item);
+        buf_push(module->import_lengths, path_len);
+      }
+      else {
+        char* name = NULL;
+        for(u32 j = 0; j < item->use.num_path; ++j)
+          buf_printf(name, j == 0 ? "%s" : ".%s", item->use.path[j]->value);
+        syntax_error(item->loc, "unable to find module '%s'\n", name);
+        buf_free(name);
+        module->missing_imports = true;
+      }
+    }
+    buf_free(dir);
+  }
+  set_report_buffer(old);
+  atomic_fetch_add(&loader->loaded, 1);
+
+  if(loader->stream) {
+    pthread_mutex_lock(&loader->lock);
+    print_report_buffer(&module->report);
+    fflush(stdout);
+    module->streamed = true;
+    pthread_mutex_unlock(&loader->lock);
+  }
+}
+
+Module* load_module(ModuleLoader* loader, const char* path) {
+  const char* real = module_path(loader, path);
+  if(!real)
+    return NULL;
+  pthread_mutex_lock(&loader->lock);
+  buf_push(loader->root_dirs, module_dir(real));
+  pthread_mutex_unlock(&loader->lock);
+  Module* module = add_module(loader, real, path);
+  buf_push(loader->roots, module);
+  return module;
+}
+
+void begin_modules(ModuleLoader* loader) {
+  ++loader->generation;
+  atomic_store(&loader->loaded, 0);
+  atomic_store(&loader->reparsed, 0);
+  buf_clear(loader->roots);
+  for(u32 i = 0; i < buf_len(loader->root_dirs); ++i)
+    buf_free(loader->root_dirs[i]);
+  buf_clear(loader->root_dirs);
+}
+
+void invalidate_module(ModuleLoader* loader, const char* path, bool created_or_removed) {
+  path = table_insert_string(loader->table, path);
+  pthread_mutex_lock(&loader->lock);
+  Module* module = map_get(&loader->modules, path);
+  if(module)
+    module->stale = true;
+  if(created_or_removed) {
+    for(u32 i = 0; i < buf_len(loader->found); ++i) {
+      Module* other = loader->found[i];
+      if(other->missing_imports)
+        other->stale = true;
+      for(u32 j = 0; j < buf_len(other->imports) and module; ++j) {
+        if(other->imports[j] == module)
+          other->stale = true;
+      }
+    }
+  }
+  pthread_mutex_unlock(&loader->lock);
+}
+
+void wait_modules(ModuleLoader* loader) {
+  if(loader->pool)
+    pool_wait_group(loader->pool, &loader->group);
+}
+
+void order_module(Module* module, Map* visited, Module*** order) {
+  if(map_get(visited, module))
+    return;
+  map_put(visited, module, module);
+  buf_push(*order, module);
+  for(u32 i = 0; i < buf_len(module->imports); ++i)
+    order_module(module->imports[i], visited, order);
+}
+
+Module** ordered_modules(ModuleLoader* loader) {
+  Module** order = NULL;
+  Map visited = {0};
+  for(u32 i = 0; i < buf_len(loader->roots); ++i)
+    order_module(loader->roots[i], &visited, &order);
+  free(visited.keys);
+  free(visited.vals);
+  return order;
+}
+
+// loads a file again after each edit of it. A tree without errors is only
+// parsed again around the edit and has to match parsing the edited text
+// from scratch, one with errors is parsed from scratch.
+void module_test(StringTable* table) {
+  const char* path = "module_test.oxy";
+  struct {
+    const char* text;
+    bool reparsed;
+    u32 errors;
+  } edits[] = {
+    {"fn f() i32 { 1 }\nfn g() i32 { 2 }\nstruct S { x: i32 }\n", false, 0},
+    {"fn f() i32 { 1 }\nfn h() i32 { 3 }\nfn g() i32 { 2 }\nstruct S { x: i32 }\n", true, 0},
+    {"fn f() i32 { 1 }\nfn h() i32 { 3 }\nfn g() i32 { 2 }\nstruct S { x: i32, y: f32 }\n", true, 0},
+    {"fn f() i32 { 1 }\nfn h() i32 { 3 + }\nfn g() i32 { 2 }\nstruct S { x: i32, y: f32 }\n", true, 1},
+    {"fn f() i32 { 1 }\nfn h() i32 { 3 }\nfn g() i32 { 2 }\nstruct S { x: i32, y: f32 }\n", false, 0},
+    {"fn g() i32 { 2 }\nstruct S { x: i32, y: f32 }\n", true, 0},
+  };
+
+  ModuleLoader loader = new_module_loader(table, NULL, NULL, Parse_Default);
+  for(u32 i = 0; i < sizeof(edits) / sizeof(edits[0]); ++i) {
+    FILE* out = fopen(path, "wb");
+    assert(out);
+    fputs(edits[i].text, out);
+    fclose(out);
+
+    begin_modules(&loader);
+    Module* module = load_module(&loader, path);
+    wait_modules(&loader);
+    assert(module and module->ast);
+    assert(atomic_load(&loader.reparsed) == edits[i].reparsed);
+    assert(report_error_count(&module->report) == edits[i].errors);
+
+    File file = {module->file->fullpath, (char*) edits[i].text, strlen(edits[i].text), NULL};
+    ReportBuffer buffer = {NULL};
+    ReportBuffer* old = set_report_buffer(&buffer);
+    AstFile* expected = parse_file(&file, table);
+    set_report_buffer(old);
+    clear_report_buffer(&buffer);
+    assert(module->file->len == file.len and memcmp(module->file->content, file.content, file.len) == 0);
+    assert(ast_num_items(module->ast) == ast_num_items(expected));
+    for(u32 j = 0; j < ast_num_items(expected); ++j) {
+      assert(module->ast->items[j]->kind == expected->items[j]->kind);
+      assert(module->ast->items[j]->loc.line == expected->items[j]->loc.line);
+      assert(module->ast->item_tokens[j] == expected->item_tokens[j]);
+    }
+    destroy_ast_file(expected);
+  }
+  destroy_module_loader(&loader);
+  remove(path);
+  printf("module_test: %u edits\n", (u32) (sizeof(edits) / sizeof(edits[0])));
+}
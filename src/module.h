@@ -0,0 +1,101 @@
+#ifndef MODULE_H_
+#define MODULE_H_
+
+#include "cache.h"
+#include "report.h"
+
+// Module loading
+//
+// Every file is a module. The use items of a parsed module name the modules
+// it imports, 'use a.b.{c};' is found as a/b.oxy, or as a.oxy when there is
+// no such file, next to the importing file, next to one of the files given to
+// load_module or in one of the module paths.
+// A module is submitted to the pool as soon as an import of it is found, so
+// independent imports are parsed in parallel and loading takes about as long
+// as the longest chain of imports. Each file is only loaded once.
+
+typedef struct Module {
+  // real path of the file, interned.
+  const char* path;
+  File* file;
+  AstFile* ast;
+  // diagnostics of the module, kept as long as the module is not reloaded.
+  ReportBuffer report;
+  // imported modules, in the order of the use items.
+  struct Module** imports;
+  // the use item of each import and the number of names of its path naming
+  // the module, the rest name an item of the module.
+  Item** import_items;
+  u32* import_lengths;
+
+  // modification time of the file when it was read, in nanoseconds.
+  u64 mtime;
+  // parse flags of the load that read the file.
+  u32 flags;
+  // the last load the module was part of.
+  u32 generation;
+  // set by invalidate_module, the file is read again by the next load.
+  bool stale;
+  // a use item of the module named a file that was not found.
+  bool missing_imports;
+  // the diagnostics were printed when the current load read the module.
+  bool streamed;
+} Module;
+
+typedef struct ModuleLoader {
+  StringTable* table;
+  // modules are loaded on the calling thread when NULL.
+  Pool* pool;
+  ParseCache* cache;
+  u32 flags;
+  // directories searched after the directory of the importing file and the
+  // directories of the roots.
+  const char** search_paths;
+
+  pthread_mutex_t lock;
+  // path to Module.
+  Map modules;
+  // modules in the order they were found, this depends on scheduling.
+  Module** found;
+  // the modules given to load_module and their directories.
+  Module** roots;
+  char** root_dirs;
+  TaskGroup group;
+  u32 generation;
+  // the diagnostics of a module are printed as soon as it is loaded.
+  bool stream;
+  // modules read and parsed by the current load, and how many of them were
+  // only parsed again around an edit.
+  atomic_uint loaded;
+  atomic_uint reparsed;
+} ModuleLoader;
+
+ModuleLoader new_module_loader(StringTable* table, Pool* pool, ParseCache* cache, u32 flags);
+
+void destroy_module_loader(ModuleLoader* loader);
+
+// a loader can be used for more than one load, which keeps the modules of
+// the previous ones. A module whose file has not changed since it was read
+// is not parsed again. Clears the roots.
+void begin_modules(ModuleLoader* loader);
+
+// starts loading the file at path and everything it imports. NULL is
+// returned when the file does not exist.
+Module* load_module(ModuleLoader* loader, const char* path);
+
+// marks the module of the file at path, a real path, to be read again by the
+// next load. When the file was created or removed the modules importing it
+// and the modules with imports that were not found are read again as well,
+// since the files their use items name may have changed.
+void invalidate_module(ModuleLoader* loader, const char* path, bool created_or_removed);
+
+// waits for every module to be loaded.
+void wait_modules(ModuleLoader* loader);
+
+// every loaded module in a fixed order, each root followed by its imports
+// depth first.
+Module** ordered_modules(ModuleLoader* loader);
+
+void module_test(StringTable* table);
+
+#endif
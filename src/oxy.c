@@ -1,3 +1,5 @@
+#define _XOPEN_SOURCE 700
+
 #include "oxy.h"
 #include "io.h"
 #include "common.h"
@@ -6,54 +8,411 @@
 #include "lex.h"
 #include "print.h"
 #include "checker.h"
+#include "fingerprint.h"
+#include "report.h"
+#include "pool.h"
+#include "ast_io.h"
+#include "cache.h"
+#include "module.h"
+#include "server.h"
+#include "watch.h"
+#include "visit.h"
+#include <ctype.h>
+#include <time.h>
+
+extern bool debug;
+
+#define DEFAULT_MAX_ERRORS 20
 
 StringTable* table = NULL;
+// the bodies a server request checked, the next requests check only the
+// ones that changed.
+BodyCache* body_cache = NULL;
 
-bool validate_input(u32 num, const char* const* args) {
-  if(num < 2) {
-    printf("Error: oxc [file.oxy]\n");
+const Options default_options = {
+  .root = NULL,
+  .max_errors = DEFAULT_MAX_ERRORS,
+  .decls_only = false,
+  .threads = 0,
+  .ast_image = NULL,
+  .cache_dir = NULL,
+  .inputs = NULL,
+  .module_paths = NULL,
+  .server = false,
+  .socket = NULL,
+  .connect = NULL,
+  .shutdown = false,
+  .watch = NULL,
+  .diagnostics_format = Diagnostics_Text,
+  .emit_ast = false,
+  .ast_format = Ast_Text,
+  .check_stats = false,
+  .type_of = NULL,
+  .test = false,
+};
+
+Options options = default_options;
+
+void reset_options() {
+  buf_free(options.inputs);
+  buf_free(options.module_paths);
+  options = default_options;
+}
+
+void usage() {
+  printf("Error: oxc [options] file.oxy... | @filelist\n");
+  printf("\t--max-errors=<n>\tstop reporting errors after n errors (0 is unlimited, default %u)\n", DEFAULT_MAX_ERRORS);
+  printf("\t--decls-only\t\tonly parse and check declarations, function bodies are only\n");
+  printf("\t\t\t\tparsed when a constant calls them at compile time\n");
+  printf("\t--threads=<n>\t\tnumber of worker threads (default one per processor)\n");
+  printf("\t--write-ast=<file>\twrite the parsed tree to a binary image\n");
+  printf("\t--cache-dir=<dir>\treuse the parsed trees of unchanged files stored in dir\n");
+  printf("\t--module-path=<dir>\talso search dir for imported modules\n");
+  printf("\t--server[=<socket>]\tcompile the requests read from stdio or a unix socket, keeping\n");
+  printf("\t\t\t\tthe parsed files and checked bodies of earlier requests\n");
+  printf("\t--connect=<socket>\tsend the other arguments to a server and print its output\n");
+  printf("\t--shutdown\t\tstop the server given to --connect\n");
+  printf("\t--emit=ast[:json|:sexp]\tprint the parsed tree of every file\n");
+  printf("\t--check-stats\t\tprint the number of checked declarations and the checking time\n");
+  printf("\t--type-of=<name>\tprint the type of a declaration of the first input, resolving only\n");
+  printf("\t\t\t\twhat it needs instead of checking everything\n");
+  printf("\t--diagnostics-format=<f>\tprint diagnostics as text (default), jsonl or sarif\n");
+  printf("\t--watch=<dir>\t\tcompile again whenever a file under dir changes, the inputs\n");
+  printf("\t\t\t\tdefault to every .oxy file under dir\n");
+  printf("\t--test\t\t\trun the tests of the compiler, and those taking a file on the inputs\n");
+  printf("\t--trace\t\t\tprint the tokens and the trace of the parser, files are parsed\n");
+  printf("\t\t\t\tone at a time\n");
+}
+
+// matches '--name=value' or '--name value', advancing the argument index for the latter.
+const char* option_value(u32 num, const char* const* args, u32* i, const char* name) {
+  u64 len = strlen(name);
+  if(strncmp(args[*i], name, len) != 0)
+    return NULL;
+  if(args[*i][len] == '=')
+    return args[*i] + len + 1;
+  if(args[*i][len] == 0 and *i + 1 < num)
+    return args[++*i];
+  return NULL;
+}
+
+bool parse_u32(const char* str, u32* value) {
+  char* end = NULL;
+  unsigned long val = strtoul(str, &end, 10);
+  if(end == str or *end != 0)
+    return false;
+  *value = (u32) val;
+  return true;
+}
+
+// adds the paths listed in a file, one per line.
+bool read_file_list(const char* path) {
+  File* list = read_file(path);
+  if(!list) {
+    printf("Error: unable to read file list '%s'\n", path);
     return false;
   }
+  for(char* line = strtok(list->content, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+    while(isspace(*line))
+      ++line;
+    char* end = line + strlen(line);
+    while(end > line and isspace(end[-1]))
+      *--end = 0;
+    if(*line)
+      buf_push(options.inputs, line);
+  }
   return true;
 }
 
-void compile_root(File* file);
+bool validate_input(u32 num, const char* const* args) {
+  for(u32 i = 1; i < num; ++i) {
+    const char* value = NULL;
+    if((value = option_value(num, args, &i, "--max-errors"))) {
+      if(!parse_u32(value, &options.max_errors)) {
+        printf("Error: invalid value for --max-errors: '%s'\n", value);
+        return false;
+      }
+    }
+    else if((value = option_value(num, args, &i, "--threads"))) {
+      if(!parse_u32(value, &options.threads)) {
+        printf("Error: invalid value for --threads: '%s'\n", value);
+        return false;
+      }
+    }
+    else if((value = option_value(num, args, &i, "--write-ast")))
+      options.ast_image = value;
+    else if((value = option_value(num, args, &i, "--cache-dir")))
+      options.cache_dir = value;
+    else if((value = option_value(num, args, &i, "--module-path")))
+      buf_push(options.module_paths, value);
+    else if((value = option_value(num, args, &i, "--emit"))) {
+      if(!parse_ast_format(value, &options.ast_format)) {
+        printf("Error: invalid value for --emit: '%s'\n", value);
+        return false;
+      }
+      options.emit_ast = true;
+    }
+    else if((value = option_value(num, args, &i, "--diagnostics-format"))) {
+      if(!parse_diagnostics_format(value, &options.diagnostics_format)) {
+        printf("Error: invalid value for --diagnostics-format: '%s'\n", value);
+        return false;
+      }
+    }
+    else if((value = option_value(num, args, &i, "--type-of")))
+      options.type_of = value;
+    else if((value = option_value(num, args, &i, "--watch")))
+      options.watch = value;
+    else if((value = option_value(num, args, &i, "--connect")))
+      options.connect = value;
+    else if(strcmp(args[i], "--server") == 0)
+      options.server = true;
+    else if(strncmp(args[i], "--server=", 9) == 0) {
+      options.server = true;
+      options.socket = args[i] + 9;
+    }
+    else if(strcmp(args[i], "--shutdown") == 0)
+      options.shutdown = true;
+    else if(strcmp(args[i], "--decls-only") == 0)
+      options.decls_only = true;
+    else if(strcmp(args[i], "--check-stats") == 0)
+      options.check_stats = true;
+    else if(strcmp(args[i], "--test") == 0)
+      options.test = true;
+    else if(strcmp(args[i], "--trace") == 0)
+      debug = true;
+    else if(args[i][0] == '-') {
+      printf("Error: unknown option '%s'\n", args[i]);
+      usage();
+      return false;
+    }
+    else if(args[i][0] == '@') {
+      if(!read_file_list(args[i] + 1))
+        return false;
+    }
+    else
+      buf_push(options.inputs, args[i]);
+  }
+
+  if(buf_len(options.inputs) == 0 and !options.server and !options.shutdown and !options.watch and !options.test) {
+    usage();
+    return false;
+  }
+  if(options.watch and (options.server or options.connect)) {
+    printf("Error: --watch can not be used with a server\n");
+    return false;
+  }
+  if(options.shutdown and !options.connect) {
+    printf("Error: --shutdown is only sent to a server with --connect\n");
+    return false;
+  }
+  if(options.ast_image and buf_len(options.inputs) > 1) {
+    printf("Error: --write-ast takes a single input file\n");
+    return false;
+  }
+  options.root = buf_len(options.inputs) ? options.inputs[0] : NULL;
+  return true;
+}
 
 int oxy_main(u32 num, const char* const* argv) {
-  if(validate_input(num, argv)) {
-    File* root = read_file(argv[1]);
+  if(!validate_input(num, argv))
+    return 1;
 
-    table = (StringTable*) malloc(sizeof(StringTable));
-    *table = create_table(TABLE_START);
+  if(options.connect)
+    return run_client(options.connect, num, argv);
 
-    // checker_test();
+  table = (StringTable*) malloc(sizeof(StringTable));
+  *table = create_table(TABLE_START);
 
-    compile_root(root);
+  if(options.test)
+    return run_tests();
+
+  // the debug trace of the parser is only readable when the files are
+  // compiled one at a time.
+  Pool* pool = new_pool(options.threads);
+  ModuleLoader loader = new_module_loader(table, debug ? NULL : pool, NULL, Parse_Default);
+
+  int status = 0;
+  if(options.server) {
+    body_cache = (BodyCache*) calloc(1, sizeof(BodyCache));
+    status = run_server(options.socket, &loader);
+    destroy_body_cache(body_cache);
+    free(body_cache);
   }
-  else
-    return 1;
+  else if(options.watch) {
+    apply_report_options();
+    status = run_watch(options.watch, &loader);
+  }
+  else {
+    apply_report_options();
+    begin_diagnostics();
+    status = compile_files(&loader) and error_count() == 0 ? 0 : 1;
+    end_diagnostics();
+  }
+
+  destroy_module_loader(&loader);
+  destroy_pool(pool);
+  return status;
+}
 
+// runs the tests of the compiler, the ones taking a parsed file on every
+// input. A failing test stops on its assert.
+int run_tests() {
+  buf_test();
+  map_test();
+  report_test();
+  value_test();
+  type_test();
+  fingerprint_test(table);
+  checker_test(table);
+  eval_test(table);
+  expr_depth_test();
+  walk_depth_test();
+  error_budget_test();
+  module_test(table);
+
+  for(u32 i = 0; i < buf_len(options.inputs); ++i) {
+    File* file = read_file(options.inputs[i]);
+    if(!file) {
+      printf("Error: unable to read file '%s'\n", options.inputs[i]);
+      return 1;
+    }
+    reparse_test(file);
+    AstFile* ast = parse_file(file, table);
+    ast_io_test(ast, table);
+    visit_test(ast);
+    destroy_ast_file(ast);
+  }
+  printf("all tests passed\n");
   return 0;
 }
 
-void compile_root(File* file) {
+void apply_report_options() {
+  set_max_errors(options.max_errors);
+  set_diagnostics_format(options.diagnostics_format);
+}
+
+// lexes and parses every input and the modules they import. The files are
+// tasks of the pool and the large ones are also split between the workers.
+// Modules the loader has from an earlier call are reused when their files
+// have not changed. Returns false when an input could not be read.
+bool compile_files(ModuleLoader* loader) {
   //buf_test();
   //map_test();
   // parse
   //scan_test(file);
   // parse_test(file);
-  AstFile* ast = parse_file(file, table);
-  for(u32 i = 0; i < ast_num_items(ast); ++i)
-    print_item(ast->items[i]);
+  ParseCache parse_cache;
+  ParseCache* cache = NULL;
+  if(options.cache_dir) {
+    if(init_parse_cache(&parse_cache, options.cache_dir))
+      cache = &parse_cache;
+    else
+      driver_error("unable to use cache directory '%s'\n", options.cache_dir);
+  }
+
+  begin_modules(loader);
+  loader->cache = cache;
+  loader->flags = options.decls_only ? Parse_LazyBodies : Parse_Default;
+  loader->search_paths = options.module_paths;
+  // the records of the machine readable formats do not depend on their order,
+  // they are written as soon as a module is parsed instead of in module order.
+  loader->stream = options.diagnostics_format != Diagnostics_Text;
+
+  bool result = true;
+  for(u32 i = 0; i < buf_len(options.inputs); ++i) {
+    if(!load_module(loader, options.inputs[i])) {
+      driver_error("unable to read file '%s'\n", options.inputs[i]);
+      result = false;
+    }
+  }
+  wait_modules(loader);
+  loader->cache = NULL;
+  loader->stream = false;
+
+  Module** modules = ordered_modules(loader);
+  ReportBuffer** reports = NULL;
+  for(u32 i = 0; i < buf_len(modules); ++i) {
+    Module* module = modules[i];
+    if(!module->file) {
+      driver_error("unable to read file '%s'\n", module->path);
+      result = false;
+      continue;
+    }
+    if(!module->streamed)
+      buf_push(reports, &module->report);
+    if(options.ast_image and i == 0 and !write_ast_image(module->ast, options.ast_image))
+      driver_error("unable to write '%s'\n", options.ast_image);
+
+    if(options.emit_ast)
+      dump_ast_file(module->ast, options.ast_format);
+  }
+  // the diagnostics of every module not streamed, in module order.
+  print_report_buffers(reports, buf_len(reports));
+  flush_diagnostics();
+  buf_free(reports);
 
-  // Checker checker = new_checker(table);
+  if(cache and options.diagnostics_format == Diagnostics_Text)
+    print_cache_stats(cache);
 
-  // type check
-  // if(resolve_file(&checker, ast)) {
-    // generate object file
-  // }
+  // the modules are only checked without syntax errors, which would be
+  // reported again as missing declarations.
+  if(result and error_count() == 0)
+    check_files(loader->pool, modules, buf_len(modules));
+  buf_free(modules);
+  return result;
+}
+
+// prints the type of the declaration given to --type-of and its layout.
+void query_type(Checker* checker, Module** modules, u32 num) {
+  collect_modules(checker, modules, num);
+  const char* name = table_insert_string(table, options.type_of);
+  Entity* entity = num and modules[0]->ast ? resolve_name(modules[0]->ast->scope, name) : NULL;
+  if(!entity) {
+    driver_error("'%s' is not declared in '%s'\n", options.type_of, options.root);
+    return;
+  }
+  Type* type = type_of(checker, entity);
+  if(!type)
+    return;
+  if(entity->kind != Entity_Funct and layout_of(checker, type))
+    printf("%s: %s (size %u, align %u)\n", name, type_string(type), type->size, type->align);
+  else
+    printf("%s: %s\n", name, type_string(type));
+}
+
+void check_files(Pool* pool, Module** modules, u32 num) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  Checker checker;
+  init_checker(&checker, table);
+  checker.pool = pool;
+  checker.body_cache = body_cache;
+  if(options.type_of)
+    query_type(&checker, modules, num);
+  else
+    check_modules(&checker, modules, num);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  flush_diagnostics();
+
+  if(options.check_stats and options.diagnostics_format == Diagnostics_Text) {
+    printf("check: %u declarations, %u bodies", checker.num_entities, checker.num_bodies);
+    if(body_cache)
+      printf(", %u reused", checker.num_reused);
+    printf(" in %.3f ms, %llu of %llu outer lookups cached\n",
+      (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6,
+      (unsigned long long) checker.cache.hits,
+      (unsigned long long) (checker.cache.hits + checker.cache.misses));
+    if(checker.eval.evaluations)
+      printf("eval: %u evaluations, %llu steps, %llu memoized calls\n", checker.eval.evaluations,
+        (unsigned long long) checker.eval.total_steps, (unsigned long long) checker.eval.memo_hits);
+  }
+  destroy_checker(&checker);
 }
 
 StringTable* get_string_table() {
   return table;
+}
+
+Options* get_options() {
+  return &options;
 }
\ No newline at end of file
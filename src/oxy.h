@@ -2,9 +2,77 @@
 #define OXY_H_
 
 #include "common.h"
+#include "report.h"
+#include "print.h"
+#include "pool.h"
+
+// command line options
+typedef struct Options {
+  // the first input.
+  const char* root;
+  // files given on the command line and in file lists.
+  const char** inputs;
+  // stop reporting errors after this many, zero is unlimited.
+  u32 max_errors;
+  // only declarations are parsed and checked, function bodies are deferred
+  // until a constant or a query needs them.
+  bool decls_only;
+  // number of worker threads, zero uses one per processor.
+  u32 threads;
+  // the parsed tree is written to this image when set, see ast_io.h.
+  const char* ast_image;
+  // parsed files are cached in this directory when set, see cache.h.
+  const char* cache_dir;
+  // directories searched for imported modules.
+  const char** module_paths;
+  // serves compile requests, on the unix socket when it is set or on stdio.
+  bool server;
+  const char* socket;
+  // sends the arguments to the server on this socket.
+  const char* connect;
+  bool shutdown;
+  // directory compiled again on every change.
+  const char* watch;
+  DiagnosticsFormat diagnostics_format;
+  // prints the parsed tree of every file.
+  bool emit_ast;
+  AstFormat ast_format;
+  // prints the number of checked declarations and the time spent checking.
+  bool check_stats;
+  // prints the type of this declaration of the first input instead of
+  // checking, resolving only what it needs.
+  const char* type_of;
+  // runs the tests of the compiler instead of compiling, the inputs are
+  // given to the tests that take a file.
+  bool test;
+} Options;
+
+typedef struct ModuleLoader ModuleLoader;
 
 int oxy_main(u32 num, const char* const* argv);
 
+// reads the command line into the options, printing the errors.
+bool validate_input(u32 num, const char* const* args);
+
+// restores the default options.
+void reset_options();
+
+// sets the error budget and the diagnostics format from the options.
+void apply_report_options();
+
+int run_tests();
+
+bool compile_files(ModuleLoader* loader);
+
+typedef struct Module Module;
+
+// checks the loaded modules, in the order they were loaded.
+// checks the modules, the bodies of their functions on the workers of the
+// pool when it is not NULL.
+void check_files(Pool* pool, Module** modules, u32 num);
+
 StringTable* get_string_table();
 
+Options* get_options();
+
 #endif
@@ -7,6 +7,10 @@
 #include "print.h"
 #include "report.h"
 #include "oxy.h"
+#include "pool.h"
+#include "io.h"
+
+#include <pthread.h>
 
 extern bool debug;
 
@@ -14,7 +18,8 @@ extern bool debug;
 #define Current() (*parser->current)
 #define Next() (*(parser->current + 1))
 // #define Consume() consume_(parser)
-#define Consume() (++parser->current)
+// never steps past the end of file token
+#define Consume() (parser->current += (parser->current->kind != Tkn_Eof))
 #define IS_EOF() parser->current == parser->end
 
 #define Debug() debug_(__FUNCTION__, __LINE__, Current())
@@ -52,6 +57,25 @@ typedef struct Parser {
   Token* comments;
 
   StringTable* table;
+  // ParseFlags
+  u32 flags;
+
+  // error recovery.
+  // while in panic mode errors are suppressed, this is cleared once the
+  // parser synchronizes on an item or statement boundary.
+  bool panic;
+  // number of errors found by this parser, including suppressed errors.
+  u32 num_errors;
+  // the token the last error was reported on.
+  Token* last_error;
+  // the last error was reported, its notes are added to it.
+  bool reported;
+  // number of errors reported by this parser. Parsing stops once they use up
+  // the error budget, the diagnostics are sorted by location so none of the
+  // later ones would be printed.
+  u32 num_reported;
+  // errors are counted but not reported, the first one ends parsing.
+  bool speculative;
 } Parser;
 
 TypeSpec* expr_to_typespec(Expr* expr);
@@ -69,28 +93,68 @@ SourceLoc loc_from_token(Parser* parser, Token token) {
   return loc;
 }
 
-Parser new_parser(File* file, StringTable* table) {
-  u32 num;
+Parser new_parser_from_tokens(File* file, Token* tokens, u32 num, StringTable* table) {
   Parser parser;
 
-  parser.table = table;// create_table(TABLE_START);
-  //the tokenizer builds the string table.
-
-  Token* tokens = get_tokens(file, &num, parser.table);
-
+  parser.table = table;
   parser.tokens = tokens;
   parser.end = tokens + num;
   parser.current = tokens;
   parser.file = file;
   parser.comments = NULL;
+  parser.restriction = 0;
+  parser.panic = false;
+  parser.reported = false;
+  parser.num_errors = 0;
+  parser.num_reported = 0;
+  parser.last_error = NULL;
+  parser.flags = Parse_Default;
+  parser.speculative = false;
 
   return parser;
 }
 
+Parser new_parser(File* file, StringTable* table) {
+  u32 num;
+  //the tokenizer builds the string table.
+  Token* tokens = get_tokens(file, &num, table);
+  return new_parser_from_tokens(file, tokens, num, table);
+}
+
 void set_restriction(Parser* parser, Restriciton res) {
   parser->restriction = res;
 }
 
+// reports a syntax error unless the parser is recovering from a previous one.
+// Once its errors spend the error budget the parser is moved to the end of
+// the file so every parsing loop unwinds.
+void parser_error(Parser* parser, SourceLoc loc, const char* msg, ...) {
+  ++parser->num_errors;
+  parser->reported = false;
+  if(parser->speculative) {
+    parser->current = parser->end - 1;
+    return;
+  }
+  if(parser->panic or parser->current == parser->last_error or error_budget_spent(parser->num_reported))
+    return;
+
+  parser->panic = true;
+  parser->last_error = parser->current;
+  // the scanner already reported the character it could not make a token
+  // of, the parser recovers without an error of its own.
+  if(parser->current->kind == Tkn_Error)
+    return;
+  parser->reported = true;
+
+  va_list va;
+  va_start(va, msg);
+  vsyntax_error(loc, msg, va);
+  va_end(va);
+
+  if(error_budget_spent(++parser->num_reported))
+    parser->current = parser->end - 1;
+}
+
 #define check(tok) check_(parser, tok)
 #define match(tok) match_(parser, tok)
 #define expect(tok) expect_(parser, tok)
@@ -124,7 +188,7 @@ bool expect_(Parser* parser, TokenKind kind) {
     Token current = Current();
     Token temp = current;
     temp.kind = kind;
-    syntax_error(loc_from_token(parser, Current()), "Expecting '%s', found '%s'\n", get_token_string(&temp),
+    parser_error(parser, loc_from_token(parser, Current()), "Expecting '%s', found '%s'\n", get_token_string(&temp),
       get_token_string(&current));
     return false;
   }
@@ -133,6 +197,7 @@ bool expect_(Parser* parser, TokenKind kind) {
 
 
 void sync(Parser* parser);
+bool at_boundary(Parser* parser);
 
 Expr* parse_expr(Parser* parser);
 Expr* parse_expr_with_res(Parser* parser, Restriciton res);
@@ -160,70 +225,162 @@ Expr* parse_prefix_expr(Parser* parser);
 Expr* parse_bottom_expr(Parser* parser);
 Expr* parse_dot_call_expr(Parser* parser, Expr* already_parsed);
 Expr* parse_if_expr(Parser* parser);
+Expr* parse_when_expr(Parser* parser);
 Expr* parse_while_expr(Parser* parser);
 Expr* parse_for_expr(Parser* parser);
 Expr* parse_dot_suffix_expr(Parser* parser, Expr* operand);
 
+// Binary, unary and range expressions are parsed without recursion, only
+// bracketed sub expressions recurse, so long machine generated chains use
+// constant stack space.
+//
+// Operators on the stack always have increasing precedence, an operator of
+// lower or equal precedence first reduces the ones above it. So the stacks
+// never hold more than one operator per precedence level.
+#define MAX_PRECEDENCE_LEVELS 16
+
+// an expression being parsed as the end or step of a range.
+typedef struct RangeFrame {
+  Expr* start;
+  Expr* end;
+  bool step;
+  u32 min_prec;
+  Restriciton restriction;
+} RangeFrame;
+
+typedef struct ExprStack {
+  Expr* operands[MAX_PRECEDENCE_LEVELS + 1];
+  Token* operators[MAX_PRECEDENCE_LEVELS];
+  u32 num_operands;
+  u32 num_operators;
+} ExprStack;
+
+// applies the top operator to the top two operands.
+void reduce_binary(ExprStack* stack, Parser* parser) {
+  Token* op = stack->operators[--stack->num_operators];
+  Expr* rhs = stack->operands[--stack->num_operands];
+  Expr* lhs = stack->operands[stack->num_operands - 1];
+
+  SourceLoc loc = expand_loc(lhs->loc, loc_from_token(parser, *op));
+  loc = expand_loc(loc, rhs->loc);
+  if(is_assignment(op))
+    stack->operands[stack->num_operands - 1] = new_assign(*op, lhs, rhs, loc);
+  else
+    stack->operands[stack->num_operands - 1] = new_binary(*op, lhs, rhs, loc);
+}
+
+Expr* reduce_all(ExprStack* stack, Parser* parser) {
+  while(stack->num_operators > 0)
+    reduce_binary(stack, parser);
+  assert(stack->num_operands <= 1);
+  stack->num_operands = 0;
+  return stack->operands[0];
+}
+
 Expr* parse_assoc_expr(Parser* parser, u32 min_prec) {
   Debug();
-  Expr* expr = parse_prefix_expr(parser);
-  while(precedence(&Current()) >= min_prec) {
-    Token current = Current();
-    if(debug) {
-      printf("Current Op: ");
-      print_token(&current);
-      printf("\tPrec: %u, Min Prec: %u\n", precedence(&current), min_prec);
-    }
-    Consume();
-    if(precedence(&current) < min_prec)
-      break;
+  ExprStack stack;
+  stack.num_operands = 0;
+  stack.num_operators = 0;
+  stack.operands[0] = NULL;
+  RangeFrame* ranges = NULL;
 
-    if(current.kind == Tkn_PeriodPeriod) {
-      Expr* end = parse_expr_with_res(parser, NO_STRUCT_LITERAL);
-      Expr* step = NULL;
-      if(match(Tkn_Comma))
-        step = parse_expr_with_res(parser, NO_STRUCT_LITERAL);
-      SourceLoc loc = expr->loc;
-      if(end)
-        loc = expand_loc(loc, end->loc);
-      if(step)
-        loc = expand_loc(loc, step->loc);
-      return new_range(expr, end, step, loc);
+  for(;;) {
+    Expr* expr = NULL;
+    Expr* operand = parse_prefix_expr(parser);
+    if(operand) {
+      stack.operands[stack.num_operands++] = operand;
+
+      Token* op = parser->current;
+      u32 prec = precedence(op);
+      if(debug) {
+        printf("Current Op: ");
+        print_token(op);
+        printf("\tPrec: %u, Min Prec: %u\n", prec, min_prec);
+      }
+      if(prec != 0 and prec >= min_prec) {
+        Consume();
+        if(op->kind != Tkn_PeriodPeriod) {
+          while(stack.num_operators > 0 and precedence(stack.operators[stack.num_operators - 1]) >= prec)
+            reduce_binary(&stack, parser);
+          assert(stack.num_operators < MAX_PRECEDENCE_LEVELS);
+          stack.operators[stack.num_operators++] = op;
+          continue;
+        }
+
+        // the end of the range is a new expression.
+        RangeFrame frame = {reduce_all(&stack, parser), NULL, false, min_prec, parser->restriction};
+        buf_push(ranges, frame);
+        set_restriction(parser, NO_STRUCT_LITERAL);
+        min_prec = 1;
+        continue;
+      }
+      expr = reduce_all(&stack, parser);
+    }
+    else if(stack.num_operators > 0) {
+      Token* op = stack.operators[--stack.num_operators];
+      parser_error(parser, loc_from_token(parser, Current()), "Expecting expression following '%s', found: '%s'\n",
+        get_token_string(op), get_token_string(&Current()));
+      expr = reduce_all(&stack, parser);
     }
 
-    if(!is_operator(&current))
-      syntax_error(loc_from_token(parser, current), "Execting binary operator in expression, found: '%s'\n", get_token_string(&current));
-      // continue parsing as if it was valid
+    // finishes the ranges whose end or step was just parsed, an expression
+    // ends after its range.
+    while(buf_len(ranges) > 0) {
+      RangeFrame* frame = &ranges[buf_len(ranges) - 1];
+      if(!frame->step) {
+        frame->end = expr;
+        if(match(Tkn_Comma)) {
+          frame->step = true;
+          break;
+        }
+        expr = NULL;
+      }
 
-    Expr* rhs = parse_assoc_expr(parser, precedence(&current) + 1);
-    SourceLoc loc = expand_loc(expr->loc, loc_from_token(parser, current));
-    loc = expand_loc(loc, rhs->loc);
-    if(is_assignment(&current))
-      expr = new_assign(current, expr, rhs, loc);
-    else
-      expr = new_binary(current, expr, rhs, loc);
+      SourceLoc loc = frame->start->loc;
+      if(frame->end)
+        loc = expand_loc(loc, frame->end->loc);
+      if(expr)
+        loc = expand_loc(loc, expr->loc);
+      expr = new_range(frame->start, frame->end, expr, loc);
+
+      min_prec = frame->min_prec;
+      set_restriction(parser, frame->restriction);
+      buf__hdr(ranges)->len--;
+    }
+
+    if(buf_len(ranges) == 0) {
+      buf_free(ranges);
+      return expr;
+    }
   }
-  return expr;
+}
+
+bool is_prefix_operator(TokenKind kind) {
+  return kind == Tkn_Minus or kind == Tkn_Astrick or kind == Tkn_Ampersand or kind == Tkn_Tilde;
 }
 
 Expr* parse_prefix_expr(Parser* parser) {
   Debug();
-  Token current = Current();
-  switch(current.kind) {
-    case Tkn_Minus:
-    case Tkn_Astrick:
-    case Tkn_Ampersand:
-    case Tkn_Tilde: {
-      // Consume();
-      Expr* expr = parse_prefix_expr(parser);
-      SourceLoc loc = loc_from_token(parser, current);
-      return new_unary(current, expr, expand_loc(loc, expr->loc));
-    }
-    default:;
+  // the operators are applied innermost first once the operand is parsed.
+  Token* first = parser->current;
+  while(is_prefix_operator(Current().kind))
+    Consume();
+  Token* last = parser->current;
+
+  Expr* expr = parse_bottom_expr(parser);
+  if(!expr) {
+    if(last != first)
+      parser_error(parser, loc_from_token(parser, Current()), "Expecting operand following '%s'\n", get_token_string(last - 1));
+    return NULL;
   }
+  expr = parse_dot_call_expr(parser, expr);
 
-  Expr* bottom = parse_bottom_expr(parser);
-  return parse_dot_call_expr(parser, bottom);
+  while(last != first) {
+    --last;
+    expr = new_unary(*last, expr, expand_loc(loc_from_token(parser, *last), expr->loc));
+  }
+  return expr;
 }
 
 Expr* parse_name_expr(Parser* parser);
@@ -237,6 +394,8 @@ Expr* parse_bottom_expr(Parser* parser) {
   switch(current.kind) {
     case Tkn_If:
       return parse_if_expr(parser);
+    case Tkn_When:
+      return parse_when_expr(parser);
     case Tkn_While:
       return parse_while_expr(parser);
     case Tkn_For:;
@@ -249,6 +408,11 @@ Expr* parse_bottom_expr(Parser* parser) {
       SourceLoc loc = loc_from_token(parser, current);
       Consume();
       Expr* expr = parse_expr(parser);
+      if(!expr) {
+        parser_error(parser, loc_from_token(parser, Current()), "Expecting expression following '(', found: '%s'\n", get_token_string(&Current()));
+        expect(Tkn_CloseParen);
+        return NULL;
+      }
 
       loc = expand_loc(loc, expr->loc);
       // tuple expression
@@ -259,11 +423,11 @@ Expr* parse_bottom_expr(Parser* parser) {
         while(match(Tkn_Comma)) {
           loc = expand_loc(loc, loc_from_token(parser, *(parser->current - 1)));
           Expr* e = parse_expr(parser);
-          loc = expand_loc(loc, e->loc);
           if(!e) {
-            syntax_error(loc_from_token(parser, Current()), "Expecting primary expression in tuple\n");
+            parser_error(parser, loc_from_token(parser, Current()), "Expecting primary expression in tuple\n");
             break;
           }
+          loc = expand_loc(loc, e->loc);
 
           buf_push(elems, e);
         }
@@ -292,6 +456,10 @@ Expr* parse_bottom_expr(Parser* parser) {
           buf_push(elems, elem);
           loc = expand_loc(loc, elem->loc);
         }
+        else {
+          parser_error(parser, loc_from_token(parser, Current()), "Expecting expression in array literal, found: '%s'\n", get_token_string(&Current()));
+          break;
+        }
         match(Tkn_Comma);
       }
       expect(Tkn_CloseBrace);
@@ -313,19 +481,31 @@ Expr* parse_block_expr(Parser* parser) {
     SourceLoc loc = loc_from_token(parser, Current());
     Consume();
     Stmt** stmts = NULL;
-    while(!check(Tkn_CloseBracket)) {
+    while(!check(Tkn_CloseBracket) and !check(Tkn_Eof)) {
+      Token* start = parser->current;
+      u32 errors = parser->num_errors;
       Stmt* stmt = parse_stmt(parser);
-      if(!stmt)
-        break;
-      loc = expand_loc(loc, stmt->loc);
-      buf_push(stmts, stmt);
+      if(stmt) {
+        loc = expand_loc(loc, stmt->loc);
+        buf_push(stmts, stmt);
+      }
+      else
+        parser_error(parser, loc_from_token(parser, Current()), "Expecting statement, found: '%s'\n", get_token_string(&Current()));
+
+      if(parser->num_errors != errors) {
+        if(parser->current == start and !check(Tkn_CloseBracket))
+          Consume();
+        if(!at_boundary(parser))
+          sync(parser);
+      }
+      parser->panic = false;
     }
     expect(Tkn_CloseBracket);
     loc.span += 1;
     return new_block(stmts, loc);
   }
   else {
-   syntax_error(loc_from_token(parser, Current()), "Execting '{' to begin a block, found: '%s'\n", get_token_string(&Current()));
+   parser_error(parser, loc_from_token(parser, Current()), "Execting '{' to begin a block, found: '%s'\n", get_token_string(&Current()));
   }
   return NULL;
 }
@@ -337,7 +517,7 @@ Expr* parse_literal(Parser* parser) {
     Consume();
     return new_literal(current, loc_from_token(parser, current));
   }
-  syntax_error(loc_from_token(parser, current), "Expecting literal: found '%s'\n", get_token_string(&current));
+  parser_error(parser, loc_from_token(parser, current), "Expecting literal: found '%s'\n", get_token_string(&current));
   return NULL;
 }
 
@@ -356,10 +536,13 @@ Expr* parse_dot_call_expr(Parser* parser, Expr* already_parsed) {
     // assert(expr->kind != Binding);
 
     switch(Current().kind) {
-      case Tkn_Period:
+      case Tkn_Period: {
         Consume();
-        expr = parse_dot_suffix_expr(parser, expr);
-      break;
+        Expr* suffix = parse_dot_suffix_expr(parser, expr);
+        if(!suffix)
+          return expr;
+        expr = suffix;
+      } break;
       case Tkn_OpenParen: {
         SourceLoc loc = expr->loc;
         expect(Tkn_OpenParen);
@@ -375,6 +558,8 @@ Expr* parse_dot_call_expr(Parser* parser, Expr* already_parsed) {
         if(parser->restriction & NO_STRUCT_LITERAL)
           return expr;
         TypeSpec* type = expr_to_typespec(expr);
+        if(expr->kind == DotFnCall)
+          parser_error(parser, expr->loc, "type generics are not implemented\n");
         expect(Tkn_OpenBracket);
         Expr** args = NULL;
 
@@ -387,7 +572,7 @@ Expr* parse_dot_call_expr(Parser* parser, Expr* already_parsed) {
               buf_push(args, expr);
             }
             else {
-              syntax_error(loc_from_token(parser, Current()), "Expecting primary expression following comma in struct literal\n");
+              parser_error(parser, loc_from_token(parser, Current()), "Expecting primary expression following comma in struct literal\n");
               break;
             }
 
@@ -409,7 +594,9 @@ Expr* parse_dot_call_expr(Parser* parser, Expr* already_parsed) {
         Expr* index = parse_expr_with_res(parser, NO_BINDING);
         Expr* end = NULL;
         bool is_slice = false;
-        SourceLoc loc = expand_loc(expr->loc, index->loc);
+        SourceLoc loc = expr->loc;
+        if(index)
+          loc = expand_loc(loc, index->loc);
 
         // check for slice syntax
         if(match(Tkn_Colon)) {
@@ -433,9 +620,9 @@ Expr* parse_dot_call_expr(Parser* parser, Expr* already_parsed) {
         expect(Tkn_Colon);
 
         Expr* e = parse_expr(parser);
-        SourceLoc loc;
+        SourceLoc loc = expr->loc;
         if(!e) {
-          syntax_error(loc_from_token(parser, Current()), "expecting primary expression following colon\n");
+          parser_error(parser, loc_from_token(parser, Current()), "expecting primary expression following colon\n");
         }
         else {
           // i know the name isnt right but it does the same thing.
@@ -484,7 +671,7 @@ Expr* parse_dot_suffix_expr(Parser* parser, Expr* operand) {
       return new_tupelelem(operand, index, operand->loc);
     }
     default: {
-      syntax_error(loc_from_token(parser, current), "Expecting an identifier or integer following period, found: '%s'\n", get_token_string(&current));
+      parser_error(parser, loc_from_token(parser, current), "Expecting an identifier or integer following period, found: '%s'\n", get_token_string(&current));
     }
   }
   return NULL;
@@ -503,7 +690,7 @@ Expr** parse_fn_arguments(Parser* parser) {
         buf_push(args, expr);
       }
       else {
-        syntax_error(loc_from_token(parser, Current()), "Expecting primary expression following comma in function arguments\n");
+        parser_error(parser, loc_from_token(parser, Current()), "Expecting primary expression following comma in function arguments\n");
         break;
       }
 
@@ -511,14 +698,12 @@ Expr** parse_fn_arguments(Parser* parser) {
         expecting_expr = true;
     }
   }
-  print_token(&Current());
   expect(Tkn_CloseParen);
   return args;
 }
 
 Expr* parse_name_expr(Parser* parser) {
   Debug();
-  Token current = Current();
   Ident* ident = parse_ident(parser);
   // check for polymohpic parameters
   return new_name(ident, ident->loc);
@@ -535,7 +720,7 @@ Ident* parse_ident(Parser* parser) {
     return new_ident(str, loc_from_token(parser, current));
   }
   else
-    syntax_error(loc_from_token(parser, current), "Expecting identifier: found '%s'\n", get_token_string(&current));
+    parser_error(parser, loc_from_token(parser, current), "Expecting identifier: found '%s'\n", get_token_string(&current));
   return NULL;
 }
 
@@ -547,6 +732,11 @@ Expr* parse_if_expr(Parser* parser) {
   Debug();
   expect(Tkn_If);
   Expr* cond = parse_expr_with_res(parser, NO_STRUCT_LITERAL);
+  if(!cond) {
+    parser_error(parser, loc_from_token(parser, Current()), "expecting condition following 'if'\n");
+    sync(parser);
+    return NULL;
+  }
   if(check(Tkn_OpenBracket)) {
     if(Next().kind == Tkn_Pipe) {
       Consume();
@@ -556,8 +746,9 @@ Expr* parse_if_expr(Parser* parser) {
       return parse_if_body(parser, cond);
   }
   else {
-    syntax_error(loc_from_token(parser, Current()), "expecting open bracket\n");
-    note("if body must start with '}'\n");
+    parser_error(parser, loc_from_token(parser, Current()), "expecting open bracket\n");
+    if(parser->reported)
+      note("if body must start with '{'\n");
   }
   return NULL;
 }
@@ -570,27 +761,31 @@ Expr* parse_for_expr(Parser* parser) {
   Pattern* pat = parse_pattern(parser);
   SourceLoc loc = loc_from_token(parser, Current());
   if(!pat) {
-    syntax_error(loc, "execting pattern in for\n");
+    parser_error(parser, loc, "execting pattern in for\n");
     sync(parser);
+    return NULL;
   }
   if(match(Tkn_In)) {
     Expr* expr = parse_expr_with_res(parser, NO_STRUCT_LITERAL);
+    if(!expr)
+      parser_error(parser, loc_from_token(parser, Current()), "expecting expression following 'in'\n");
     if(check(Tkn_OpenBracket)) {
       Expr* body = parse_block_expr(parser);
       SourceLoc l = loc_from_token(parser, top);
       l = expand_loc(l, pat->loc);
-      l = expand_loc(l, expr->loc);
+      if(expr)
+        l = expand_loc(l, expr->loc);
       l = expand_loc(l, body->loc);
       return new_for(pat, expr, body, l);
     }
     else {
       loc = loc_from_token(parser, Current());
-      syntax_error(loc, "expecting '{' in a block\n");
+      parser_error(parser, loc, "expecting '{' in a block\n");
       sync(parser);
     }
   }
   else {
-    syntax_error(loc, "expecting 'in' in for\n");
+    parser_error(parser, loc, "expecting 'in' in for\n");
     sync(parser);
   }
 
@@ -601,16 +796,19 @@ Expr* parse_while_expr(Parser* parser) {
   Token top = Current();
   expect(Tkn_While);
   Expr* cond = parse_expr_with_res(parser, NO_STRUCT_LITERAL);
+  if(!cond)
+    parser_error(parser, loc_from_token(parser, Current()), "expecting condition following 'while'\n");
   if(check(Tkn_OpenBracket)) {
     Expr* body = parse_block_expr(parser);
     SourceLoc l = loc_from_token(parser, top);
-    l = expand_loc(l, cond->loc);
+    if(cond)
+      l = expand_loc(l, cond->loc);
     l = expand_loc(l, body->loc);
     return new_while(cond, body, l);
   }
   else {
     SourceLoc loc = loc_from_token(parser, Current());
-    syntax_error(loc, "expecting '{' to begin a body\n");
+    parser_error(parser, loc, "expecting '{' to begin a body\n");
     sync(parser);
   }
   return NULL;
@@ -635,13 +833,13 @@ Pattern* parse_pattern(Parser* parser) {
         Pattern* pat = parse_pattern(parser);
         if(pat) {
           if(pat->kind == StructPattern || pat->kind == TuplePattern) {
-            syntax_error(pat->loc, "tuple elements must be build to a name\n");
+            parser_error(parser, pat->loc, "tuple elements must be build to a name\n");
           }
           buf_push(pats, pat);
           loc = expand_loc(loc, pat->loc);
         }
         else {
-          syntax_error(loc_from_token(parser, Current()), "expecting pattern\n");
+          parser_error(parser, loc_from_token(parser, Current()), "expecting pattern\n");
           break;
         }
         if(!match(Tkn_Comma))
@@ -655,8 +853,12 @@ Pattern* parse_pattern(Parser* parser) {
       Consume();
       Mutability mut = parse_mutability(parser);
       Pattern* pat = parse_pattern(parser);
+      if(!pat) {
+        parser_error(parser, loc_from_token(parser, Current()), "expecting pattern following '%s'\n", get_token_string(&current));
+        return NULL;
+      }
       if(pat->kind != IdentPattern) {
-        syntax_error(pat->loc, "reference pattern must bind to a name\n");
+        parser_error(parser, pat->loc, "reference pattern must bind to a name\n");
       }
       return new_ref_pat(mut, pat, pat->loc);
     } break;
@@ -664,8 +866,12 @@ Pattern* parse_pattern(Parser* parser) {
       Consume();
       Mutability mut = parse_mutability(parser);
       Pattern* pat = parse_pattern(parser);
+      if(!pat) {
+        parser_error(parser, loc_from_token(parser, Current()), "expecting pattern following '%s'\n", get_token_string(&current));
+        return NULL;
+      }
       if(pat->kind != IdentPattern) {
-        syntax_error(pat->loc, "pointer pattern must bind to a name\n");
+        parser_error(parser, pat->loc, "pointer pattern must bind to a name\n");
       }
       return new_ptr_pat(mut, pat, pat->loc);
     } break;
@@ -681,11 +887,11 @@ Pattern* parse_pattern(Parser* parser) {
     if(match(Tkn_PeriodPeriod)) {
       Pattern* end = parse_pattern(parser);
       if(!end) {
-        syntax_error(loc_from_token(parser, Current()), "execting end value for range pattern\n");
+        parser_error(parser, loc_from_token(parser, Current()), "execting end value for range pattern\n");
         return NULL;
       }
       if(end->kind != LiteralPattern) {
-        syntax_error(loc_from_token(parser, Current()), "range end must be a literal\n");
+        parser_error(parser, loc_from_token(parser, Current()), "range end must be a literal\n");
       }
       SourceLoc loc = lit->loc;
       loc.span += 2;
@@ -717,7 +923,7 @@ Pattern* parse_stuct_pattern(Parser* parser) {
     while(!check(Tkn_CloseParen)) {
       Pattern* pat = parse_pattern(parser);
       if(pat && (pat->kind == StructPattern || pat->kind == TuplePattern)) {
-        syntax_error(pat->loc, "invalid sub pattern in structure pattern\n");
+        parser_error(parser, pat->loc, "invalid sub pattern in structure pattern\n");
         sync(parser);
       }
       if(pat) {
@@ -725,7 +931,7 @@ Pattern* parse_stuct_pattern(Parser* parser) {
         loc = expand_loc(loc, pat->loc);
       }
       else {
-        syntax_error(loc_from_token(parser, Current()), "expecting pattern, found: '%s'\n", get_token_string(&Current()));
+        parser_error(parser, loc_from_token(parser, Current()), "expecting pattern, found: '%s'\n", get_token_string(&Current()));
         sync(parser);
       }
 
@@ -737,7 +943,7 @@ Pattern* parse_stuct_pattern(Parser* parser) {
     return new_struct_pat(spec, pats, loc);
   }
   else {
-    syntax_error(loc_from_token(parser, Current()), "expecting '(' follow type path\n");
+    parser_error(parser, loc_from_token(parser, Current()), "expecting '(' follow type path\n");
     sync(parser);
   }
   return NULL;
@@ -768,7 +974,7 @@ Clause* parse_clause(Parser* parser) {
   Pattern** patterns = parse_patterns(parser, Tkn_Pipe);
   SourceLoc loc;
   if(patterns == NULL)
-    syntax_error(loc_from_token(parser, Current()), "expecting pattern in matching if\n");
+    parser_error(parser, loc_from_token(parser, Current()), "expecting pattern in matching if\n");
   else {
     loc = patterns[0]->loc;
     for(u32 i = 1; i < buf_len(patterns); ++i)
@@ -787,7 +993,7 @@ Pattern** parse_patterns(Parser* parser, TokenKind delim) {
       buf_push(pats, pat);
     }
     else {
-      syntax_error(loc_from_token(parser, Current()), "expecting pattern in match clause\n");
+      parser_error(parser, loc_from_token(parser, Current()), "expecting pattern in match clause\n");
       sync(parser);
     }
   } while(match(delim));
@@ -807,7 +1013,7 @@ Expr* parse_match(Parser* parser, Expr* cond) {
       if(clause)
         buf_push(clauses, clause);
       else {
-        syntax_error(loc_from_token(parser, Current()), "expecting pattern following pipe\n");
+        parser_error(parser, loc_from_token(parser, Current()), "expecting pattern following pipe\n");
         sync(parser);
         break;
       }
@@ -829,16 +1035,46 @@ Expr* parse_if_body(Parser* parser, Expr* cond) {
       else_if = parse_block_expr(parser);
   }
   SourceLoc loc = cond->loc;
-  loc = expand_loc(loc, body->loc);
+  if(body)
+    loc = expand_loc(loc, body->loc);
   if(else_if)
     loc = expand_loc(loc, else_if->loc);
   return new_if(cond, body, else_if, loc);
 }
 
+// 'when' is an if whose condition is known at compile time, only the
+// branch it selects is checked. Its else branch is a block or another when.
+Expr* parse_when_expr(Parser* parser) {
+  Debug();
+  Token top = Current();
+  expect(Tkn_When);
+  Expr* cond = parse_expr_with_res(parser, NO_STRUCT_LITERAL);
+  if(!cond) {
+    parser_error(parser, loc_from_token(parser, Current()), "expecting condition following 'when'\n");
+    sync(parser);
+    return NULL;
+  }
+  if(!check(Tkn_OpenBracket)) {
+    parser_error(parser, loc_from_token(parser, Current()), "expecting open bracket\n");
+    return NULL;
+  }
+  Expr* body = parse_block_expr(parser);
+  Expr* else_when = NULL;
+  if(match(Tkn_Else))
+    else_when = check(Tkn_When) ? parse_when_expr(parser) : parse_block_expr(parser);
+  SourceLoc loc = expand_loc(loc_from_token(parser, top), cond->loc);
+  if(body)
+    loc = expand_loc(loc, body->loc);
+  if(else_when)
+    loc = expand_loc(loc, else_when->loc);
+  return new_when(cond, body, else_when, loc);
+}
+
 bool requires_semicolon(Expr* expr) {
   if(!expr) return false;
   switch(expr->kind) {
     case If:
+    case When:
     case While:
     case For:
       return false;
@@ -855,11 +1091,14 @@ Stmt* parse_stmt(Parser* parser) {
     case Tkn_Let:
     case Tkn_Struct:
     case Tkn_Enum:
+    case Tkn_Use:
     case Tkn_Type: {
-      // syntax_error(loc_from_token(parser, current), "Unimplemented feature\n");
+      // parser_error(parser, loc_from_token(parser, current), "Unimplemented feature\n");
       Item* item = parse_item(parser);
-      if(item->kind == ItemLocal || item->kind == ItemUse || item->kind == ItemAlias
-         || item->kind == ItemTupleStruct)
+      if(!item)
+        return NULL;
+      // local items consume their own semicolon
+      if(item->kind == ItemUse || item->kind == ItemAlias || item->kind == ItemTupleStruct)
         expect(Tkn_Semicolon);
       return new_item_stmt(item, item->loc);
     }
@@ -877,7 +1116,7 @@ Stmt* parse_stmt(Parser* parser) {
     }
     else {
       // if(requires_semicolon(expr)) {
-        // syntax_error(loc_from_token(parser, Current()), "expecting ';'\n");
+        // parser_error(parser, loc_from_token(parser, Current()), "expecting ';'\n");
       // }
       return new_expr_stmt(expr, loc);
     }
@@ -895,9 +1134,6 @@ TypeSpec* expr_to_typespec(Expr* expr) {
       return new_path_typespec(expr_to_typespec(expr->field.operand), new_name_typespec(expr->field.name,
         Immutable, expr->field.name->loc), Immutable, expr->loc);
     }
-    case DotFnCall: {
-      printf("Type Generics not implemented\n");
-    }
     default: return NULL;
   }
 }
@@ -916,6 +1152,10 @@ TypeSpec* parse_typespec(Parser* parser) {
       Mutability mut = parse_mutability(parser);
       loc.span += (mut == Mutable ? 3 : 0);
       TypeSpec* type = parse_typespec(parser);
+      if(!type) {
+        parser_error(parser, loc_from_token(parser, Current()), "expecting type following '*', found: '%s'\n", get_token_string(&Current()));
+        return NULL;
+      }
       return new_ptr_typespec(type, mut, expand_loc(loc, type->loc));
     } break;
     case Tkn_Ampersand: {
@@ -924,15 +1164,23 @@ TypeSpec* parse_typespec(Parser* parser) {
       Mutability mut = parse_mutability(parser);
       loc.span += (mut == Mutable ? 3 : 0);
       TypeSpec* type = parse_typespec(parser);
+      if(!type) {
+        parser_error(parser, loc_from_token(parser, Current()), "expecting type following '&', found: '%s'\n", get_token_string(&Current()));
+        return NULL;
+      }
       return new_ref_typespec(type, mut, expand_loc(loc, type->loc));
 #else
-     syntax_error(loc, "reference types are allowed at the moment\n");
+     parser_error(parser, loc, "reference types are allowed at the moment\n");
 #endif
     } break;
     case Tkn_OpenBrace: {
       Consume();
       if(match(Tkn_CloseBrace)) {
         TypeSpec* type = parse_typespec(parser);
+        if(!type) {
+          parser_error(parser, loc_from_token(parser, Current()), "expecting element type of array, found: '%s'\n", get_token_string(&Current()));
+          return NULL;
+        }
         loc.span += 2;
         return new_array_typespec(type, expand_loc(loc, type->loc));
       }
@@ -941,6 +1189,10 @@ TypeSpec* parse_typespec(Parser* parser) {
         expect(Tkn_Comma);
         TypeSpec* value = parse_typespec(parser);
         expect(Tkn_CloseBrace);
+        if(!key or !value) {
+          parser_error(parser, loc, "expecting key and value types of map\n");
+          return NULL;
+        }
         return new_map_typespec(key, value, Immutable, expand_loc(key->loc, value->loc));
       }
     } break;
@@ -976,6 +1228,7 @@ TypeSpec* parse_name_or_path(Parser* parser) {
 
 Item* parse_local_item(Parser* parse);
 Item* parse_function_item(Parser* parse);
+void skip_block(Parser* parser);
 Item* parse_structure_item(Parser* parse);
 Item* parse_tuplestruct_item(Parser* parse);
 Item* parse_enum_item(Parser* parse);
@@ -1024,20 +1277,26 @@ Item* parse_local_item(Parser* parser) {
   Expr* init = NULL;
   if(match(Tkn_Colon)) {
     spec = parse_typespec(parser);
-    loc = expand_loc(loc, spec->loc);
+    if(spec)
+      loc = expand_loc(loc, spec->loc);
+    else
+      parser_error(parser, loc_from_token(parser, Current()), "expecting type following ':', found: '%s'\n", get_token_string(&Current()));
   }
 
   if(match(Tkn_Equal)) {
     init = parse_expr(parser);
-    loc = expand_loc(loc, init->loc);
+    if(init)
+      loc = expand_loc(loc, init->loc);
+    else
+      parser_error(parser, loc_from_token(parser, Current()), "expecting expression following '=', found: '%s'\n", get_token_string(&Current()));
   }
 
   if(!spec and !init) {
-    syntax_error(loc_from_token(parser, Current()), "must annotate type without initialization\n");
+    parser_error(parser, loc_from_token(parser, Current()), "must annotate type without initialization\n");
   }
 
   if(!match(Tkn_Semicolon)) {
-    syntax_error(loc_from_token(parser, Current()), "expecting ';' following variable declaration\n");
+    parser_error(parser, loc_from_token(parser, Current()), "expecting ';' following variable declaration\n");
   }
 
   return new_itemlocal(pattern, spec, init, mut, loc);
@@ -1056,7 +1315,7 @@ Item* parse_function_item(Parser* parser) {
     Item** params = NULL;
     while(!check(Tkn_CloseParen)) {
       if(!check(Tkn_Identifier)) {
-        syntax_error(loc_from_token(parser, Current()), "execting an identifer following '('\n");
+        parser_error(parser, loc_from_token(parser, Current()), "execting an identifer following '('\n");
         sync(parser);
         break;
       }
@@ -1074,22 +1333,33 @@ Item* parse_function_item(Parser* parser) {
     if(!check(Tkn_OpenBracket)) {
       spec = parse_typespec(parser);
       if(!spec) {
-        syntax_error(loc_from_token(parser, Current()), "expecting return type, found: '%s'\n", get_token_string(&Current()));
+        parser_error(parser, loc_from_token(parser, Current()), "expecting return type, found: '%s'\n", get_token_string(&Current()));
         sync(parser);
       }
       else
         loc = expand_loc(loc, spec->loc);
     }
+    u32 body_begin = 0;
+    u32 body_end = 0;
     if(check(Tkn_OpenBracket)) {
-      body = parse_block_expr(parser);
+      if(parser->flags & Parse_LazyBodies) {
+        body_begin = parser->current - parser->tokens;
+        skip_block(parser);
+        body_end = parser->current - parser->tokens;
+      }
+      else
+        body = parse_block_expr(parser);
     }
     else {
-      syntax_error(loc_from_token(parser, Current()), "expecting '{'\n");
+      parser_error(parser, loc_from_token(parser, Current()), "expecting '{'\n");
     }
-    return new_itemfunction(name, params, spec, body, loc);
+    Item* item = new_itemfunction(name, params, spec, body, loc);
+    item->function.body_begin = body_begin;
+    item->function.body_end = body_end;
+    return item;
   }
   else if(is_operator(&Current())) {
-    printf("Overloading of operators is currently unimplemented\n");
+    parser_error(parser, loc_from_token(parser, Current()), "overloading of operators is not implemented\n");
   }
 
   return NULL;
@@ -1109,7 +1379,7 @@ Item* parse_structure_item(Parser* parser) {
       if(check(Tkn_CloseBracket)) break;
 
       if(!check(Tkn_Identifier)) {
-        syntax_error(loc_from_token(parser, Current()), "execting an identifer following '{'\n");
+        parser_error(parser, loc_from_token(parser, Current()), "execting an identifer following '{'\n");
         sync(parser);
         break;
       }
@@ -1125,7 +1395,7 @@ Item* parse_structure_item(Parser* parser) {
     expect(Tkn_CloseBracket);
     return new_itemstruct(name, fields, loc);
   }
-  syntax_error(loc_from_token(parser, Current()), "expecting ident following keyword 'struct'\n");
+  parser_error(parser, loc_from_token(parser, Current()), "expecting ident following keyword 'struct'\n");
   return NULL;
 }
 
@@ -1150,7 +1420,7 @@ Item* parse_tuple_struct(Parser* parser) {
           loc = expand_loc(loc, type->loc);
         }
         else {
-          syntax_error(loc_from_token(parser, Current()), "Expecting type following comma in tuple struct\n");
+          parser_error(parser, loc_from_token(parser, Current()), "Expecting type following comma in tuple struct\n");
           break;
         }
 
@@ -1197,7 +1467,7 @@ Item* parse_enum_item(Parser* parser) {
     Item** body = NULL;
     if(check(Tkn_OpenBracket)) {
       Consume();
-      while(!check(Tkn_CloseBracket)) {
+      while(!check(Tkn_CloseBracket) and !check(Tkn_Eof)) {
         Item* elem = parse_enum_elem(parser);
 
         if(elem) {
@@ -1205,38 +1475,78 @@ Item* parse_enum_item(Parser* parser) {
           loc = expand_loc(loc, elem->loc);
         }
 
-        match(Tkn_Comma);
+        if(!match(Tkn_Comma) and !elem)
+          break;
       }
       expect(Tkn_CloseBracket);
 
       return new_itemenum(name, body, loc);
     }
     else {
-      syntax_error(loc_from_token(parser, Current()), "execting '{' in enum declaration\n");
+      parser_error(parser, loc_from_token(parser, Current()), "execting '{' in enum declaration\n");
       sync(parser);
     }
   }
   else {
-    syntax_error(loc_from_token(parser, Current()), "execting identifier following keyword 'enum'\n");
+    parser_error(parser, loc_from_token(parser, Current()), "execting identifier following keyword 'enum'\n");
     sync(parser);
   }
   return NULL;
 }
 
+// the semicolon is consumed by the caller.
+// use <ident> ('.' <ident>)* ('.' '{' <ident> (',' <ident>)* '}' | '.' '*')?
+// use fmt;
+// use fmt.println;
+// use fmt.{println, write};
+// use fmt.*;
 Item* parse_use_item(Parser* parser) {
   Debug();
+  SourceLoc loc = loc_from_token(parser, Current());
+  expect(Tkn_Use);
 
-  if(!match(Tkn_Semicolon)) {
-    syntax_error(loc_from_token(parser, Current()), "expecting ';' following variable declaration\n");
+  Ident** path = NULL;
+  Ident** names = NULL;
+  Ident* ident = parse_ident(parser);
+  if(!ident)
+    return NULL;
+  buf_push(path, ident);
+  loc = expand_loc(loc, ident->loc);
+
+  while(match(Tkn_Period)) {
+    Token current = Current();
+    if(match(Tkn_Astrick)) {
+      buf_push(names, new_ident("*", loc_from_token(parser, current)));
+      loc = expand_loc(loc, names[0]->loc);
+      break;
+    }
+    else if(match(Tkn_OpenBracket)) {
+      do {
+        Ident* name = parse_ident(parser);
+        if(!name)
+          break;
+        buf_push(names, name);
+      } while(match(Tkn_Comma));
+      loc = expand_loc(loc, loc_from_token(parser, Current()));
+      expect(Tkn_CloseBracket);
+      break;
+    }
+    else if((ident = parse_ident(parser))) {
+      buf_push(path, ident);
+      loc = expand_loc(loc, ident->loc);
+    }
+    else
+      break;
   }
-  return NULL;
+
+  return new_itemuse(path, names, loc);
 }
 
 Item* parse_module_item(Parser* parser) {
   Debug();
 
   if(!match(Tkn_Semicolon)) {
-    syntax_error(loc_from_token(parser, Current()), "expecting ';' following variable declaration\n");
+    parser_error(parser, loc_from_token(parser, Current()), "expecting ';' following variable declaration\n");
   }
   return NULL;
 }
@@ -1257,16 +1567,22 @@ Item* parse_field_item(Parser* parser) {
     Expr* init = NULL;
     if(match(Tkn_Colon)) {
       spec = parse_typespec(parser);
-      loc = expand_loc(loc, spec->loc);
+      if(spec)
+        loc = expand_loc(loc, spec->loc);
+      else
+        parser_error(parser, loc_from_token(parser, Current()), "expecting type following ':', found: '%s'\n", get_token_string(&Current()));
     }
 
     if(match(Tkn_Equal)) {
       init = parse_expr(parser);
-      loc = expand_loc(loc, init->loc);
+      if(init)
+        loc = expand_loc(loc, init->loc);
+      else
+        parser_error(parser, loc_from_token(parser, Current()), "expecting expression following '=', found: '%s'\n", get_token_string(&Current()));
     }
 
     if(!spec and !init)
-      syntax_error(loc_from_token(parser, Current()), "a type or initial value must be given\n");
+      parser_error(parser, loc_from_token(parser, Current()), "a type or initial value must be given\n");
 
     return new_itemfield(spec, ident, init, loc);
   }
@@ -1289,11 +1605,15 @@ Item* parse_type_or_tuplestruct(Parser* parser) {
       expect(Tkn_Equal);
       loc = expand_loc(loc, name->loc);
       TypeSpec* type = parse_typespec(parser);
+      if(!type) {
+        parser_error(parser, loc_from_token(parser, Current()), "expecting type following '=', found: '%s'\n", get_token_string(&Current()));
+        return NULL;
+      }
       loc = expand_loc(loc, type->loc);
       return new_itemalias(name, type, loc);
     }
     else {
-      syntax_error(loc_from_token(parser, Current()), "expecting '(' or '='\n");
+      parser_error(parser, loc_from_token(parser, Current()), "expecting '(' or '='\n");
     }
   }
   else {
@@ -1303,8 +1623,86 @@ Item* parse_type_or_tuplestruct(Parser* parser) {
 }
 
 
+// skips a block by matching braces, used for deferred function bodies.
+void skip_block(Parser* parser) {
+  Token* start = parser->current;
+  Token* current = parser->current;
+  u32 depth = 0;
+  for(; current->kind != Tkn_Eof; ++current) {
+    if(current->kind == Tkn_OpenBracket)
+      ++depth;
+    else if(current->kind == Tkn_CloseBracket and --depth == 0) {
+      parser->current = current + 1;
+      return;
+    }
+  }
+  parser->current = current;
+  parser_error(parser, loc_from_token(parser, *start), "unmatched '{', expecting '}' before the end of file\n");
+}
+
+bool is_item_start(TokenKind kind) {
+  switch(kind) {
+    case Tkn_Fn:
+    case Tkn_Struct:
+    case Tkn_Enum:
+    case Tkn_Type:
+    case Tkn_Use:
+    case Tkn_Let:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// the parser is at the start of a statement when the last token ended one
+// or the current token starts an item.
+bool at_boundary(Parser* parser) {
+  if(parser->current == parser->tokens)
+    return true;
+  TokenKind prev = (parser->current - 1)->kind;
+  return prev == Tkn_Semicolon or prev == Tkn_CloseBracket or
+    check(Tkn_CloseBracket) or check(Tkn_Eof) or is_item_start(Current().kind);
+}
+
+// skips tokens until a statement boundary: past a ';', or before a '}' or
+// an item keyword that is not nested within a block.
 void sync(Parser* parser) {
+  u32 depth = 0;
+  while(!check(Tkn_Eof)) {
+    TokenKind kind = Current().kind;
+    if(depth == 0) {
+      if(kind == Tkn_Semicolon) {
+        Consume();
+        break;
+      }
+      if(kind == Tkn_CloseBracket or is_item_start(kind))
+        break;
+    }
 
+    if(kind == Tkn_OpenBracket)
+      ++depth;
+    else if(kind == Tkn_CloseBracket)
+      --depth;
+    Consume();
+  }
+  parser->panic = false;
+}
+
+// skips tokens until the start of an item that is not nested within a block.
+void sync_item(Parser* parser) {
+  u32 depth = 0;
+  while(!check(Tkn_Eof)) {
+    TokenKind kind = Current().kind;
+    if(depth == 0 and is_item_start(kind))
+      break;
+
+    if(kind == Tkn_OpenBracket)
+      ++depth;
+    else if(kind == Tkn_CloseBracket and depth > 0)
+      --depth;
+    Consume();
+  }
+  parser->panic = false;
 }
 
 void parse_test(File* file) {
@@ -1323,21 +1721,500 @@ void parse_test(File* file) {
 
 
 AstFile* parse_file(File* file, StringTable* table) {
+  return parse_file_with_flags(file, table, Parse_Default);
+}
+
+// parses top level items until the end token, recovering from errors.
+// The index of the first token of each item is pushed to starts.
+void parse_items(Parser* parser, Token* end, ItemSet* items, u32** starts) {
+  while(parser->current < end and !check(Tkn_Eof)) {
+    Token* start = parser->current;
+    u32 errors = parser->num_errors;
+    Item* item = parse_item(parser);
+    if(item) {
+      buf_push(*items, item);
+      buf_push(*starts, (u32) (start - parser->tokens));
+      if(item->kind == ItemUse)
+        expect(Tkn_Semicolon);
+      else if(item->kind == ItemAlias or item->kind == ItemTupleStruct)
+        match(Tkn_Semicolon);
+    }
+    else
+      parser_error(parser, loc_from_token(parser, Current()), "invalid declaration in file scope, found: '%s'\n",
+        get_token_string(&Current()));
+
+    if(parser->num_errors != errors) {
+      if(parser->current == start)
+        Consume();
+      sync_item(parser);
+    }
+    parser->panic = false;
+  }
+}
+
+void parse_tokens(AstFile* ast, Token* tokens, u32 num, u32 flags) {
+  Arena* old = set_ast_arena(add_ast_arena(ast));
+
+  Parser parser = new_parser_from_tokens(ast->file, tokens, num, NULL);
+  parser.flags = flags;
+  parse_items(&parser, parser.end, &ast->items, &ast->item_tokens);
+  ast->truncated = error_budget_spent(parser.num_reported);
+
+  set_ast_arena(old);
+}
+
+AstFile* parse_file_with_flags(File* file, StringTable* table, u32 flags) {
   AstFile* ast = new_ast_file(file);
   // this works but might be bad practice
 
   assert(table);
+  ast->flags = flags;
+
+  u32 num;
+  ast->tokens = get_tokens(file, &num, table);
+  parse_tokens(ast, ast->tokens, num, flags);
+  return ast;
+}
+
+// Parallel parsing
+//
+// Top level items do not depend on each other while parsing, so after the
+// file is lexed the token stream is split at item boundaries and each range
+// is parsed by a worker into its own arena. The items are then joined in
+// source order.
+//
+// A range that has a syntax error, or that is not parsed up to exactly its
+// end, means the pre scan did not match how the serial parser sees the file.
+// The parallel result is thrown away and the file is parsed serially, so the
+// tree and its diagnostics are always the same as parse_file.
+
+// files with fewer tokens are not worth splitting.
+#define PARALLEL_PARSE_MIN_TOKENS 8192
+
+typedef struct ParseRange {
+  File* file;
+  Token* tokens;
+  u32 num_tokens;
+  u32 flags;
+
+  // token range, [begin, end)
+  u32 begin;
+  u32 end;
+
+  Arena* arena;
+  ItemSet items;
+  u32* starts;
+  bool failed;
+} ParseRange;
+
+// finds the tokens starting a top level item, an item keyword that is not
+// within any parentheses or brackets.
+u32* find_item_starts(Token* tokens, u32 num) {
+  u32* starts = NULL;
+  u32 depth = 0;
+  for(u32 i = 0; i < num; ++i) {
+    switch(tokens[i].kind) {
+      case Tkn_OpenParen:
+      case Tkn_OpenBrace:
+      case Tkn_OpenBracket:
+        ++depth;
+        break;
+      case Tkn_CloseParen:
+      case Tkn_CloseBrace:
+      case Tkn_CloseBracket:
+        if(depth > 0)
+          --depth;
+        break;
+      default:
+        if(depth == 0 and is_item_start(tokens[i].kind))
+          buf_push(starts, i);
+    }
+  }
+  return starts;
+}
+
+void parse_range_task(void* data) {
+  ParseRange* range = (ParseRange*) data;
+  Arena* old = set_ast_arena(range->arena);
 
-  Parser parser = new_parser(ast->file, table);
-  while(!check_(&parser, Tkn_Eof)) {
-    Item* item = parse_item(&parser);
-    if(item)
-      add_item(ast, item);
+  Parser parser = new_parser_from_tokens(range->file, range->tokens, range->num_tokens, NULL);
+  parser.flags = range->flags;
+  parser.speculative = true;
+  parser.current = range->tokens + range->begin;
+  parse_items(&parser, range->tokens + range->end, &range->items, &range->starts);
+
+  range->failed = parser.num_errors != 0 or parser.current != range->tokens + range->end;
+  set_ast_arena(old);
+}
+
+AstFile* parse_file_parallel(File* file, StringTable* table, u32 flags, Pool* pool) {
+  AstFile* ast = new_ast_file(file);
+  assert(table);
+  ast->flags = flags;
+
+  u32 num;
+  ast->tokens = get_tokens(file, &num, table);
+
+  u32 num_threads = pool ? pool_num_threads(pool) : 1;
+  u32* starts = NULL;
+  // the debug trace of the parser is only readable when it runs on one thread.
+  if(num_threads > 1 and !debug and num >= PARALLEL_PARSE_MIN_TOKENS)
+    starts = find_item_starts(ast->tokens, num);
+
+  if(buf_len(starts) < 2) {
+    buf_free(starts);
+    parse_tokens(ast, ast->tokens, num, flags);
+    return ast;
+  }
+
+  // split into one range per thread with about the same number of tokens.
+  // the eof token is never part of a range.
+  ParseRange* ranges = NULL;
+  u32 last = num - 1;
+  u32 target = last / num_threads + 1;
+  u32 begin = 0;
+  for(u32 i = 1; i < buf_len(starts); ++i) {
+    if(starts[i] - begin >= target) {
+      buf_push(ranges, (ParseRange) {file, ast->tokens, num, flags, begin, starts[i], NULL, NULL, NULL, false});
+      begin = starts[i];
+    }
+  }
+  buf_push(ranges, (ParseRange) {file, ast->tokens, num, flags, begin, last, NULL, NULL, NULL, false});
+  buf_free(starts);
+
+  // waits on a group so files can also be parsed by tasks of the same pool.
+  TaskGroup group = {0};
+  for(u32 i = 0; i < buf_len(ranges); ++i) {
+    ranges[i].arena = (Arena*) malloc(sizeof(Arena));
+    memset(ranges[i].arena, 0, sizeof(Arena));
+    pool_submit_group(pool, &group, parse_range_task, &ranges[i]);
+  }
+  pool_wait_group(pool, &group);
+
+  bool failed = false;
+  for(u32 i = 0; i < buf_len(ranges); ++i)
+    failed = failed or ranges[i].failed;
+
+  for(u32 i = 0; i < buf_len(ranges); ++i) {
+    if(failed) {
+      arena_free(ranges[i].arena);
+      free(ranges[i].arena);
+    }
     else {
-      syntax_error(loc_from_token(&parser, *parser.current), "invalid declaration in file scope\n");
+      buf_push(ast->arenas, ranges[i].arena);
+      for(u32 j = 0; j < buf_len(ranges[i].items); ++j) {
+        add_item(ast, ranges[i].items[j]);
+        buf_push(ast->item_tokens, ranges[i].starts[j]);
+      }
+    }
+    buf_free(ranges[i].items);
+    buf_free(ranges[i].starts);
+  }
+  buf_free(ranges);
+
+  if(failed)
+    parse_tokens(ast, ast->tokens, num, flags);
+
+  return ast;
+}
+
+// Incremental reparsing
+//
+// An edit can only change the items around it. The file is scanned again
+// from the first item the edit may touch until the scanner reaches the start
+// of an old item past the edit; from there on the text, and so the tokens,
+// are the same as before, only moved. Items are then parsed again from the
+// same point until the parser lands on the start of an old item, every item
+// after it is kept and only its locations are moved.
+//
+// The replaced items stay in the file's arena until the file is destroyed.
+
+// index of the first token starting at or after the byte offset.
+u32 find_token_at(AstFile* ast, u64 offset) {
+  u32 low = 0;
+  u32 high = buf_len(ast->tokens);
+  while(low < high) {
+    u32 mid = low + (high - low) / 2;
+    if(ast->tokens[mid].index < offset)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+// index of the first item starting at or after the token.
+u32 find_item_at(AstFile* ast, u32 token) {
+  u32 low = 0;
+  u32 high = buf_len(ast->items);
+  while(low < high) {
+    u32 mid = low + (high - low) / 2;
+    if(ast->item_tokens[mid] < token)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+AstFile* reparse_file(AstFile* ast, SourceEdit edit, StringTable* table) {
+  assert(table);
+  assert(edit.begin <= edit.end and edit.begin <= edit.new_end);
+
+  u32 num_items = buf_len(ast->items);
+  u32 num_tokens = buf_len(ast->tokens);
+  i64 delta = (i64) edit.new_end - (i64) edit.end;
+
+  // the token before the edit may continue into it, and parsing an item can
+  // look one token past its end. So an item is kept only when the item after
+  // it starts at least two tokens before the one the edit touches.
+  u32 touched = find_token_at(ast, edit.begin);
+  u32 first = find_item_at(ast, touched > 1 ? touched - 2 : 0);
+  first = first > 0 ? first - 1 : 0;
+
+  u32 begin = 0;
+  Token from = new_token(Tkn_None, 1, 1, 0, 0);
+  if(first > 0) {
+    begin = ast->item_tokens[first];
+    from = ast->tokens[begin];
+  }
+
+  // the items after the edit are where scanning can stop.
+  u32 after = find_item_at(ast, find_token_at(ast, edit.end));
+  u64* stops = NULL;
+  for(u32 i = after; i < num_items; ++i)
+    buf_push(stops, ast->tokens[ast->item_tokens[i]].index + delta);
+
+  u32 stop;
+  Token last;
+  Token* scanned = get_tokens_from(ast->file, table, from, stops, buf_len(stops), &stop, &last);
+  u32 num_scanned = buf_len(scanned);
+
+  // old tokens from end on are kept.
+  u32 kept = num_items;
+  u32 end = num_tokens;
+  LineShift shift = {0, 0, 0};
+  if(stop < buf_len(stops)) {
+    kept = after + stop;
+    end = ast->item_tokens[kept];
+    shift.line = ast->tokens[end].line;
+    shift.lines = (i64) last.line - (i64) ast->tokens[end].line;
+    shift.columns = (i64) last.column - (i64) ast->tokens[end].column;
+  }
+  buf_free(stops);
+
+  // splices the scanned tokens in place of [begin, end).
+  u32 num = begin + num_scanned + (num_tokens - end);
+  i64 moved = (i64) num - (i64) num_tokens;
+  buf_fit(ast->tokens, num);
+  Token* tokens = ast->tokens;
+  memmove(tokens + begin + num_scanned, tokens + end, (num_tokens - end) * sizeof(Token));
+  if(scanned)
+    memcpy(tokens + begin, scanned, num_scanned * sizeof(Token));
+  buf__hdr(tokens)->len = num;
+  buf_free(scanned);
+
+  for(u32 i = begin + num_scanned; i < num; ++i) {
+    tokens[i].index += delta;
+    shift_token(&tokens[i], shift);
+  }
+  for(u32 i = kept; i < num_items; ++i)
+    ast->item_tokens[i] += moved;
+
+  Arena* old = set_ast_arena(buf_len(ast->arenas) ? ast->arenas[0] : add_ast_arena(ast));
+  Parser parser = new_parser_from_tokens(ast->file, tokens, num, NULL);
+  parser.flags = ast->flags;
+  parser.current = tokens + begin;
+
+  // parses until an item ends where a kept one starts.
+  ItemSet items = NULL;
+  u32* starts = NULL;
+  u32 next = kept;
+  while(true) {
+    Token* boundary = next < num_items ? tokens + ast->item_tokens[next] : parser.end;
+    parse_items(&parser, boundary, &items, &starts);
+    if(next == num_items or parser.current == boundary)
       break;
+    while(next < num_items and tokens + ast->item_tokens[next] < parser.current)
+      ++next;
+  }
+  set_ast_arena(old);
+  // the items after the error budget ran out are dropped like in a full parse.
+  ast->truncated = error_budget_spent(parser.num_reported);
+
+  for(u32 i = next; i < num_items; ++i) {
+    Item* item = ast->items[i];
+    if(is_body_deferred(item)) {
+      item->function.body_begin += moved;
+      item->function.body_end += moved;
+    }
+    if(shift.lines != 0 or (shift.columns != 0 and tokens[ast->item_tokens[i]].line == shift.line))
+      shift_item(item, shift);
+  }
+
+  // joins the kept items before and after the reparsed ones.
+  u32 num_parsed = buf_len(items);
+  u32 num_after = num_items - next;
+  u32 total = first + num_parsed + num_after;
+  buf_fit(ast->items, total);
+  buf_fit(ast->item_tokens, total);
+  if(ast->items) {
+    memmove(ast->items + first + num_parsed, ast->items + next, num_after * sizeof(Item*));
+    memmove(ast->item_tokens + first + num_parsed, ast->item_tokens + next, num_after * sizeof(u32));
+    if(items) {
+      memcpy(ast->items + first, items, num_parsed * sizeof(Item*));
+      memcpy(ast->item_tokens + first, starts, num_parsed * sizeof(u32));
     }
+    buf__hdr(ast->items)->len = total;
+    buf__hdr(ast->item_tokens)->len = total;
   }
 
+  buf_free(items);
+  buf_free(starts);
+  ast->uid = new_ast_uid();
   return ast;
 }
+
+// edits a copy of the file and checks that reparsing gives the same items
+// and tokens as parsing the edited text from scratch.
+void reparse_test(File* file) {
+  StringTable* table = (StringTable*) malloc(sizeof(StringTable));
+  *table = create_table(TABLE_START);
+
+  File copy = *file;
+  copy.content = (char*) malloc(file->len + 1);
+  memcpy(copy.content, file->content, file->len + 1);
+
+  // the edits leave syntax errors, they are dropped.
+  ReportBuffer buffer = {NULL};
+  ReportBuffer* old = set_report_buffer(&buffer);
+  const char* edits[] = {"\nfn g() {}\n", "x", "{", "}", "\"", "/*", "*/", ";", ""};
+  AstFile* ast = parse_file(&copy, table);
+  for(u32 i = 0; i < sizeof(edits) / sizeof(edits[0]); ++i) {
+    u64 begin = copy.len * (i + 1) / 11;
+    u64 end = begin + (i % 3 == 0 and begin < copy.len);
+    u64 len = strlen(edits[i]);
+    replace_text(&copy, begin, end, edits[i], len);
+    reparse_file(ast, (SourceEdit) {begin, end, begin + len}, table);
+
+    AstFile* expected = parse_file(&copy, table);
+    assert(buf_len(ast->tokens) == buf_len(expected->tokens));
+    for(u32 j = 0; j < buf_len(ast->tokens); ++j) {
+      assert(ast->tokens[j].kind == expected->tokens[j].kind);
+      assert(ast->tokens[j].index == expected->tokens[j].index);
+      assert(ast->tokens[j].line == expected->tokens[j].line);
+    }
+    assert(ast_num_items(ast) == ast_num_items(expected));
+    for(u32 j = 0; j < ast_num_items(ast); ++j) {
+      assert(ast->item_tokens[j] == expected->item_tokens[j]);
+      assert(ast->items[j]->kind == expected->items[j]->kind);
+      assert(ast->items[j]->loc.line == expected->items[j]->loc.line);
+      assert(ast->items[j]->loc.column == expected->items[j]->loc.column);
+    }
+    destroy_ast_file(expected);
+  }
+  destroy_ast_file(ast);
+  free(copy.content);
+  set_report_buffer(old);
+  clear_report_buffer(&buffer);
+  printf("reparse_test: %u edits of %s\n", (u32) (sizeof(edits) / sizeof(edits[0])), file->fullpath);
+}
+
+// parses a function body of count terms joined by the operators, or
+// prefixed by them when prefix is set.
+void parse_expr_chain(const char* op, u32 count, bool prefix) {
+  char* source = NULL;
+  buf_printf(source, "fn f() i32 {\n  ");
+  for(u32 i = 0; i < count; ++i) {
+    if(prefix)
+      buf_printf(source, "%s", op);
+    else
+      buf_printf(source, "%u %s ", i, op);
+  }
+  buf_printf(source, "x\n}\n");
+
+  File file = {"<expr_depth_test>", source, buf_len(source), NULL};
+  StringTable table = create_table(TABLE_START);
+  u32 errors = thread_error_count();
+  AstFile* ast = parse_file(&file, &table);
+  assert(ast_num_items(ast) == 1 and thread_error_count() == errors);
+  assert(ast->items[0]->function.body);
+
+  destroy_ast_file(ast);
+  buf_free(source);
+}
+
+void* expr_depth_test_thread(void* data) {
+  const u32 count = 100000;
+  parse_expr_chain("+", count, false);
+  parse_expr_chain("*", count, false);
+  parse_expr_chain("**", count, false);
+  parse_expr_chain("=", count, false);
+  parse_expr_chain("..", count, false);
+  parse_expr_chain("- ", count, true);
+  parse_expr_chain("& ", count, true);
+  return data;
+}
+
+// parses long operator chains on a thread with a small stack, which would
+// overflow if the expression parser recursed for each term.
+void expr_depth_test(void) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 256 * 1024);
+
+  pthread_t thread;
+  int result = pthread_create(&thread, &attr, expr_depth_test_thread, NULL);
+  assert(result == 0);
+  pthread_join(thread, NULL);
+  pthread_attr_destroy(&attr);
+  printf("expr_depth_test: passed\n");
+}
+
+// parses a file with more syntax errors than the error budget, the parser
+// stops at the error that spends it.
+void error_budget_test(void) {
+  char* source = NULL;
+  for(u32 i = 0; i < 1000; ++i)
+    buf_printf(source, "fn f%u( {}\n", i);
+  File file = {"<error_budget_test>", source, buf_len(source), NULL};
+  StringTable table = create_table(TABLE_START);
+  ReportBuffer buffer = {NULL};
+  ReportBuffer* old = set_report_buffer(&buffer);
+
+  // the tests run without a budget.
+  set_max_errors(20);
+  AstFile* ast = parse_file(&file, &table);
+  assert(ast->truncated and report_error_count(&buffer) == 21 and ast_num_items(ast) < 21);
+  destroy_ast_file(ast);
+  clear_report_buffer(&buffer);
+
+  set_max_errors(0);
+  ast = parse_file(&file, &table);
+  assert(!ast->truncated and report_error_count(&buffer) == 2000 and ast_num_items(ast) == 1000);
+  destroy_ast_file(ast);
+  clear_report_buffer(&buffer);
+
+  set_report_buffer(old);
+  buf_free(source);
+  printf("error_budget_test: passed\n");
+}
+
+bool is_body_deferred(Item* item) {
+  return item->kind == ItemFunction and !item->function.body and
+    item->function.body_end > item->function.body_begin;
+}
+
+Expr* parse_function_body(AstFile* ast, Item* item) {
+  assert(item->kind == ItemFunction);
+  if(!is_body_deferred(item))
+    return item->function.body;
+
+  Parser parser = new_parser_from_tokens(ast->file, ast->tokens, buf_len(ast->tokens), NULL);
+  parser.current = parser.tokens + item->function.body_begin;
+  Arena* old = set_ast_arena(buf_len(ast->arenas) ? ast->arenas[0] : NULL);
+  item->function.body = parse_block_expr(&parser);
+  set_ast_arena(old);
+  item->function.body_begin = item->function.body_end = 0;
+  return item->function.body;
+}
@@ -4,10 +4,50 @@
 #include "io.h"
 
 typedef struct AstFile AstFile;
+typedef struct Item Item;
+typedef struct Expr Expr;
 
+typedef enum ParseFlags {
+  Parse_Default = 0,
+  // function bodies are skipped by matching braces, only their token range
+  // is recorded. They are parsed on request by parse_function_body.
+  Parse_LazyBodies = 1 << 0,
+} ParseFlags;
 
 AstFile* parse_file(File* file, StringTable* table);
 
+AstFile* parse_file_with_flags(File* file, StringTable* table, u32 flags);
+
+typedef struct Pool Pool;
+
+// parses the top level items of large files concurrently on the pool.
+// The resulting tree is the same as the one from parse_file_with_flags.
+AstFile* parse_file_parallel(File* file, StringTable* table, u32 flags, Pool* pool);
+
+// the bytes [begin, end) of the old text were replaced by [begin, new_end)
+// of the new one.
+typedef struct SourceEdit {
+  u64 begin;
+  u64 end;
+  u64 new_end;
+} SourceEdit;
+
+// updates the tree of a file after its text was edited in place, only the
+// items touched by the edit are parsed again.
+AstFile* reparse_file(AstFile* ast, SourceEdit edit, StringTable* table);
+
+// returns the body of a function item, parsing it first if it was deferred.
+Expr* parse_function_body(AstFile* ast, Item* item);
+
+// true if the body of the function item has not been parsed yet.
+bool is_body_deferred(Item* item);
+
 void parse_test(File* file);
 
+void reparse_test(File* file);
+
+void expr_depth_test(void);
+
+void error_budget_test(void);
+
 #endif
@@ -0,0 +1,220 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct Task {
+  TaskFn fn;
+  void* data;
+  TaskGroup* group;
+} Task;
+
+// tasks of one worker. The owner pushes and pops at the back, thieves take
+// from the front.
+typedef struct Deque {
+  pthread_mutex_t lock;
+  Task* tasks;
+  u64 head;
+} Deque;
+
+typedef struct Pool {
+  pthread_t* threads;
+  u32 num_threads;
+  // one deque per worker, the last one holds the tasks submitted from
+  // threads outside of the pool.
+  Deque* deques;
+
+  pthread_mutex_t lock;
+  // signaled when a task is submitted or the pool is destroyed
+  pthread_cond_t work;
+  // signaled when the last pending task of the pool or of a group finishes
+  pthread_cond_t done;
+
+  // tasks waiting in the deques, it is incremented before a task is pushed
+  // so it never under counts.
+  atomic_ullong queued;
+  // submitted tasks that have not finished
+  atomic_ullong pending;
+  bool shutdown;
+} Pool;
+
+typedef struct Worker {
+  Pool* pool;
+  u32 index;
+} Worker;
+
+// the worker running on this thread.
+_Thread_local Worker current_worker;
+
+void deque_push(Deque* deque, Task task) {
+  pthread_mutex_lock(&deque->lock);
+  buf_push(deque->tasks, task);
+  pthread_mutex_unlock(&deque->lock);
+}
+
+bool deque_take(Deque* deque, Task* task, bool back) {
+  pthread_mutex_lock(&deque->lock);
+  bool found = deque->head < buf_len(deque->tasks);
+  if(found) {
+    if(back)
+      *task = deque->tasks[--buf__hdr(deque->tasks)->len];
+    else
+      *task = deque->tasks[deque->head++];
+    if(deque->head == buf_len(deque->tasks)) {
+      buf_clear(deque->tasks);
+      deque->head = 0;
+    }
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+// index of the deque of the calling thread.
+u32 own_deque(Pool* pool) {
+  return current_worker.pool == pool ? current_worker.index : pool->num_threads;
+}
+
+// takes from the own deque first, then steals from the others.
+bool take_task(Pool* pool, Task* task) {
+  if(atomic_load(&pool->queued) == 0)
+    return false;
+  u32 self = own_deque(pool);
+  u32 num = pool->num_threads + 1;
+  for(u32 i = 0; i < num; ++i) {
+    u32 index = (self + i) % num;
+    if(deque_take(&pool->deques[index], task, i == 0)) {
+      atomic_fetch_sub(&pool->queued, 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void finish_task(Pool* pool, Task* task) {
+  bool group_done = task->group and atomic_fetch_sub(&task->group->pending, 1) == 1;
+  bool pool_done = atomic_fetch_sub(&pool->pending, 1) == 1;
+  if(group_done or pool_done) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+void* pool_worker(void* data) {
+  current_worker = *(Worker*) data;
+  free(data);
+  Pool* pool = current_worker.pool;
+  for(;;) {
+    Task task;
+    if(take_task(pool, &task)) {
+      task.fn(task.data);
+      finish_task(pool, &task);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while(atomic_load(&pool->queued) == 0 and !pool->shutdown)
+      pthread_cond_wait(&pool->work, &pool->lock);
+    bool stop = pool->shutdown and atomic_load(&pool->queued) == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if(stop)
+      break;
+  }
+  return NULL;
+}
+
+u32 num_processors() {
+  long num = sysconf(_SC_NPROCESSORS_ONLN);
+  return num > 0 ? (u32) num : 1;
+}
+
+Pool* new_pool(u32 num_threads) {
+  Pool* pool = (Pool*) malloc(sizeof(Pool));
+  memset(pool, 0, sizeof(Pool));
+
+  pool->num_threads = num_threads ? num_threads : num_processors();
+  pool->threads = (pthread_t*) malloc(sizeof(pthread_t) * pool->num_threads);
+  pool->deques = (Deque*) calloc(pool->num_threads + 1, sizeof(Deque));
+  for(u32 i = 0; i <= pool->num_threads; ++i)
+    pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  atomic_init(&pool->queued, 0);
+  atomic_init(&pool->pending, 0);
+
+  for(u32 i = 0; i < pool->num_threads; ++i) {
+    Worker* worker = (Worker*) malloc(sizeof(Worker));
+    *worker = (Worker) {pool, i};
+    pthread_create(&pool->threads[i], NULL, pool_worker, worker);
+  }
+
+  return pool;
+}
+
+void destroy_pool(Pool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for(u32 i = 0; i < pool->num_threads; ++i)
+    pthread_join(pool->threads[i], NULL);
+
+  for(u32 i = 0; i <= pool->num_threads; ++i) {
+    pthread_mutex_destroy(&pool->deques[i].lock);
+    buf_free(pool->deques[i].tasks);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work);
+  pthread_cond_destroy(&pool->done);
+  free(pool->deques);
+  free(pool->threads);
+  free(pool);
+}
+
+void pool_submit_group(Pool* pool, TaskGroup* group, TaskFn fn, void* data) {
+  if(group)
+    atomic_fetch_add(&group->pending, 1);
+  atomic_fetch_add(&pool->pending, 1);
+  atomic_fetch_add(&pool->queued, 1);
+  deque_push(&pool->deques[own_deque(pool)], (Task) {fn, data, group});
+
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_submit(Pool* pool, TaskFn fn, void* data) {
+  pool_submit_group(pool, NULL, fn, data);
+}
+
+void pool_wait(Pool* pool) {
+  assert(current_worker.pool != pool);
+  pthread_mutex_lock(&pool->lock);
+  while(atomic_load(&pool->pending))
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait_group(Pool* pool, TaskGroup* group) {
+  while(atomic_load(&group->pending)) {
+    Task task;
+    if(take_task(pool, &task)) {
+      task.fn(task.data);
+      finish_task(pool, &task);
+      continue;
+    }
+
+    // the remaining tasks of the group are running on other workers.
+    pthread_mutex_lock(&pool->lock);
+    while(atomic_load(&group->pending) and atomic_load(&pool->queued) == 0)
+      pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+u32 pool_num_threads(Pool* pool) {
+  return pool->num_threads;
+}
@@ -0,0 +1,46 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include "common.h"
+
+#include <stdatomic.h>
+
+// A fixed size pool of worker threads running submitted tasks.
+//
+// Every worker has its own queue of tasks. Tasks submitted by a task go to
+// the queue of its worker, which runs them newest first, and idle workers
+// steal the oldest tasks of the other queues.
+
+typedef void (*TaskFn)(void* data);
+
+typedef struct Pool Pool;
+
+// counts the unfinished tasks submitted with it, see pool_wait_group.
+typedef struct TaskGroup {
+  atomic_uint pending;
+} TaskGroup;
+
+// creates a pool with num_threads workers, zero uses one per processor.
+Pool* new_pool(u32 num_threads);
+
+void destroy_pool(Pool* pool);
+
+void pool_submit(Pool* pool, TaskFn fn, void* data);
+
+// submits a task counted by group.
+void pool_submit_group(Pool* pool, TaskGroup* group, TaskFn fn, void* data);
+
+// blocks until every submitted task, including tasks submitted by tasks, has finished.
+// Must not be called from a task.
+void pool_wait(Pool* pool);
+
+// runs tasks until every task of group has finished. Can be called from a
+// task, which keeps its worker busy instead of blocking it.
+void pool_wait_group(Pool* pool, TaskGroup* group);
+
+u32 pool_num_threads(Pool* pool);
+
+// number of processors available to the process.
+u32 num_processors();
+
+#endif
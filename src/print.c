@@ -1,360 +1,407 @@
 #include "print.h"
+#include "io.h"
 #include "entity.h"
 #include "type.h"
+#include "visit.h"
 
 void print_expr_(Expr* expr, int i);
 void print_item_(Item* item, int i);
 void print_stmt_(Stmt* stmt, int i);
 void print_typespec_(TypeSpec* spec, int i);
 void print_pattern_(Pattern* pattern, int i);
-void print_clause_(Clause* clause, int i);
 
-const char* indent(int i) {
-  if(i == 0)
-    return "";
+// Output
+//
+// Everything is appended to one buffer of the thread and written to stdout
+// in large blocks, so a dump costs no allocation or system call per node.
+// The walk is the same for every format, the nodes are opened and closed
+// with begin_print_node and end_print_node and the leaves are written with the
+// functions below them.
 
-  // tabbing is two spaces
-  i *= 2;
-  char* buffer = NULL;
+// written out once this much is buffered.
+#define PRINT_FLUSH_SIZE (64 * 1024)
 
-  while(--i >= 0)
-    buf_push(buffer, ' ');
-  return buffer;
-}
+typedef struct Dumper {
+  char* out;
+  AstFormat format;
+  // a value was written in the current JSON array, the next one is
+  // separated by a comma.
+  bool separate;
+  // depth of the next node.
+  int depth;
+} Dumper;
 
-// void print_stmt(Stmt* stmt, int i);
+static _Thread_local Dumper dumper = {NULL, Ast_Text, false, 0};
 
-void print_loc(SourceLoc loc) {
-  printf("\t%llu|%llu-%llu", loc.line, loc.column, loc.span);
+// tabbing is two spaces, deeper levels are written in more than one piece.
+static const char spaces[] = "                                                                ";
+
+void flush_print() {
+  if(buf_len(dumper.out))
+    fwrite(dumper.out, 1, buf_len(dumper.out), stdout);
+  buf_clear(dumper.out);
 }
 
-void print_token(Token* token) {
-  printf("Token(%s, %d, %llu, %llu, %llu)\n", get_token_string(token), token->type, token->line, token->column, token->span);
+void emit(const char* str, u64 len) {
+  u64 start = buf_len(dumper.out);
+  buf_fit(dumper.out, start + len);
+  memcpy(dumper.out + start, str, len);
+  buf__hdr(dumper.out)->len = start + len;
 }
 
-void print_token_(Token* token, int i) {
-  printf("%s", indent(i));
-  print_token(token);
+void emit_str(const char* str) {
+  emit(str, strlen(str));
 }
 
-void print_literal_(Token* token, int i) {
-  print_token_(token, i);
+void emit_u64(u64 value) {
+  char digits[20];
+  u32 i = sizeof(digits);
+  do {
+    digits[--i] = '0' + value % 10;
+    value /= 10;
+  } while(value);
+  emit(digits + i, sizeof(digits) - i);
 }
 
-void print_ident_(Ident* ident, int i) {
-  printf("%sIdent(%s)\n", indent(i), ident->value);
-}
-
-void print_expr_list(Expr** e, u32 num, u32 in) {
-  for(u32 i = 0; i < num; ++i)
-    print_expr_(e[i], in);
-}
-
-void print_stmt_list(Stmt** e, u32 num, u32 in) {
-  for(u32 i = 0; i < num; ++i)
-    print_stmt_(e[i], in);
-}
-
-void print_item_list(Item** e, u32 num, u32 in) {
-  for(u32 i = 0; i < num; ++i)
-    print_item_(e[i], in);
-}
-
-void print_pattern_list(Pattern** p, u32 num, u32 in) {
-  for(u32 i = 0; i < num; ++i)
-    print_pattern_(p[i], in);
-}
-
-void print_typespec_list(TypeSpec** p, u32 num, u32 in) {
-  for(u32 i = 0; i < num; ++i)
-    print_typespec_(p[i], in);
-}
-
-void print_expr_(Expr* expr, int i) {
-  if(!expr) return;
-  printf("%s%s", indent(i), expr_string(expr->kind));
-  print_loc(expr->loc);
-  printf("\n");
-  switch(expr->kind) {
-    case Name: {
-      print_ident_(expr->name, i + 1);
-    } break;
-    case Literal: {
-      print_literal_(&expr->literal, i + 1);
-    } break;
-    case StructLiteral: {
-      print_typespec_(expr->struct_lit.name, i + 1);
-      print_expr_list(expr->struct_lit.members, expr->struct_lit.num_members, i + 1);
-    } break;
-    case CompoundLiteral: {
-      print_expr_list(expr->compound_lit.members, expr->compound_lit.num_members, i + 1);
-    } break;
-    case Unary: {
-      print_token_(&expr->unary.op, i + 1);
-      print_expr_(expr->unary.expr, i + 1);
-    } break;
-    case Binary: {
-      print_token_(&expr->binary.op, i + 1);
-      print_expr_(expr->binary.lhs, i + 1);
-      print_expr_(expr->binary.rhs, i + 1);
-    } break;
-    case FnCall: {
-      print_expr_(expr->fncall.name, i + 1);
-      print_expr_list(expr->fncall.actuals, expr->fncall.num_actuals, i + 1);
-    } break;
-    case Field: {
-      print_expr_(expr->field.operand, i + 1);
-      print_ident_(expr->field.name, i + 1);
-    } break;
-    case DotFnCall: {
-      print_expr_(expr->dotcall.operand, i + 1);
-      print_expr_(expr->dotcall.name, i + 1);
-      print_expr_list(expr->dotcall.actuals, expr->dotcall.num_actuals, i + 1);
-    } break;
-    case If: {
-      print_expr_(expr->if_expr.cond, i + 1);
-      print_expr_(expr->if_expr.body, i + 1);
-      print_expr_(expr->if_expr.else_if, i + 1);
-    } break;
-    case MatchIf: {
-      print_expr_(expr->matchif_expr.cond, i + 1);
-      for(int x = 0; x < expr->matchif_expr.num_body; ++x)
-        print_clause_(expr->matchif_expr.body[i], i + 1);
-    } break;
-    case While: {
-      print_expr_(expr->while_expr.cond, i + 1);
-      print_expr_(expr->while_expr.body, i + 1);
-    } break;
-    case For: {
-      print_pattern_(expr->for_expr.pat, i + 1);
-      print_expr_(expr->for_expr.cond, i + 1);
-      print_expr_(expr->for_expr.body, i + 1);
-    } break;
-    case Return: {
-      print_expr_list(expr->return_expr.exprs, expr->return_expr.num_exprs, i + 1);
-    } break;
-    case Break: {
-      print_token_(&expr->break_expr, i + 1);
-    } break;
-    case Continue: {
-      print_token_(&expr->continue_expr, i + 1);
-    } break;
-    case Block: {
-      print_stmt_list(expr->block.stmts, expr->block.num_stmts, i + 1);
-    } break;
-    case Binding: {
-      print_expr_(expr->binding.name, i + 1);
-      print_expr_(expr->binding.binding, i + 1);
-    } break;
-    case In: {
-      print_expr_(expr->in.in, i + 1);
-      print_expr_(expr->in.expr, i + 1);
-    } break;
-    case Tuple: {
-      print_expr_list(expr->tuple.elems, expr->tuple.num_elems, i + 1);
-    } break;
-    case PatternExpr: {
-    } break;
-    case Assignment: {
-      print_token_(&expr->assign.op, i + 1);
-      print_expr_(expr->assign.variable, i + 1);
-      print_expr_(expr->assign.value, i + 1);
-    } break;
-    case Index: {
-      print_expr_(expr->index.operand, i + 1);
-      print_expr_(expr->index.index, i + 1);
-    } break;
-    case TupleElem: {
-      print_expr_(expr->tupleelem.operand, i + 1);
-      print_token_(&expr->tupleelem.elem, i + 1);
-    } break;
-    case Range: {
-      print_expr_(expr->range.start, i + 1);
-      print_expr_(expr->range.end, i + 1);
-      print_expr_(expr->range.step, i + 1);
-    } break;
-    case Slice: {
-      print_expr_(expr->slice.operand, i + 1);
-      print_expr_(expr->slice.start, i + 1);
-      print_expr_(expr->slice.end, i + 1);
-    } break;
-    default:;
+void emit_quoted(const char* str) {
+  emit_str("\"");
+  for(const char* c = str; *c; ++c) {
+    switch(*c) {
+      case '"': emit_str("\\\""); break;
+      case '\\': emit_str("\\\\"); break;
+      case '\n': emit_str("\\n"); break;
+      case '\t': emit_str("\\t"); break;
+      case '\r': emit_str("\\r"); break;
+      default:
+        if((unsigned char) *c < 0x20)
+          buf_printf(dumper.out, "\\u%04x", *c);
+        else
+          emit(c, 1);
+    }
   }
+  emit_str("\"");
 }
 
-void print_mutablity(Mutability mut, int i) {
-  printf("%s%s\n", indent(i), (mut == Immutable? "Immutable" : "Mutable"));
-}
-
-void print_item_(Item* item, int i) {
-  if(!item) return;
-  printf("%s%s", indent(i), item_string(item->kind));
-  print_loc(item->loc);
-  printf("\n");
-  switch(item->kind) {
-    case ItemLocal: {
-      print_mutablity(item->local.mut, i + 1);
-      print_pattern_(item->local.name, i + 1);
-      print_typespec_(item->local.type, i + 1);
-      print_expr_(item->local.init, i + 1);
-    } break;
-    case ItemFunction: {
-      print_ident_(item->function.name, i + 1);
-      print_item_list(item->function.arguments, item->function.num_args, i + 1);
-      print_typespec_(item->function.ret, i + 1);
-      print_expr_(item->function.body, i + 1);
-    } break;
-    case ItemStruct: {
-      print_ident_(item->structure.name, i + 1);
-      print_item_list(item->structure.fields, item->structure.num_fields, i + 1);
-    } break;
-    case ItemTupleStruct: {
-      print_ident_(item->tuplestruct.name, i + 1);
-      print_typespec_list(item->tuplestruct.fields, item->tuplestruct.num_fields, i + 1);
-    } break;
-    case ItemEnum: {
-      print_ident_(item->enumeration.name, i + 1);
-      print_item_list(item->enumeration.elems, item->enumeration.num_elems, i + 1);
-    } break;
-    case ItemUse: {
-
-    } break;
-    case ItemModule: {
-
-    } break;
-    case ItemField: {
-      print_ident_(item->field.name, i + 1);
-      print_typespec_(item->field.type, i + 1);
-      print_expr_(item->field.init, i + 1);
-    } break;
-    case ItemAlias: {
-      print_ident_(item->alias.name, i + 1);
-      print_typespec_(item->alias.type, i + 1);
-    } break;
-    case ItemName: {
-      print_ident_(item->name.name, i + 1);
-      print_expr_(item->name.value, i + 1);
-    } break;
+void indent(int i) {
+  u64 len = (u64) i * 2;
+  while(len) {
+    u64 part = len < sizeof(spaces) - 1 ? len : sizeof(spaces) - 1;
+    emit(spaces, part);
+    len -= part;
   }
 }
 
+// starts a value at depth i, the node or leaf follows on the same line.
+void begin_print_value(int i) {
+  switch(dumper.format) {
+    case Ast_Text:
+      indent(i);
+      break;
+    case Ast_Json:
+      if(dumper.separate)
+        emit_str(",");
+      dumper.separate = true;
+      break;
+    case Ast_Sexp:
+      if(i > 0) {
+        emit_str("\n");
+        indent(i);
+      }
+      break;
+  }
+}
+
+// ends a value at depth i.
+void end_print_value(int i) {
+  if(dumper.format == Ast_Text or (dumper.format == Ast_Sexp and i == 0))
+    emit_str("\n");
+  if(buf_len(dumper.out) >= PRINT_FLUSH_SIZE)
+    flush_print();
+}
+
+void print_loc(SourceLoc loc) {
+  emit_u64(loc.line);
+  emit_str("|");
+  emit_u64(loc.column);
+  emit_str("-");
+  emit_u64(loc.span);
+}
+
+void begin_print_node(const char* kind, SourceLoc loc, int i) {
+  begin_print_value(i);
+  switch(dumper.format) {
+    case Ast_Text:
+      emit_str(kind);
+      emit_str("\t");
+      print_loc(loc);
+      emit_str("\n");
+      break;
+    case Ast_Json:
+      emit_str("{\"kind\":\"");
+      emit_str(kind);
+      emit_str("\",\"loc\":[");
+      emit_u64(loc.line);
+      emit_str(",");
+      emit_u64(loc.column);
+      emit_str(",");
+      emit_u64(loc.span);
+      emit_str("],\"children\":[");
+      dumper.separate = false;
+      break;
+    case Ast_Sexp:
+      emit_str("(");
+      emit_str(kind);
+      emit_str(" ");
+      print_loc(loc);
+      break;
+  }
+}
 
-void print_stmt_(Stmt* stmt, int i) {
-  if(!stmt) return;
-  printf("%s%s", indent(i), stmt_string(stmt->kind));
-  print_loc(stmt->loc);
-  printf("\n");
-  switch(stmt->kind) {
-    case ExprStmt:
-      print_expr_(stmt->expr, i + 1);
+void end_print_node(int i) {
+  switch(dumper.format) {
+    case Ast_Text:
       break;
-    case SemiStmt:
-      print_expr_(stmt->semi, i + 1);
+    case Ast_Json:
+      emit_str("]}");
+      dumper.separate = true;
       break;
-    case ItemStmt:;
-      print_item_(stmt->item, i + 1);
+    case Ast_Sexp:
+      emit_str(")");
+      end_print_value(i);
       break;
+  }
+  if(buf_len(dumper.out) >= PRINT_FLUSH_SIZE)
+    flush_print();
+}
 
+void print_token_(Token* token, int i) {
+  const char* value = get_token_string(token);
+  if(!value)
+    value = "(null)";
+  begin_print_value(i);
+  switch(dumper.format) {
+    case Ast_Text:
+      emit_str("Token(");
+      emit_str(value);
+      emit_str(", ");
+      buf_printf(dumper.out, "%d", token->type);
+      emit_str(", ");
+      emit_u64(token->line);
+      emit_str(", ");
+      emit_u64(token->column);
+      emit_str(", ");
+      emit_u64(token->span);
+      emit_str(")");
+      break;
+    case Ast_Json:
+      emit_str("{\"kind\":\"Token\",\"value\":");
+      emit_quoted(value);
+      buf_printf(dumper.out, ",\"type\":%d,\"loc\":[", token->type);
+      emit_u64(token->line);
+      emit_str(",");
+      emit_u64(token->column);
+      emit_str(",");
+      emit_u64(token->span);
+      emit_str("]}");
+      break;
+    case Ast_Sexp:
+      emit_str("(Token ");
+      emit_quoted(value);
+      buf_printf(dumper.out, " %d ", token->type);
+      print_loc((SourceLoc) {NULL, token->line, token->column, token->span});
+      emit_str(")");
+      break;
   }
+  end_print_value(i);
 }
 
+void print_token(Token* token) {
+  print_token_(token, 0);
+  flush_print();
+}
 
-void print_typespec_(TypeSpec* spec, int i) {
-  if(!spec) return;
-  printf("%s%s", indent(i), typespec_string(spec->kind));
-  print_loc(spec->loc);
-  printf("\n");
-  print_mutablity(spec->mut, i + 1);
-  switch(spec->kind) {
-    case TypeSpecNone: {
-    } break;
-    case TypeSpecName: {
-      print_ident_(spec->name.name, i + 1);
-    } break;
-    case TypeSpecPath: {
-      print_typespec_(spec->path.parent, i + 1);
-      print_typespec_(spec->path.elem, i + 1);
-    } break;
-    case TypeSpecFunc: {
-      // print_ident_(item->function.name, i + 1);
-      print_typespec_list(spec->funct.args, spec->funct.num_args, i + 1);
-      print_typespec_(spec->funct.ret, i + 1);
-    } break;
-    case TypeSpecArray: {
-      print_typespec_(spec->array.elem, i + 1);
-    } break;
-    case TypeSpecPtr: {
-      print_typespec_(spec->ptr.elem, i + 1);
-    } break;
-    case TypeSpecRef: {
-      print_typespec_(spec->ref.elem, i + 1);
-    } break;
-    case TypeSpecMap: {
-      print_typespec_(spec->map.key, i + 1);
-      print_typespec_(spec->map.value, i + 1);
-    } break;
-    case TypeSpecTuple: {
-      print_typespec_list(spec->tuple.types, spec->tuple.num_types, i + 1);
-    } break;
+void print_literal_(Token* token, int i) {
+  print_token_(token, i);
+}
+
+void print_ident_(Ident* ident, int i) {
+  begin_print_value(i);
+  switch(dumper.format) {
+    case Ast_Text:
+      emit_str("Ident(");
+      emit_str(ident->value);
+      emit_str(")");
+      break;
+    case Ast_Json:
+      emit_str("{\"kind\":\"Ident\",\"value\":");
+      emit_quoted(ident->value);
+      emit_str("}");
+      break;
+    case Ast_Sexp:
+      emit_str("(Ident ");
+      emit_str(ident->value);
+      emit_str(")");
+      break;
   }
+  end_print_value(i);
 }
 
-void print_pattern_(Pattern* pat, int i) {
-  if(!pat) return;
-  printf("%s%s", indent(i), pattern_string(pat->kind));
-  print_loc(pat->loc);
-  printf("\n");
-  switch(pat->kind) {
-    case WildCard: {
-      print_token_(&pat->wildcard, i + 1);
-    } break;
-    case StructPattern: {
-      print_typespec_(pat->structure.path, i + 1);
-      print_pattern_list(pat->structure.elems, pat->structure.num_elems, i + 1);
-    } break;
-    case TuplePattern: {
-      print_pattern_list(pat->tuple.elems, pat->tuple.num_elems, i + 1);
-    } break;
-    case RefPattern: {
-      print_mutablity(pat->ref.mut, i + 1);
-      print_pattern_(pat->ref.pat, i + 1);
-    } break;
-    case PointerPattern: {
-      print_mutablity(pat->ptr.mut, i + 1);
-      print_pattern_(pat->ptr.pat, i + 1);
-    } break;
-    case IdentPattern: {
-      print_ident_(pat->ident, i + 1);
-    } break;
-    case LiteralPattern: {
-      print_literal_(&pat->literal, i + 1);
-    } break;
-    case RangePattern: {
-      print_pattern_(pat->range.start, i + 1);
-      print_pattern_(pat->range.end, i + 1);
-    } break;
-    default:;
+// a leaf that is only a name.
+void print_word(const char* word, int i) {
+  begin_print_value(i);
+  if(dumper.format == Ast_Json) {
+    emit_str("{\"kind\":\"");
+    emit_str(word);
+    emit_str("\"}");
   }
+  else
+    emit_str(word);
+  end_print_value(i);
+}
+
+// the tree is printed by a visitor, a node is opened before its children and
+// closed after them. Clauses are not printed, their patterns and body are
+// printed as children of the match.
+bool print_node(const char* kind, SourceLoc loc) {
+  begin_print_node(kind, loc, dumper.depth++);
+  return true;
+}
+
+void end_node() {
+  end_print_node(--dumper.depth);
+}
+
+bool print_item_node(void* data, Item* item) {
+  UNUSED(data);
+  return print_node(item_string(item->kind), item->loc);
+}
+
+bool print_stmt_node(void* data, Stmt* stmt) {
+  UNUSED(data);
+  return print_node(stmt_string(stmt->kind), stmt->loc);
 }
 
-void print_clause_(Clause* clause, int i) {
-  print_pattern_list(clause->patterns, clause->num_patterns, i);
-  print_expr_(clause->body, i);
+bool print_expr_node(void* data, Expr* expr) {
+  UNUSED(data);
+  return print_node(expr_string(expr->kind), expr->loc);
 }
 
-void note(const char* msg, ...) {
-  printf("\tNote: ");
-  va_list va;
-  va_start(va, msg);
-  vprintf(msg, va);
-  va_end(va);
+bool print_spec_node(void* data, TypeSpec* spec) {
+  UNUSED(data);
+  return print_node(typespec_string(spec->kind), spec->loc);
 }
 
-void print_literal(Token* token) { print_literal_(token, 0); }
-void print_expr(Expr* expr) { print_expr_(expr, 0); }
-void print_stmt(Stmt* stmt) { print_stmt_(stmt, 0); }
-void print_pattern(Pattern* pat) { print_pattern_(pat, 0); }
-void print_item(Item* item) { print_item_(item, 0); }
+bool print_pat_node(void* data, Pattern* pat) {
+  UNUSED(data);
+  return print_node(pattern_string(pat->kind), pat->loc);
+}
+
+void end_item_node(void* data, Item* item) {
+  UNUSED(data);
+  UNUSED(item);
+  end_node();
+}
+
+void end_stmt_node(void* data, Stmt* stmt) {
+  UNUSED(data);
+  UNUSED(stmt);
+  end_node();
+}
+
+void end_expr_node(void* data, Expr* expr) {
+  UNUSED(data);
+  UNUSED(expr);
+  end_node();
+}
+
+void end_spec_node(void* data, TypeSpec* spec) {
+  UNUSED(data);
+  UNUSED(spec);
+  end_node();
+}
+
+void end_pat_node(void* data, Pattern* pat) {
+  UNUSED(data);
+  UNUSED(pat);
+  end_node();
+}
+
+bool print_ident_leaf(void* data, Ident* ident) {
+  UNUSED(data);
+  print_ident_(ident, dumper.depth);
+  return true;
+}
+
+bool print_token_leaf(void* data, Token* token) {
+  UNUSED(data);
+  print_token_(token, dumper.depth);
+  return true;
+}
+
+bool print_mut_leaf(void* data, Mutability* mut) {
+  UNUSED(data);
+  print_word(*mut == Immutable ? "Immutable" : "Mutable", dumper.depth);
+  return true;
+}
+
+static const Visitor printer = {
+  .pre_item = print_item_node, .post_item = end_item_node,
+  .pre_stmt = print_stmt_node, .post_stmt = end_stmt_node,
+  .pre_expr = print_expr_node, .post_expr = end_expr_node,
+  .pre_spec = print_spec_node, .post_spec = end_spec_node,
+  .pre_pat = print_pat_node, .post_pat = end_pat_node,
+  .pre_ident = print_ident_leaf,
+  .pre_token = print_token_leaf,
+  .pre_mut = print_mut_leaf,
+};
+
+// prints node at depth i with walk.
+#define PRINT_TREE(walk, node, i) { \
+    Walk w = new_walk((Visitor*) &printer, 1); \
+    dumper.depth = i; \
+    walk(&w, node); \
+  }
+
+void print_expr_(Expr* expr, int i) PRINT_TREE(walk_expr, expr, i)
+void print_item_(Item* item, int i) PRINT_TREE(walk_item, item, i)
+void print_stmt_(Stmt* stmt, int i) PRINT_TREE(walk_stmt, stmt, i)
+void print_typespec_(TypeSpec* spec, int i) PRINT_TREE(walk_spec, spec, i)
+void print_pattern_(Pattern* pat, int i) PRINT_TREE(walk_pat, pat, i)
+
+void print_literal(Token* token) { print_literal_(token, 0); flush_print(); }
+void print_expr(Expr* expr) { print_expr_(expr, 0); flush_print(); }
+void print_stmt(Stmt* stmt) { print_stmt_(stmt, 0); flush_print(); }
+void print_pattern(Pattern* pat) { print_pattern_(pat, 0); flush_print(); }
+void print_item(Item* item) { print_item_(item, 0); flush_print(); }
+void print_ident(Ident* ident) { print_ident_(ident, 0); flush_print(); }
+
+bool parse_ast_format(const char* name, AstFormat* format) {
+  if(strcmp(name, "ast") == 0)
+    *format = Ast_Text;
+  else if(strcmp(name, "ast:json") == 0)
+    *format = Ast_Json;
+  else if(strcmp(name, "ast:sexp") == 0)
+    *format = Ast_Sexp;
+  else
+    return false;
+  return true;
+}
+
+void dump_ast_file(AstFile* ast, AstFormat format) {
+  dumper.format = format;
+  dumper.separate = false;
+  if(format == Ast_Json) {
+    emit_str("{\"file\":");
+    emit_quoted(ast->file->fullpath);
+    emit_str(",\"items\":[");
+  }
+  for(u32 i = 0; i < ast_num_items(ast); ++i)
+    print_item_(ast->items[i], 0);
+  if(format == Ast_Json)
+    emit_str("]}\n");
+  flush_print();
+  dumper.format = Ast_Text;
+}
 
 
 // void print_entity(Entity* entity) {
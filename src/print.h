@@ -25,6 +25,19 @@ void print_pattern(Pattern* pattern);
 //
 void print_entity(Entity* entity);
 
-void note(const char* msg, ...);
+// formats of dump_ast_file. The text format is the tree print_item prints,
+// a JSON dump is one object per file on its own line and an S-expression
+// dump has one expression per item.
+typedef enum AstFormat {
+  Ast_Text,
+  Ast_Json,
+  Ast_Sexp,
+} AstFormat;
+
+// the format named by --emit, "ast", "ast:json" or "ast:sexp".
+bool parse_ast_format(const char* name, AstFormat* format);
+
+// writes every item of the file to stdout.
+void dump_ast_file(AstFile* ast, AstFormat format);
 
 #endif
@@ -1,44 +1,484 @@
 #include "report.h"
+#include "cache.h"
 #include <stdarg.h>
+#include <stdatomic.h>
 
+// rendered diagnostics are written out once this much is buffered.
+#define REPORT_FLUSH_SIZE (64 * 1024)
+
+static atomic_uint num_errors = 0;
+static u32 max_errors = 0;
+
+static DiagnosticsFormat format = Diagnostics_Text;
+// no result has been written to the SARIF log yet.
+static bool sarif_first = true;
+
+static _Thread_local ReportBuffer* report_buffer = NULL;
+// the buffer owned by the thread, used when no buffer is set.
+static _Thread_local ReportBuffer* thread_buffer = NULL;
+static _Thread_local u32 thread_errors = 0;
+
+// the buffers owned by the threads, rendered by flush_diagnostics.
+static pthread_mutex_t thread_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static ReportBuffer** thread_buffers = NULL;
+
+ReportBuffer* current_report_buffer() {
+  if(report_buffer)
+    return report_buffer;
+  if(!thread_buffer) {
+    thread_buffer = (ReportBuffer*) calloc(1, sizeof(ReportBuffer));
+    pthread_mutex_lock(&thread_buffers_lock);
+    buf_push(thread_buffers, thread_buffer);
+    pthread_mutex_unlock(&thread_buffers_lock);
+  }
+  return thread_buffer;
+}
+
+// appends to the message of the last diagnostic.
 void vprint(const char* msg, va_list va) {
-  vprintf(msg, va);
+  ReportBuffer* buffer = current_report_buffer();
+  Diagnostic* diag = &buffer->diagnostics[buf_len(buffer->diagnostics) - 1];
+  va_list copy;
+  va_copy(copy, va);
+  int len = vsnprintf(NULL, 0, msg, copy);
+  va_end(copy);
+  u64 start = buf_len(diag->message);
+  buf_fit(diag->message, start + len + 1);
+  vsnprintf(diag->message + start, len + 1, msg, va);
+  buf__hdr(diag->message)->len = start + len;
+}
+
+void print(const char* msg, ...) {
+  va_list va;
+  va_start(va, msg);
+  vprint(msg, va);
+  va_end(va);
 }
 
-void print_location(File* file, u32 line, u32 column, const char* type) {
-  printf("%s:%u:%u %s ", file->fullpath, line, column, type);
+void set_max_errors(u32 max) {
+  max_errors = max;
 }
 
-// this will eventually handle print the source code line, showing where the error occured.
+u32 error_count() {
+  return atomic_load(&num_errors);
+}
+
+bool error_budget_spent(u32 count) {
+  return max_errors != 0 and count > max_errors;
+}
+
+u32 thread_error_count() {
+  return thread_errors;
+}
+
+ReportBuffer* set_report_buffer(ReportBuffer* buffer) {
+  ReportBuffer* old = report_buffer;
+  report_buffer = buffer;
+  return old;
+}
+
+// records a diagnostic, the message is formatted with print.
+void begin_diagnostic(DiagnosticKind kind, const char* code, File* file, u32 line, u32 column, u32 span) {
+  if(kind == Diag_Error)
+    ++thread_errors;
+  ReportBuffer* buffer = current_report_buffer();
+  buf_push(buffer->diagnostics, (Diagnostic) {kind, code, file, line, column, span, NULL, NULL});
+}
+
+void vreport(DiagnosticKind kind, const char* code, File* file, u32 line, u32 column, u32 span,
+  const char* msg, va_list va) {
+  begin_diagnostic(kind, code, file, line, column, span);
+  vprint(msg, va);
+
+  // the messages are written with a trailing newline.
+  ReportBuffer* buffer = current_report_buffer();
+  Diagnostic* diag = &buffer->diagnostics[buf_len(buffer->diagnostics) - 1];
+  while(buf_len(diag->message) and diag->message[buf_len(diag->message) - 1] == '\n')
+    diag->message[--buf__hdr(diag->message)->len] = 0;
+}
+
+// the message without its trailing newlines.
+char* vformat_message(const char* msg, va_list va) {
+  va_list copy;
+  va_copy(copy, va);
+  int len = vsnprintf(NULL, 0, msg, copy);
+  va_end(copy);
+  char* text = NULL;
+  buf_fit(text, len + 1);
+  vsnprintf(text, len + 1, msg, va);
+  while(len > 0 and text[len - 1] == '\n')
+    --len;
+  text[len] = 0;
+  buf__hdr(text)->len = len;
+  return text;
+}
+
+void note(const char* msg, ...) {
+  ReportBuffer* buffer = current_report_buffer();
+  if(!buf_len(buffer->diagnostics))
+    return;
+  Diagnostic* diag = &buffer->diagnostics[buf_len(buffer->diagnostics) - 1];
+  va_list va;
+  va_start(va, msg);
+  buf_push(diag->notes, vformat_message(msg, va));
+  va_end(va);
+}
+
+// counts the error and decides if it should be rendered.
+bool count_error(char** out) {
+  u32 count = atomic_fetch_add(&num_errors, 1);
+  if(max_errors != 0 and count >= max_errors) {
+    if(count == max_errors and format == Diagnostics_Text)
+      buf_printf(*out, "too many errors emitted, stopping now (--max-errors=%u)\n", max_errors);
+    return false;
+  }
+  return true;
+}
+
+typedef struct SortedDiagnostic {
+  Diagnostic* diag;
+  u32 buffer;
+  u32 index;
+} SortedDiagnostic;
+
+int compare_u32(u32 a, u32 b) {
+  return a < b ? -1 : a > b;
+}
+
+int compare_diagnostics(const void* a, const void* b) {
+  const SortedDiagnostic* x = (const SortedDiagnostic*) a;
+  const SortedDiagnostic* y = (const SortedDiagnostic*) b;
+  int cmp = compare_u32(x->buffer, y->buffer);
+  if(cmp == 0 and x->diag->file != y->diag->file) {
+    if(!x->diag->file or !y->diag->file)
+      cmp = x->diag->file ? 1 : -1;
+    else
+      cmp = strcmp(x->diag->file->fullpath, y->diag->file->fullpath);
+  }
+  if(cmp == 0)
+    cmp = compare_u32(x->diag->line, y->diag->line);
+  if(cmp == 0)
+    cmp = compare_u32(x->diag->column, y->diag->column);
+  if(cmp == 0)
+    cmp = compare_u32(x->diag->kind, y->diag->kind);
+  if(cmp == 0)
+    cmp = strcmp(x->diag->message ? x->diag->message : "", y->diag->message ? y->diag->message : "");
+  // keeps the order the diagnostics were reported in.
+  return cmp == 0 ? compare_u32(x->index, y->index) : cmp;
+}
+
+bool same_diagnostic(Diagnostic* a, Diagnostic* b) {
+  SortedDiagnostic x = {a, 0, 0};
+  SortedDiagnostic y = {b, 0, 0};
+  return compare_diagnostics(&x, &y) == 0;
+}
+
+bool parse_diagnostics_format(const char* name, DiagnosticsFormat* result) {
+  if(strcmp(name, "text") == 0)
+    *result = Diagnostics_Text;
+  else if(strcmp(name, "jsonl") == 0)
+    *result = Diagnostics_Jsonl;
+  else if(strcmp(name, "sarif") == 0)
+    *result = Diagnostics_Sarif;
+  else
+    return false;
+  return true;
+}
+
+void set_diagnostics_format(DiagnosticsFormat value) {
+  format = value;
+}
+
+DiagnosticsFormat diagnostics_format() {
+  return format;
+}
+
+void begin_diagnostics() {
+  if(format != Diagnostics_Sarif)
+    return;
+  sarif_first = true;
+  printf("{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"version\":\"2.1.0\","
+    "\"runs\":[{\"tool\":{\"driver\":{\"name\":\"oxc\",\"version\":\"%s\"}},\"results\":[", OXC_VERSION);
+}
+
+void end_diagnostics() {
+  if(format == Diagnostics_Sarif)
+    printf("]}]}\n");
+  fflush(stdout);
+}
+
+void render_json_string(char** out, const char* str) {
+  buf_push(*out, '"');
+  for(const char* c = str ? str : ""; *c; ++c) {
+    switch(*c) {
+      case '"': buf_printf(*out, "\\\""); break;
+      case '\\': buf_printf(*out, "\\\\"); break;
+      case '\n': buf_printf(*out, "\\n"); break;
+      case '\r': buf_printf(*out, "\\r"); break;
+      case '\t': buf_printf(*out, "\\t"); break;
+      default:
+        if((unsigned char) *c < 0x20)
+          buf_printf(*out, "\\u%04x", *c);
+        else
+          buf_push(*out, *c);
+    }
+  }
+  buf_push(*out, '"');
+}
+
+// offset in the file of the first byte of the diagnostic.
+u64 diagnostic_offset(Diagnostic* diag) {
+  u64 len = 0;
+  const char* text = file_line(diag->file, diag->line, &len);
+  if(!text)
+    return diag->file->len;
+  u64 offset = (u64) (text - diag->file->content) + (diag->column ? diag->column - 1 : 0);
+  return offset < diag->file->len ? offset : diag->file->len;
+}
+
+void render_text(char** out, Diagnostic* diag) {
+  if(diag->file)
+    buf_printf(*out, "%s:%u:%u ", diag->file->fullpath, diag->line, diag->column);
+  buf_printf(*out, "%s %s\n", diag->kind == Diag_Error ? "Error:" : "Internal Compiler Error:",
+    diag->message ? diag->message : "");
+
+  u64 len = 0;
+  const char* text = diag->file ? file_line(diag->file, diag->line, &len) : NULL;
+  if(text) {
+    buf_printf(*out, "  %.*s\n  ", (int) len, text);
+    // tabs are kept so the caret lines up with the source.
+    for(u32 i = 0; i + 1 < diag->column and i < len; ++i)
+      buf_push(*out, text[i] == '\t' ? '\t' : ' ');
+    buf_printf(*out, "^\n");
+  }
+  for(u32 i = 0; i < buf_len(diag->notes); ++i)
+    buf_printf(*out, "\tNote: %s\n", diag->notes[i]);
+}
+
+// the notes as an array of objects holding their message.
+void render_json_notes(char** out, Diagnostic* diag) {
+  buf_printf(*out, "[");
+  for(u32 i = 0; i < buf_len(diag->notes); ++i) {
+    buf_printf(*out, "%s{\"message\":", i ? "," : "");
+    render_json_string(out, diag->notes[i]);
+    buf_printf(*out, "}");
+  }
+  buf_printf(*out, "]");
+}
+
+void render_jsonl(char** out, Diagnostic* diag) {
+  buf_printf(*out, "{\"severity\":\"error\",\"code\":");
+  render_json_string(out, diag->code);
+  if(diag->file) {
+    u64 offset = diagnostic_offset(diag);
+    buf_printf(*out, ",\"file\":");
+    render_json_string(out, diag->file->fullpath);
+    buf_printf(*out, ",\"line\":%u,\"column\":%u,\"range\":[%llu,%llu]", diag->line, diag->column,
+      (unsigned long long) offset, (unsigned long long) (offset + diag->span));
+  }
+  buf_printf(*out, ",\"message\":");
+  render_json_string(out, diag->message);
+  buf_printf(*out, ",\"notes\":");
+  render_json_notes(out, diag);
+  buf_printf(*out, "}\n");
+}
+
+void render_sarif(char** out, Diagnostic* diag) {
+  buf_printf(*out, "%s{\"ruleId\":", sarif_first ? "" : ",");
+  sarif_first = false;
+  render_json_string(out, diag->code);
+  buf_printf(*out, ",\"level\":\"error\",\"message\":{\"text\":");
+  render_json_string(out, diag->message);
+  buf_printf(*out, "}");
+  if(diag->file) {
+    buf_printf(*out, ",\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":");
+    render_json_string(out, diag->file->fullpath);
+    buf_printf(*out, "},\"region\":{\"startLine\":%u,\"startColumn\":%u,\"byteOffset\":%llu,"
+      "\"byteLength\":%u}}}]", diag->line, diag->column, (unsigned long long) diagnostic_offset(diag),
+      diag->span);
+  }
+  // SARIF has no place for notes, they are kept in the property bag.
+  if(diag->notes) {
+    buf_printf(*out, ",\"properties\":{\"notes\":");
+    render_json_notes(out, diag);
+    buf_printf(*out, "}");
+  }
+  buf_printf(*out, "}\n");
+}
+
+void render_diagnostic(char** out, Diagnostic* diag) {
+  switch(format) {
+    case Diagnostics_Text: render_text(out, diag); break;
+    case Diagnostics_Jsonl: render_jsonl(out, diag); break;
+    case Diagnostics_Sarif: render_sarif(out, diag); break;
+  }
+}
+
+// renders into out, which is written to stream and emptied whenever it is
+// full when stream is not NULL.
+void render_diagnostics(ReportBuffer** buffers, u32 num, char** out, FILE* stream) {
+  SortedDiagnostic* sorted = NULL;
+  for(u32 i = 0; i < num; ++i) {
+    for(u32 j = 0; j < buf_len(buffers[i]->diagnostics); ++j)
+      buf_push(sorted, (SortedDiagnostic) {&buffers[i]->diagnostics[j], i, j});
+  }
+  if(sorted)
+    qsort(sorted, buf_len(sorted), sizeof(SortedDiagnostic), compare_diagnostics);
+
+  for(u32 i = 0; i < buf_len(sorted); ++i) {
+    Diagnostic* diag = sorted[i].diag;
+    if(i > 0 and sorted[i - 1].buffer == sorted[i].buffer and same_diagnostic(sorted[i - 1].diag, diag))
+      continue;
+    if(diag->kind == Diag_Error and !count_error(out))
+      continue;
+    render_diagnostic(out, diag);
+    if(stream and buf_len(*out) >= REPORT_FLUSH_SIZE) {
+      fwrite(*out, 1, buf_len(*out), stream);
+      buf_clear(*out);
+    }
+  }
+  buf_free(sorted);
+}
+
+void print_report_buffers(ReportBuffer** buffers, u32 num) {
+  char* out = NULL;
+  render_diagnostics(buffers, num, &out, stdout);
+  if(out)
+    fwrite(out, 1, buf_len(out), stdout);
+  buf_free(out);
+}
+
+void print_report_buffer(ReportBuffer* buffer) {
+  print_report_buffers(&buffer, 1);
+}
+
+void flush_diagnostics() {
+  pthread_mutex_lock(&thread_buffers_lock);
+  print_report_buffers(thread_buffers, buf_len(thread_buffers));
+  for(u32 i = 0; i < buf_len(thread_buffers); ++i)
+    clear_report_buffer(thread_buffers[i]);
+  pthread_mutex_unlock(&thread_buffers_lock);
+}
+
+u32 report_error_count(ReportBuffer* buffer) {
+  u32 count = 0;
+  for(u32 i = 0; i < buf_len(buffer->diagnostics); ++i)
+    count += buffer->diagnostics[i].kind == Diag_Error;
+  return count;
+}
+
+void append_report_buffer(ReportBuffer* buffer) {
+  ReportBuffer* current = current_report_buffer();
+  for(u32 i = 0; i < buf_len(buffer->diagnostics); ++i) {
+    thread_errors += buffer->diagnostics[i].kind == Diag_Error;
+    buf_push(current->diagnostics, buffer->diagnostics[i]);
+  }
+  buf_free(buffer->diagnostics);
+}
+
+void clear_report_buffer(ReportBuffer* buffer) {
+  for(u32 i = 0; i < buf_len(buffer->diagnostics); ++i) {
+    Diagnostic* diag = &buffer->diagnostics[i];
+    buf_free(diag->message);
+    for(u32 j = 0; j < buf_len(diag->notes); ++j)
+      buf_free(diag->notes[j]);
+    buf_free(diag->notes);
+  }
+  buf_free(buffer->diagnostics);
+}
+
+void reset_errors() {
+  atomic_store(&num_errors, 0);
+}
+
+void vsyntax_error(SourceLoc loc, const char* msg, va_list va) {
+  vreport(Diag_Error, "syntax", loc.file, loc.line, loc.column, loc.span, msg, va);
+}
 
 void syntax_error(SourceLoc loc, const char* msg, ...) {
-  print_location(loc.file, loc.line, loc.column, "Error:");
   va_list va;
   va_start(va, msg);
-  vprint(msg, va);
+  vsyntax_error(loc, msg, va);
   va_end(va);
 }
 
 void compiler_error(const char* msg, ...) {
-  printf("Internal Compiler Error: ");
   va_list va;
   va_start(va, msg);
-  vprint(msg, va);
+  vreport(Diag_Internal, "internal", NULL, 0, 0, 0, msg, va);
   va_end(va);
 }
 
 void scan_error(File* file, u32 line, u32 column, const char* msg, ...) {
-  print_location(file, line, column, "Error:");
   va_list va;
   va_start(va, msg);
-  vprint(msg, va);
+  vreport(Diag_Error, "scan", file, line, column, 1, msg, va);
   va_end(va);
 }
 
 void check_error(SourceLoc loc, const char* msg, ...) {
-  print_location(loc.file, loc.line, loc.column, "Error:");
   va_list va;
   va_start(va, msg);
-  vprint(msg, va);
+  vreport(Diag_Error, "check", loc.file, loc.line, loc.column, loc.span, msg, va);
+  va_end(va);
+}
+
+void driver_error(const char* msg, ...) {
+  va_list va;
+  va_start(va, msg);
+  vreport(Diag_Error, "driver", NULL, 0, 0, 0, msg, va);
   va_end(va);
 }
+
+void report_test() {
+  char source[] = "fn f() {\n\tlet x = ;\n}\n";
+  File file = {"<report_test>", source, sizeof(source) - 1, NULL};
+
+  ReportBuffer buffer = {0};
+  ReportBuffer* old = set_report_buffer(&buffer);
+  u32 errors = thread_error_count();
+  scan_error(&file, 3, 1, "second\n");
+  syntax_error((SourceLoc) {&file, 2, 10, 1}, "first %d\n", 1);
+  note("an %s\n", "explanation");
+  scan_error(&file, 3, 1, "second\n");
+  compiler_error("internal\n");
+  set_report_buffer(old);
+  assert(thread_error_count() == errors + 3);
+  assert(report_error_count(&buffer) == 3);
+
+  u32 max = max_errors;
+  DiagnosticsFormat old_format = format;
+  max_errors = 0;
+  char* out = NULL;
+  render_diagnostics(&(ReportBuffer*) {&buffer}, 1, &out, NULL);
+  buf_push(out, 0);
+  const char* expected =
+    "Internal Compiler Error: internal\n"
+    "<report_test>:2:10 Error: first 1\n"
+    "  \tlet x = ;\n"
+    "  \t        ^\n"
+    "\tNote: an explanation\n"
+    "<report_test>:3:1 Error: second\n"
+    "  }\n"
+    "  ^\n";
+  assert(strcmp(out, expected) == 0);
+
+  buf_clear(out);
+  format = Diagnostics_Jsonl;
+  render_diagnostics(&(ReportBuffer*) {&buffer}, 1, &out, NULL);
+  buf_push(out, 0);
+  expected =
+    "{\"severity\":\"error\",\"code\":\"internal\",\"message\":\"internal\",\"notes\":[]}\n"
+    "{\"severity\":\"error\",\"code\":\"syntax\",\"file\":\"<report_test>\",\"line\":2,\"column\":10,"
+    "\"range\":[18,19],\"message\":\"first 1\",\"notes\":[{\"message\":\"an explanation\"}]}\n"
+    "{\"severity\":\"error\",\"code\":\"scan\",\"file\":\"<report_test>\",\"line\":3,\"column\":1,"
+    "\"range\":[20,21],\"message\":\"second\",\"notes\":[]}\n";
+  assert(strcmp(out, expected) == 0);
+  atomic_fetch_sub(&num_errors, 4);
+  format = old_format;
+  max_errors = max;
+
+  buf_free(out);
+  buf_free(file.lines);
+  clear_report_buffer(&buffer);
+}
@@ -6,10 +6,131 @@
 
 void syntax_error(SourceLoc loc, const char* msg, ...);
 
+void vsyntax_error(SourceLoc loc, const char* msg, va_list va);
+
 void compiler_error(const char* msg, ...);
 
 void scan_error(File* file, u32 line, u32 column, const char* msg, ...);
 
 void check_error(SourceLoc, const char* msg, ...);
 
+// an error of the compiler driver, without a location in the source.
+void driver_error(const char* msg, ...);
+
+// the error budget. Once more than max errors have been reported, further
+// errors are counted but not printed. zero means there is no limit.
+void set_max_errors(u32 max);
+
+u32 error_count();
+
+// true when count errors are more than the error budget. The one past the
+// budget is printed as the note that errors were dropped, the ones a pass
+// reports after it could not be printed, so a pass counting its own can stop.
+bool error_budget_spent(u32 count);
+
+// errors reported on the calling thread, printed or buffered.
+u32 thread_error_count();
+
+// Diagnostics
+//
+// Reports are not printed when they are made. Each one is recorded as a
+// Diagnostic in the buffer of the calling thread, the buffer set with
+// set_report_buffer or else a buffer owned by the thread, so threads never
+// write to the output at the same time. The buffers are rendered once the
+// work that fills them is done: the diagnostics are sorted by location,
+// duplicates are dropped and each is printed with its source line and a
+// caret under the column, all through one output buffer.
+//
+// Every format is rendered this way, JSON Lines included, so the records of
+// a buffer are sorted and never interleaved with those of another thread.
+// With JSON Lines and SARIF the buffer of a module is rendered as soon as the
+// module is parsed, so the modules are written in the order they finish,
+// and the diagnostics of checking are rendered when it ends. Text is
+// rendered in module order once every module is parsed. The reports of a
+// module are kept with the module so a server can render them again for an
+// unchanged file, the memory this holds grows with the number of
+// diagnostics of the modules. The error budget is applied when they are
+// rendered, so with a budget the records written can depend on the order
+// the modules finish in.
+
+typedef enum DiagnosticKind {
+  Diag_Error,
+  Diag_Internal,
+} DiagnosticKind;
+
+typedef struct Diagnostic {
+  DiagnosticKind kind;
+  // the kind of check that failed, "scan", "syntax", "check", "driver" or
+  // "internal".
+  const char* code;
+  // NULL for diagnostics without a location.
+  File* file;
+  u32 line;
+  u32 column;
+  // length in bytes of the source the diagnostic is about.
+  u32 span;
+  // without the trailing newline.
+  char* message;
+  // the notes explaining the diagnostic, rendered after it.
+  char** notes;
+} Diagnostic;
+
+typedef struct ReportBuffer {
+  Diagnostic* diagnostics;
+} ReportBuffer;
+
+// adds a note to the last diagnostic reported on the calling thread.
+void note(const char* msg, ...);
+
+// sets the buffer of the calling thread, NULL records into the buffer owned
+// by the thread. Returns the previous buffer.
+ReportBuffer* set_report_buffer(ReportBuffer* buffer);
+
+// the format diagnostics are rendered in. The machine readable formats hold
+// the byte range of the source instead of the source line. A JSON Lines
+// record is written for every diagnostic, a SARIF log is one document per
+// compile, begun and ended by begin_diagnostics and end_diagnostics. Notes
+// are an array of objects in both, in the property bag of a SARIF result.
+typedef enum DiagnosticsFormat {
+  Diagnostics_Text,
+  Diagnostics_Jsonl,
+  Diagnostics_Sarif,
+} DiagnosticsFormat;
+
+// returns false for an unknown name.
+bool parse_diagnostics_format(const char* name, DiagnosticsFormat* format);
+
+void set_diagnostics_format(DiagnosticsFormat format);
+
+DiagnosticsFormat diagnostics_format();
+
+void begin_diagnostics();
+
+void end_diagnostics();
+
+// renders the diagnostics of the buffers, in the order of the buffers and by
+// location within each one. Errors count against the error budget when they
+// are rendered. The buffers are kept until they are cleared.
+void print_report_buffers(ReportBuffer** buffers, u32 num);
+
+void print_report_buffer(ReportBuffer* buffer);
+
+// renders and clears the buffers owned by the threads, the diagnostics
+// reported outside of any buffer set with set_report_buffer.
+void flush_diagnostics();
+
+// number of errors in the buffer.
+u32 report_error_count(ReportBuffer* buffer);
+
+// moves the diagnostics of the buffer into the buffer of the calling
+// thread, its errors count as reported on the thread.
+void append_report_buffer(ReportBuffer* buffer);
+
+void clear_report_buffer(ReportBuffer* buffer);
+
+// starts counting errors from zero, used between the requests of a server.
+void reset_errors();
+
+void report_test();
+
 #endif
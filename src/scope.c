@@ -0,0 +1,122 @@
+#include "scope.h"
+
+// grows the table when it is half full, the first table has 8 slots.
+void grow_symbol_table(SymbolTable* table, Arena* arena) {
+  u32 cap = table->cap ? table->cap * 2 : 8;
+  SymbolSlot* slots = (SymbolSlot*) arena_alloc(arena, sizeof(SymbolSlot) * cap);
+  memset(slots, 0, sizeof(SymbolSlot) * cap);
+  for(u32 i = 0; i < table->cap; ++i) {
+    SymbolSlot slot = table->slots[i];
+    if(!slot.name)
+      continue;
+    u32 j = (u32) hash_ptr(slot.name) & (cap - 1);
+    while(slots[j].name)
+      j = (j + 1) & (cap - 1);
+    slots[j] = slot;
+  }
+  table->slots = slots;
+  table->cap = cap;
+}
+
+SymbolSlot* find_symbol_slot(SymbolTable* table, const char* name) {
+  u32 mask = table->cap - 1;
+  for(u32 i = (u32) hash_ptr(name) & mask;; i = (i + 1) & mask) {
+    SymbolSlot* slot = table->slots + i;
+    if(slot->name == name or !slot->name)
+      return slot;
+  }
+}
+
+Entity* symbol_get(SymbolTable* table, const char* name) {
+  if(table->num == 0)
+    return NULL;
+  return find_symbol_slot(table, name)->entity;
+}
+
+void symbol_put(SymbolTable* table, Arena* arena, const char* name, Entity* entity) {
+  if(2 * (table->num + 1) > table->cap)
+    grow_symbol_table(table, arena);
+  SymbolSlot* slot = find_symbol_slot(table, name);
+  if(!slot->name)
+    table->num++;
+  slot->name = name;
+  slot->entity = entity;
+}
+
+void symbol_clear(SymbolTable* table) {
+  if(table->num)
+    memset(table->slots, 0, sizeof(SymbolSlot) * table->cap);
+  table->num = 0;
+}
+
+Scope* new_scope(Arena* arena, ScopeKind kind, Scope* parent) {
+  Scope* scope = (Scope*) arena_alloc(arena, sizeof(Scope));
+  memset(scope, 0, sizeof(Scope));
+  scope->kind = kind;
+  scope->parent = parent;
+  scope->arena = arena;
+  return scope;
+}
+
+void destroy_scope(Scope* scope) {
+  buf_free(scope->declared);
+}
+
+Entity* scope_import(Scope* scope, const char* name, Entity* entity) {
+  Entity* previous = symbol_get(&scope->entities, name);
+  if(previous)
+    return previous;
+  symbol_put(&scope->entities, scope->arena, name, entity);
+  return NULL;
+}
+
+Entity* scope_add(Scope* scope, Entity* entity) {
+  Entity* previous = scope_import(scope, entity->name->value, entity);
+  if(previous)
+    return previous;
+  entity->scope = scope;
+  buf_push(scope->declared, entity);
+  return NULL;
+}
+
+Entity* scope_find(Scope* scope, const char* name) {
+  return symbol_get(&scope->entities, name);
+}
+
+Entity* scope_lookup(Scope* scope, const char* name) {
+  for(; scope; scope = scope->parent) {
+    Entity* entity = symbol_get(&scope->entities, name);
+    if(entity)
+      return entity;
+  }
+  return NULL;
+}
+
+void reset_scope_cache(ScopeCache* cache, Scope* scope) {
+  symbol_clear(&cache->names);
+  cache->scope = scope;
+}
+
+Entity* cached_lookup(ScopeCache* cache, Arena* arena, Scope* scope, const char* name) {
+  Scope* inner = scope;
+  for(; inner; inner = inner->parent) {
+    Entity* entity = symbol_get(&inner->entities, name);
+    if(entity)
+      return entity;
+    if(inner == cache->scope)
+      break;
+  }
+  if(!inner)
+    return NULL;
+
+  Entity* entity = symbol_get(&cache->names, name);
+  if(entity) {
+    cache->hits++;
+    return entity;
+  }
+  cache->misses++;
+  entity = scope_lookup(inner->parent, name);
+  if(entity)
+    symbol_put(&cache->names, arena, name, entity);
+  return entity;
+}
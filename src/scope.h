@@ -0,0 +1,94 @@
+#ifndef SCOPE_H_
+#define SCOPE_H_
+
+#include "entity.h"
+
+// Scopes
+//
+// A scope maps names to the entities declared in it. A name not found in a
+// scope is looked up in its parent, the global scope holding the builtins is
+// the root of every chain.
+//
+// Names are interned by the string table, so the address of a name is its
+// symbol id and the tables of the scopes are open addressed on it, compared
+// without looking at the characters. The tables are allocated from the arena
+// of the checker, a table that grows leaves its old slots in the arena.
+
+typedef struct SymbolSlot {
+  const char* name;
+  Entity* entity;
+} SymbolSlot;
+
+typedef struct SymbolTable {
+  SymbolSlot* slots;
+  u32 cap;
+  u32 num;
+} SymbolTable;
+
+// the entity of the name, NULL when it is not in the table.
+Entity* symbol_get(SymbolTable* table, const char* name);
+
+// adds or replaces the entity of the name.
+void symbol_put(SymbolTable* table, Arena* arena, const char* name, Entity* entity);
+
+// removes every name, keeping the slots.
+void symbol_clear(SymbolTable* table);
+
+typedef enum ScopeKind {
+  Scope_Global,
+  Scope_File,
+  Scope_Function,
+  Scope_Block,
+} ScopeKind;
+
+typedef struct Scope {
+  ScopeKind kind;
+  Scope* parent;
+  Arena* arena;
+  // name to Entity, including the names imported by use items.
+  SymbolTable entities;
+  // the entities declared in the scope, in order.
+  Entity** declared;
+  // names resolve_name found from the scope in its parents.
+  SymbolTable resolved;
+} Scope;
+
+Scope* new_scope(Arena* arena, ScopeKind kind, Scope* parent);
+
+void destroy_scope(Scope* scope);
+
+// adds the entity under its name. Returns the entity already using the name
+// in this scope, or NULL when it was added.
+Entity* scope_add(Scope* scope, Entity* entity);
+
+// adds an entity declared in another scope under name.
+Entity* scope_import(Scope* scope, const char* name, Entity* entity);
+
+// the entity of name in this scope only.
+Entity* scope_find(Scope* scope, const char* name);
+
+// the entity of name in this scope or the closest parent declaring it.
+Entity* scope_lookup(Scope* scope, const char* name);
+
+// Lookup cache
+//
+// The names a function uses from outside of it resolve the same way
+// everywhere in its body, so they are looked up once and kept in the cache
+// until another function is checked. Inside the function only the scopes up
+// to its own are walked, most of which declare nothing and are skipped.
+
+typedef struct ScopeCache {
+  // the outermost scope of the function, NULL when nothing is cached.
+  Scope* scope;
+  SymbolTable names;
+  u64 hits;
+  u64 misses;
+} ScopeCache;
+
+// clears the cache and makes it cache the names used under scope.
+void reset_scope_cache(ScopeCache* cache, Scope* scope);
+
+// scope_lookup, through the cache when scope is under the cached one.
+Entity* cached_lookup(ScopeCache* cache, Arena* arena, Scope* scope, const char* name);
+
+#endif
@@ -0,0 +1,246 @@
+#define _XOPEN_SOURCE 700
+
+#include "server.h"
+#include "oxy.h"
+#include "report.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// reads a request into data and returns its strings, the first one is the
+// working directory. NULL is returned when the input ends first.
+const char** read_request(FILE* in, char** data) {
+  buf_clear(*data);
+  u64* starts = NULL;
+  u64 start = 0;
+  for(int c; (c = getc(in)) != EOF;) {
+    buf_push(*data, (char) c);
+    if(c != 0)
+      continue;
+    if(buf_len(*data) - 1 == start) {
+      // the strings are only pointed to once data no longer grows.
+      const char** strings = NULL;
+      for(u32 i = 0; i < buf_len(starts); ++i)
+        buf_push(strings, *data + starts[i]);
+      buf_free(starts);
+      return strings;
+    }
+    buf_push(starts, start);
+    start = buf_len(*data);
+  }
+  buf_free(starts);
+  return NULL;
+}
+
+int serve_request(ModuleLoader* loader, const char** strings, const char* server_dir, bool* shutdown) {
+  reset_options();
+  reset_errors();
+  if(buf_len(strings) < 2) {
+    printf("Error: invalid request\n");
+    return 1;
+  }
+  if(chdir(strings[0]) != 0) {
+    printf("Error: unable to enter directory '%s'\n", strings[0]);
+    return 1;
+  }
+
+  int status = 1;
+  if(!validate_input(buf_len(strings) - 1, strings + 1))
+    status = 1;
+  else if(get_options()->server) {
+    printf("Error: --server can not be sent to a server\n");
+    status = 1;
+  }
+  else if(get_options()->shutdown) {
+    *shutdown = true;
+    status = 0;
+  }
+  else {
+    apply_report_options();
+    begin_diagnostics();
+    status = compile_files(loader) and error_count() == 0 ? 0 : 1;
+    end_diagnostics();
+  }
+
+  if(chdir(server_dir) != 0)
+    printf("Error: unable to return to directory '%s'\n", server_dir);
+  return status;
+}
+
+// ends the output of a request.
+void respond(int status) {
+  fputc(0, stdout);
+  printf("%d\n", status);
+  fflush(stdout);
+}
+
+bool socket_address(const char* path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(struct sockaddr_un));
+  addr->sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(addr->sun_path))
+    return false;
+  strcpy(addr->sun_path, path);
+  return true;
+}
+
+int connect_socket(const char* path) {
+  struct sockaddr_un addr;
+  if(!socket_address(path, &addr))
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+    return -1;
+  if(connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// removes a socket left behind at path by a server that did not shut down.
+// Anything else there, a file or the socket of a server still running, is
+// kept and errno tells why.
+bool remove_stale_socket(const char* path) {
+  struct stat st;
+  if(lstat(path, &st) != 0)
+    return errno == ENOENT;
+  if(!S_ISSOCK(st.st_mode)) {
+    errno = EEXIST;
+    return false;
+  }
+  int fd = connect_socket(path);
+  if(fd >= 0) {
+    close(fd);
+    errno = EADDRINUSE;
+    return false;
+  }
+  return unlink(path) == 0;
+}
+
+int listen_socket(const char* path) {
+  struct sockaddr_un addr;
+  if(!socket_address(path, &addr)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  if(!remove_stale_socket(path))
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+    return -1;
+  if(bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 or listen(fd, 16) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int run_server(const char* socket_path, ModuleLoader* loader) {
+  char server_dir[PATH_MAX];
+  if(!getcwd(server_dir, sizeof(server_dir))) {
+    printf("Error: unable to get the working directory\n");
+    return 1;
+  }
+
+  char* data = NULL;
+  const char** strings = NULL;
+  bool shutdown = false;
+
+  if(!socket_path) {
+    while(!shutdown and (strings = read_request(stdin, &data))) {
+      respond(serve_request(loader, strings, server_dir, &shutdown));
+      buf_free(strings);
+    }
+    buf_free(data);
+    return 0;
+  }
+
+  int fd = listen_socket(socket_path);
+  if(fd < 0) {
+    printf("Error: unable to listen on '%s': %s\n", socket_path, strerror(errno));
+    return 1;
+  }
+  // a client that goes away must not stop the server.
+  signal(SIGPIPE, SIG_IGN);
+
+  while(!shutdown) {
+    int client = accept(fd, NULL, NULL);
+    if(client < 0) {
+      if(errno == EINTR)
+        continue;
+      break;
+    }
+    FILE* in = fdopen(client, "r");
+    if((strings = read_request(in, &data))) {
+      // the output of the request goes to the client.
+      fflush(stdout);
+      int saved = dup(STDOUT_FILENO);
+      dup2(client, STDOUT_FILENO);
+      respond(serve_request(loader, strings, server_dir, &shutdown));
+      dup2(saved, STDOUT_FILENO);
+      close(saved);
+      buf_free(strings);
+    }
+    fclose(in);
+  }
+
+  buf_free(data);
+  close(fd);
+  unlink(socket_path);
+  return 0;
+}
+
+bool write_all(int fd, const char* data, u64 len) {
+  while(len) {
+    ssize_t written = write(fd, data, len);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+int run_client(const char* socket_path, u32 num, const char* const* args) {
+  char cwd[PATH_MAX];
+  if(!getcwd(cwd, sizeof(cwd))) {
+    printf("Error: unable to get the working directory\n");
+    return 1;
+  }
+  int fd = connect_socket(socket_path);
+  if(fd < 0) {
+    printf("Error: unable to connect to '%s'\n", socket_path);
+    return 1;
+  }
+
+  char* request = NULL;
+  buf_printf(request, "%s", cwd);
+  buf_push(request, 0);
+  for(u32 i = 0; i < num; ++i) {
+    buf_printf(request, "%s", args[i]);
+    buf_push(request, 0);
+  }
+  buf_push(request, 0);
+  bool sent = write_all(fd, request, buf_len(request));
+  buf_free(request);
+
+  FILE* in = fdopen(fd, "r");
+  int c = EOF;
+  while(sent and (c = getc(in)) != EOF and c != 0)
+    putchar(c);
+  int status = 1;
+  if(c == EOF or fscanf(in, "%d", &status) != 1) {
+    printf("Error: the connection to the server was closed\n");
+    status = 1;
+  }
+  fclose(in);
+  return status;
+}
@@ -0,0 +1,24 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "module.h"
+
+// Compile server
+//
+// A server keeps the string table and the loaded modules between requests,
+// so a request only reads and parses the files that changed since the last
+// one. A request is the working directory of the client followed by its
+// arguments, each terminated by a zero byte, and ends with an empty argument.
+// The response is the output of the compile, a zero byte and the exit status
+// followed by a newline.
+
+// serves requests until --shutdown is requested or the input is closed. The
+// requests are read from the unix socket at socket_path, or from stdin when
+// it is NULL.
+int run_server(const char* socket_path, ModuleLoader* loader);
+
+// sends the arguments to the server at socket_path, prints the output and
+// returns the exit status of the request.
+int run_client(const char* socket_path, u32 num, const char* const* args);
+
+#endif
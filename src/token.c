@@ -15,6 +15,8 @@ Token new_token(TokenKind kind, u64 line, u64 column, u64 span, u64 index) {
   token.span = span;
   token.index = index;
   token.type = NoType;
+  token.string = NULL;
+  token.string_len = 0;
   return token;
 }
 
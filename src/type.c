@@ -0,0 +1,537 @@
+#include "type.h"
+
+#define PRIMITIVE(n, kind, size) \
+  static Type n##_type = {Type_##kind, size, size ? size : 1, #n, 0, {0}}; \
+  Type* n##_t = &n##_type;
+
+PRIMITIVE(bool, Bool, 1)
+PRIMITIVE(i8, I8, 1)
+PRIMITIVE(i16, I16, 2)
+PRIMITIVE(i32, I32, 4)
+PRIMITIVE(i64, I64, 8)
+PRIMITIVE(u8, U8, 1)
+PRIMITIVE(u16, U16, 2)
+PRIMITIVE(u32, U32, 4)
+PRIMITIVE(u64, U64, 8)
+PRIMITIVE(f32, F32, 4)
+PRIMITIVE(f64, F64, 8)
+PRIMITIVE(char, Char, 1)
+PRIMITIVE(null, Null, 8)
+#undef PRIMITIVE
+
+// a string is a pointer and a length.
+static Type str_type = {Type_Str, 16, 8, "str", 0, {0}};
+Type* str_t = &str_type;
+static Type unit_type = {Type_Unit, 0, 1, "()", 0, {0}};
+Type* unit_t = &unit_type;
+
+Type** primitive_types(u32* num) {
+  static Type* types[] = {
+    &bool_type, &i8_type, &i16_type, &i32_type, &i64_type, &u8_type, &u16_type,
+    &u32_type, &u64_type, &f32_type, &f64_type, &char_type, &str_type,
+  };
+  *num = sizeof(types) / sizeof(types[0]);
+  return types;
+}
+
+void init_conversions();
+
+void init_type_table(TypeTable* types) {
+  memset(types, 0, sizeof(TypeTable));
+  pthread_mutex_init(&types->lock, NULL);
+  init_conversions();
+}
+
+void destroy_type_table(TypeTable* types) {
+  pthread_mutex_destroy(&types->lock);
+  free(types->interned);
+  arena_free(&types->arena);
+}
+
+Type* new_type(TypeTable* types, TypeKind kind, u32 size, u32 align) {
+  Type* type = (Type*) arena_alloc(&types->arena, sizeof(Type));
+  memset(type, 0, sizeof(Type));
+  type->kind = kind;
+  type->size = size;
+  type->align = align;
+  return type;
+}
+
+// copies the name built in buf into the arena and frees buf.
+const char* type_name(TypeTable* types, char* buf) {
+  u64 len = buf_len(buf);
+  char* name = (char*) arena_alloc(&types->arena, len + 1);
+  memcpy(name, buf, len);
+  name[len] = 0;
+  buf_free(buf);
+  return name;
+}
+
+void* copy_array(TypeTable* types, const void* elems, u64 size) {
+  if(!size)
+    return NULL;
+  void* copy = arena_alloc(&types->arena, size);
+  memcpy(copy, elems, size);
+  return copy;
+}
+
+// Interning
+//
+// A derived type is its kind and the types it is made of, which are already
+// interned, so its hash mixes their addresses and two keys are the same type
+// when their elements are the same pointers.
+
+typedef struct TypeKey {
+  TypeKind kind;
+  Type** elems;
+  u32 num_elems;
+  // the key and value of a map, the result of a function.
+  Type* other;
+} TypeKey;
+
+u64 type_key_hash(TypeKey key) {
+  u64 hash = hash_mix(hash_uint64(key.kind), hash_ptr(key.other));
+  for(u32 i = 0; i < key.num_elems; ++i)
+    hash = hash_mix(hash, hash_ptr(key.elems[i]));
+  return hash_mix(hash, key.num_elems);
+}
+
+bool type_matches_key(Type* type, TypeKey key) {
+  if(type->kind != key.kind)
+    return false;
+  switch(key.kind) {
+    case Type_Ptr:
+    case Type_Ref:
+    case Type_Array:
+      return type->elem == key.elems[0];
+    case Type_Map:
+      return type->map.key == key.elems[0] and type->map.value == key.other;
+    case Type_Tuple:
+      return type->tuple.num_elems == key.num_elems and
+             memcmp(type->tuple.elems, key.elems, sizeof(Type*) * key.num_elems) == 0;
+    case Type_Func:
+      return type->func.ret == key.other and type->func.num_params == key.num_elems and
+             (key.num_elems == 0 or memcmp(type->func.params, key.elems, sizeof(Type*) * key.num_elems) == 0);
+    default:
+      return false;
+  }
+}
+
+// the slot of the type of the key, empty when it is not interned.
+Type** find_type_slot(TypeTable* types, TypeKey key, u64 hash) {
+  u32 mask = types->cap - 1;
+  for(u32 i = (u32) hash & mask;; i = (i + 1) & mask) {
+    Type* type = types->interned[i];
+    if(!type or (type->hash == hash and type_matches_key(type, key)))
+      return types->interned + i;
+  }
+}
+
+void grow_type_table(TypeTable* types) {
+  u32 cap = types->cap ? types->cap * 2 : 256;
+  Type** old = types->interned;
+  u32 old_cap = types->cap;
+  types->interned = (Type**) calloc(cap, sizeof(Type*));
+  types->cap = cap;
+  for(u32 i = 0; i < old_cap; ++i) {
+    Type* type = old[i];
+    if(!type)
+      continue;
+    u32 j = (u32) type->hash & (cap - 1);
+    while(types->interned[j])
+      j = (j + 1) & (cap - 1);
+    types->interned[j] = type;
+  }
+  free(old);
+}
+
+// the interned type of the key, NULL when it has to be made. The slot is
+// where the new type goes. The table is locked by the caller until the type
+// is interned.
+Type* lookup_type(TypeTable* types, TypeKey key, u64* hash, Type*** slot) {
+  if(2 * (types->num + 1) > types->cap)
+    grow_type_table(types);
+  *hash = type_key_hash(key);
+  *slot = find_type_slot(types, key, *hash);
+  return **slot;
+}
+
+Type* intern_type(TypeTable* types, Type** slot, Type* type, u64 hash) {
+  type->hash = hash;
+  *slot = type;
+  types->num++;
+  return type;
+}
+
+Type* elem_type(TypeTable* types, TypeKind kind, Type* elem, u32 size, const char* prefix) {
+  TypeKey key = {kind, &elem, 1, NULL};
+  u64 hash;
+  Type** slot;
+  pthread_mutex_lock(&types->lock);
+  Type* type = lookup_type(types, key, &hash, &slot);
+  if(!type) {
+    type = new_type(types, kind, size, 8);
+    type->elem = elem;
+    char* name = NULL;
+    buf_printf(name, "%s%s", prefix, type_string(elem));
+    type->name = type_name(types, name);
+    intern_type(types, slot, type, hash);
+  }
+  pthread_mutex_unlock(&types->lock);
+  return type;
+}
+
+Type* ptr_type(TypeTable* types, Type* elem) {
+  return elem_type(types, Type_Ptr, elem, 8, "*");
+}
+
+Type* ref_type(TypeTable* types, Type* elem) {
+  return elem_type(types, Type_Ref, elem, 8, "&");
+}
+
+// arrays are a pointer to the elements and a length.
+Type* array_type(TypeTable* types, Type* elem) {
+  return elem_type(types, Type_Array, elem, 16, "[]");
+}
+
+Type* map_type(TypeTable* types, Type* key_type, Type* value) {
+  TypeKey key = {Type_Map, &key_type, 1, value};
+  u64 hash;
+  Type** slot;
+  pthread_mutex_lock(&types->lock);
+  Type* type = lookup_type(types, key, &hash, &slot);
+  if(!type) {
+    type = new_type(types, Type_Map, 8, 8);
+    type->map.key = key_type;
+    type->map.value = value;
+    char* name = NULL;
+    buf_printf(name, "[%s]%s", type_string(key_type), type_string(value));
+    type->name = type_name(types, name);
+    intern_type(types, slot, type, hash);
+  }
+  pthread_mutex_unlock(&types->lock);
+  return type;
+}
+
+u32 align_up(u32 offset, u32 align) {
+  return (offset + align - 1) / align * align;
+}
+
+// the size and alignment of members laid out in order.
+void layout_members(Type* type, Type** members, u32 num, u32* offsets) {
+  u32 size = 0;
+  u32 align = 1;
+  for(u32 i = 0; i < num; ++i) {
+    u32 member_size = members[i] ? members[i]->size : 0;
+    u32 member_align = members[i] ? members[i]->align : 1;
+    size = align_up(size, member_align);
+    if(offsets)
+      offsets[i] = size;
+    size += member_size;
+    if(member_align > align)
+      align = member_align;
+  }
+  type->size = align_up(size, align);
+  type->align = align;
+}
+
+Type* tuple_type(TypeTable* types, Type** elems, u32 num) {
+  if(num == 0)
+    return unit_t;
+  TypeKey key = {Type_Tuple, elems, num, NULL};
+  u64 hash;
+  Type** slot;
+  pthread_mutex_lock(&types->lock);
+  Type* type = lookup_type(types, key, &hash, &slot);
+  if(!type) {
+    type = new_type(types, Type_Tuple, 0, 1);
+    type->tuple.elems = (Type**) copy_array(types, elems, sizeof(Type*) * num);
+    type->tuple.num_elems = num;
+    layout_members(type, elems, num, NULL);
+    char* name = NULL;
+    buf_printf(name, "(");
+    for(u32 i = 0; i < num; ++i)
+      buf_printf(name, i ? ", %s" : "%s", type_string(elems[i]));
+    buf_printf(name, ")");
+    type->name = type_name(types, name);
+    intern_type(types, slot, type, hash);
+  }
+  pthread_mutex_unlock(&types->lock);
+  return type;
+}
+
+void layout_tuple_type(Type* type) {
+  layout_members(type, type->tuple.elems, type->tuple.num_elems, NULL);
+}
+
+Type* func_type(TypeTable* types, Type** params, u32 num, Type* ret) {
+  TypeKey key = {Type_Func, params, num, ret};
+  u64 hash;
+  Type** slot;
+  pthread_mutex_lock(&types->lock);
+  Type* type = lookup_type(types, key, &hash, &slot);
+  if(!type) {
+    type = new_type(types, Type_Func, 8, 8);
+    type->func.params = (Type**) copy_array(types, params, sizeof(Type*) * num);
+    type->func.num_params = num;
+    type->func.ret = ret;
+    char* name = NULL;
+    buf_printf(name, "fn(");
+    for(u32 i = 0; i < num; ++i)
+      buf_printf(name, i ? ", %s" : "%s", type_string(params[i]));
+    buf_printf(name, ")");
+    if(ret and ret != unit_t)
+      buf_printf(name, " %s", type_string(ret));
+    type->name = type_name(types, name);
+    intern_type(types, slot, type, hash);
+  }
+  pthread_mutex_unlock(&types->lock);
+  return type;
+}
+
+Type* struct_type(TypeTable* types, Entity* entity, const char* name) {
+  pthread_mutex_lock(&types->lock);
+  Type* type = new_type(types, Type_Struct, 0, 1);
+  pthread_mutex_unlock(&types->lock);
+  type->strct.entity = entity;
+  type->name = name;
+  return type;
+}
+
+Type* enum_type(TypeTable* types, Entity* entity, const char* name) {
+  pthread_mutex_lock(&types->lock);
+  Type* type = new_type(types, Type_Enum, 4, 4);
+  pthread_mutex_unlock(&types->lock);
+  type->enm.entity = entity;
+  type->name = name;
+  return type;
+}
+
+void complete_struct_type(TypeTable* types, Type* type, const char** names, Type** members, u32 num) {
+  assert(type->kind == Type_Struct);
+  pthread_mutex_lock(&types->lock);
+  type->strct.names = (const char**) copy_array(types, names, sizeof(const char*) * num);
+  type->strct.members = (Type**) copy_array(types, members, sizeof(Type*) * num);
+  type->strct.offsets = num ? (u32*) arena_alloc(&types->arena, sizeof(u32) * num) : NULL;
+  pthread_mutex_unlock(&types->lock);
+  type->strct.num_members = num;
+  layout_members(type, members, num, type->strct.offsets);
+  type->strct.complete = true;
+}
+
+// the tag is followed by the largest payload.
+void complete_enum_type(TypeTable* types, Type* type, EnumVariant* variants, u32 num) {
+  assert(type->kind == Type_Enum);
+  pthread_mutex_lock(&types->lock);
+  type->enm.variants = (EnumVariant*) copy_array(types, variants, sizeof(EnumVariant) * num);
+  pthread_mutex_unlock(&types->lock);
+  type->enm.num_variants = num;
+  u32 size = 0;
+  u32 align = 4;
+  for(u32 i = 0; i < num; ++i) {
+    Type* payload = variants[i].payload;
+    if(!payload)
+      continue;
+    if(payload->size > size)
+      size = payload->size;
+    if(payload->align > align)
+      align = payload->align;
+  }
+  type->size = size ? align_up(align_up(4, align) + size, align) : 4;
+  type->align = align;
+  type->enm.complete = true;
+}
+
+i32 struct_member(Type* type, const char* name) {
+  for(u32 i = 0; i < type->strct.num_members; ++i) {
+    if(type->strct.names[i] == name or strcmp(type->strct.names[i], name) == 0)
+      return (i32) i;
+  }
+  return -1;
+}
+
+EnumVariant* enum_variant(Type* type, const char* name) {
+  for(u32 i = 0; i < type->enm.num_variants; ++i) {
+    if(type->enm.variants[i].name == name or strcmp(type->enm.variants[i].name, name) == 0)
+      return type->enm.variants + i;
+  }
+  return NULL;
+}
+
+const char* type_string(Type* type) {
+  return type ? type->name : "<invalid>";
+}
+
+bool is_integer_type(Type* type) {
+  return type and type->kind >= Type_I8 and type->kind <= Type_U64;
+}
+
+bool is_signed_type(Type* type) {
+  return type and type->kind >= Type_I8 and type->kind <= Type_I64;
+}
+
+bool is_float_type(Type* type) {
+  return type and (type->kind == Type_F32 or type->kind == Type_F64);
+}
+
+bool is_arithmetic_type(Type* type) {
+  return is_integer_type(type) or is_float_type(type) or (type and type->kind == Type_Char);
+}
+
+bool is_ptr_type(Type* type) {
+  return type and (type->kind == Type_Ptr or type->kind == Type_Ref);
+}
+
+bool is_bool_type(Type* type) {
+  return type and type->kind == Type_Bool;
+}
+
+bool is_null_type(Type* type) {
+  return type and type->kind == Type_Null;
+}
+
+i32 type_rank(Type* type) {
+  if(!type)
+    return -1;
+  switch(type->kind) {
+    case Type_Char:
+    case Type_I8:
+    case Type_U8:
+      return 1;
+    case Type_I16:
+    case Type_U16:
+      return 2;
+    case Type_I32:
+    case Type_U32:
+      return 3;
+    case Type_I64:
+    case Type_U64:
+      return 4;
+    case Type_F32:
+      return 5;
+    case Type_F64:
+      return 6;
+    default:
+      return -1;
+  }
+}
+
+// Conversions
+//
+// Which kinds convert to which is a bitset per kind, built once. A row
+// holds a bit for every kind a value of the kind converts to. Conversions
+// between the same derived kinds also need the elements to match, which is
+// a pointer compare since those types are interned.
+
+_Static_assert(Num_Types <= 32, "a row of the conversions is a u32");
+
+u32 implicit_conversions[Num_Types];
+u32 explicit_conversions[Num_Types];
+// conversions that also need the same element type.
+u32 element_conversions[Num_Types];
+pthread_once_t conversions_once = PTHREAD_ONCE_INIT;
+
+#define KIND(k) (1u << Type_##k)
+#define INTEGER_KINDS (KIND(I8) | KIND(I16) | KIND(I32) | KIND(I64) | KIND(U8) | KIND(U16) | KIND(U32) | KIND(U64))
+#define ARITHMETIC_KINDS (INTEGER_KINDS | KIND(F32) | KIND(F64) | KIND(Char))
+#define POINTER_KINDS (KIND(Ptr) | KIND(Ref))
+
+void add_conversions(u32* rows, u32 from_kinds, u32 to_kinds) {
+  for(u32 kind = 0; kind < Num_Types; ++kind) {
+    if(from_kinds & (1u << kind))
+      rows[kind] |= to_kinds;
+  }
+}
+
+void build_conversions() {
+  // arithmetic values convert to each other, a literal is an i32 or f64
+  // until it is used.
+  add_conversions(implicit_conversions, ARITHMETIC_KINDS, ARITHMETIC_KINDS);
+  add_conversions(implicit_conversions, KIND(Null), POINTER_KINDS);
+  // a reference is used as a pointer to the same type.
+  add_conversions(element_conversions, KIND(Ref), KIND(Ptr));
+
+  for(u32 kind = 0; kind < Num_Types; ++kind)
+    explicit_conversions[kind] = implicit_conversions[kind];
+  add_conversions(explicit_conversions, POINTER_KINDS, POINTER_KINDS | INTEGER_KINDS);
+  add_conversions(explicit_conversions, INTEGER_KINDS, POINTER_KINDS);
+  add_conversions(explicit_conversions, KIND(Bool), INTEGER_KINDS);
+}
+
+#undef KIND
+#undef INTEGER_KINDS
+#undef ARITHMETIC_KINDS
+#undef POINTER_KINDS
+
+void init_conversions() {
+  pthread_once(&conversions_once, build_conversions);
+}
+
+bool type_convertable(Type* from, Type* to) {
+  if(from == to)
+    return true;
+  if(!from or !to)
+    return false;
+  if(implicit_conversions[from->kind] & (1u << to->kind))
+    return true;
+  return (element_conversions[from->kind] & (1u << to->kind)) and from->elem == to->elem;
+}
+
+bool type_castable(Type* from, Type* to) {
+  if(type_convertable(from, to))
+    return true;
+  return from and to and (explicit_conversions[from->kind] & (1u << to->kind));
+}
+
+void type_test() {
+  TypeTable types;
+  init_type_table(&types);
+
+  Type* bytes = array_type(&types, u8_t);
+  assert(array_type(&types, u8_t) == bytes);
+  assert(ptr_type(&types, u8_t) != ref_type(&types, u8_t));
+  assert(map_type(&types, str_t, bytes) == map_type(&types, str_t, array_type(&types, u8_t)));
+  assert(map_type(&types, str_t, bytes) != map_type(&types, bytes, str_t));
+
+  Type* elems[] = {i32_t, bytes, ptr_type(&types, bytes)};
+  Type* tuple = tuple_type(&types, elems, 3);
+  Type* same[] = {i32_t, array_type(&types, u8_t), ptr_type(&types, array_type(&types, u8_t))};
+  assert(tuple_type(&types, same, 3) == tuple);
+  assert(tuple_type(&types, elems, 2) != tuple);
+  assert(tuple_type(&types, elems, 0) == unit_t);
+  assert(strcmp(tuple->name, "(i32, []u8, *[]u8)") == 0);
+
+  Type* func = func_type(&types, elems, 2, bool_t);
+  assert(func_type(&types, same, 2, bool_t) == func);
+  assert(func_type(&types, same, 2, unit_t) != func);
+  assert(func_type(&types, NULL, 0, unit_t) == func_type(&types, NULL, 0, unit_t));
+
+  // the same type made many times is stored once.
+  u32 num = types.num;
+  for(u32 i = 0; i < 100000; ++i)
+    assert(array_type(&types, u8_t) == bytes);
+  assert(types.num == num);
+
+  // types made while the table grows are still found.
+  Type* nested = i32_t;
+  for(u32 i = 0; i < 1000; ++i)
+    nested = ptr_type(&types, array_type(&types, nested));
+  Type* again = i32_t;
+  for(u32 i = 0; i < 1000; ++i)
+    again = ptr_type(&types, array_type(&types, again));
+  assert(nested == again);
+  assert(types.num == num + 2000);
+
+  Type* ptr = ptr_type(&types, i32_t);
+  Type* ref = ref_type(&types, i32_t);
+  assert(type_convertable(u8_t, f64_t) and type_convertable(char_t, i32_t));
+  assert(type_convertable(null_t, ptr) and type_convertable(ref, ptr));
+  assert(!type_convertable(ref_type(&types, u8_t), ptr) and !type_convertable(ptr, ref));
+  assert(!type_convertable(bool_t, i32_t) and !type_convertable(i32_t, bool_t));
+  assert(!type_convertable(ptr, i64_t) and type_castable(ptr, i64_t) and type_castable(u64_t, ptr));
+  assert(type_castable(bool_t, u8_t) and !type_castable(u8_t, bool_t));
+  assert(type_castable(ptr, ptr_type(&types, u8_t)) and !type_castable(bytes, ptr));
+
+  destroy_type_table(&types);
+  printf("type_test: %u types interned\n", num + 2000);
+}
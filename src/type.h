@@ -0,0 +1,185 @@
+#ifndef TYPE_H_
+#define TYPE_H_
+
+#include "common.h"
+
+typedef struct Entity Entity;
+
+// Types
+//
+// The primitive types are static and shared by every checker, the other
+// types are made by the constructors below from the arena of a TypeTable.
+// Pointer, reference, array, map, tuple and function types are interned by
+// the table, a type is made once and every later request for the same
+// structure returns it, so two types are the same exactly when they are the
+// same pointer. Structs and enums are nominal, each declaration has its own
+// type which is made before its members are resolved so declarations can
+// refer to each other. Every type carries its name as written in the source, e.g. "[]u8"
+// or "fn(i32) bool", for the diagnostics.
+
+#define TYPEKINDS \
+  TYPEKIND(Invalid) \
+  TYPEKIND(I8) \
+  TYPEKIND(I16) \
+  TYPEKIND(I32) \
+  TYPEKIND(I64) \
+  TYPEKIND(U8) \
+  TYPEKIND(U16) \
+  TYPEKIND(U32) \
+  TYPEKIND(U64) \
+  TYPEKIND(F32) \
+  TYPEKIND(F64) \
+  TYPEKIND(Bool) \
+  TYPEKIND(Char) \
+  TYPEKIND(Str) \
+  TYPEKIND(Null) \
+  TYPEKIND(Unit) \
+  TYPEKIND(Ptr) \
+  TYPEKIND(Ref) \
+  TYPEKIND(Array) \
+  TYPEKIND(Map) \
+  TYPEKIND(Tuple) \
+  TYPEKIND(Func) \
+  TYPEKIND(Struct) \
+  TYPEKIND(Enum)
+
+typedef enum TypeKind {
+#define TYPEKIND(n) Type_##n,
+  TYPEKINDS
+#undef TYPEKIND
+  Num_Types
+} TypeKind;
+
+// a variant of an enum, a name with an optional payload.
+typedef struct EnumVariant {
+  const char* name;
+  // payload of a tuple variant, NULL for a plain name.
+  struct Type* payload;
+  i64 value;
+} EnumVariant;
+
+typedef struct Type {
+  TypeKind kind;
+  u32 size;
+  u32 align;
+  const char* name;
+  // structural hash of an interned type.
+  u64 hash;
+
+  union {
+    // pointers, references and arrays.
+    struct Type* elem;
+    struct {
+      struct Type* key;
+      struct Type* value;
+    } map;
+    struct {
+      struct Type** elems;
+      u32 num_elems;
+    } tuple;
+    struct {
+      struct Type** params;
+      u32 num_params;
+      struct Type* ret;
+    } func;
+    // the members of a tuple struct are named by their index.
+    struct {
+      Entity* entity;
+      const char** names;
+      struct Type** members;
+      u32* offsets;
+      u32 num_members;
+      // the members and layout are known.
+      bool complete;
+    } strct;
+    struct {
+      Entity* entity;
+      EnumVariant* variants;
+      u32 num_variants;
+      bool complete;
+    } enm;
+  };
+} Type;
+
+extern Type* bool_t;
+extern Type* i8_t;
+extern Type* i16_t;
+extern Type* i32_t;
+extern Type* i64_t;
+extern Type* u8_t;
+extern Type* u16_t;
+extern Type* u32_t;
+extern Type* u64_t;
+extern Type* f32_t;
+extern Type* f64_t;
+extern Type* char_t;
+extern Type* str_t;
+extern Type* null_t;
+extern Type* unit_t;
+
+// the primitive types that are named in the global scope.
+Type** primitive_types(u32* num);
+
+// owns the types made by a checker. The lock is held while a type is made,
+// the bodies of functions are checked by several threads.
+typedef struct TypeTable {
+  pthread_mutex_t lock;
+  Arena arena;
+  // the interned types, open addressed by their hash.
+  Type** interned;
+  u32 cap;
+  u32 num;
+} TypeTable;
+
+void init_type_table(TypeTable* types);
+
+void destroy_type_table(TypeTable* types);
+
+Type* ptr_type(TypeTable* types, Type* elem);
+Type* ref_type(TypeTable* types, Type* elem);
+Type* array_type(TypeTable* types, Type* elem);
+Type* map_type(TypeTable* types, Type* key, Type* value);
+// elems are copied, an empty tuple is the unit type.
+Type* tuple_type(TypeTable* types, Type** elems, u32 num);
+// lays out a tuple again once the structs it holds are complete.
+void layout_tuple_type(Type* type);
+Type* func_type(TypeTable* types, Type** params, u32 num, Type* ret);
+
+// the members of a struct or the variants of an enum are set by
+// complete_struct_type and complete_enum_type once they are resolved.
+Type* struct_type(TypeTable* types, Entity* entity, const char* name);
+Type* enum_type(TypeTable* types, Entity* entity, const char* name);
+
+// lays out the members, which are copied.
+void complete_struct_type(TypeTable* types, Type* type, const char** names, Type** members, u32 num);
+void complete_enum_type(TypeTable* types, Type* type, EnumVariant* variants, u32 num);
+
+// index of the member, -1 when there is none.
+i32 struct_member(Type* type, const char* name);
+EnumVariant* enum_variant(Type* type, const char* name);
+
+const char* type_string(Type* type);
+
+bool is_integer_type(Type* type);
+bool is_signed_type(Type* type);
+bool is_float_type(Type* type);
+bool is_arithmetic_type(Type* type);
+bool is_ptr_type(Type* type);
+bool is_bool_type(Type* type);
+bool is_null_type(Type* type);
+
+// order of the arithmetic types in conversions, integers before floats.
+// -1 for the other types.
+i32 type_rank(Type* type);
+
+// a value of type from can be used where a value of type to is expected.
+// The conversions are tables built by the first init_type_table.
+bool type_convertable(Type* from, Type* to);
+
+// a value of type from can be cast to type to, the implicit conversions,
+// pointers to other pointers and integers, and bools to integers.
+bool type_castable(Type* from, Type* to);
+
+void type_test();
+
+#endif
@@ -1,6 +1,7 @@
 #include "value.h"
 
 #include <assert.h>
+#include <math.h>
 
 Value alloc_value(ValueKind kind) {
 	Value val = default_value;
@@ -63,121 +64,595 @@ MapValue new_map_element(Value key, Value value) {
 	return val;
 }
 
-void check_size(Value val, ValueKind kind) {
-
-}
-
 Value value_integer_to_float(Value val) {
 	assert(val.kind == Value_Integer);
-	check_size(val, Value_Float);
-	return new_float_value((f64) val.float_value);
+	return new_float_value((f64) val.integer_value);
 }
 
 Value value_float_to_integer(Value val) {
 	assert(val.kind == Value_Float);
-	check_size(val, Value_Integer);
 	return new_integer_value((i64) val.float_value);
 }
 
 Value value_integer_to_char(Value val) {
 	assert(val.kind == Value_Integer);
-	check_size(val, Value_Char);
 	return new_char_value((char) val.integer_value);
 }
 
-// is represented as an integer
-bool value_is_integer_root(Value val) {
-	return val.kind == Value_Integer || val.kind == Value_Char ||
+Value new_null_value() {
+	return alloc_value(Value_Null);
+}
+
+bool value_is_integral(Value val) {
+	return value_is_float(val) ||
+				 value_is_integer(val) ||
+				 val.kind == Value_Char ||
 				 val.kind == Value_Bool;
 }
 
-// #define CASE(field, op) \
-// 	switch(rhs.kind) {
-// 		Value_Bool:
+bool value_is_float(Value val) {
+	return val.kind == Value_Float;
+}
 
-// 		Value_Integer:
-// 		Value_Char:
+bool value_is_integer(Value val) {
+	return val.kind == Value_Integer;
+}
 
-// 		Value_Float:
+// Folding
 
-// 		Value_Pointer:
+__extension__ typedef __int128 i128;
+__extension__ typedef unsigned __int128 u128;
 
-// 		Value_String:
-// 		Value_Array:
-// 		Value_Map:
-// 		Value_Invalid:
-// 	}
+u32 value_bits(ValueType type) {
+	return type.size * 8;
+}
 
-Value value_eval_binary(Token op, Value lhs, Value rhs) {
-	if(!value_is_integral(lhs) and !value_is_integral(rhs))
-		return default_value;
+// the bits of an integer of the type, a char is an unsigned byte.
+i128 integer_bits(Value val, ValueType type) {
+	switch(val.kind) {
+		case Value_Integer:
+			if(!type.is_signed and type.size == 8)
+				return (i128) (u64) val.integer_value;
+			return val.integer_value;
+		case Value_Char: return (u8) val.char_value;
+		case Value_Bool: return val.bool_value;
+		default: return 0;
+	}
+}
+
+i128 integer_min(ValueType type) {
+	return type.is_signed ? -((i128) 1 << (value_bits(type) - 1)) : 0;
+}
+
+i128 integer_max(ValueType type) {
+	if(type.is_signed)
+		return ((i128) 1 << (value_bits(type) - 1)) - 1;
+	return ((i128) 1 << value_bits(type)) - 1;
+}
+
+// the value of the type with the low bits of the exact result.
+Value wrap_integer(i128 exact, ValueType type, FoldError* error) {
+	if(exact < integer_min(type) or exact > integer_max(type))
+		*error = Fold_Overflow;
+	u64 bits = (u64) exact;
+	u32 width = value_bits(type);
+	if(width < 64) {
+		bits &= ((u64) 1 << width) - 1;
+		if(type.is_signed and (bits >> (width - 1)) & 1)
+			bits |= ~(((u64) 1 << width) - 1);
+	}
+	if(type.kind == Value_Char)
+		return new_char_value((char) bits);
+	return new_integer_value((i64) bits);
+}
+
+f64 float_of(Value val, ValueType from) {
+	if(val.kind == Value_Float)
+		return val.float_value;
+	if(val.kind == Value_Integer and !from.is_signed and from.size == 8)
+		return (f64) (u64) val.integer_value;
+	return (f64) integer_bits(val, from);
+}
+
+Value round_float(f64 val, ValueType type) {
+	return new_float_value(type.size == 4 ? (f64) (f32) val : val);
+}
+
+// the type a value has when nothing else is known, used for the operands of
+// conversions.
+ValueType value_type_of(Value val) {
+	ValueType type = {val.kind, 8, true};
+	if(val.kind == Value_Char or val.kind == Value_Bool) {
+		type.size = 1;
+		type.is_signed = false;
+	}
+	return type;
+}
+
+Value value_convert(Value val, ValueType type, FoldError* error) {
+	*error = Fold_Ok;
+	ValueType from = value_type_of(val);
+	switch(type.kind) {
+		case Value_Integer:
+		case Value_Char:
+			if(val.kind == Value_Float) {
+				f64 f = val.float_value;
+				if(f != f or f <= (f64) integer_min(type) - 1 or f >= (f64) integer_max(type) + 1) {
+					*error = Fold_Overflow;
+					return wrap_integer(0, type, error);
+				}
+				return wrap_integer((i128) f, type, error);
+			}
+			if(val.kind == Value_Integer or val.kind == Value_Char or val.kind == Value_Bool)
+				return wrap_integer(integer_bits(val, from), type, error);
+			break;
+		case Value_Float:
+			if(val.kind == Value_Float or val.kind == Value_Integer or val.kind == Value_Char)
+				return round_float(float_of(val, from), type);
+			break;
+		case Value_Bool:
+			if(val.kind == Value_Bool)
+				return val;
+			break;
+		default:
+			if(val.kind == type.kind)
+				return val;
+	}
+	*error = Fold_Invalid;
+	return default_value;
+}
+
+// the operand in the type of the operation, the usual conversions wrap and
+// only the operation reports overflow.
+Value fold_operand(Value val, ValueType type) {
+	FoldError ignored;
+	return value_convert(val, type, &ignored);
+}
 
-	switch(op.kind) {
-		case Tkn_Plus: {
-			// switch(lhs.kind) {
-			// 	case Tkn_
-			// }
-		} break;
-		case Tkn_Minus:
+Value compare_values(TokenKind op, i32 order) {
+	switch(op) {
+		case Tkn_EqualEqual: return new_bool_value(order == 0);
+		case Tkn_BangEqual: return new_bool_value(order != 0);
+		case Tkn_Less: return new_bool_value(order < 0);
+		case Tkn_Greater: return new_bool_value(order > 0);
+		case Tkn_LessEqual: return new_bool_value(order <= 0);
+		case Tkn_GreaterEqual: return new_bool_value(order >= 0);
+		default: return default_value;
+	}
+}
+
+bool is_comparison(TokenKind op) {
+	return op == Tkn_EqualEqual or op == Tkn_BangEqual or op == Tkn_Less or
+				 op == Tkn_Greater or op == Tkn_LessEqual or op == Tkn_GreaterEqual;
+}
+
+bool value_truth(Value val, bool* truth) {
+	if(val.kind == Value_Bool)
+		*truth = val.bool_value;
+	else if(val.kind == Value_Integer)
+		*truth = val.integer_value != 0;
+	else
+		return false;
+	return true;
+}
+
+Value eval_integer_binary(TokenKind op, i128 a, i128 b, ValueType type, FoldError* error) {
+	FoldError wrapped = Fold_Ok;
+	switch(op) {
+		case Tkn_Plus: return wrap_integer(a + b, type, error);
+		case Tkn_Minus: return wrap_integer(a - b, type, error);
+		case Tkn_Astrick: {
+			if(type.is_signed)
+				return wrap_integer(a * b, type, error);
+			// the product of two u64 only fits an unsigned 128 bit integer.
+			u128 product = (u128) a * (u128) b;
+			if(product > (u128) integer_max(type))
+				*error = Fold_Overflow;
+			return wrap_integer((i128) (u64) product, type, &wrapped);
+		}
 		case Tkn_Slash:
-		case Tkn_Astrick:
-		case Tkn_AstrickAstrick:
-		case Tkn_LessLess:
-			if(!value_is_integer_root(lhs) or !value_is_integer_root(rhs))
-				return default_value;
-			return new_integer_value(lhs.integer_value >> rhs.integer_value);
-		case Tkn_GreaterGreater:
-			if(!value_is_integer_root(lhs) or !value_is_integer_root(rhs))
-				return default_value;
-			return new_integer_value(lhs.integer_value << rhs.integer_value);
 		case Tkn_Percent:
-			// I would like to have support for floating point modulos
-			// without using fmod.
-
-			// for now, both operands must be integers.
-			if(!value_is_integer_root(lhs) or !value_is_integer_root(rhs))
+			if(b == 0) {
+				*error = Fold_DivideByZero;
 				return default_value;
-
-			return new_integer_value(lhs.integer_value % rhs.integer_value);
-		case Tkn_Pipe:
-			if(!value_is_integer_root(lhs) or !value_is_integer_root(rhs))
+			}
+			return wrap_integer(op == Tkn_Slash ? a / b : a % b, type, error);
+		case Tkn_AstrickAstrick: {
+			if(b < 0) {
+				*error = Fold_Invalid;
 				return default_value;
-
-			return new_integer_value(lhs.integer_value | rhs.integer_value);
-		case Tkn_Ampersand:
-			if(!value_is_integer_root(lhs) or !value_is_integer_root(rhs))
+			}
+			// the wrapped result by squaring, the exact one while it fits.
+			u64 result = 1;
+			u64 base = (u64) a;
+			for(u128 n = (u128) b; n; n >>= 1, base *= base) {
+				if(n & 1)
+					result *= base;
+			}
+			if(a < -1 or a > 1) {
+				i128 bound = type.is_signed ? -integer_min(type) : integer_max(type);
+				i128 magnitude = a < 0 ? -a : a;
+				i128 exact = 1;
+				bool overflow = b >= 128;
+				for(i128 i = 0; i < b and !overflow; ++i) {
+					overflow = (exact < 0 ? -exact : exact) > bound / magnitude;
+					exact *= a;
+				}
+				if(overflow or exact < integer_min(type) or exact > integer_max(type))
+					*error = Fold_Overflow;
+			}
+			return wrap_integer((i128) result, type, &wrapped);
+		}
+		case Tkn_LessLess:
+		case Tkn_GreaterGreater:
+			if(b < 0 or b >= value_bits(type)) {
+				*error = Fold_ShiftRange;
 				return default_value;
+			}
+			// bits shifted out are dropped, not an overflow.
+			if(op == Tkn_LessLess)
+				return wrap_integer((i128) ((u64) a << (u32) b), type, &wrapped);
+			return wrap_integer(a >> (u32) b, type, &wrapped);
+		case Tkn_Ampersand: return wrap_integer(a & b, type, error);
+		case Tkn_Pipe: return wrap_integer(a | b, type, error);
+		case Tkn_Carrot: return wrap_integer(a ^ b, type, error);
+		default:
+			if(is_comparison(op))
+				return compare_values(op, a < b ? -1 : a > b);
+			*error = Fold_Invalid;
+			return default_value;
+	}
+}
 
-			return new_integer_value(lhs.integer_value & rhs.integer_value);
-		case Tkn_Carrot:
-			if(!value_is_integer_root(lhs) or !value_is_integer_root(rhs))
-				return default_value;
+Value eval_float_binary(TokenKind op, f64 a, f64 b, ValueType type, FoldError* error) {
+	switch(op) {
+		case Tkn_Plus: return round_float(a + b, type);
+		case Tkn_Minus: return round_float(a - b, type);
+		case Tkn_Astrick: return round_float(a * b, type);
+		case Tkn_Slash: return round_float(a / b, type);
+		case Tkn_Percent: return round_float(fmod(a, b), type);
+		case Tkn_AstrickAstrick: return round_float(pow(a, b), type);
+		case Tkn_EqualEqual: return new_bool_value(a == b);
+		case Tkn_BangEqual: return new_bool_value(a != b);
+		case Tkn_Less: return new_bool_value(a < b);
+		case Tkn_Greater: return new_bool_value(a > b);
+		case Tkn_LessEqual: return new_bool_value(a <= b);
+		case Tkn_GreaterEqual: return new_bool_value(a >= b);
+		default:
+			*error = Fold_Invalid;
+			return default_value;
+	}
+}
 
-			return new_integer_value(lhs.integer_value ^ rhs.integer_value);
+Value eval_bool_binary(TokenKind op, bool a, bool b, FoldError* error) {
+	switch(op) {
+		case Tkn_EqualEqual: return new_bool_value(a == b);
+		case Tkn_BangEqual:
+		case Tkn_Carrot: return new_bool_value(a != b);
+		case Tkn_Ampersand: return new_bool_value(a and b);
+		case Tkn_Pipe: return new_bool_value(a or b);
 		default:
+			*error = Fold_Invalid;
 			return default_value;
 	}
 }
 
-Value new_null_value() {
-	return alloc_value(Value_Null);
+Value value_eval_binary(TokenKind op, Value lhs, Value rhs, ValueType type, FoldError* error) {
+	*error = Fold_Ok;
+	if(op == Tkn_And or op == Tkn_Or) {
+		bool a, b;
+		if(!value_truth(lhs, &a) or !value_truth(rhs, &b)) {
+			*error = Fold_Invalid;
+			return default_value;
+		}
+		return new_bool_value(op == Tkn_And ? a and b : a or b);
+	}
+
+	Value a = fold_operand(lhs, type);
+	// the count of a shift keeps its own type.
+	bool shift = op == Tkn_LessLess or op == Tkn_GreaterGreater;
+	Value b = shift ? rhs : fold_operand(rhs, type);
+	if(a.kind != type.kind or (!shift and b.kind != type.kind) or
+		 (shift and b.kind != Value_Integer and b.kind != Value_Char)) {
+		*error = Fold_Invalid;
+		return default_value;
+	}
+
+	switch(type.kind) {
+		case Value_Integer:
+		case Value_Char:
+			return eval_integer_binary(op, integer_bits(a, type),
+				shift ? integer_bits(b, value_type_of(b)) : integer_bits(b, type), type, error);
+		case Value_Float:
+			return eval_float_binary(op, a.float_value, b.float_value, type, error);
+		case Value_Bool:
+			return eval_bool_binary(op, a.bool_value, b.bool_value, error);
+		default:
+			if((op == Tkn_EqualEqual or op == Tkn_BangEqual) and a.kind == b.kind and
+				 (a.kind == Value_Null or a.kind == Value_String))
+				return compare_values(op, value_equal(a, b) ? 0 : 1);
+			*error = Fold_Invalid;
+			return default_value;
+	}
 }
 
-Value value_eval_unary(Token op, Value lhs, Value rhs) {
+Value value_eval_unary(TokenKind op, Value operand, ValueType type, FoldError* error) {
+	*error = Fold_Ok;
+	if(op == Tkn_Bang) {
+		bool truth;
+		if(value_truth(operand, &truth))
+			return new_bool_value(!truth);
+		*error = Fold_Invalid;
+		return default_value;
+	}
 
+	Value val = fold_operand(operand, type);
+	if(val.kind != type.kind) {
+		*error = Fold_Invalid;
+		return default_value;
+	}
+	switch(type.kind) {
+		case Value_Integer:
+		case Value_Char:
+			if(op == Tkn_Minus)
+				return wrap_integer(-integer_bits(val, type), type, error);
+			if(op == Tkn_Tilde) {
+				FoldError wrapped = Fold_Ok;
+				return wrap_integer(~integer_bits(val, type), type, &wrapped);
+			}
+			break;
+		case Value_Float:
+			if(op == Tkn_Minus)
+				return new_float_value(-val.float_value);
+			break;
+		case Value_Bool:
+			if(op == Tkn_Tilde)
+				return new_bool_value(!val.bool_value);
+			break;
+		default:;
+	}
+	*error = Fold_Invalid;
+	return default_value;
 }
 
-bool value_is_integral(Value val) {
-	return value_is_float(val) ||
-				 value_is_integer(val) ||
-				 val.kind == Value_Char ||
-				 val.kind == Value_Bool;
+bool value_equal(Value lhs, Value rhs) {
+	if(lhs.kind != rhs.kind)
+		return false;
+	switch(lhs.kind) {
+		case Value_Invalid:
+		case Value_Null: return true;
+		case Value_Bool: return lhs.bool_value == rhs.bool_value;
+		case Value_String: return strcmp(lhs.string_value, rhs.string_value) == 0;
+		case Value_Integer: return lhs.integer_value == rhs.integer_value;
+		// the same bits, so NaN is equal to itself.
+		case Value_Float: return memcmp(&lhs.float_value, &rhs.float_value, sizeof(f64)) == 0;
+		case Value_Char: return lhs.char_value == rhs.char_value;
+		case Value_Pointer: return lhs.pointer_value == rhs.pointer_value;
+		case Value_Array: return lhs.array_value == rhs.array_value;
+		case Value_Map: return lhs.map_value == rhs.map_value;
+	}
+	return false;
 }
 
-bool value_is_float(Value val) {
-	return val.kind == Value_Float;
+// the result of an 8 bit operation computed with ints, for value_test.
+Value reference_binary(TokenKind op, int a, int b, ValueType type, FoldError* error) {
+	int min = type.is_signed ? -128 : 0;
+	int max = type.is_signed ? 127 : 255;
+	int exact = 0;
+	*error = Fold_Ok;
+	switch(op) {
+		case Tkn_Plus: exact = a + b; break;
+		case Tkn_Minus: exact = a - b; break;
+		case Tkn_Astrick: exact = a * b; break;
+		case Tkn_Slash:
+		case Tkn_Percent:
+			if(b == 0) {
+				*error = Fold_DivideByZero;
+				return default_value;
+			}
+			exact = op == Tkn_Slash ? a / b : a % b;
+			break;
+		case Tkn_LessLess:
+		case Tkn_GreaterGreater:
+			if(b < 0 or b >= 8) {
+				*error = Fold_ShiftRange;
+				return default_value;
+			}
+			exact = op == Tkn_LessLess ? (int) ((unsigned) a << b) : a >> b;
+			return new_integer_value(type.is_signed ? (i8) exact : (u8) exact);
+		case Tkn_Ampersand: exact = a & b; break;
+		case Tkn_Pipe: exact = a | b; break;
+		case Tkn_Carrot: exact = a ^ b; break;
+		default:
+			return compare_values(op, a < b ? -1 : a > b);
+	}
+	if(exact < min or exact > max)
+		*error = Fold_Overflow;
+	return new_integer_value(type.is_signed ? (i8) exact : (u8) exact);
 }
 
-bool value_is_integer(Value val) {
-	return val.kind == Value_Integer;
+void value_test() {
+	const ValueType i8_type = {Value_Integer, 1, true};
+	const ValueType u8_type = {Value_Integer, 1, false};
+	const ValueType i16_type = {Value_Integer, 2, true};
+	const ValueType u16_type = {Value_Integer, 2, false};
+	const ValueType i32_type = {Value_Integer, 4, true};
+	const ValueType u32_type = {Value_Integer, 4, false};
+	const ValueType i64_type = {Value_Integer, 8, true};
+	const ValueType u64_type = {Value_Integer, 8, false};
+	const ValueType f32_type = {Value_Float, 4, true};
+	const ValueType f64_type = {Value_Float, 8, true};
+	const ValueType bool_type = {Value_Bool, 1, false};
+	const ValueType char_type = {Value_Char, 1, false};
+
+	// every pair of 8 bit operands against the same operation on ints.
+	TokenKind ops[] = {
+		Tkn_Plus, Tkn_Minus, Tkn_Astrick, Tkn_Slash, Tkn_Percent, Tkn_LessLess, Tkn_GreaterGreater,
+		Tkn_Ampersand, Tkn_Pipe, Tkn_Carrot, Tkn_EqualEqual, Tkn_BangEqual, Tkn_Less, Tkn_Greater,
+		Tkn_LessEqual, Tkn_GreaterEqual,
+	};
+	ValueType bytes[] = {i8_type, u8_type};
+	u32 checked = 0;
+	for(u32 t = 0; t < 2; ++t) {
+		int min = bytes[t].is_signed ? -128 : 0;
+		for(int a = min; a < min + 256; ++a) {
+			for(int b = min; b < min + 256; ++b) {
+				for(u32 o = 0; o < sizeof(ops) / sizeof(ops[0]); ++o) {
+					FoldError error, expected_error;
+					Value result = value_eval_binary(ops[o], new_integer_value(a), new_integer_value(b), bytes[t], &error);
+					Value expected = reference_binary(ops[o], a, b, bytes[t], &expected_error);
+					assert(error == expected_error);
+					assert(value_equal(result, expected));
+					checked++;
+				}
+			}
+		}
+	}
+
+	struct {
+		TokenKind op;
+		ValueType type;
+		Value lhs;
+		Value rhs;
+		Value expected;
+		FoldError error;
+	} tests[] = {
+		// the sizes wrap and report overflow.
+		{Tkn_Plus, i16_type, new_integer_value(32767), new_integer_value(1), new_integer_value(-32768), Fold_Overflow},
+		{Tkn_Minus, u16_type, new_integer_value(0), new_integer_value(1), new_integer_value(65535), Fold_Overflow},
+		{Tkn_Astrick, i32_type, new_integer_value(65536), new_integer_value(32768), new_integer_value(INT32_MIN), Fold_Overflow},
+		{Tkn_Astrick, i32_type, new_integer_value(46340), new_integer_value(46340), new_integer_value(2147395600), Fold_Ok},
+		{Tkn_Plus, u32_type, new_integer_value(UINT32_MAX), new_integer_value(1), new_integer_value(0), Fold_Overflow},
+		{Tkn_Plus, i64_type, new_integer_value(INT64_MAX), new_integer_value(1), new_integer_value(INT64_MIN), Fold_Overflow},
+		{Tkn_Minus, i64_type, new_integer_value(INT64_MIN), new_integer_value(1), new_integer_value(INT64_MAX), Fold_Overflow},
+		{Tkn_Slash, i64_type, new_integer_value(INT64_MIN), new_integer_value(-1), new_integer_value(INT64_MIN), Fold_Overflow},
+		{Tkn_Percent, i64_type, new_integer_value(-7), new_integer_value(2), new_integer_value(-1), Fold_Ok},
+		{Tkn_Astrick, u64_type, new_integer_value(-1), new_integer_value(2), new_integer_value(-2), Fold_Overflow},
+		{Tkn_Astrick, u64_type, new_integer_value(1ll << 32), new_integer_value(1ll << 31), new_integer_value(INT64_MIN), Fold_Ok},
+		{Tkn_Plus, u64_type, new_integer_value(INT64_MAX), new_integer_value(1), new_integer_value(INT64_MIN), Fold_Ok},
+		{Tkn_Slash, u64_type, new_integer_value(-2), new_integer_value(2), new_integer_value(INT64_MAX), Fold_Ok},
+		{Tkn_Greater, u64_type, new_integer_value(-1), new_integer_value(1), new_bool_value(true), Fold_Ok},
+		{Tkn_Greater, i64_type, new_integer_value(-1), new_integer_value(1), new_bool_value(false), Fold_Ok},
+		{Tkn_GreaterGreater, u64_type, new_integer_value(-1), new_integer_value(63), new_integer_value(1), Fold_Ok},
+		{Tkn_GreaterGreater, i64_type, new_integer_value(-1), new_integer_value(63), new_integer_value(-1), Fold_Ok},
+		{Tkn_LessLess, i32_type, new_integer_value(1), new_integer_value(31), new_integer_value(INT32_MIN), Fold_Ok},
+		{Tkn_LessLess, i32_type, new_integer_value(1), new_integer_value(32), default_value, Fold_ShiftRange},
+		{Tkn_LessLess, u64_type, new_integer_value(1), new_integer_value(-1), default_value, Fold_ShiftRange},
+		{Tkn_Slash, u32_type, new_integer_value(1), new_integer_value(0), default_value, Fold_DivideByZero},
+		{Tkn_Percent, i16_type, new_integer_value(1), new_integer_value(0), default_value, Fold_DivideByZero},
+		{Tkn_Ampersand, u16_type, new_integer_value(0xff0f), new_integer_value(0x0ff0), new_integer_value(0x0f00), Fold_Ok},
+		{Tkn_Pipe, i32_type, new_integer_value(0x0f), new_integer_value(0xf0), new_integer_value(0xff), Fold_Ok},
+		{Tkn_Carrot, u8_type, new_integer_value(0xff), new_integer_value(0x0f), new_integer_value(0xf0), Fold_Ok},
+		// powers.
+		{Tkn_AstrickAstrick, i32_type, new_integer_value(2), new_integer_value(30), new_integer_value(1 << 30), Fold_Ok},
+		{Tkn_AstrickAstrick, i32_type, new_integer_value(2), new_integer_value(31), new_integer_value(INT32_MIN), Fold_Overflow},
+		{Tkn_AstrickAstrick, i8_type, new_integer_value(-2), new_integer_value(7), new_integer_value(-128), Fold_Ok},
+		{Tkn_AstrickAstrick, u64_type, new_integer_value(2), new_integer_value(64), new_integer_value(0), Fold_Overflow},
+		{Tkn_AstrickAstrick, u64_type, new_integer_value(3), new_integer_value(40), new_integer_value(12157665459056928801ull), Fold_Ok},
+		{Tkn_AstrickAstrick, i64_type, new_integer_value(-1), new_integer_value(INT64_MAX), new_integer_value(-1), Fold_Ok},
+		{Tkn_AstrickAstrick, i64_type, new_integer_value(7), new_integer_value(0), new_integer_value(1), Fold_Ok},
+		{Tkn_AstrickAstrick, i64_type, new_integer_value(7), new_integer_value(-1), default_value, Fold_Invalid},
+		// operands are converted to the type.
+		{Tkn_Plus, f64_type, new_integer_value(1), new_float_value(0.5), new_float_value(1.5), Fold_Ok},
+		{Tkn_Plus, u8_type, new_integer_value(-1), new_integer_value(1), new_integer_value(0), Fold_Overflow},
+		{Tkn_Plus, i64_type, new_char_value('a'), new_integer_value(1), new_integer_value('b'), Fold_Ok},
+		// floats are rounded to their size.
+		{Tkn_Slash, f32_type, new_float_value(1), new_float_value(3), new_float_value((f32) 1 / 3), Fold_Ok},
+		{Tkn_Slash, f64_type, new_float_value(1), new_float_value(3), new_float_value(1.0 / 3), Fold_Ok},
+		{Tkn_Slash, f64_type, new_float_value(1), new_float_value(0), new_float_value(INFINITY), Fold_Ok},
+		{Tkn_Percent, f64_type, new_float_value(7.5), new_float_value(2), new_float_value(1.5), Fold_Ok},
+		{Tkn_AstrickAstrick, f64_type, new_float_value(2), new_float_value(0.5), new_float_value(sqrt(2)), Fold_Ok},
+		{Tkn_Minus, f32_type, new_float_value(0.1), new_float_value(0.2), new_float_value((f32) ((f32) 0.1 - (f32) 0.2)), Fold_Ok},
+		{Tkn_LessEqual, f64_type, new_float_value(2), new_float_value(2), new_bool_value(true), Fold_Ok},
+		{Tkn_BangEqual, f64_type, new_float_value(NAN), new_float_value(NAN), new_bool_value(true), Fold_Ok},
+		{Tkn_LessLess, f64_type, new_float_value(1), new_integer_value(1), default_value, Fold_Invalid},
+		{Tkn_Ampersand, f32_type, new_float_value(1), new_float_value(1), default_value, Fold_Invalid},
+		// bools, chars, strings and null.
+		{Tkn_EqualEqual, bool_type, new_bool_value(true), new_bool_value(false), new_bool_value(false), Fold_Ok},
+		{Tkn_Carrot, bool_type, new_bool_value(true), new_bool_value(false), new_bool_value(true), Fold_Ok},
+		{Tkn_Less, bool_type, new_bool_value(true), new_bool_value(false), default_value, Fold_Invalid},
+		{Tkn_Plus, bool_type, new_bool_value(true), new_bool_value(true), default_value, Fold_Invalid},
+		{Tkn_And, bool_type, new_bool_value(true), new_integer_value(0), new_bool_value(false), Fold_Ok},
+		{Tkn_Or, i32_type, new_integer_value(0), new_integer_value(3), new_bool_value(true), Fold_Ok},
+		{Tkn_Or, i32_type, new_float_value(1), new_integer_value(3), default_value, Fold_Invalid},
+		{Tkn_Plus, char_type, new_char_value('a'), new_char_value(1), new_char_value('b'), Fold_Ok},
+		{Tkn_Plus, char_type, new_char_value((char) 255), new_char_value(1), new_char_value(0), Fold_Overflow},
+		{Tkn_Less, char_type, new_char_value('a'), new_char_value((char) 200), new_bool_value(true), Fold_Ok},
+		{Tkn_EqualEqual, (ValueType) {Value_String, 16, false}, new_string_value("ab"), new_string_value("ab"), new_bool_value(true), Fold_Ok},
+		{Tkn_EqualEqual, (ValueType) {Value_Null, 8, false}, new_null_value(), new_null_value(), new_bool_value(true), Fold_Ok},
+		{Tkn_Plus, (ValueType) {Value_String, 16, false}, new_string_value("a"), new_string_value("b"), default_value, Fold_Invalid},
+	};
+
+	for(u32 i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+		FoldError error;
+		Value result = value_eval_binary(tests[i].op, tests[i].lhs, tests[i].rhs, tests[i].type, &error);
+		if(error != tests[i].error or !value_equal(result, tests[i].expected))
+			printf("value_test: case %u failed, error %d\n", i, error);
+		assert(error == tests[i].error);
+		assert(value_equal(result, tests[i].expected));
+	}
+
+	struct {
+		TokenKind op;
+		ValueType type;
+		Value operand;
+		Value expected;
+		FoldError error;
+	} unary_tests[] = {
+		{Tkn_Minus, i8_type, new_integer_value(-128), new_integer_value(-128), Fold_Overflow},
+		{Tkn_Minus, i8_type, new_integer_value(127), new_integer_value(-127), Fold_Ok},
+		{Tkn_Minus, u32_type, new_integer_value(1), new_integer_value(UINT32_MAX), Fold_Overflow},
+		{Tkn_Minus, i64_type, new_integer_value(INT64_MIN), new_integer_value(INT64_MIN), Fold_Overflow},
+		{Tkn_Minus, f32_type, new_float_value(1.5), new_float_value(-1.5), Fold_Ok},
+		{Tkn_Tilde, u8_type, new_integer_value(0x0f), new_integer_value(0xf0), Fold_Ok},
+		{Tkn_Tilde, i16_type, new_integer_value(0), new_integer_value(-1), Fold_Ok},
+		{Tkn_Tilde, u64_type, new_integer_value(0), new_integer_value(-1), Fold_Ok},
+		{Tkn_Tilde, f64_type, new_float_value(0), default_value, Fold_Invalid},
+		{Tkn_Bang, bool_type, new_bool_value(false), new_bool_value(true), Fold_Ok},
+		{Tkn_Bang, i32_type, new_integer_value(2), new_bool_value(false), Fold_Ok},
+		{Tkn_Ampersand, i32_type, new_integer_value(2), default_value, Fold_Invalid},
+		{Tkn_Astrick, i32_type, new_integer_value(2), default_value, Fold_Invalid},
+	};
+
+	for(u32 i = 0; i < sizeof(unary_tests) / sizeof(unary_tests[0]); ++i) {
+		FoldError error;
+		Value result = value_eval_unary(unary_tests[i].op, unary_tests[i].operand, unary_tests[i].type, &error);
+		if(error != unary_tests[i].error or !value_equal(result, unary_tests[i].expected))
+			printf("value_test: unary case %u failed, error %d\n", i, error);
+		assert(error == unary_tests[i].error);
+		assert(value_equal(result, unary_tests[i].expected));
+	}
+
+	struct {
+		ValueType type;
+		Value val;
+		Value expected;
+		FoldError error;
+	} conversions[] = {
+		{u8_type, new_integer_value(255), new_integer_value(255), Fold_Ok},
+		{u8_type, new_integer_value(256), new_integer_value(0), Fold_Overflow},
+		{i8_type, new_integer_value(200), new_integer_value(-56), Fold_Overflow},
+		{u64_type, new_integer_value(-1), new_integer_value(-1), Fold_Overflow},
+		{i32_type, new_float_value(-2.75), new_integer_value(-2), Fold_Ok},
+		{u16_type, new_float_value(65536), new_integer_value(0), Fold_Overflow},
+		{i64_type, new_float_value(NAN), new_integer_value(0), Fold_Overflow},
+		{f32_type, new_integer_value(16777217), new_float_value(16777216), Fold_Ok},
+		{f64_type, new_char_value('A'), new_float_value(65), Fold_Ok},
+		{i32_type, new_bool_value(true), new_integer_value(1), Fold_Ok},
+		{char_type, new_integer_value('z'), new_char_value('z'), Fold_Ok},
+		{bool_type, new_integer_value(1), default_value, Fold_Invalid},
+	};
+
+	for(u32 i = 0; i < sizeof(conversions) / sizeof(conversions[0]); ++i) {
+		FoldError error;
+		Value result = value_convert(conversions[i].val, conversions[i].type, &error);
+		if(error != conversions[i].error or !value_equal(result, conversions[i].expected))
+			printf("value_test: conversion %u failed, error %d\n", i, error);
+		assert(error == conversions[i].error);
+		assert(value_equal(result, conversions[i].expected));
+	}
+
+	printf("value_test: %u exhaustive 8 bit cases, %u table cases\n", checked,
+		(u32) (sizeof(tests) / sizeof(tests[0]) + sizeof(unary_tests) / sizeof(unary_tests[0]) +
+			sizeof(conversions) / sizeof(conversions[0])));
 }
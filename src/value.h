@@ -68,7 +68,48 @@ bool value_is_integral(Value val);
 bool value_is_float(Value val);
 bool value_is_integer(Value val);
 
-Value value_eval_binary(Token op, Value lhs, Value rhs);
-Value value_eval_unary(Token op, Value lhs, Value rhs);
+// Constant folding
+//
+// Constants are folded in the type of their operands. An integer is kept in
+// integer_value truncated to the size of its type, sign extended when the
+// type is signed and zero extended when it is not, so a u64 above the
+// largest i64 is negative in integer_value. Arithmetic wraps like the
+// machine would and reports the overflow, floats are rounded to their size.
+
+// the type a constant is folded in, the kind of the values with the size in
+// bytes of an integer or float.
+typedef struct ValueType {
+	ValueKind kind;
+	u32 size;
+	bool is_signed;
+} ValueType;
+
+typedef enum FoldError {
+	Fold_Ok,
+	// the result does not fit the type, it is wrapped.
+	Fold_Overflow,
+	Fold_DivideByZero,
+	// a shift by a negative amount or by the size of the type or more.
+	Fold_ShiftRange,
+	// the operator does not apply to the values.
+	Fold_Invalid,
+} FoldError;
+
+// the value as the type, wrapped when it does not fit.
+Value value_convert(Value val, ValueType type, FoldError* error);
+
+// the operands are converted to type, the result is a bool for comparisons
+// and 'and'/'or' or else has the type. The count of a shift is only
+// converted to an integer. Returns the invalid value with Fold_Invalid when
+// the operator does not fold.
+Value value_eval_binary(TokenKind op, Value lhs, Value rhs, ValueType type, FoldError* error);
+Value value_eval_unary(TokenKind op, Value operand, ValueType type, FoldError* error);
+
+bool value_equal(Value lhs, Value rhs);
+
+// the truth of a bool or integer, false when the value has none.
+bool value_truth(Value val, bool* truth);
+
+void value_test();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,391 @@
+#include "visit.h"
+#include "ast_io.h"
+#include "parser.h"
+#include "fingerprint.h"
+#include "report.h"
+
+#include <time.h>
+
+Walk new_walk(Visitor* visitors, u32 num) {
+  assert(num <= MAX_VISITORS);
+  Walk walk;
+  memset(&walk, 0, sizeof(Walk));
+  memcpy(walk.visitors, visitors, sizeof(Visitor) * num);
+  walk.num_visitors = num;
+  walk.active = num;
+  return walk;
+}
+
+// the hooks of every visitor for one node. A visitor skipping the children
+// of a node at depth d is marked with d + 1 until the node is left.
+#define VISITKIND(name, type) \
+  bool walk_pre_##name(Walk* walk, type* node) { \
+    for(u32 i = 0; i < walk->num_visitors; ++i) { \
+      Visitor* visitor = walk->visitors + i; \
+      if(walk->skipped[i] == 0 and visitor->pre_##name and !visitor->pre_##name(visitor->data, node)) { \
+        walk->skipped[i] = walk->depth + 1; \
+        walk->active--; \
+      } \
+    } \
+    return walk->active != 0; \
+  } \
+  void walk_post_##name(Walk* walk, type* node) { \
+    for(u32 i = 0; i < walk->num_visitors; ++i) { \
+      Visitor* visitor = walk->visitors + i; \
+      if(walk->skipped[i] == walk->depth + 1) { \
+        walk->skipped[i] = 0; \
+        walk->active++; \
+      } \
+      else if(walk->skipped[i] == 0 and visitor->post_##name) \
+        visitor->post_##name(visitor->data, node); \
+    } \
+  }
+  VISITKINDS
+#undef VISITKIND
+
+// the kinds of the entries of the stack of a walk.
+enum {
+#define VISITKIND(name, type) Walk_##name,
+  VISITKINDS
+#undef VISITKIND
+  // the entry of a node whose children are being visited, its post hooks are
+  // called when it is popped.
+  Walk_Post = 1 << 4,
+};
+
+bool walk_pre(Walk* walk, u32 kind, void* node) {
+  switch(kind) {
+#define VISITKIND(name, type) case Walk_##name: return walk_pre_##name(walk, (type*) node);
+    VISITKINDS
+#undef VISITKIND
+    default: return false;
+  }
+}
+
+void walk_post(Walk* walk, u32 kind, void* node) {
+  switch(kind) {
+#define VISITKIND(name, type) case Walk_##name: walk_post_##name(walk, (type*) node); break;
+    VISITKINDS
+#undef VISITKIND
+  }
+}
+
+void push_node(Walk* walk, u32 kind, void* node) {
+  if(node)
+    buf_push(walk->stack, (WalkEntry) {node, kind});
+}
+
+// the children as listed by the CHILDREN_<kind> macros of ast.h.
+#define EXPR(x) push_node(walk, Walk_expr, x);
+#define STMT(x) push_node(walk, Walk_stmt, x);
+#define ITEM(x) push_node(walk, Walk_item, x);
+#define SPEC(x) push_node(walk, Walk_spec, x);
+#define PAT(x) push_node(walk, Walk_pat, x);
+#define CLAUSE(x) push_node(walk, Walk_clause, x);
+#define IDENT(x) push_node(walk, Walk_ident, x);
+#define TOKEN(x) push_node(walk, Walk_token, &(x));
+#define MUT(x) push_node(walk, Walk_mut, &(x));
+#define EXPRS(list, num) for(u32 i_ = 0; i_ < (num); ++i_) EXPR((list)[i_])
+#define STMTS(list, num) for(u32 i_ = 0; i_ < (num); ++i_) STMT((list)[i_])
+#define ITEMS(list, num) for(u32 i_ = 0; i_ < (num); ++i_) ITEM((list)[i_])
+#define SPECS(list, num) for(u32 i_ = 0; i_ < (num); ++i_) SPEC((list)[i_])
+#define PATS(list, num) for(u32 i_ = 0; i_ < (num); ++i_) PAT((list)[i_])
+#define CLAUSES(list, num) for(u32 i_ = 0; i_ < (num); ++i_) CLAUSE((list)[i_])
+#define IDENTS(list, num) for(u32 i_ = 0; i_ < (num); ++i_) IDENT((list)[i_])
+
+void push_children(Walk* walk, u32 kind, void* node) {
+  switch(kind) {
+    case Walk_item: {
+      Item* item = (Item*) node;
+      switch(item->kind) {
+#define ITEMKIND(n) case n: CHILDREN_##n break;
+        ITEMKINDS
+#undef ITEMKIND
+      }
+    } break;
+    case Walk_stmt: {
+      Stmt* stmt = (Stmt*) node;
+      switch(stmt->kind) {
+#define STMTKIND(n) case n: CHILDREN_##n break;
+        STMTKINDS
+#undef STMTKIND
+      }
+    } break;
+    case Walk_expr: {
+      Expr* expr = (Expr*) node;
+      switch(expr->kind) {
+#define EXPRKIND(n) case n: CHILDREN_##n break;
+        EXPRKINDS
+#undef EXPRKIND
+      }
+    } break;
+    case Walk_spec: {
+      TypeSpec* spec = (TypeSpec*) node;
+      switch(spec->kind) {
+#define TYPESPECKIND(n) case n: CHILDREN_##n break;
+        TYPESPECKINDS
+#undef TYPESPECKIND
+      }
+    } break;
+    case Walk_pat: {
+      Pattern* pat = (Pattern*) node;
+      switch(pat->kind) {
+#define PATTERNKIND(n) case n: CHILDREN_##n break;
+        PATTERNKINDS
+#undef PATTERNKIND
+      }
+    } break;
+    case Walk_clause: {
+      Clause* clause = (Clause*) node;
+      CHILDREN_Clause
+    } break;
+  }
+}
+
+#undef EXPR
+#undef STMT
+#undef ITEM
+#undef SPEC
+#undef PAT
+#undef CLAUSE
+#undef IDENT
+#undef TOKEN
+#undef MUT
+#undef EXPRS
+#undef STMTS
+#undef ITEMS
+#undef SPECS
+#undef PATS
+#undef CLAUSES
+#undef IDENTS
+
+// the entries above first were pushed in order, they are visited from the
+// top of the stack.
+void reverse_entries(Walk* walk, u64 first) {
+  for(u64 i = first, j = buf_len(walk->stack); i + 1 < j; ++i, --j) {
+    WalkEntry entry = walk->stack[i];
+    walk->stack[i] = walk->stack[j - 1];
+    walk->stack[j - 1] = entry;
+  }
+}
+
+// visits the nodes pushed above base. A node is popped for its pre hooks and
+// pushed again below its children for its post hooks, so the walk does not
+// recurse and the depth of a tree is not limited by the stack of the thread.
+// Identifiers, tokens and mutabilities have no children.
+void run_walk(Walk* walk, u64 base) {
+  while(buf_len(walk->stack) > base) {
+    WalkEntry entry = walk->stack[--buf__hdr(walk->stack)->len];
+    if(entry.kind & Walk_Post) {
+      walk->depth--;
+      walk_post(walk, entry.kind & ~Walk_Post, entry.node);
+    }
+    else if(entry.kind < Walk_ident and walk_pre(walk, entry.kind, entry.node)) {
+      walk->depth++;
+      buf_push(walk->stack, (WalkEntry) {entry.node, entry.kind | Walk_Post});
+      u64 first = buf_len(walk->stack);
+      push_children(walk, entry.kind, entry.node);
+      reverse_entries(walk, first);
+    }
+    else {
+      if(entry.kind >= Walk_ident)
+        walk_pre(walk, entry.kind, entry.node);
+      walk_post(walk, entry.kind, entry.node);
+    }
+  }
+  // a hook can walk more nodes with the walk it is called from, the stack is
+  // kept until the outermost call returns.
+  if(base == 0)
+    buf_free(walk->stack);
+}
+
+void walk_node(Walk* walk, u32 kind, void* node) {
+  u64 base = buf_len(walk->stack);
+  push_node(walk, kind, node);
+  run_walk(walk, base);
+}
+
+void walk_item(Walk* walk, Item* item) {
+  walk_node(walk, Walk_item, item);
+}
+
+void walk_stmt(Walk* walk, Stmt* stmt) {
+  walk_node(walk, Walk_stmt, stmt);
+}
+
+void walk_expr(Walk* walk, Expr* expr) {
+  walk_node(walk, Walk_expr, expr);
+}
+
+void walk_spec(Walk* walk, TypeSpec* spec) {
+  walk_node(walk, Walk_spec, spec);
+}
+
+void walk_pat(Walk* walk, Pattern* pat) {
+  walk_node(walk, Walk_pat, pat);
+}
+
+void walk_ast_file(Walk* walk, AstFile* ast) {
+  u64 base = buf_len(walk->stack);
+  for(u32 i = ast_num_items(ast); i > 0; --i)
+    push_node(walk, Walk_item, ast->items[i - 1]);
+  run_walk(walk, base);
+}
+
+void visit_item(Visitor* visitor, Item* item) {
+  Walk walk = new_walk(visitor, 1);
+  walk_item(&walk, item);
+}
+
+void visit_expr(Visitor* visitor, Expr* expr) {
+  Walk walk = new_walk(visitor, 1);
+  walk_expr(&walk, expr);
+}
+
+void visit_ast_file(Visitor* visitor, AstFile* ast) {
+  Walk walk = new_walk(visitor, 1);
+  walk_ast_file(&walk, ast);
+}
+
+// counts of the nodes reached, function bodies are skipped when skip_bodies
+// is set.
+typedef struct NodeCounts {
+  u64 nodes;
+  u64 leaves;
+  u64 posts;
+  bool skip_bodies;
+} NodeCounts;
+
+bool count_item(void* data, Item* item) {
+  NodeCounts* counts = (NodeCounts*) data;
+  counts->nodes++;
+  return !(counts->skip_bodies and item->kind == ItemFunction);
+}
+
+#define COUNT_NODE(name, type) \
+  bool count_##name(void* data, type* name) { \
+    UNUSED(name); \
+    ((NodeCounts*) data)->nodes++; \
+    return true; \
+  }
+COUNT_NODE(stmt, Stmt)
+COUNT_NODE(expr, Expr)
+COUNT_NODE(spec, TypeSpec)
+COUNT_NODE(pat, Pattern)
+COUNT_NODE(clause, Clause)
+#undef COUNT_NODE
+
+bool count_ident(void* data, Ident* ident) {
+  UNUSED(ident);
+  ((NodeCounts*) data)->leaves++;
+  return true;
+}
+
+bool count_token(void* data, Token* token) {
+  UNUSED(token);
+  ((NodeCounts*) data)->leaves++;
+  return true;
+}
+
+void count_post(void* data, Expr* expr) {
+  UNUSED(expr);
+  ((NodeCounts*) data)->posts++;
+}
+
+Visitor counting_visitor(NodeCounts* counts) {
+  Visitor visitor;
+  memset(&visitor, 0, sizeof(Visitor));
+  visitor.pre_item = count_item;
+  visitor.pre_stmt = count_stmt;
+  visitor.pre_expr = count_expr;
+  visitor.pre_spec = count_spec;
+  visitor.pre_pat = count_pat;
+  visitor.pre_clause = count_clause;
+  visitor.pre_ident = count_ident;
+  visitor.pre_token = count_token;
+  visitor.post_expr = count_post;
+  visitor.data = counts;
+  return visitor;
+}
+
+void visit_test(AstFile* ast) {
+  NodeCounts all = {0, 0, 0, false};
+  NodeCounts items = {0, 0, 0, true};
+  Visitor alone[] = {counting_visitor(&all), counting_visitor(&items)};
+
+  clock_t start = clock();
+  visit_ast_file(&alone[0], ast);
+  visit_ast_file(&alone[1], ast);
+  clock_t separate = clock();
+
+  NodeCounts fused_all = {0, 0, 0, false};
+  NodeCounts fused_items = {0, 0, 0, true};
+  Visitor both[] = {counting_visitor(&fused_all), counting_visitor(&fused_items)};
+  Walk walk = new_walk(both, 2);
+  walk_ast_file(&walk, ast);
+  clock_t fused = clock();
+
+  printf("visit_test: %lu nodes, %lu leaves, %lu outside bodies, separate %.2fms, fused %.2fms\n",
+    (unsigned long) all.nodes, (unsigned long) all.leaves, (unsigned long) items.nodes,
+    (separate - start) * 1000.0 / CLOCKS_PER_SEC, (fused - separate) * 1000.0 / CLOCKS_PER_SEC);
+
+  assert(fused_all.nodes == all.nodes and fused_all.leaves == all.leaves and fused_all.posts == all.posts);
+  assert(fused_items.nodes == items.nodes and fused_items.leaves == items.leaves);
+  assert(fused_items.posts == items.posts);
+  assert(items.nodes <= all.nodes);
+  assert(walk.active == 2 and walk.depth == 0);
+}
+
+char* chain_source(const char* term, u32 count, const char* last) {
+  char* source = NULL;
+  buf_printf(source, "fn f() {\n  let mut y = 0;\n  ");
+  for(u32 i = 0; i < count; ++i)
+    buf_printf(source, "%s", term);
+  buf_printf(source, "%s\n}\n", last);
+  return source;
+}
+
+void walk_chain(const char* term, u32 count, const char* last) {
+  char* source = chain_source(term, count, last);
+  File file = {"<walk_depth_test>", source, buf_len(source), NULL};
+  StringTable table = create_table(TABLE_START);
+  u32 errors = thread_error_count();
+  AstFile* ast = parse_file(&file, &table);
+  assert(ast_num_items(ast) == 1 and thread_error_count() == errors);
+
+  NodeCounts counts = {0, 0, 0, false};
+  Visitor visitor = counting_visitor(&counts);
+  visit_ast_file(&visitor, ast);
+  assert(counts.nodes > count and counts.posts > count);
+
+  bool unstable = false;
+  signature_fingerprint(ast->items[0]);
+  body_fingerprint(ast->items[0], &unstable);
+  ast_io_test(ast, &table);
+  destroy_ast_file(ast);
+  buf_free(source);
+}
+
+void* walk_depth_test_thread(void* data) {
+  const u32 count = 200000;
+  walk_chain("1 + ", count, "1");
+  walk_chain("-", count, "1");
+  walk_chain("y = ", count, "1");
+  return data;
+}
+
+// walks, fingerprints, writes and loads images of and frees trees as deep as
+// their chains of operators on a thread with a small stack, which would overflow if the walk recursed
+// for each node.
+void walk_depth_test(void) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 256 * 1024);
+
+  pthread_t thread;
+  int result = pthread_create(&thread, &attr, walk_depth_test_thread, NULL);
+  assert(result == 0);
+  pthread_join(thread, NULL);
+  pthread_attr_destroy(&attr);
+  printf("walk_depth_test: passed\n");
+}
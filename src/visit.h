@@ -0,0 +1,87 @@
+#ifndef VISIT_H_
+#define VISIT_H_
+
+#include "ast.h"
+
+// AST visitors
+//
+// A visitor is a set of hooks called for the nodes of a tree, a walk visits
+// every node before its children and after them in the order of the
+// CHILDREN_<kind> lists in ast.h. The walk itself is generated from those
+// lists so no pass writes its own traversal. It keeps the nodes left to
+// visit on a stack of its own instead of recursing, so a deep tree such as a
+// long chain of operators does not overflow the stack of the thread.
+// More than one visitor can share a walk, each node is then only reached
+// once and its hooks are called for every visitor in the order they were
+// given, which lets independent passes run over the tree together.
+
+// kinds of the nodes a visitor has hooks for. Identifiers, tokens and
+// mutabilities are leaves.
+#define VISITKINDS \
+  VISITKIND(item, Item) \
+  VISITKIND(stmt, Stmt) \
+  VISITKIND(expr, Expr) \
+  VISITKIND(spec, TypeSpec) \
+  VISITKIND(pat, Pattern) \
+  VISITKIND(clause, Clause) \
+  VISITKIND(ident, Ident) \
+  VISITKIND(token, Token) \
+  VISITKIND(mut, Mutability)
+
+// the hooks of a visitor, any of them can be NULL. A pre hook returning false
+// skips the children of the node and its post hook for that visitor only.
+typedef struct Visitor {
+#define VISITKIND(name, type) \
+  bool (*pre_##name)(void* data, type* name); \
+  void (*post_##name)(void* data, type* name);
+  VISITKINDS
+#undef VISITKIND
+  void* data;
+} Visitor;
+
+#define MAX_VISITORS 16
+
+// a node a walk has yet to visit, or one whose children it is visiting.
+typedef struct WalkEntry {
+  void* node;
+  u32 kind;
+} WalkEntry;
+
+typedef struct Walk {
+  Visitor visitors[MAX_VISITORS];
+  u32 num_visitors;
+  // depth of the node whose children a visitor skips, 0 when it is visiting.
+  u32 skipped[MAX_VISITORS];
+  // visitors that are not skipping, the children of a node are not walked
+  // when there are none.
+  u32 active;
+  u32 depth;
+  // the nodes left to visit, the walk keeps them instead of recursing.
+  WalkEntry* stack;
+} Walk;
+
+Walk new_walk(Visitor* visitors, u32 num);
+
+void walk_item(Walk* walk, Item* item);
+void walk_stmt(Walk* walk, Stmt* stmt);
+void walk_expr(Walk* walk, Expr* expr);
+void walk_spec(Walk* walk, TypeSpec* spec);
+void walk_pat(Walk* walk, Pattern* pat);
+
+// walks every item of the file.
+void walk_ast_file(Walk* walk, AstFile* ast);
+
+// a walk of a single visitor.
+void visit_item(Visitor* visitor, Item* item);
+void visit_expr(Visitor* visitor, Expr* expr);
+void visit_ast_file(Visitor* visitor, AstFile* ast);
+
+void visit_test(AstFile* ast);
+
+// the source of a function whose body repeats term count times before the
+// last term, for the tests of deep trees.
+char* chain_source(const char* term, u32 count, const char* last);
+
+void walk_depth_test(void);
+
+#endif
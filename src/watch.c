@@ -0,0 +1,241 @@
+#define _XOPEN_SOURCE 700
+
+#include "watch.h"
+#include "oxy.h"
+#include "parser.h"
+#include "report.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+typedef struct WatchDir {
+  int wd;
+  // real path of the directory.
+  char* path;
+} WatchDir;
+
+typedef struct Watch {
+  int fd;
+  ModuleLoader* loader;
+  WatchDir* dirs;
+  // the .oxy files under the directory, the roots when there are no inputs.
+  char** files;
+} Watch;
+
+bool is_source_file(const char* name) {
+  u64 len = strlen(name);
+  return len > 4 and strcmp(name + len - 4, ".oxy") == 0;
+}
+
+const char* watch_dir_path(Watch* watch, int wd) {
+  for(u32 i = 0; i < buf_len(watch->dirs); ++i) {
+    if(watch->dirs[i].wd == wd)
+      return watch->dirs[i].path;
+  }
+  return NULL;
+}
+
+// watches dir and the directories under it and adds the files found.
+void add_watch_dir(Watch* watch, const char* dir) {
+  char* real = realpath(dir, NULL);
+  if(!real)
+    return;
+  int wd = inotify_add_watch(watch->fd, real, WATCH_EVENTS);
+  if(wd < 0 or watch_dir_path(watch, wd)) {
+    free(real);
+    return;
+  }
+  WatchDir entry = {wd, NULL};
+  buf_printf(entry.path, "%s", real);
+  buf_push(watch->dirs, entry);
+  free(real);
+
+  DIR* handle = opendir(entry.path);
+  if(!handle)
+    return;
+  char* path = NULL;
+  for(struct dirent* ent; (ent = readdir(handle));) {
+    if(ent->d_name[0] == '.')
+      continue;
+    buf_clear(path);
+    buf_printf(path, "%s/%s", entry.path, ent->d_name);
+    struct stat st;
+    if(stat(path, &st) != 0)
+      continue;
+    if(S_ISDIR(st.st_mode))
+      add_watch_dir(watch, path);
+    else if(is_source_file(ent->d_name)) {
+      char* file = NULL;
+      buf_printf(file, "%s", path);
+      buf_push(watch->files, file);
+    }
+  }
+  buf_free(path);
+  closedir(handle);
+}
+
+void remove_file(Watch* watch, const char* path) {
+  for(u32 i = 0; i < buf_len(watch->files); ++i) {
+    if(strcmp(watch->files[i], path) == 0) {
+      buf_free(watch->files[i]);
+      watch->files[i] = watch->files[buf_len(watch->files) - 1];
+      --buf__hdr(watch->files)->len;
+      return;
+    }
+  }
+}
+
+int compare_paths(const void* a, const void* b) {
+  return strcmp(*(const char**) a, *(const char**) b);
+}
+
+double elapsed_ms(struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void watch_compile(Watch* watch) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ModuleLoader* loader = watch->loader;
+  Options* options = get_options();
+
+  reset_errors();
+  begin_diagnostics();
+  begin_modules(loader);
+  loader->flags = options->decls_only ? Parse_LazyBodies : Parse_Default;
+  loader->search_paths = options->module_paths;
+
+  if(buf_len(options->inputs)) {
+    for(u32 i = 0; i < buf_len(options->inputs); ++i) {
+      if(!load_module(loader, options->inputs[i]))
+        driver_error("unable to read file '%s'\n", options->inputs[i]);
+    }
+  }
+  else {
+    // sorted so the output does not depend on the order of the directories.
+    if(watch->files)
+      qsort(watch->files, buf_len(watch->files), sizeof(char*), compare_paths);
+    for(u32 i = 0; i < buf_len(watch->files); ++i)
+      load_module(loader, watch->files[i]);
+  }
+  wait_modules(loader);
+  flush_diagnostics();
+
+  u32 errors = 0;
+  u32 error_files = 0;
+  Module** modules = ordered_modules(loader);
+  for(u32 i = 0; i < buf_len(modules); ++i) {
+    u32 count = report_error_count(&modules[i]->report);
+    errors += count;
+    error_files += count != 0;
+  }
+  // the machine readable formats only hold diagnostics.
+  if(diagnostics_format() == Diagnostics_Text)
+    printf("[watch] %u errors in %u of %u files, parsed %u files (%u around an edit) in %.1fms\n",
+      errors, error_files, (u32) buf_len(modules), atomic_load(&loader->loaded),
+      atomic_load(&loader->reparsed), elapsed_ms(&start));
+  end_diagnostics();
+  buf_free(modules);
+}
+
+// returns true when the event can change the output.
+bool handle_event(Watch* watch, struct inotify_event* event) {
+  const char* dir = watch_dir_path(watch, event->wd);
+  if(!dir or event->len == 0 or event->name[0] == '.')
+    return false;
+
+  char* path = NULL;
+  buf_printf(path, "%s/%s", dir, event->name);
+  bool changed = false;
+  if(event->mask & IN_ISDIR) {
+    // the files of a directory moved in are new roots.
+    if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+      add_watch_dir(watch, path);
+      invalidate_module(watch->loader, path, true);
+      changed = true;
+    }
+  }
+  else if(is_source_file(event->name)) {
+    bool created = event->mask & (IN_CREATE | IN_MOVED_TO);
+    bool removed = event->mask & (IN_DELETE | IN_MOVED_FROM);
+    if(created or removed)
+      remove_file(watch, path);
+    if(created) {
+      char* file = NULL;
+      buf_printf(file, "%s", path);
+      buf_push(watch->files, file);
+    }
+    invalidate_module(watch->loader, path, created or removed);
+    changed = true;
+  }
+  buf_free(path);
+  return changed;
+}
+
+int run_watch(const char* dir, ModuleLoader* loader) {
+  Watch watch = {0};
+  watch.loader = loader;
+  watch.fd = inotify_init1(IN_CLOEXEC);
+  if(watch.fd < 0) {
+    printf("Error: unable to watch '%s'\n", dir);
+    return 1;
+  }
+  add_watch_dir(&watch, dir);
+  if(buf_len(watch.dirs) == 0) {
+    printf("Error: unable to watch '%s'\n", dir);
+    close(watch.fd);
+    return 1;
+  }
+
+  loader->stream = true;
+  watch_compile(&watch);
+
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool pending = false;
+  for(;;) {
+    struct pollfd poll_fd = {watch.fd, POLLIN, 0};
+    int ready = poll(&poll_fd, 1, pending ? WATCH_DEBOUNCE_MS : -1);
+    if(ready < 0) {
+      if(errno == EINTR)
+        continue;
+      break;
+    }
+    if(ready == 0) {
+      // no event since the debounce interval.
+      watch_compile(&watch);
+      pending = false;
+      continue;
+    }
+
+    ssize_t len = read(watch.fd, events, sizeof(events));
+    if(len <= 0) {
+      if(len < 0 and errno == EINTR)
+        continue;
+      break;
+    }
+    for(char* ptr = events; ptr < events + len;) {
+      struct inotify_event* event = (struct inotify_event*) ptr;
+      pending |= handle_event(&watch, event);
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  for(u32 i = 0; i < buf_len(watch.dirs); ++i)
+    buf_free(watch.dirs[i].path);
+  buf_free(watch.dirs);
+  for(u32 i = 0; i < buf_len(watch.files); ++i)
+    buf_free(watch.files[i]);
+  buf_free(watch.files);
+  close(watch.fd);
+  loader->stream = false;
+  return 1;
+}
@@ -0,0 +1,22 @@
+#ifndef WATCH_H_
+#define WATCH_H_
+
+#include "module.h"
+
+// Watch mode
+//
+// Compiles the inputs, or every .oxy file under the watched directory when
+// there are none, then waits for files under the directory to change. A
+// burst of changes is collected until no event arrives for
+// WATCH_DEBOUNCE_MS and then only the changed files, and the files whose
+// imports they can affect, are read and parsed again. The diagnostics of a
+// file are printed as soon as it is parsed and every compile ends with a
+// summary of the errors of all files.
+
+#define WATCH_DEBOUNCE_MS 50
+
+// runs until the process is stopped, returns when the directory can not be
+// watched.
+int run_watch(const char* dir, ModuleLoader* loader);
+
+#endif